@@ -4949,6 +4949,55 @@ bool C_BaseAnimating::Interpolate( float flCurrentTime )
 	return true;
 }
 
+bool C_BaseAnimating::BeginBatchedInterpolate( BatchedInterpolate_t& batch )
+{
+	// ragdolls don't need interpolation
+	if( m_pRagdoll )
+	{
+		batch.m_nResult = INTERPOLATE_STOP;
+		batch.m_bNoMoreChanges = 0;
+		return true;
+	}
+
+	batch.m_flOldCycle = GetCycle();
+
+	if( !m_bClientSideAnimation )
+	{
+		m_iv_flCycle.SetLooping( IsSequenceLooping( GetSequence() ) );
+	}
+
+	batch.m_nResult = BaseInterpolateBegin( batch.m_flCurrentTime, batch.m_vecOldOrigin, batch.m_angOldAngles, batch.m_vecOldVel, batch.m_bNoMoreChanges );
+	return true;
+}
+
+bool C_BaseAnimating::FinishBatchedInterpolate( BatchedInterpolate_t& batch )
+{
+	if( batch.m_nResult == INTERPOLATE_STOP )
+	{
+		if( batch.m_bNoMoreChanges )
+		{
+			RemoveFromInterpolationList();
+		}
+		return true;
+	}
+
+	int nChangeFlags = 0;
+
+	// Did cycle change?
+	if( GetCycle() != batch.m_flOldCycle )
+	{
+		nChangeFlags |= ANIMATION_CHANGED;
+	}
+
+	if( batch.m_bNoMoreChanges )
+	{
+		RemoveFromInterpolationList();
+	}
+
+	BaseInterpolatePart2( batch.m_vecOldOrigin, batch.m_angOldAngles, batch.m_vecOldVel, nChangeFlags );
+	return true;
+}
+
 
 //-----------------------------------------------------------------------------
 // returns true if we're currently being ragdolled
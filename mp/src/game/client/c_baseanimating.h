@@ -118,6 +118,8 @@ public:
 	bool UsesPowerOfTwoFrameBufferTexture( void );
 
 	virtual bool	Interpolate( float currentTime );
+	virtual bool	BeginBatchedInterpolate( BatchedInterpolate_t& batch );
+	virtual bool	FinishBatchedInterpolate( BatchedInterpolate_t& batch );
 	virtual void	Simulate();
 	virtual void	Release();
 
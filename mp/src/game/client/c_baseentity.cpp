@@ -40,6 +40,7 @@
 #include "cdll_bounded_cvars.h"
 #include "inetchannelinfo.h"
 #include "proto_version.h"
+#include "vstdlib/jobthread.h"
 #ifdef MAPBASE
 	#include "viewrender.h"
 #endif
@@ -84,6 +85,8 @@ void cc_cl_interp_all_changed( IConVar* pConVar, const char* pOldString, float f
 static ConVar  cl_extrapolate( "cl_extrapolate", "1", FCVAR_CHEAT, "Enable/disable extrapolation if interpolation history runs out." );
 static ConVar  cl_interp_npcs( "cl_interp_npcs", "0.0", FCVAR_USERINFO, "Interpolate NPC positions starting this many seconds in past (or cl_interp, if greater)" );
 static ConVar  cl_interp_all( "cl_interp_all", "0", 0, "Disable interpolation list optimizations.", 0, 0, 0, 0, cc_cl_interp_all_changed );
+static ConVar  cl_interp_threaded( "cl_interp_threaded", "1", 0, "Blend the interpolated variables of the whole interpolation list as one batch spread across the thread pool." );
+static ConVar  cl_interp_threaded_min( "cl_interp_threaded_min", "32", 0, "Fewest entities in the interpolation list before they're blended on the thread pool." );
 ConVar  r_drawmodeldecals( "r_drawmodeldecals", "1" );
 extern ConVar	cl_showerror;
 int C_BaseEntity::m_nPredictionRandomSeed = -1;
@@ -3119,6 +3122,17 @@ void C_BaseEntity::OnLatchInterpolatedVariables( int flags )
 }
 
 int CBaseEntity::BaseInterpolatePart1( float& currentTime, Vector& oldOrigin, QAngle& oldAngles, Vector& oldVel, int& bNoMoreChanges )
+{
+	if( BaseInterpolateBegin( currentTime, oldOrigin, oldAngles, oldVel, bNoMoreChanges ) == INTERPOLATE_STOP )
+	{
+		return INTERPOLATE_STOP;
+	}
+
+	bNoMoreChanges = BaseInterpolateVars( currentTime );
+	return INTERPOLATE_CONTINUE;
+}
+
+int CBaseEntity::BaseInterpolateBegin( float& currentTime, Vector& oldOrigin, QAngle& oldAngles, Vector& oldVel, int& bNoMoreChanges )
 {
 	// Don't mess with the world!!!
 	bNoMoreChanges = 1;
@@ -3148,13 +3162,18 @@ int CBaseEntity::BaseInterpolatePart1( float& currentTime, Vector& oldOrigin, QA
 	oldAngles = m_angRotation;
 	oldVel = m_vecVelocity;
 
-	bNoMoreChanges = Interp_Interpolate( GetVarMapping(), currentTime );
+	return INTERPOLATE_CONTINUE;
+}
+
+int CBaseEntity::BaseInterpolateVars( float currentTime )
+{
+	int bNoMoreChanges = Interp_Interpolate( GetVarMapping(), currentTime );
 	if( cl_interp_all.GetInt() || ( m_EntClientFlags & ENTCLIENTFLAG_ALWAYS_INTERPOLATE ) )
 	{
 		bNoMoreChanges = 0;
 	}
 
-	return INTERPOLATE_CONTINUE;
+	return bNoMoreChanges;
 }
 
 #if 0
@@ -3225,6 +3244,28 @@ bool C_BaseEntity::Interpolate( float currentTime )
 	return true;
 }
 
+bool C_BaseEntity::BeginBatchedInterpolate( BatchedInterpolate_t& batch )
+{
+	batch.m_nResult = BaseInterpolateBegin( batch.m_flCurrentTime, batch.m_vecOldOrigin, batch.m_angOldAngles, batch.m_vecOldVel, batch.m_bNoMoreChanges );
+	return true;
+}
+
+bool C_BaseEntity::FinishBatchedInterpolate( BatchedInterpolate_t& batch )
+{
+	if( batch.m_bNoMoreChanges )
+	{
+		RemoveFromInterpolationList();
+	}
+
+	if( batch.m_nResult == INTERPOLATE_STOP )
+	{
+		return true;
+	}
+
+	BaseInterpolatePart2( batch.m_vecOldOrigin, batch.m_angOldAngles, batch.m_vecOldVel, 0 );
+	return true;
+}
+
 CStudioHdr* C_BaseEntity::OnNewModel()
 {
 #ifdef TF_CLIENT_DLL
@@ -3425,18 +3466,71 @@ void C_BaseEntity::CheckInterpolatedVarParanoidMeasurement()
 }
 
 
+void C_BaseEntity::InterpolateBatchedVars( BatchedInterpolate_t& batch )
+{
+	if( batch.m_pEntity && batch.m_nResult == INTERPOLATE_CONTINUE )
+	{
+		batch.m_bNoMoreChanges = batch.m_pEntity->BaseInterpolateVars( batch.m_flCurrentTime );
+	}
+}
+
 void C_BaseEntity::ProcessInterpolatedList()
 {
 	CheckInterpolatedVarParanoidMeasurement();
 
-	// Interpolate the minimal set of entities that need it.
-	int iNext;
-	for( int iCur = g_InterpolationList.Head(); iCur != g_InterpolationList.InvalidIndex(); iCur = iNext )
+	if( !cl_interp_threaded.GetBool() || g_InterpolationList.Count() < cl_interp_threaded_min.GetInt() )
+	{
+		// Interpolate the minimal set of entities that need it.
+		int iNext;
+		for( int iCur = g_InterpolationList.Head(); iCur != g_InterpolationList.InvalidIndex(); iCur = iNext )
+		{
+			iNext = g_InterpolationList.Next( iCur );
+			C_BaseEntity* pCur = g_InterpolationList[iCur];
+
+			pCur->m_bReadyToDraw = pCur->Interpolate( gpGlobals->curtime );
+		}
+		return;
+	}
+
+	// Entities that can't be batched keep their place in the list; the batch
+	// holds everyone else, with m_pEntity NULL where an unbatched one goes.
+	static CUtlVector<C_BaseEntity*> s_Entities;
+	static CUtlVector<BatchedInterpolate_t> s_Batch;
+	s_Entities.RemoveAll();
+	s_Batch.RemoveAll();
+
+	for( int iCur = g_InterpolationList.Head(); iCur != g_InterpolationList.InvalidIndex(); iCur = g_InterpolationList.Next( iCur ) )
+	{
+		s_Entities.AddToTail( g_InterpolationList[iCur] );
+	}
+
+	s_Batch.SetCount( s_Entities.Count() );
+	for( int i = 0; i < s_Entities.Count(); i++ )
 	{
-		iNext = g_InterpolationList.Next( iCur );
-		C_BaseEntity* pCur = g_InterpolationList[iCur];
+		BatchedInterpolate_t& batch = s_Batch[i];
+		batch.m_pEntity = s_Entities[i];
+		batch.m_flCurrentTime = gpGlobals->curtime;
+		batch.m_nResult = INTERPOLATE_STOP;
+		batch.m_bNoMoreChanges = 0;
+		if( !batch.m_pEntity->BeginBatchedInterpolate( batch ) )
+		{
+			batch.m_pEntity = NULL;
+		}
+	}
 
-		pCur->m_bReadyToDraw = pCur->Interpolate( gpGlobals->curtime );
+	ParallelProcess( "C_BaseEntity::ProcessInterpolatedList", s_Batch.Base(), s_Batch.Count(), &C_BaseEntity::InterpolateBatchedVars );
+
+	for( int i = 0; i < s_Entities.Count(); i++ )
+	{
+		C_BaseEntity* pCur = s_Entities[i];
+		if( s_Batch[i].m_pEntity )
+		{
+			pCur->m_bReadyToDraw = pCur->FinishBatchedInterpolate( s_Batch[i] );
+		}
+		else
+		{
+			pCur->m_bReadyToDraw = pCur->Interpolate( gpGlobals->curtime );
+		}
 	}
 }
 
@@ -844,6 +844,28 @@ public:
 	// Interpolate the position for rendering
 	virtual bool					Interpolate( float currentTime );
 
+	// Interpolate() in three steps so ProcessInterpolatedList can blend the
+	// variables of the whole list on the thread pool. BeginBatchedInterpolate runs
+	// on the main thread; return false to be interpolated by Interpolate() instead.
+	// Then BaseInterpolateVars runs on a worker, and FinishBatchedInterpolate
+	// applies the side effects on the main thread, returning what Interpolate()
+	// would have. Classes that override Interpolate() must override both of
+	// these to match, or return false from BeginBatchedInterpolate.
+	struct BatchedInterpolate_t
+	{
+		C_BaseEntity*	m_pEntity;
+		float			m_flCurrentTime;
+		Vector			m_vecOldOrigin;
+		QAngle			m_angOldAngles;
+		Vector			m_vecOldVel;
+		float			m_flOldCycle;
+		int				m_nResult;			// INTERPOLATE_STOP or INTERPOLATE_CONTINUE
+		int				m_bNoMoreChanges;
+	};
+
+	virtual bool					BeginBatchedInterpolate( BatchedInterpolate_t& batch );
+	virtual bool					FinishBatchedInterpolate( BatchedInterpolate_t& batch );
+
 	// Did the object move so far that it shouldn't interpolate?
 	bool							Teleported( void );
 	// Is this a submodel of the world ( *1 etc. in name ) ( brush models only )
@@ -1596,6 +1618,12 @@ protected:
 	int BaseInterpolatePart1( float& currentTime, Vector& oldOrigin, QAngle& oldAngles, Vector& oldVel, int& bNoMoreChanges );
 	void BaseInterpolatePart2( Vector& oldOrigin, QAngle& oldAngles, Vector& oldVel, int nChangeFlags );
 
+	// BaseInterpolatePart1 is these two. The first has the side effects; the second
+	// only blends this entity's own variables, so it's safe to run on a worker thread.
+	int BaseInterpolateBegin( float& currentTime, Vector& oldOrigin, QAngle& oldAngles, Vector& oldVel, int& bNoMoreChanges );
+	int BaseInterpolateVars( float currentTime );
+	static void InterpolateBatchedVars( BatchedInterpolate_t& batch );
+
 
 public:
 	// Accessors for above
@@ -25,6 +25,7 @@
 #include "materialsystem/imaterialsystemhardwareconfig.h"
 #include "tier1/callqueue.h"
 #include "tier1/memstack.h"
+#include "vstdlib/jobthread.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -123,6 +124,12 @@ static ConVar r_ropes_holiday_lights_allowed( "r_ropes_holiday_lights_allowed",
 static ConVar rope_wind_dist( "rope_wind_dist", "1000", 0, "Don't use CPU applying small wind gusts to ropes when they're past this distance." );
 static ConVar rope_averagelight( "rope_averagelight", "1", 0, "Makes ropes use average of cubemap lighting instead of max intensity." );
 
+static ConVar rope_threaded( "rope_threaded", "1", 0, "Simulate ropes as one batch spread across the thread pool. Ropes that collide with the world always simulate on the main thread." );
+static ConVar rope_threaded_min( "rope_threaded_min", "8", 0, "Fewest ropes simulating in a frame before the batch is split across threads." );
+#ifdef MAPBASE
+static ConVar rope_wind_sleep_interval( "rope_wind_sleep_interval", "0", 0, "How often resting wind ropes wake up to check for wind and moving endpoints. 0 checks every frame; above 0 a moved endpoint can lag by up to this long." );
+#endif
+
 
 static ConVar rope_rendersolid( "rope_rendersolid", "1" );
 
@@ -276,6 +283,10 @@ public:
 	void ResetRenderCache( void );
 	void AddToRenderCache( C_RopeKeyframe* pRope );
 	void DrawRenderCache( bool bShadowDepth );
+
+	bool QueueSimulation( C_RopeKeyframe* pRope );
+	void SimulateQueuedRopes( void );
+	void RemoveRopeFromSimulationQueue( C_RopeKeyframe* pRope );
 #ifndef MAPBASE
 	void OnRenderStart( void )
 	{
@@ -352,6 +363,11 @@ private:
 	CUtlLinkedList<RopeQueuedRenderCache_t> m_RopeQueuedRenderCaches;
 #endif
 
+	static void SimulateRope( C_RopeKeyframe*& pRope );
+
+	// Ropes that thought this frame and are waiting to simulate
+	CUtlVector<C_RopeKeyframe*>	m_aSimulationQueue;
+
 	bool m_bDrawHolidayLights;
 	bool m_bHolidayInitialized;
 	int m_nHolidayLightsStyle;
@@ -1049,6 +1065,80 @@ void CRopeManager::DrawRenderCache( bool bShadowDepth )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Holds the rope's simulation for the batch in SimulateQueuedRopes().
+//          Returns false if the rope has to simulate right away.
+//-----------------------------------------------------------------------------
+bool CRopeManager::QueueSimulation( C_RopeKeyframe* pRope )
+{
+	if( !rope_threaded.GetBool() || !pRope->CanSimulateInParallel() )
+	{
+		return false;
+	}
+
+	if( !pRope->m_bSimulationQueued )
+	{
+		pRope->m_bSimulationQueued = true;
+		m_aSimulationQueue.AddToTail( pRope );
+	}
+
+	return true;
+}
+
+void CRopeManager::SimulateRope( C_RopeKeyframe*& pRope )
+{
+	pRope->RunRopeSimulation( gpGlobals->frametime );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs every queued rope. Each rope only touches its own nodes, so the
+//          batch is split across the thread pool when there are enough of them.
+//-----------------------------------------------------------------------------
+void CRopeManager::SimulateQueuedRopes( void )
+{
+	int nRopes = m_aSimulationQueue.Count();
+	if( !nRopes )
+	{
+		return;
+	}
+
+	VPROF_BUDGET( "CRopeManager::SimulateQueuedRopes", VPROF_BUDGETGROUP_ROPES );
+
+	if( nRopes >= rope_threaded_min.GetInt() )
+	{
+		ParallelProcess( "CRopeManager::SimulateQueuedRopes", m_aSimulationQueue.Base(), nRopes, &CRopeManager::SimulateRope );
+	}
+	else
+	{
+		for( int i = 0; i < nRopes; i++ )
+		{
+			SimulateRope( m_aSimulationQueue[i] );
+		}
+	}
+
+	// Bounds go into the leaf system and gusts use the random stream, so these stay here
+	for( int i = 0; i < nRopes; i++ )
+	{
+		C_RopeKeyframe* pRope = m_aSimulationQueue[i];
+		pRope->m_bSimulationQueued = false;
+		pRope->FinishRopeSimulation();
+	}
+
+	m_aSimulationQueue.RemoveAll();
+}
+
+void CRopeManager::RemoveRopeFromSimulationQueue( C_RopeKeyframe* pRope )
+{
+	if( pRope->m_bSimulationQueued )
+	{
+		m_aSimulationQueue.FindAndRemove( pRope );
+		pRope->m_bSimulationQueued = false;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
 bool CRopeManager::IsHolidayLightMode( void )
 {
 	if( !r_ropes_holiday_lights_allowed.GetBool() )
@@ -1509,6 +1599,8 @@ C_RopeKeyframe::C_RopeKeyframe()
 	m_PhysicsDelegate.m_pKeyframe = this;
 	m_pMaterial = NULL;
 	m_bPhysicsInitted = false;
+	m_bPhysicsHooked = false;
+	m_bSimulationQueued = false;
 	m_RopeFlags = 0;
 	m_TextureHeight = 1;
 	m_hStartPoint = m_hEndPoint = NULL;
@@ -1540,6 +1632,7 @@ C_RopeKeyframe::C_RopeKeyframe()
 C_RopeKeyframe::~C_RopeKeyframe()
 {
 	s_RopeManager.RemoveRopeFromQueuedRenderCaches( this );
+	s_RopeManager.RemoveRopeFromSimulationQueue( this );
 	g_Ropes.FindAndRemove( this );
 
 #ifndef MAPBASE
@@ -1729,6 +1822,7 @@ C_BaseEntity* C_RopeKeyframe::GetEndEntity() const
 CSimplePhysics::IHelper* C_RopeKeyframe::HookPhysics( CSimplePhysics::IHelper* pHook )
 {
 	m_RopePhysics.SetDelegate( pHook );
+	m_bPhysicsHooked = ( pHook != &m_PhysicsDelegate );
 	return &m_PhysicsDelegate;
 }
 
@@ -1959,16 +2053,60 @@ void C_RopeKeyframe::ClientThink()
 		{
 			SetNextClientThink( CLIENT_THINK_NEVER );
 		}
+		else if( rope_wind_sleep_interval.GetFloat() > 0.0f )
+		{
+			// Nothing to do until the player gets close enough for wind or an endpoint moves
+			SetNextClientThink( gpGlobals->curtime + rope_wind_sleep_interval.GetFloat() );
+		}
 		return;
 	}
 #endif
+
+	if( s_RopeManager.QueueSimulation( this ) )
+	{
+		// The locked endpoints are cached here so the simulation doesn't have to touch other entities
+		if( m_fLockedPoints & ( ROPE_LOCK_START_POINT | ROPE_LOCK_END_POINT ) )
+		{
+			Vector vPos;
+			QAngle angles;
+			GetEndPointAttachment( 0, vPos, angles );
+		}
+		return;
+	}
+
 	// Update the simulation.
+	{
 #ifndef MAPBASE
-	CTimeAdder adder( &g_RopeSimulateTicks );
+		CTimeAdder adder( &g_RopeSimulateTicks );
 #endif
 
-	RunRopeSimulation( gpGlobals->frametime );
+		RunRopeSimulation( gpGlobals->frametime );
+	}
 
+	FinishRopeSimulation();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Whether RunRopeSimulation() can run on another thread. World traces,
+//          hooked physics and rope_shake's random numbers have to stay here.
+//-----------------------------------------------------------------------------
+bool C_RopeKeyframe::CanSimulateInParallel()
+{
+	if( m_bPhysicsHooked || rope_shake.GetInt() )
+	{
+		return false;
+	}
+
+	if( ( ( m_RopeFlags & ROPE_COLLIDE ) && rope_collide.GetInt() ) || ( rope_collide.GetInt() == 2 ) )
+	{
+		return false;
+	}
+
+	return true;
+}
+
+void C_RopeKeyframe::FinishRopeSimulation()
+{
 	g_nRopePointsSimulated += m_RopePhysics.NumNodes();
 
 	m_bNewDataThisFrame = false;
@@ -155,6 +155,8 @@ private:
 	void			FinishInit( const char* pMaterialName );
 
 	void			RunRopeSimulation( float flSeconds );
+	bool			CanSimulateInParallel();
+	void			FinishRopeSimulation();
 	Vector			ConstrainNode( const Vector& vNormal, const Vector& vNodePosition, const Vector& vMidpiont, float fNormalLength );
 	void			ConstrainNodesBetweenEndpoints( void );
 
@@ -265,6 +267,8 @@ private:
 	bool			m_bNewDataThisFrame : 1;			// Set to true in OnDataChanged so that we simulate that frame
 	bool			m_bPhysicsInitted : 1;				// It waits until all required entities are
 	// present to start simulating and rendering.
+	bool			m_bPhysicsHooked : 1;				// HookPhysics() was called, so the delegate isn't ours
+	bool			m_bSimulationQueued : 1;			// Waiting in CRopeManager's batch for this frame
 
 	friend class CRopeManager;
 };
@@ -285,6 +289,7 @@ public:
 	virtual void				ResetRenderCache( void ) = 0;
 	virtual void				AddToRenderCache( C_RopeKeyframe * pRope ) = 0;
 	virtual void				DrawRenderCache( bool bShadowDepth ) = 0;
+	virtual void				SimulateQueuedRopes( void ) = 0;
 #ifndef MAPBASE
 	virtual void				OnRenderStart( void ) = 0;
 #endif
@@ -2280,6 +2280,9 @@ void SimulateEntities()
 	// Service timer events (think functions).
 	ClientThinkList()->PerformThinkFunctions();
 
+	// Ropes queue their simulation while thinking, so run the batch now
+	RopeManager()->SimulateQueuedRopes();
+
 	// TODO: make an ISimulateable interface so C_BaseNetworkables can simulate?
 	{
 		VPROF_( "C_BaseEntity::Simulate", 1, VPROF_BUDGETGROUP_CLIENT_SIM, false, BUDGETFLAG_CLIENT );
@@ -33,6 +33,7 @@ static ConVar cl_drawleaf( "cl_drawleaf", "-1", FCVAR_CHEAT );
 static ConVar r_PortalTestEnts( "r_PortalTestEnts", "1", FCVAR_CHEAT, "Clip entities against portal frustums." );
 static ConVar r_portalsopenall( "r_portalsopenall", "0", FCVAR_CHEAT, "Open all portals" );
 static ConVar cl_threaded_client_leaf_system( "cl_threaded_client_leaf_system", "0" );
+static ConVar cl_threaded_build_renderables( "cl_threaded_build_renderables", "0", 0, "Cull and classify renderables for the render lists on the thread pool." );
 
 
 DEFINE_FIXEDSIZE_ALLOCATOR( CClientRenderablesList, 1, CUtlMemoryPool::GROW_SLOW );
@@ -121,6 +122,7 @@ public:
 	virtual void CollateViewModelRenderables( CUtlVector< IClientRenderable* >& opaque, CUtlVector< IClientRenderable* >& translucent );
 	virtual void BuildRenderablesList( const SetupRenderInfo_t& info );
 	void CollateRenderablesInLeaf( int leaf, int worldListLeafIndex, const SetupRenderInfo_t& info );
+	void CollateDetailObjectsInLeaf( int leaf, int worldListLeafIndex, const SetupRenderInfo_t& info );
 	virtual void DrawStaticProps( bool enable );
 	virtual void DrawSmallEntities( bool enable );
 	virtual void EnableAlternateSorting( ClientRenderHandle_t handle, bool bEnable );
@@ -153,6 +155,10 @@ public:
 	// Get leaves this renderable is in
 	virtual bool GetRenderableLeaf( ClientRenderHandle_t handle, int* pOutLeaf, const int* pInIterator = 0, int* pOutIterator = 0 );
 
+	// Fills this (otherwise unused) leaf system with synthetic leaves and renderables, builds
+	// render lists with the serial and threaded paths and compares them. Doesn't need a map.
+	void TestBuildRenderablesList( int nLeaves, int nRenderables, int nIterations );
+
 	// Singleton instance...
 	static CClientLeafSystem s_ClientLeafSystem;
 
@@ -165,6 +171,28 @@ private:
 
 	void SortEntities( const Vector& vecRenderOrigin, const Vector& vecRenderForward, CClientRenderablesList::CEntry* pEntities, int nEntities );
 
+	// The two ways of building the render lists. Both produce the same lists.
+	void BuildRenderablesListSerial( const SetupRenderInfo_t& info );
+	void BuildRenderablesListThreaded( const SetupRenderInfo_t& info );
+
+	// A renderable that made it past the per-leaf checks in BuildRenderablesListThreaded
+	struct CollateCandidate_t
+	{
+		ClientRenderHandle_t	m_hRenderable;
+		bool					m_bEvaluateSerially;	// has a move parent, its abs origin may set up the parent's bones
+
+		// Filled in by EvaluateCollateCandidate
+		bool					m_bVisible;
+		bool					m_bTestOcclusion;
+		bool					m_bTwoPass;
+		RenderGroup_t			m_nGroup;
+		Vector					m_vecAbsMins;
+		Vector					m_vecAbsMaxs;
+	};
+
+	void EvaluateCollateCandidate( CollateCandidate_t& candidate );
+	void EvaluateCollateCandidateThreaded( CollateCandidate_t& candidate );
+
 	// Returns -1 if the renderable spans more than one area. If it's totally in one area, then this returns the leaf.
 	short GetRenderableArea( ClientRenderHandle_t handle );
 
@@ -333,6 +361,12 @@ private:
 	int	m_ShadowEnum;
 
 	CTSList<EnumResultList_t> m_DeferredInserts;
+
+	// Scratch for BuildRenderablesListThreaded
+	CUtlVector< CollateCandidate_t > m_CollateCandidates;
+	CUtlVector< int > m_CollateLeafStart;
+	const SetupRenderInfo_t* m_pCollateInfo;
+	bool m_bCollatePortalTestEnts;
 };
 
 
@@ -445,7 +479,7 @@ void CalcRenderableWorldSpaceAABB_Fast( IClientRenderable* pRenderable, Vector&
 //-----------------------------------------------------------------------------
 // constructor, destructor
 //-----------------------------------------------------------------------------
-CClientLeafSystem::CClientLeafSystem() : m_DrawStaticProps( true ), m_DrawSmallObjects( true )
+CClientLeafSystem::CClientLeafSystem() : m_DrawStaticProps( true ), m_DrawSmallObjects( true ), m_pCollateInfo( NULL ), m_bCollatePortalTestEnts( false )
 {
 	// Set up the bi-directional lists...
 	m_RenderablesInLeaf.Init( FirstRenderableInLeaf, FirstLeafInRenderable );
@@ -1768,10 +1802,19 @@ void CClientLeafSystem::CollateRenderablesInLeaf( int leaf, int worldListLeafInd
 	}
 
 	// Do detail objects.
-	// These don't have render handles!
+	CollateDetailObjectsInLeaf( leaf, worldListLeafIndex, info );
+}
+
+
+//-----------------------------------------------------------------------------
+// Adds the detail objects in a leaf to the render list.
+// These don't have render handles!
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::CollateDetailObjectsInLeaf( int leaf, int worldListLeafIndex, const SetupRenderInfo_t& info )
+{
 	if( info.m_bDrawDetailObjects && ShouldDrawDetailObjectsInLeaf( leaf, info.m_nDetailBuildFrame ) )
 	{
-		idx = m_Leaf[leaf].m_FirstDetailProp;
+		int idx = m_Leaf[leaf].m_FirstDetailProp;
 		int count = m_Leaf[leaf].m_DetailPropCount;
 		while( --count >= 0 )
 		{
@@ -1867,6 +1910,19 @@ void CClientLeafSystem::SortEntities( const Vector& vecRenderOrigin, const Vecto
 void CClientLeafSystem::BuildRenderablesList( const SetupRenderInfo_t& info )
 {
 	VPROF_BUDGET( "BuildRenderablesList", "BuildRenderablesList" );
+
+	if( cl_threaded_build_renderables.GetBool() && g_pThreadPool->NumThreads() )
+	{
+		BuildRenderablesListThreaded( info );
+	}
+	else
+	{
+		BuildRenderablesListSerial( info );
+	}
+}
+
+void CClientLeafSystem::BuildRenderablesListSerial( const SetupRenderInfo_t& info )
+{
 	int leafCount = info.m_pWorldListInfo->m_LeafCount;
 	const Vector& vecRenderOrigin = info.m_vecRenderOrigin;
 	const Vector& vecRenderForward = info.m_vecRenderForward;
@@ -1888,3 +1944,509 @@ void CClientLeafSystem::BuildRenderablesList( const SetupRenderInfo_t& info )
 		}
 	}
 }
+
+
+//-----------------------------------------------------------------------------
+// The per-renderable tests of CollateRenderablesInLeaf that don't depend on
+// the other renderables: fade, bounds, frustum culling and which group it
+// goes in. Only reads the leaf system, so it can run on any thread.
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::EvaluateCollateCandidate( CollateCandidate_t& candidate )
+{
+	const SetupRenderInfo_t& info = *m_pCollateInfo;
+	RenderableInfo_t& renderable = m_Renderables[candidate.m_hRenderable];
+
+	candidate.m_bVisible = false;
+	candidate.m_bTestOcclusion = false;
+	candidate.m_bTwoPass = false;
+	candidate.m_nGroup = ( RenderGroup_t )renderable.m_RenderGroup;
+
+	unsigned char nAlpha = 255;
+	if( info.m_bDrawTranslucentObjects )
+	{
+		// Prevent culling if the renderable is invisible
+		// NOTE: OPAQUE objects can have alpha == 0.
+		// They are made to be opaque because they don't have to be sorted.
+		nAlpha = renderable.m_pRenderable->GetFxBlend();
+		if( nAlpha == 0 )
+		{
+			return;
+		}
+	}
+
+	CalcRenderableWorldSpaceAABB( renderable.m_pRenderable, candidate.m_vecAbsMins, candidate.m_vecAbsMaxs );
+	// If the renderable is inside an area, cull it using the frustum for that area.
+	if( m_bCollatePortalTestEnts && renderable.m_Area != -1 )
+	{
+		VPROF( "r_PortalTestEnts" );
+		if( !engine->DoesBoxTouchAreaFrustum( candidate.m_vecAbsMins, candidate.m_vecAbsMaxs, renderable.m_Area ) )
+		{
+			return;
+		}
+	}
+	else
+	{
+		// cull with main frustum
+		if( engine->CullBox( candidate.m_vecAbsMins, candidate.m_vecAbsMaxs ) )
+		{
+			return;
+		}
+	}
+
+	// Occlusion is tested when the lists are filled in, on the calling thread
+	candidate.m_bTestOcclusion = ( renderable.m_Flags & RENDER_FLAGS_STUDIO_MODEL ) != 0;
+
+#ifdef INVASION_CLIENT_DLL
+	if( info.m_flRenderDistSq != 0.0f )
+	{
+		Vector mins, maxs;
+		renderable.m_pRenderable->GetRenderBounds( mins, maxs );
+
+		if( ( maxs.z - mins.z ) < 100 )
+		{
+			Vector vCenter;
+			VectorLerp( mins, maxs, 0.5f, vCenter );
+			vCenter += renderable.m_pRenderable->GetRenderOrigin();
+
+			float flDistSq = info.m_vecRenderOrigin.DistToSqr( vCenter );
+			if( info.m_flRenderDistSq <= flDistSq )
+			{
+				return;
+			}
+		}
+	}
+#endif
+
+	if( renderable.m_RenderGroup != RENDER_GROUP_TRANSLUCENT_ENTITY )
+	{
+		// Determine object group offset
+		if( RENDER_GROUP_CFG_NUM_OPAQUE_ENT_BUCKETS > 1 &&
+				candidate.m_nGroup >= RENDER_GROUP_OPAQUE_STATIC &&
+				candidate.m_nGroup <= RENDER_GROUP_OPAQUE_ENTITY )
+		{
+			Vector dims;
+			VectorSubtract( candidate.m_vecAbsMaxs, candidate.m_vecAbsMins, dims );
+
+			float const fDimension = MAX( MAX( fabs( dims.x ), fabs( dims.y ) ), fabs( dims.z ) );
+			candidate.m_nGroup = DetectBucketedRenderGroup( candidate.m_nGroup, fDimension );
+
+			Assert( candidate.m_nGroup >= RENDER_GROUP_OPAQUE_STATIC_HUGE && candidate.m_nGroup <= RENDER_GROUP_OPAQUE_ENTITY );
+		}
+	}
+	else
+	{
+		candidate.m_bTwoPass = ( ( renderable.m_Flags & RENDER_FLAGS_TWOPASS ) != 0 ) && ( nAlpha == 255 );	// Two pass?
+	}
+
+	candidate.m_bVisible = true;
+}
+
+void CClientLeafSystem::EvaluateCollateCandidateThreaded( CollateCandidate_t& candidate )
+{
+	if( !candidate.m_bEvaluateSerially )
+	{
+		EvaluateCollateCandidate( candidate );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Same lists as BuildRenderablesListSerial, in three passes:
+//  - walk the leaves in order and pick out the renderables each one would
+//    test, which is where the order dependent part (skipping renderables
+//    already seen in an earlier leaf) happens
+//  - cull and classify all of those on the thread pool, each into its own slot
+//  - walk the leaves in order again and add the survivors, detail objects and
+//    sorted translucents exactly as CollateRenderablesInLeaf would
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::BuildRenderablesListThreaded( const SetupRenderInfo_t& info )
+{
+	int leafCount = info.m_pWorldListInfo->m_LeafCount;
+	CClientRenderablesList& renderList = *info.m_pRenderList;
+	CClientRenderablesList::CEntry* pTranslucentEntries = renderList.m_RenderGroups[RENDER_GROUP_TRANSLUCENT_ENTITY];
+	int& nTranslucentEntries = renderList.m_RenderGroupCounts[RENDER_GROUP_TRANSLUCENT_ENTITY];
+
+	m_pCollateInfo = &info;
+	m_bCollatePortalTestEnts = r_PortalTestEnts.GetBool() && !r_portalsopenall.GetBool();
+	m_CollateCandidates.RemoveAll();
+	m_CollateLeafStart.SetCount( leafCount + 1 );
+
+	for( int i = 0; i < leafCount; i++ )
+	{
+		int leaf = info.m_pWorldListInfo->m_pLeafList[i];
+		m_CollateLeafStart[i] = m_CollateCandidates.Count();
+
+		unsigned int idx = m_RenderablesInLeaf.FirstElement( leaf );
+		for( ; idx != m_RenderablesInLeaf.InvalidIndex(); idx = m_RenderablesInLeaf.NextElement( idx ) )
+		{
+			ClientRenderHandle_t handle = m_RenderablesInLeaf.Element( idx );
+			RenderableInfo_t& renderable = m_Renderables[handle];
+
+			// Early out on static props if we don't want to render them
+			if( ( !m_DrawStaticProps ) && ( renderable.m_Flags & RENDER_FLAGS_STATIC_PROP ) )
+			{
+				continue;
+			}
+
+			Assert( m_DrawSmallObjects ); // MOTODO
+
+			// Don't hit the same ent in multiple leaves twice.
+			if( renderable.m_RenderGroup != RENDER_GROUP_TRANSLUCENT_ENTITY )
+			{
+				if( renderable.m_RenderFrame2 == info.m_nRenderFrame )
+				{
+					continue;
+				}
+
+				renderable.m_RenderFrame2 = info.m_nRenderFrame;
+			}
+			else // translucent
+			{
+				// Translucent entities already have had ComputeTranslucentRenderLeaf called on them
+				// so m_RenderLeaf should be set to the nearest leaf, so that's what we want here.
+				if( renderable.m_RenderLeaf != ( unsigned int )leaf )
+				{
+					continue;
+				}
+			}
+
+			C_BaseEntity* pEnt = renderable.m_pRenderable->GetIClientUnknown()->GetBaseEntity();
+
+			CollateCandidate_t& candidate = m_CollateCandidates[m_CollateCandidates.AddToTail()];
+			candidate.m_hRenderable = handle;
+			// Bonemerged followers take the _Fast bounds and never touch the parent, but anything
+			// parented to an attachment computes its abs origin through GetAttachment, which can
+			// set up the parent's bones. Keep all parented entities off the workers.
+			candidate.m_bEvaluateSerially = pEnt && pEnt->GetMoveParent();
+		}
+	}
+	m_CollateLeafStart[leafCount] = m_CollateCandidates.Count();
+
+	// Not worth waking the pool for a handful
+	int nCandidates = m_CollateCandidates.Count();
+	if( nCandidates >= 64 && g_pThreadPool->NumThreads() )
+	{
+		ParallelProcess( "CClientLeafSystem::BuildRenderablesList", m_CollateCandidates.Base(), nCandidates, this,
+						 &CClientLeafSystem::EvaluateCollateCandidateThreaded, &CClientLeafSystem::FrameLock, &CClientLeafSystem::FrameUnlock );
+	}
+	else
+	{
+		for( int i = 0; i < nCandidates; i++ )
+		{
+			m_CollateCandidates[i].m_bEvaluateSerially = true;
+		}
+	}
+
+	for( int i = 0; i < leafCount; i++ )
+	{
+		int leaf = info.m_pWorldListInfo->m_pLeafList[i];
+		int nTranslucent = nTranslucentEntries;
+
+		// Place a fake entity for static/opaque ents in this leaf
+		AddRenderableToRenderList( renderList, NULL, i, RENDER_GROUP_OPAQUE_STATIC, NULL );
+		AddRenderableToRenderList( renderList, NULL, i, RENDER_GROUP_OPAQUE_ENTITY, NULL );
+
+		for( int j = m_CollateLeafStart[i]; j < m_CollateLeafStart[i + 1]; j++ )
+		{
+			CollateCandidate_t& candidate = m_CollateCandidates[j];
+			if( candidate.m_bEvaluateSerially )
+			{
+				EvaluateCollateCandidate( candidate );
+			}
+
+			if( !candidate.m_bVisible )
+			{
+				continue;
+			}
+
+			// UNDONE: Investigate speed tradeoffs of occlusion culling brush models too?
+			// The engine doesn't promise IsOccluded() is thread safe, so it stays here.
+			if( candidate.m_bTestOcclusion && engine->IsOccluded( candidate.m_vecAbsMins, candidate.m_vecAbsMaxs ) )
+			{
+				continue;
+			}
+
+			IClientRenderable* pRenderable = m_Renderables[candidate.m_hRenderable].m_pRenderable;
+			if( candidate.m_nGroup != RENDER_GROUP_TRANSLUCENT_ENTITY )
+			{
+				AddRenderableToRenderList( renderList, pRenderable, i, candidate.m_nGroup, candidate.m_hRenderable );
+			}
+			else
+			{
+				// Add to appropriate list if drawing translucent objects (shadow depth mapping will skip this)
+				if( info.m_bDrawTranslucentObjects )
+				{
+					AddRenderableToRenderList( renderList, pRenderable, i, RENDER_GROUP_TRANSLUCENT_ENTITY, candidate.m_hRenderable, candidate.m_bTwoPass );
+				}
+
+				if( candidate.m_bTwoPass )	// Also add to opaque list if it's a two-pass model...
+				{
+					AddRenderableToRenderList( renderList, pRenderable, i, RENDER_GROUP_OPAQUE_ENTITY, candidate.m_hRenderable, candidate.m_bTwoPass );
+				}
+			}
+		}
+
+		CollateDetailObjectsInLeaf( leaf, i, info );
+
+		int nNewTranslucent = nTranslucentEntries - nTranslucent;
+		if( ( nNewTranslucent != 0 ) && info.m_bDrawTranslucentObjects )
+		{
+			// Sort the new translucent entities.
+			SortEntities( info.m_vecRenderOrigin, info.m_vecRenderForward, &pTranslucentEntries[nTranslucent], nNewTranslucent );
+		}
+	}
+
+	m_pCollateInfo = NULL;
+}
+
+
+//-----------------------------------------------------------------------------
+// Stand-in renderable for TestBuildRenderablesList
+//-----------------------------------------------------------------------------
+class CCollateTestRenderable : public CDefaultClientRenderable
+{
+public:
+	CCollateTestRenderable( const Vector& vecOrigin, const QAngle& angles, const Vector& vecHalfSize, bool bTranslucent, int nAlpha )
+		: m_vecOrigin( vecOrigin ), m_Angles( angles ), m_vecHalfSize( vecHalfSize ), m_bTranslucent( bTranslucent ), m_nAlpha( nAlpha )
+	{
+		AngleMatrix( m_Angles, m_vecOrigin, m_Transform );
+	}
+
+	virtual const Vector&			GetRenderOrigin( void )
+	{
+		return m_vecOrigin;
+	}
+	virtual const QAngle&			GetRenderAngles( void )
+	{
+		return m_Angles;
+	}
+	virtual const matrix3x4_t& 		RenderableToWorldTransform()
+	{
+		return m_Transform;
+	}
+	virtual bool					ShouldDraw( void )
+	{
+		return true;
+	}
+	virtual bool					IsTransparent( void )
+	{
+		return m_bTranslucent;
+	}
+	virtual int						GetFxBlend( void )
+	{
+		return m_nAlpha;
+	}
+	virtual void					GetRenderBounds( Vector& mins, Vector& maxs )
+	{
+		mins = -m_vecHalfSize;
+		maxs = m_vecHalfSize;
+	}
+
+private:
+	Vector		m_vecOrigin;
+	QAngle		m_Angles;
+	Vector		m_vecHalfSize;
+	matrix3x4_t	m_Transform;
+	bool		m_bTranslucent;
+	int			m_nAlpha;
+};
+
+static bool RenderListsMatch( const CClientRenderablesList& a, const CClientRenderablesList& b, int& nGroup, int& nEntry )
+{
+	for( nGroup = 0; nGroup < RENDER_GROUP_COUNT; nGroup++ )
+	{
+		nEntry = -1;
+		if( a.m_RenderGroupCounts[nGroup] != b.m_RenderGroupCounts[nGroup] )
+		{
+			return false;
+		}
+
+		for( nEntry = 0; nEntry < a.m_RenderGroupCounts[nGroup]; nEntry++ )
+		{
+			const CClientRenderablesList::CEntry& entryA = a.m_RenderGroups[nGroup][nEntry];
+			const CClientRenderablesList::CEntry& entryB = b.m_RenderGroups[nGroup][nEntry];
+			if( entryA.m_pRenderable != entryB.m_pRenderable || entryA.m_iWorldListInfoLeaf != entryB.m_iWorldListInfoLeaf ||
+					entryA.m_TwoPass != entryB.m_TwoPass || entryA.m_RenderHandle != entryB.m_RenderHandle )
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void CClientLeafSystem::TestBuildRenderablesList( int nLeaves, int nRenderables, int nIterations )
+{
+	Assert( !m_Leaf.Count() && !m_Renderables.Count() );
+
+	// Fixed seed so runs can be compared
+	CUniformRandomStream random;
+	random.SetSeed( 1234 );
+
+	ClientLeaf_t newLeaf;
+	newLeaf.m_FirstElement = m_RenderablesInLeaf.InvalidIndex();
+	newLeaf.m_FirstShadow = m_ShadowsInLeaf.InvalidIndex();
+	memset( newLeaf.m_pSubSystemData, 0, sizeof( newLeaf.m_pSubSystemData ) );
+	newLeaf.m_FirstDetailProp = 0;
+	newLeaf.m_DetailPropCount = 0;
+	newLeaf.m_DetailPropRenderFrame = -1;
+	for( int i = 0; i < nLeaves; i++ )
+	{
+		m_Leaf.AddToTail( newLeaf );
+	}
+
+	// Spread them through a box in front of the view so most of them survive frustum culling
+	const Vector& vecOrigin = MainViewOrigin();
+	const Vector& vecForward = MainViewForward();
+	const Vector& vecRight = MainViewRight();
+	const Vector& vecUp = MainViewUp();
+
+	CUtlVector< CCollateTestRenderable* > renderables;
+	renderables.EnsureCapacity( nRenderables );
+	for( int i = 0; i < nRenderables; i++ )
+	{
+		Vector vecPos = vecOrigin + vecForward * random.RandomFloat( 32.0f, 3072.0f ) +
+						vecRight * random.RandomFloat( -1536.0f, 1536.0f ) + vecUp * random.RandomFloat( -512.0f, 512.0f );
+		QAngle angles = ( random.RandomInt( 0, 1 ) ) ? vec3_angle : QAngle( random.RandomFloat( -90.0f, 90.0f ), random.RandomFloat( 0.0f, 360.0f ), 0.0f );
+		float flSize = random.RandomFloat( 4.0f, 256.0f );
+		Vector vecHalfSize( flSize, flSize * random.RandomFloat( 0.25f, 1.0f ), flSize * random.RandomFloat( 0.25f, 1.0f ) );
+
+		bool bTranslucent = random.RandomInt( 0, 4 ) == 0;
+		int nAlpha = bTranslucent ? random.RandomInt( 0, 3 ) * 85 : 255;
+
+		CCollateTestRenderable* pRenderable = new CCollateTestRenderable( vecPos, angles, vecHalfSize, bTranslucent, nAlpha );
+		RenderGroup_t group = RENDER_GROUP_OPAQUE_ENTITY;
+		int flags = 0;
+		if( bTranslucent )
+		{
+			group = RENDER_GROUP_TRANSLUCENT_ENTITY;
+			flags = ( nAlpha == 255 ) ? RENDER_FLAGS_TWOPASS : 0;
+		}
+		NewRenderable( pRenderable, group, flags );
+		renderables.AddToTail( pRenderable );
+
+		// Most renderables straddle a few leaves, which is what the order dependent
+		// "seen in an earlier leaf" skipping has to get right
+		ClientRenderHandle_t handle = pRenderable->RenderHandle();
+		int nInLeaves = random.RandomInt( 1, 4 );
+		for( int j = 0; j < nInLeaves; j++ )
+		{
+			int leaf = random.RandomInt( 0, nLeaves - 1 );
+			if( m_RenderablesInLeaf.IsElementInBucket( leaf, handle ) )
+			{
+				continue;
+			}
+			AddRenderableToLeaf( leaf, handle );
+		}
+		m_Renderables[handle].m_Area = -1;
+	}
+
+	// The visible leaves, in a shuffled order standing in for front to back
+	CUtlVector< LeafIndex_t > leafList;
+	CUtlVector< LeafFogVolume_t > leafFogVolumes;
+	for( int i = 0; i < nLeaves; i++ )
+	{
+		if( random.RandomInt( 0, 3 ) != 0 )
+		{
+			leafList.AddToTail( i );
+			leafFogVolumes.AddToTail( -1 );
+		}
+	}
+	for( int i = leafList.Count(); --i > 0; )
+	{
+		V_swap( leafList[i], leafList[random.RandomInt( 0, i )] );
+	}
+
+	WorldListInfo_t worldListInfo;
+	worldListInfo.m_ViewFogVolume = -1;
+	worldListInfo.m_LeafCount = leafList.Count();
+	worldListInfo.m_pLeafList = leafList.Base();
+	worldListInfo.m_pLeafFogVolume = leafFogVolumes.Base();
+
+	int nFrame = 0;
+	ComputeTranslucentRenderLeaf( leafList.Count(), leafList.Base(), leafFogVolumes.Base(), ++nFrame, VIEW_MAIN );
+
+	CClientRenderablesList* pSerialList = new CClientRenderablesList;
+	CClientRenderablesList* pThreadedList = new CClientRenderablesList;
+
+	SetupRenderInfo_t info;
+	info.m_pWorldListInfo = &worldListInfo;
+	info.m_vecRenderOrigin = vecOrigin;
+	info.m_vecRenderForward = vecForward;
+	info.m_nDetailBuildFrame = -1;
+	info.m_flRenderDistSq = 0.0f;
+	info.m_bDrawDetailObjects = false;
+	info.m_bDrawTranslucentObjects = true;
+
+	float flSerialTime = 0.0f;
+	float flThreadedTime = 0.0f;
+	bool bMatch = true;
+	for( int i = 0; i < nIterations && bMatch; i++ )
+	{
+		memset( pSerialList->m_RenderGroupCounts, 0, sizeof( pSerialList->m_RenderGroupCounts ) );
+		memset( pThreadedList->m_RenderGroupCounts, 0, sizeof( pThreadedList->m_RenderGroupCounts ) );
+
+		CFastTimer timer;
+		info.m_pRenderList = pSerialList;
+		info.m_nRenderFrame = ++nFrame;
+		timer.Start();
+		BuildRenderablesListSerial( info );
+		timer.End();
+		flSerialTime += timer.GetDuration().GetMillisecondsF();
+
+		info.m_pRenderList = pThreadedList;
+		info.m_nRenderFrame = ++nFrame;
+		timer.Start();
+		BuildRenderablesListThreaded( info );
+		timer.End();
+		flThreadedTime += timer.GetDuration().GetMillisecondsF();
+
+		int nGroup, nEntry;
+		if( !RenderListsMatch( *pSerialList, *pThreadedList, nGroup, nEntry ) )
+		{
+			Warning( "Render lists differ on iteration %d, group %d, entry %d (serial count %d, threaded count %d)\n",
+					 i, nGroup, nEntry, pSerialList->m_RenderGroupCounts[nGroup], pThreadedList->m_RenderGroupCounts[nGroup] );
+			bMatch = false;
+		}
+	}
+
+	// Every leaf gets two placeholder entries, don't count those
+	int nEntries = -2 * leafList.Count();
+	for( int i = 0; i < RENDER_GROUP_COUNT; i++ )
+	{
+		nEntries += pSerialList->m_RenderGroupCounts[i];
+	}
+
+	Msg( "%d of %d leaves visible, %d renderables, %d list entries after culling, %d pool threads\n",
+		 leafList.Count(), nLeaves, nRenderables, nEntries, g_pThreadPool->NumThreads() );
+	if( bMatch )
+	{
+		Msg( "Lists match over %d iterations. serial %.3f ms, threaded %.3f ms per build (%.2fx)\n", nIterations,
+			 flSerialTime / nIterations, flThreadedTime / nIterations, flThreadedTime > 0.0f ? flSerialTime / flThreadedTime : 0.0f );
+	}
+
+	pSerialList->Release();
+	pThreadedList->Release();
+
+	for( int i = 0; i < renderables.Count(); i++ )
+	{
+		RemoveRenderable( renderables[i]->RenderHandle() );
+		delete renderables[i];
+	}
+	LevelShutdownPostEntity();
+}
+
+//-----------------------------------------------------------------------------
+// Runs on a leaf system of its own, so it works from the main menu and leaves
+// the real one alone. Frustum culling still uses the engine's last view.
+//-----------------------------------------------------------------------------
+CON_COMMAND( cl_build_renderables_test, "Builds render lists for synthetic leaves and renderables with the serial and threaded paths and compares them.\n\tArguments: [leaves] [renderables] [iterations]\n" )
+{
+	int nLeaves = ( args.ArgC() > 1 ) ? atoi( args[1] ) : 512;
+	int nRenderables = ( args.ArgC() > 2 ) ? atoi( args[2] ) : 3000;
+	int nIterations = ( args.ArgC() > 3 ) ? atoi( args[3] ) : 20;
+
+	CClientLeafSystem* pTestSystem = new CClientLeafSystem;
+	pTestSystem->TestBuildRenderablesList( Max( nLeaves, 1 ), Max( nRenderables, 0 ), Max( nIterations, 1 ) );
+	delete pTestSystem;
+}
@@ -21,6 +21,7 @@
 #include "env_detail_controller.h"
 #include "tier0/icommandline.h"
 #include "c_world.h"
+#include "vstdlib/jobthread.h"
 
 #include "tier0/valve_minmax_off.h"
 #include <algorithm>
@@ -51,6 +52,9 @@ struct model_t;
 
 ConVar cl_detaildist( "cl_detaildist", "1200", 0, "Distance at which detail props are no longer visible" );
 ConVar cl_detailfade( "cl_detailfade", "400", 0, "Distance across which detail props fade in" );
+ConVar cl_detail_sort_reuse_dist( "cl_detail_sort_reuse_dist", "4", 0, "Reuse a leaf's back-to-front detail sprite order until the view moves this far from where it was sorted. 0 sorts every frame." );
+ConVar cl_detail_threaded_min( "cl_detail_threaded_min", "4096", 0, "Fewest visible detail sprites before leaves are built and sorted on the thread pool." );
+ConVar cl_detail_stats( "cl_detail_stats", "0", 0, "Shows the detail sprites drawn this frame and what they cost." );
 #if defined( USE_DETAIL_SHAPES )
 	ConVar cl_detail_max_sway( "cl_detail_max_sway", "0", FCVAR_ARCHIVE, "Amplitude of the detail prop sway" );
 	ConVar cl_detail_avoid_radius( "cl_detail_avoid_radius", "0", FCVAR_ARCHIVE, "radius around detail sprite to avoid players" );
@@ -424,10 +428,15 @@ class CFastDetailLeafSpriteList : public CClientLeafSubSystemData
 	int m_nNumPendingSprites;
 	int m_nStartSpriteIndex;
 
+	// back-to-front order from the last full sort, reused while the view stays near m_vecSortOrigin
+	CUtlVector<int> m_SortedOrder;
+	Vector m_vecSortOrigin;
+
 	CFastDetailLeafSpriteList( void )
 	{
 		m_nNumPendingSprites = 0;
 		m_nStartSpriteIndex = 0;
+		m_vecSortOrigin.Init();
 	}
 
 };
@@ -526,11 +535,34 @@ private:
 		float m_flDistance;
 	};
 
+	// Where one leaf's sprites are built out and sorted
+	struct FastSpriteSortBuffers_t
+	{
+		SortInfo_t* m_pSortInfo;			// sorted output, m_nIndex points into m_pBuildout
+		SortInfo_t* m_pSortTemp;			// radix sort scratch
+		float* m_pDistances;				// squared distance of every sprite in the leaf
+		int* m_pGroupSlots;					// buildout slot of each group of 4, -1 if culled
+		FastSpriteQuadBuildoutBufferX4_t* m_pBuildout;
+	};
+
+	struct FastSpriteLeafJob_t
+	{
+		CFastDetailLeafSpriteList* m_pData;
+		FastSpriteSortBuffers_t m_Buffers;
+		int m_nCount;
+		bool m_bReusedOrder;
+	};
+
 	int BuildOutSortedSprites( CFastDetailLeafSpriteList* pData,
 							   Vector const& viewOrigin,
 							   Vector const& viewForward,
-							   Vector const& viewRight,
-							   Vector const& viewUp );
+							   FastSpriteSortBuffers_t const& buffers,
+							   bool* pbReusedOrder = NULL );
+	void BuildOutSortedSpritesJob( FastSpriteLeafJob_t& job );
+	static void SortSpritesByDistance( float const* pDistances, int nCount, SortInfo_t* pOut, SortInfo_t* pTemp );
+	void EnsureFastSortBuffers( int nGroups );
+	FastSpriteSortBuffers_t GetFastSortBuffers( int nFirstGroup );
+	void DisplayFastSpriteStats( int nLeaves, int nReused, int nSprites, bool bThreaded, float flBuildMs, float flDrawMs );
 
 	void RenderFastSprites( const Vector& viewOrigin, const Vector& viewForward, const Vector& viewRight, const Vector& viewUp, int nLeafCount, LeafIndex_t const* pLeafList );
 
@@ -581,8 +613,26 @@ private:
 	int m_nSortedLeaf;
 	int m_nSortedFastLeaf;
 	SortInfo_t* m_pSortInfo;
-	SortInfo_t* m_pFastSortInfo;
-	FastSpriteQuadBuildoutBufferX4_t* m_pBuildoutBuffer;
+
+	// Fast sprite build out and sort space for every leaf drawn in a view, grown as needed
+	CUtlVector<SortInfo_t> m_FastSortInfo;
+	CUtlVector<SortInfo_t> m_FastSortTemp;
+	CUtlVector< float, CUtlMemoryAligned<float, 16> > m_FastSortDistances;
+	CUtlVector<int> m_FastGroupSlots;
+	CUtlVector< FastSpriteQuadBuildoutBufferX4_t, CUtlMemoryAligned<FastSpriteQuadBuildoutBufferX4_t, 16> > m_FastBuildoutBuffer;
+
+	// View the leaf jobs are building for
+	Vector m_vecJobViewOrigin;
+	Vector m_vecJobViewForward;
+
+	// cl_detail_stats totals for the frame
+	int m_nStatsFrame;
+	int m_nStatsLeaves;
+	int m_nStatsReused;
+	int m_nStatsSprites;
+	bool m_bStatsThreaded;
+	float m_flStatsBuildMs;
+	float m_flStatsDrawMs;
 
 	float m_flDefaultFadeStart;
 	float m_flDefaultFadeEnd;
@@ -1531,8 +1581,7 @@ CDetailObjectSystem::CDetailObjectSystem() : m_DetailSpriteDict( 0, 32 ), m_Deta
 {
 	m_pFastSpriteData = NULL;
 	m_pSortInfo = NULL;
-	m_pFastSortInfo = NULL;
-	m_pBuildoutBuffer = NULL;
+	m_nStatsFrame = -1;
 }
 
 void CDetailObjectSystem::FreeSortBuffers( void )
@@ -1542,16 +1591,11 @@ void CDetailObjectSystem::FreeSortBuffers( void )
 		MemAlloc_FreeAligned( m_pSortInfo );
 		m_pSortInfo = NULL;
 	}
-	if( m_pFastSortInfo )
-	{
-		MemAlloc_FreeAligned( m_pFastSortInfo );
-		m_pFastSortInfo = NULL;
-	}
-	if( m_pBuildoutBuffer )
-	{
-		MemAlloc_FreeAligned( m_pBuildoutBuffer );
-		m_pBuildoutBuffer = NULL;
-	}
+	m_FastSortInfo.Purge();
+	m_FastSortTemp.Purge();
+	m_FastSortDistances.Purge();
+	m_FastGroupSlots.Purge();
+	m_FastBuildoutBuffer.Purge();
 }
 
 CDetailObjectSystem::~CDetailObjectSystem()
@@ -1906,13 +1950,8 @@ void CDetailObjectSystem::UnserializeModels( CUtlBuffer& buf )
 	}
 	if( nMaxFastInLeaf )
 	{
-		m_pFastSortInfo = reinterpret_cast<SortInfo_t*>(
-							  MemAlloc_AllocAligned( ( 3 + nMaxFastInLeaf ) * sizeof( SortInfo_t ), sizeof( fltx4 ) ) );
-
-		m_pBuildoutBuffer = reinterpret_cast<FastSpriteQuadBuildoutBufferX4_t*>(
-								MemAlloc_AllocAligned(
-									( 1 + nMaxFastInLeaf / 4 ) * sizeof( FastSpriteQuadBuildoutBufferX4_t ),
-									sizeof( fltx4 ) ) );
+		// Enough for the biggest leaf; RenderFastSprites() grows these to cover a whole view
+		EnsureFastSortBuffers( 1 + nMaxFastInLeaf / 4 );
 	}
 
 	if( nNumFastSpritesToAllocate )
@@ -2303,16 +2342,16 @@ static ALIGN16 int32 And255Mask[4] ALIGN16_POST = {0xff, 0xff, 0xff, 0xff};
 int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList* pData,
 		Vector const& viewOrigin,
 		Vector const& viewForward,
-		Vector const& viewRight,
-		Vector const& viewUp )
+		FastSpriteSortBuffers_t const& buffers,
+		bool* pbReusedOrder )
 {
 	// part 1 - do all vertex math, fading, etc into a buffer, using as much simd as we can
 	int nSIMDSprites = pData->m_nNumSIMDSprites;
 	FastSpriteX4_t const* pSprites = pData->m_pSprites;
-	SortInfo_t* pOut = m_pFastSortInfo;
-	FastSpriteQuadBuildoutBufferX4_t* pQuadBufferOut = m_pBuildoutBuffer;
-	int curidx = 0;
-	int nLastBfMask = 0;
+	FastSpriteQuadBuildoutBufferX4_t* pQuadBufferOut = buffers.m_pBuildout;
+	float* pDistances = buffers.m_pDistances;
+	int* pGroupSlots = buffers.m_pGroupSlots;
+	int nSlot = 0;
 
 	FourVectors vecViewPos;
 	vecViewPos.DuplicateVector( viewOrigin );
@@ -2326,91 +2365,244 @@ int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList* pData
 	FourVectors vecFwd;
 	vecFwd.DuplicateVector( viewForward );
 
-	do
+	for( int nGroup = 0; nGroup < nSIMDSprites; nGroup++, pSprites++ )
 	{
 		// calculate alpha
 		FourVectors ofs = pSprites->m_Pos;
 		ofs -= vecViewPos;
 		fltx4 ofsDotFwd = ofs * vecFwd;
 		fltx4 distanceSquared = ofs * ofs;
-		nLastBfMask = TestSignSIMD( OrSIMD( ofsDotFwd, CmpGtSIMD( distanceSquared, maxsqdist ) ) );		//  cull
-		if( nLastBfMask != 0xf )
+
+		// Every sprite's distance is kept, even culled ones, so the sort can be reused as the view turns
+		StoreAlignedSIMD( pDistances + ( nGroup << 2 ), distanceSquared );
+
+		if( TestSignSIMD( OrSIMD( ofsDotFwd, CmpGtSIMD( distanceSquared, maxsqdist ) ) ) == 0xf )		//  cull
 		{
-			FourVectors dx1;
-			dx1.x = fnegate( ofs.y );
-			dx1.y = ( ofs.x );
-			dx1.z = Four_Zeros;
-			dx1.VectorNormalizeFast();
-
-			FourVectors vecDx = dx1;
-			FourVectors vecDy = vecUp;
-
-			FourVectors vecPos0 = pSprites->m_Pos;
-
-			vecDx *= pSprites->m_HalfWidth;
-			vecDy *= pSprites->m_Height;
-			fltx4 alpha = MulSIMD( falloffFactor, SubSIMD( distanceSquared, startFade ) );
-			alpha = SubSIMD( Four_Ones, MinSIMD( MaxSIMD( alpha, Four_Zeros ), Four_Ones ) );
-
-			pQuadBufferOut->m_Alpha = AddSIMD( Four_MagicNumbers,
-											   MulSIMD( Four_255s, alpha ) );
-
-			vecPos0 += vecDx;
-			pQuadBufferOut->m_Coords[0] = vecPos0;
-			vecPos0 -= vecDy;
-			pQuadBufferOut->m_Coords[1] = vecPos0;
-			vecPos0 -= vecDx;
-			vecPos0 -= vecDx;
-			pQuadBufferOut->m_Coords[2] = vecPos0;
-			vecPos0 += vecDy;
-			pQuadBufferOut->m_Coords[3] = vecPos0;
-
-			fltx4 fetch4 = *( ( fltx4* )( &pSprites->m_pSpriteDefs[0] ) );
-			*( ( fltx4* )( & ( pQuadBufferOut->m_pSpriteDefs[0] ) ) ) = fetch4;
-
-			fetch4 = *( ( fltx4* )( &pSprites->m_RGBColor[0][0] ) );
-			*( ( fltx4* )( & ( pQuadBufferOut->m_RGBColor[0][0] ) ) ) = fetch4;
-
-			//!! bug!! store distance
-			// !! speed!! simd?
-			pOut[0].m_nIndex = curidx;
-			pOut[0].m_flDistance = SubFloat( distanceSquared, 0 );
-			pOut[1].m_nIndex = curidx + 1;
-			pOut[1].m_flDistance = SubFloat( distanceSquared, 1 );
-			pOut[2].m_nIndex = curidx + 2;
-			pOut[2].m_flDistance = SubFloat( distanceSquared, 2 );
-			pOut[3].m_nIndex = curidx + 3;
-			pOut[3].m_flDistance = SubFloat( distanceSquared, 3 );
-			curidx += 4;
-			pOut += 4;
-			pQuadBufferOut++;
+			pGroupSlots[nGroup] = -1;
+			continue;
 		}
-		pSprites++;
+
+		pGroupSlots[nGroup] = nSlot++;
+
+		FourVectors dx1;
+		dx1.x = fnegate( ofs.y );
+		dx1.y = ( ofs.x );
+		dx1.z = Four_Zeros;
+		dx1.VectorNormalizeFast();
+
+		FourVectors vecDx = dx1;
+		FourVectors vecDy = vecUp;
+
+		FourVectors vecPos0 = pSprites->m_Pos;
+
+		vecDx *= pSprites->m_HalfWidth;
+		vecDy *= pSprites->m_Height;
+		fltx4 alpha = MulSIMD( falloffFactor, SubSIMD( distanceSquared, startFade ) );
+		alpha = SubSIMD( Four_Ones, MinSIMD( MaxSIMD( alpha, Four_Zeros ), Four_Ones ) );
+
+		pQuadBufferOut->m_Alpha = AddSIMD( Four_MagicNumbers,
+										   MulSIMD( Four_255s, alpha ) );
+
+		vecPos0 += vecDx;
+		pQuadBufferOut->m_Coords[0] = vecPos0;
+		vecPos0 -= vecDy;
+		pQuadBufferOut->m_Coords[1] = vecPos0;
+		vecPos0 -= vecDx;
+		vecPos0 -= vecDx;
+		pQuadBufferOut->m_Coords[2] = vecPos0;
+		vecPos0 += vecDy;
+		pQuadBufferOut->m_Coords[3] = vecPos0;
+
+		fltx4 fetch4 = *( ( fltx4* )( &pSprites->m_pSpriteDefs[0] ) );
+		*( ( fltx4* )( & ( pQuadBufferOut->m_pSpriteDefs[0] ) ) ) = fetch4;
+
+		fetch4 = *( ( fltx4* )( &pSprites->m_RGBColor[0][0] ) );
+		*( ( fltx4* )( & ( pQuadBufferOut->m_RGBColor[0][0] ) ) ) = fetch4;
+
+		pQuadBufferOut++;
 	}
-	while( --nSIMDSprites );
 
-	// adjust count for tail
-	int nCount = pOut - m_pFastSortInfo;
-	if( nLastBfMask != 0xf )						// if last not skipped
+	// part 2 - sort, unless the view is still close to where this leaf was last sorted
+	int nSprites = pData->m_nNumSprites;
+	SortInfo_t* pOut = buffers.m_pSortInfo;
+
+	float flReuseDist = cl_detail_sort_reuse_dist.GetFloat();
+	bool bReuse = ( flReuseDist > 0.0f ) && ( pData->m_SortedOrder.Count() == nSprites ) &&
+				  ( viewOrigin.DistToSqr( pData->m_vecSortOrigin ) <= flReuseDist * flReuseDist );
+	if( !bReuse )
 	{
-		nCount -= ( 0 - pData->m_nNumSprites ) & 3;
+		VPROF( "CDetailObjectSystem::SortSpritesBackToFront -- Sort" );
+		SortSpritesByDistance( pDistances, nSprites, pOut, buffers.m_pSortTemp );
+
+		pData->m_SortedOrder.SetCount( nSprites );
+		for( int i = 0; i < nSprites; i++ )
+		{
+			pData->m_SortedOrder[i] = pOut[i].m_nIndex;
+		}
+		pData->m_vecSortOrigin = viewOrigin;
 	}
 
-	// part 2 - sort
-	if( nCount )
+	if( pbReusedOrder )
 	{
-		VPROF( "CDetailObjectSystem::SortSpritesBackToFront -- Sort" );
-		std::make_heap( m_pFastSortInfo, m_pFastSortInfo + nCount, SortLessFunc );
-		std::sort_heap( m_pFastSortInfo, m_pFastSortInfo + nCount, SortLessFunc );
+		*pbReusedOrder = bReuse;
 	}
+
+	// part 3 - drop culled and faded out sprites, and point the rest at their build out
+	float flMaxSqDist = m_flCurMaxSqDist;
+	int const* pOrder = pData->m_SortedOrder.Base();
+	int nCount = 0;
+	for( int i = 0; i < nSprites; i++ )
+	{
+		int nIndex = pOrder[i];
+		int nGroupSlot = pGroupSlots[nIndex >> 2];
+		float flDistance = pDistances[nIndex];
+		if( ( nGroupSlot < 0 ) || ( flDistance >= flMaxSqDist ) )
+		{
+			continue;
+		}
+
+		pOut[nCount].m_nIndex = ( nGroupSlot << 2 ) | ( nIndex & 3 );
+		pOut[nCount].m_flDistance = flDistance;
+		nCount++;
+	}
+
 	return nCount;
 }
 
 
+//-----------------------------------------------------------------------------
+// Sorts sprites back to front. Squared distances are never negative, so their bits
+// order the same as integers; the top 16 (exponent and 7 bits of mantissa) are
+// within 1% of each other, which is as close as sprite sorting needs to be.
+//-----------------------------------------------------------------------------
+void CDetailObjectSystem::SortSpritesByDistance( float const* pDistances, int nCount, SortInfo_t* pOut, SortInfo_t* pTemp )
+{
+	if( nCount < 64 )
+	{
+		// Not worth the radix passes
+		for( int i = 0; i < nCount; i++ )
+		{
+			SortInfo_t info;
+			info.m_nIndex = i;
+			info.m_flDistance = pDistances[i];
+
+			int j = i;
+			for( ; j > 0 && TREATASINT( pOut[j - 1].m_flDistance ) < TREATASINT( info.m_flDistance ); j-- )
+			{
+				pOut[j] = pOut[j - 1];
+			}
+			pOut[j] = info;
+		}
+		return;
+	}
+
+	// Two stable 8-bit passes, farthest first
+	int nLowOffsets[256];
+	int nHighOffsets[256];
+	memset( nLowOffsets, 0, sizeof( nLowOffsets ) );
+	memset( nHighOffsets, 0, sizeof( nHighOffsets ) );
+
+	for( int i = 0; i < nCount; i++ )
+	{
+		uint32 nKey = 0xffff - ( ( uint32 )TREATASINT( pDistances[i] ) >> 16 );
+		nLowOffsets[nKey & 0xff]++;
+		nHighOffsets[nKey >> 8]++;
+	}
+
+	int nLowTotal = 0, nHighTotal = 0;
+	for( int i = 0; i < 256; i++ )
+	{
+		int nLow = nLowOffsets[i];
+		nLowOffsets[i] = nLowTotal;
+		nLowTotal += nLow;
+
+		int nHigh = nHighOffsets[i];
+		nHighOffsets[i] = nHighTotal;
+		nHighTotal += nHigh;
+	}
+
+	for( int i = 0; i < nCount; i++ )
+	{
+		uint32 nKey = 0xffff - ( ( uint32 )TREATASINT( pDistances[i] ) >> 16 );
+		SortInfo_t& info = pTemp[nLowOffsets[nKey & 0xff]++];
+		info.m_nIndex = i;
+		info.m_flDistance = pDistances[i];
+	}
+
+	for( int i = 0; i < nCount; i++ )
+	{
+		uint32 nKey = 0xffff - ( ( uint32 )TREATASINT( pTemp[i].m_flDistance ) >> 16 );
+		pOut[nHighOffsets[nKey >> 8]++] = pTemp[i];
+	}
+}
+
+
+void CDetailObjectSystem::BuildOutSortedSpritesJob( FastSpriteLeafJob_t& job )
+{
+	job.m_nCount = BuildOutSortedSprites( job.m_pData, m_vecJobViewOrigin, m_vecJobViewForward, job.m_Buffers, &job.m_bReusedOrder );
+}
+
+
+//-----------------------------------------------------------------------------
+// Fast sprite build out space, nGroups groups of 4 sprites
+//-----------------------------------------------------------------------------
+void CDetailObjectSystem::EnsureFastSortBuffers( int nGroups )
+{
+	if( m_FastGroupSlots.Count() >= nGroups )
+	{
+		return;
+	}
+
+	m_FastSortInfo.SetCount( nGroups * 4 );
+	m_FastSortTemp.SetCount( nGroups * 4 );
+	m_FastSortDistances.SetCount( nGroups * 4 );
+	m_FastGroupSlots.SetCount( nGroups );
+	m_FastBuildoutBuffer.SetCount( nGroups );
+}
+
+CDetailObjectSystem::FastSpriteSortBuffers_t CDetailObjectSystem::GetFastSortBuffers( int nFirstGroup )
+{
+	FastSpriteSortBuffers_t buffers;
+	buffers.m_pSortInfo = m_FastSortInfo.Base() + nFirstGroup * 4;
+	buffers.m_pSortTemp = m_FastSortTemp.Base() + nFirstGroup * 4;
+	buffers.m_pDistances = m_FastSortDistances.Base() + nFirstGroup * 4;
+	buffers.m_pGroupSlots = m_FastGroupSlots.Base() + nFirstGroup;
+	buffers.m_pBuildout = m_FastBuildoutBuffer.Base() + nFirstGroup;
+	return buffers;
+}
+
+
+//-----------------------------------------------------------------------------
+// cl_detail_stats
+//-----------------------------------------------------------------------------
+void CDetailObjectSystem::DisplayFastSpriteStats( int nLeaves, int nReused, int nSprites, bool bThreaded, float flBuildMs, float flDrawMs )
+{
+	// Add up every view drawn this frame
+	if( m_nStatsFrame != gpGlobals->framecount )
+	{
+		m_nStatsFrame = gpGlobals->framecount;
+		m_nStatsLeaves = m_nStatsReused = m_nStatsSprites = 0;
+		m_bStatsThreaded = false;
+		m_flStatsBuildMs = m_flStatsDrawMs = 0.0f;
+	}
+
+	m_nStatsLeaves += nLeaves;
+	m_nStatsReused += nReused;
+	m_nStatsSprites += nSprites;
+	m_bStatsThreaded |= bThreaded;
+	m_flStatsBuildMs += flBuildMs;
+	m_flStatsDrawMs += flDrawMs;
+
+	engine->Con_NPrintf( 0, "Detail sprites: %d drawn in %d leaves (%d reused their sort)", m_nStatsSprites, m_nStatsLeaves, m_nStatsReused );
+	engine->Con_NPrintf( 1, "  Build and sort: %.3f ms%s", m_flStatsBuildMs, m_bStatsThreaded ? " (threaded)" : "" );
+	engine->Con_NPrintf( 2, "  Vertex fill: %.3f ms", m_flStatsDrawMs );
+	engine->Con_NPrintf( 3, "  Total: %.3f ms", m_flStatsBuildMs + m_flStatsDrawMs );
+}
+
+
 void CDetailObjectSystem::RenderFastSprites( const Vector& viewOrigin, const Vector& viewForward, const Vector& viewRight, const Vector& viewUp, int nLeafCount, LeafIndex_t const* pLeafList )
 {
 	// Here, we must draw all detail objects back-to-front
-	// FIXME: Cache off a sorted list so we don't have to re-sort every frame
 
 	// Count the total # of detail quads we possibly could render
 	int nMaxInLeaf;
@@ -2425,6 +2617,56 @@ void CDetailObjectSystem::RenderFastSprites( const Vector& viewOrigin, const Vec
 		return;
 	}
 
+	CFastTimer buildTimer;
+	buildTimer.Start();
+
+	// Give every leaf its own slice of the build out space so they can be done in parallel
+	CUtlVectorFixedGrowable<FastSpriteLeafJob_t, 64> jobs;
+	int nTotalGroups = 0;
+	for( int i = 0; i < nLeafCount; ++i )
+	{
+		CFastDetailLeafSpriteList* pData = reinterpret_cast<CFastDetailLeafSpriteList*>(
+											   ClientLeafSystem()->GetSubSystemDataInLeaf( pLeafList[i], CLSUBSYSTEM_DETAILOBJECTS ) );
+		if( pData )
+		{
+			Assert( pData->m_nNumSprites );					// ptr with no sprites?
+
+			FastSpriteLeafJob_t& job = jobs[jobs.AddToTail()];
+			job.m_pData = pData;
+			job.m_Buffers.m_pSortInfo = NULL;
+			job.m_nCount = nTotalGroups;					// first group until the buffers are in place
+			job.m_bReusedOrder = false;
+			nTotalGroups += pData->m_nNumSIMDSprites;
+		}
+	}
+
+	EnsureFastSortBuffers( nTotalGroups );
+	for( int i = 0; i < jobs.Count(); i++ )
+	{
+		jobs[i].m_Buffers = GetFastSortBuffers( jobs[i].m_nCount );
+	}
+
+	// part 1 & 2 - build out and sort each leaf
+	m_vecJobViewOrigin = viewOrigin;
+	m_vecJobViewForward = viewForward;
+
+	bool bThreaded = ( nQuadCount >= cl_detail_threaded_min.GetInt() ) && ( jobs.Count() > 1 );
+	if( bThreaded )
+	{
+		ParallelProcess( "CDetailObjectSystem::RenderFastSprites", jobs.Base(), jobs.Count(), this, &CDetailObjectSystem::BuildOutSortedSpritesJob );
+	}
+	else
+	{
+		for( int i = 0; i < jobs.Count(); i++ )
+		{
+			BuildOutSortedSpritesJob( jobs[i] );
+		}
+	}
+
+	buildTimer.End();
+
+	CFastTimer drawTimer;
+	drawTimer.Start();
 
 	CMatRenderContextPtr pRenderContext( materials );
 	pRenderContext->MatrixMode( MATERIAL_MODEL );
@@ -2450,97 +2692,99 @@ void CDetailObjectSystem::RenderFastSprites( const Vector& viewOrigin, const Vec
 
 	if( nMaxQuadsToDraw == 0 )
 	{
+		pRenderContext->PopMatrix();
 		return;
 	}
 
 	int nQuadsToDraw = MIN( nQuadCount, nMaxQuadsToDraw );
 	int nQuadsRemaining = nQuadsToDraw;
+	int nSpritesDrawn = 0;
+	int nReused = 0;
 
 	meshBuilder.Begin( pMesh, MATERIAL_QUADS, nQuadsToDraw );
 
-
-
-	// Sort detail sprites in each leaf independently; then render them
-	for( int i = 0; i < nLeafCount; ++i )
+	// part 3 - stuff the sorted sprites into the vb, leaf by leaf
+	for( int i = 0; i < jobs.Count(); ++i )
 	{
-		int nLeaf = pLeafList[i];
+		FastSpriteLeafJob_t const& job = jobs[i];
 
-		CFastDetailLeafSpriteList* pData = reinterpret_cast<CFastDetailLeafSpriteList*>(
-											   ClientLeafSystem()->GetSubSystemDataInLeaf( nLeaf, CLSUBSYSTEM_DETAILOBJECTS ) );
+		int nCount = job.m_nCount;
+		nSpritesDrawn += nCount;
+		nReused += job.m_bReusedOrder ? 1 : 0;
 
-		if( pData )
-		{
-			Assert( pData->m_nNumSprites );					// ptr with no sprites?
-
-			int nCount = BuildOutSortedSprites( pData, viewOrigin, viewForward, viewRight, viewUp );
+		SortInfo_t const* pDraw = job.m_Buffers.m_pSortInfo;
+		FastSpriteQuadBuildoutBufferNonSIMDView_t const* pQuadBuffer =
+			( FastSpriteQuadBuildoutBufferNonSIMDView_t const* ) job.m_Buffers.m_pBuildout;
 
-			// part 3 - stuff the sorted sprites into the vb
-			SortInfo_t const* pDraw = m_pFastSortInfo;
-			FastSpriteQuadBuildoutBufferNonSIMDView_t const* pQuadBuffer =
-				( FastSpriteQuadBuildoutBufferNonSIMDView_t const* ) m_pBuildoutBuffer;
+		COMPILE_TIME_ASSERT( sizeof( FastSpriteQuadBuildoutBufferNonSIMDView_t ) ==
+							 sizeof( FastSpriteQuadBuildoutBufferX4_t ) );
 
-			COMPILE_TIME_ASSERT( sizeof( FastSpriteQuadBuildoutBufferNonSIMDView_t ) ==
-								 sizeof( FastSpriteQuadBuildoutBufferX4_t ) );
-
-			while( nCount )
+		while( nCount )
+		{
+			if( ! nQuadsRemaining )					// no room left?
 			{
-				if( ! nQuadsRemaining )					// no room left?
-				{
-					meshBuilder.End();
-					pMesh->Draw();
-					nQuadsRemaining = nQuadsToDraw;
-					meshBuilder.Begin( pMesh, MATERIAL_QUADS, nQuadsToDraw );
-				}
-				int nToDraw = MIN( nCount, nQuadsRemaining );
-				nCount -= nToDraw;
-				nQuadsRemaining -= nToDraw;
-				while( nToDraw-- )
-				{
-					// draw the sucker
-					int nSIMDIdx = pDraw->m_nIndex >> 2;
-					int nSubIdx = pDraw->m_nIndex & 3;
-
-					FastSpriteQuadBuildoutBufferNonSIMDView_t const* pquad = pQuadBuffer + nSIMDIdx;
-
-					// voodoo - since everything is in 4s, offset structure pointer by a couple of floats to handle sub-index
-					pquad = ( FastSpriteQuadBuildoutBufferNonSIMDView_t const* )( ( ( int )( pquad ) ) + ( nSubIdx << 2 ) );
-					uint8 const* pColorsCasted = reinterpret_cast<uint8 const*>( pquad->m_Alpha );
-
-					uint8 color[4];
-					color[0] = pquad->m_RGBColor[0][0];
-					color[1] = pquad->m_RGBColor[0][1];
-					color[2] = pquad->m_RGBColor[0][2];
-					color[3] = pColorsCasted[MANTISSA_LSB_OFFSET];
-
-					DetailPropSpriteDict_t* pDict = pquad->m_pSpriteDefs[0];
-
-					meshBuilder.Position3f( pquad->m_flX0[0], pquad->m_flY0[0], pquad->m_flZ0[0] );
-					meshBuilder.Color4ubv( color );
-					meshBuilder.TexCoord2f( 0, pDict->m_TexLR.x, pDict->m_TexLR.y );
-					meshBuilder.AdvanceVertex();
-
-					meshBuilder.Position3f( pquad->m_flX1[0], pquad->m_flY1[0], pquad->m_flZ1[0] );
-					meshBuilder.Color4ubv( color );
-					meshBuilder.TexCoord2f( 0, pDict->m_TexLR.x, pDict->m_TexUL.y );
-					meshBuilder.AdvanceVertex();
-
-					meshBuilder.Position3f( pquad->m_flX2[0], pquad->m_flY2[0], pquad->m_flZ2[0] );
-					meshBuilder.Color4ubv( color );
-					meshBuilder.TexCoord2f( 0, pDict->m_TexUL.x, pDict->m_TexUL.y );
-					meshBuilder.AdvanceVertex();
-
-					meshBuilder.Position3f( pquad->m_flX3[0], pquad->m_flY3[0], pquad->m_flZ3[0] );
-					meshBuilder.Color4ubv( color );
-					meshBuilder.TexCoord2f( 0, pDict->m_TexUL.x, pDict->m_TexLR.y );
-					meshBuilder.AdvanceVertex();
-					pDraw++;
-				}
+				meshBuilder.End();
+				pMesh->Draw();
+				nQuadsRemaining = nQuadsToDraw;
+				meshBuilder.Begin( pMesh, MATERIAL_QUADS, nQuadsToDraw );
+			}
+			int nToDraw = MIN( nCount, nQuadsRemaining );
+			nCount -= nToDraw;
+			nQuadsRemaining -= nToDraw;
+			while( nToDraw-- )
+			{
+				// draw the sucker
+				int nSIMDIdx = pDraw->m_nIndex >> 2;
+				int nSubIdx = pDraw->m_nIndex & 3;
+
+				FastSpriteQuadBuildoutBufferNonSIMDView_t const* pquad = pQuadBuffer + nSIMDIdx;
+
+				// voodoo - since everything is in 4s, offset structure pointer by a couple of floats to handle sub-index
+				pquad = ( FastSpriteQuadBuildoutBufferNonSIMDView_t const* )( ( ( intp )( pquad ) ) + ( nSubIdx << 2 ) );
+				uint8 const* pColorsCasted = reinterpret_cast<uint8 const*>( pquad->m_Alpha );
+
+				uint8 color[4];
+				color[0] = pquad->m_RGBColor[0][0];
+				color[1] = pquad->m_RGBColor[0][1];
+				color[2] = pquad->m_RGBColor[0][2];
+				color[3] = pColorsCasted[MANTISSA_LSB_OFFSET];
+
+				DetailPropSpriteDict_t* pDict = pquad->m_pSpriteDefs[0];
+
+				meshBuilder.Position3f( pquad->m_flX0[0], pquad->m_flY0[0], pquad->m_flZ0[0] );
+				meshBuilder.Color4ubv( color );
+				meshBuilder.TexCoord2f( 0, pDict->m_TexLR.x, pDict->m_TexLR.y );
+				meshBuilder.AdvanceVertex();
+
+				meshBuilder.Position3f( pquad->m_flX1[0], pquad->m_flY1[0], pquad->m_flZ1[0] );
+				meshBuilder.Color4ubv( color );
+				meshBuilder.TexCoord2f( 0, pDict->m_TexLR.x, pDict->m_TexUL.y );
+				meshBuilder.AdvanceVertex();
+
+				meshBuilder.Position3f( pquad->m_flX2[0], pquad->m_flY2[0], pquad->m_flZ2[0] );
+				meshBuilder.Color4ubv( color );
+				meshBuilder.TexCoord2f( 0, pDict->m_TexUL.x, pDict->m_TexUL.y );
+				meshBuilder.AdvanceVertex();
+
+				meshBuilder.Position3f( pquad->m_flX3[0], pquad->m_flY3[0], pquad->m_flZ3[0] );
+				meshBuilder.Color4ubv( color );
+				meshBuilder.TexCoord2f( 0, pDict->m_TexUL.x, pDict->m_TexLR.y );
+				meshBuilder.AdvanceVertex();
+				pDraw++;
 			}
 		}
 	}
 	meshBuilder.End();
 	pMesh->Draw();
 	pRenderContext->PopMatrix();
+
+	drawTimer.End();
+
+	if( cl_detail_stats.GetBool() )
+	{
+		DisplayFastSpriteStats( jobs.Count(), nReused, nSpritesDrawn, bThreaded,
+								buildTimer.GetDuration().GetMillisecondsF(), drawTimer.GetDuration().GetMillisecondsF() );
+	}
 }
 
 
@@ -2664,7 +2908,8 @@ void CDetailObjectSystem::RenderFastTranslucentDetailObjectsInLeaf( const Vector
 	if( m_nSortedFastLeaf != nLeaf )
 	{
 		m_nSortedFastLeaf = nLeaf;
-		pData->m_nNumPendingSprites = BuildOutSortedSprites( pData, viewOrigin, viewForward, viewRight, viewUp );
+		EnsureFastSortBuffers( pData->m_nNumSIMDSprites );
+		pData->m_nNumPendingSprites = BuildOutSortedSprites( pData, viewOrigin, viewForward, GetFastSortBuffers( 0 ) );
 		pData->m_nStartSpriteIndex = 0;
 	}
 	if( pData->m_nNumPendingSprites == 0 )
@@ -2680,7 +2925,7 @@ void CDetailObjectSystem::RenderFastTranslucentDetailObjectsInLeaf( const Vector
 		flMinDistance = vecDelta.LengthSqr();
 	}
 
-	if( m_pFastSortInfo[pData->m_nStartSpriteIndex].m_flDistance < flMinDistance )
+	if( m_FastSortInfo[pData->m_nStartSpriteIndex].m_flDistance < flMinDistance )
 	{
 		return;
 	}
@@ -2725,10 +2970,10 @@ void CDetailObjectSystem::RenderFastTranslucentDetailObjectsInLeaf( const Vector
 
 	meshBuilder.Begin( pMesh, MATERIAL_QUADS, nQuadsToDraw );
 
-	SortInfo_t const* pDraw = m_pFastSortInfo + pData->m_nStartSpriteIndex;
+	SortInfo_t const* pDraw = m_FastSortInfo.Base() + pData->m_nStartSpriteIndex;
 
 	FastSpriteQuadBuildoutBufferNonSIMDView_t const* pQuadBuffer =
-		( FastSpriteQuadBuildoutBufferNonSIMDView_t const* ) m_pBuildoutBuffer;
+		( FastSpriteQuadBuildoutBufferNonSIMDView_t const* ) m_FastBuildoutBuffer.Base();
 
 	while( nCount && ( pDraw->m_flDistance >= flMinDistance ) )
 	{
@@ -2785,7 +3030,7 @@ void CDetailObjectSystem::RenderFastTranslucentDetailObjectsInLeaf( const Vector
 		}
 	}
 	pData->m_nNumPendingSprites = nCount;
-	pData->m_nStartSpriteIndex = pDraw - m_pFastSortInfo;
+	pData->m_nStartSpriteIndex = pDraw - m_FastSortInfo.Base();
 
 	meshBuilder.End();
 	pMesh->Draw();
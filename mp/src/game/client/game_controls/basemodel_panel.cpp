@@ -237,16 +237,7 @@ int CBaseModelPanel::FindSequenceFromActivity( CStudioHdr* pStudioHdr, const cha
 		return -1;
 	}
 
-	for( int iSeq = 0; iSeq < pStudioHdr->GetNumSeq(); ++iSeq )
-	{
-		mstudioseqdesc_t& seqDesc = pStudioHdr->pSeqdesc( iSeq );
-		if( !V_stricmp( seqDesc.pszActivityName(), pszActivity ) )
-		{
-			return iSeq;
-		}
-	}
-
-	return -1;
+	return pStudioHdr->FindSequenceForActivityName( pszActivity );
 }
 
 //-----------------------------------------------------------------------------
@@ -15,6 +15,12 @@
 
 extern CTimedEventMgr g_NetworkPropertyEventMgr;
 
+bool g_bTrackNetworkStateChanges = false;
+
+static void NetStateChangeStatsChanged( IConVar* pConVar, const char* pOldValue, float flOldValue );
+
+ConVar sv_netstatechange_stats( "sv_netstatechange_stats", "0", FCVAR_CHEAT, "Counts whole-entity and per-variable network state changes for each server class. Print them with sv_netstatechange_stats_dump.", NetStateChangeStatsChanged );
+
 
 //-----------------------------------------------------------------------------
 // Save/load
@@ -324,3 +330,115 @@ void CServerNetworkProperty::FireEvent()
 
 
 
+
+
+//-----------------------------------------------------------------------------
+// State change statistics
+//-----------------------------------------------------------------------------
+struct NetStateChangeCounts_t
+{
+	ServerClass*	m_pServerClass;
+	int				m_nFull;		// The whole entity has to be compared
+	int				m_nPartial;		// Only the changed variable's props are compared
+	int				m_nAbsorbed;	// Partial changes on an entity that was already fully changed
+};
+
+static CUtlMap< ServerClass*, NetStateChangeCounts_t > s_NetStateChangeCounts( DefLessFunc( ServerClass* ) );
+
+static void NetStateChangeStatsChanged( IConVar* pConVar, const char* pOldValue, float flOldValue )
+{
+	ConVarRef var( pConVar );
+	if( var.GetBool() && !g_bTrackNetworkStateChanges )
+	{
+		s_NetStateChangeCounts.RemoveAll();
+	}
+
+	g_bTrackNetworkStateChanges = var.GetBool();
+}
+
+void CServerNetworkProperty::RecordStateChange( bool bFullChange )
+{
+	if( !m_pOuter )
+	{
+		return;
+	}
+
+	ServerClass* pServerClass = GetServerClass();
+	unsigned short i = s_NetStateChangeCounts.Find( pServerClass );
+	if( i == s_NetStateChangeCounts.InvalidIndex() )
+	{
+		NetStateChangeCounts_t counts;
+		counts.m_pServerClass = pServerClass;
+		counts.m_nFull = counts.m_nPartial = counts.m_nAbsorbed = 0;
+		i = s_NetStateChangeCounts.Insert( pServerClass, counts );
+	}
+
+	NetStateChangeCounts_t& counts = s_NetStateChangeCounts[i];
+	if( bFullChange )
+	{
+		counts.m_nFull++;
+	}
+	else if( m_pPev && ( m_pPev->m_fStateFlags & FL_FULL_EDICT_CHANGED ) )
+	{
+		counts.m_nAbsorbed++;
+	}
+	else
+	{
+		counts.m_nPartial++;
+	}
+}
+
+static int NetStateChangeCountsSort( NetStateChangeCounts_t const* a, NetStateChangeCounts_t const* b )
+{
+	return b->m_nFull - a->m_nFull;
+}
+
+CON_COMMAND( sv_netstatechange_stats_dump, "Prints the state changes counted by sv_netstatechange_stats, most whole-entity changes first." )
+{
+	if( !UTIL_IsCommandIssuedByServerAdmin() )
+	{
+		return;
+	}
+
+	if( !s_NetStateChangeCounts.Count() )
+	{
+		Msg( "No state changes recorded. Set sv_netstatechange_stats 1 first.\n" );
+		return;
+	}
+
+	CUtlVector< NetStateChangeCounts_t > sorted;
+	FOR_EACH_MAP_FAST( s_NetStateChangeCounts, i )
+	{
+		sorted.AddToTail( s_NetStateChangeCounts[i] );
+	}
+	sorted.Sort( NetStateChangeCountsSort );
+
+	int nTotalFull = 0, nTotalPartial = 0, nTotalAbsorbed = 0;
+
+	Msg( "%-32s %10s %10s %10s %8s\n", "Class", "Full", "Partial", "Absorbed", "Full %" );
+	for( int i = 0; i < sorted.Count(); i++ )
+	{
+		const NetStateChangeCounts_t& counts = sorted[i];
+		int nTotal = counts.m_nFull + counts.m_nPartial + counts.m_nAbsorbed;
+
+		Msg( "%-32s %10d %10d %10d %7.1f%%\n", counts.m_pServerClass ? counts.m_pServerClass->GetName() : "(none)",
+			 counts.m_nFull, counts.m_nPartial, counts.m_nAbsorbed, nTotal ? 100.0f * counts.m_nFull / nTotal : 0.0f );
+
+		nTotalFull += counts.m_nFull;
+		nTotalPartial += counts.m_nPartial;
+		nTotalAbsorbed += counts.m_nAbsorbed;
+	}
+
+	int nTotal = nTotalFull + nTotalPartial + nTotalAbsorbed;
+	Msg( "%-32s %10d %10d %10d %7.1f%%\n", "Total", nTotalFull, nTotalPartial, nTotalAbsorbed, nTotal ? 100.0f * nTotalFull / nTotal : 0.0f );
+}
+
+CON_COMMAND( sv_netstatechange_stats_reset, "Clears the counts gathered by sv_netstatechange_stats." )
+{
+	if( !UTIL_IsCommandIssuedByServerAdmin() )
+	{
+		return;
+	}
+
+	s_NetStateChangeCounts.RemoveAll();
+}
@@ -16,6 +16,9 @@
 #include "edict.h"
 #include "timedeventmgr.h"
 
+// Set by sv_netstatechange_stats
+extern bool g_bTrackNetworkStateChanges;
+
 //
 // Lightweight base class for networkable data on the server.
 //
@@ -109,6 +112,9 @@ private:
 	// Marks the networkable that it will should transmit
 	void SetTransmit( CCheckTransmitInfo* pInfo );
 
+	// Counts a state change against our server class for sv_netstatechange_stats
+	void RecordStateChange( bool bFullChange );
+
 private:
 	CBaseEntity* m_pOuter;
 	// CBaseTransmitProxy *m_pTransmitProxy;
@@ -186,6 +192,11 @@ inline void CServerNetworkProperty::NetworkStateForceUpdate()
 
 inline void CServerNetworkProperty::NetworkStateChanged()
 {
+	if( g_bTrackNetworkStateChanges )
+	{
+		RecordStateChange( true );
+	}
+
 	// If we're using the timer, then ignore this call.
 	if( m_TimerEvent.IsRegistered() )
 	{
@@ -204,6 +215,11 @@ inline void CServerNetworkProperty::NetworkStateChanged()
 
 inline void CServerNetworkProperty::NetworkStateChanged( unsigned short varOffset )
 {
+	if( g_bTrackNetworkStateChanges )
+	{
+		RecordStateChange( false );
+	}
+
 	// If we're using the timer, then ignore this call.
 	if( m_TimerEvent.IsRegistered() )
 	{
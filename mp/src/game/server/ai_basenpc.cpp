@@ -116,6 +116,7 @@ extern ConVar sk_healthkit;
 
 #include "utlbuffer.h"
 #include "gamestats.h"
+#include "serverbenchmark_base.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -4574,6 +4575,8 @@ bool CAI_BaseNPC::CheckPVSCondition()
 
 void CAI_BaseNPC::NPCThink( void )
 {
+	CTimeAdder timer( ServerBenchmarkTimer( SERVER_BENCHMARK_AI ) );
+
 	if( m_bCheckContacts )
 	{
 		CheckPhysicsContacts();
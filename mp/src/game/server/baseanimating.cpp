@@ -2107,6 +2107,242 @@ void CBaseAnimating::SetupBones( matrix3x4_t* pBoneToWorld, int boneMask )
 	RemoveEFlags( EFL_SETTING_UP_BONES );
 }
 
+extern CBaseEntity* FindPickerEntity( CBasePlayer* pPlayer );
+
+//-----------------------------------------------------------------------------
+// Purpose: Decoded animation frame cache reporting
+//-----------------------------------------------------------------------------
+static void PrintAnimFrameCacheStats()
+{
+	animframecachestats_t stats;
+	Studio_GetAnimFrameCacheStats( stats );
+
+	int nTotal = stats.nHits + stats.nMisses;
+	Msg( "Anim frame cache: %d hits, %d misses (%.1f%% hit rate), %d frames cached (%d keys), %.1f / %.1f KB used\n",
+		 stats.nHits, stats.nMisses, nTotal ? 100.0f * stats.nHits / nTotal : 0.0f, stats.nFrames, stats.nLookups,
+		 stats.nBytesUsed / 1024.0f, stats.nBytesTarget / 1024.0f );
+}
+
+CON_COMMAND( anim_framecache_stats, "Report hit rate and memory use of the decoded animation frame cache." )
+{
+	if( !UTIL_IsCommandIssuedByServerAdmin() )
+	{
+		return;
+	}
+
+	PrintAnimFrameCacheStats();
+
+	if( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		Studio_ResetAnimFrameCacheStats();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Compares bone setup throughput with and without the decoded frame
+//			cache by posing the model under the crosshair as a crowd of NPCs,
+//			each one at a different point of its current sequence.
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( anim_framecache_bench, "Usage: anim_framecache_bench [npc count] [frames]. Times SetupBones for a crowd copied from the model under the crosshair.", FCVAR_CHEAT )
+{
+	if( !UTIL_IsCommandIssuedByServerAdmin() )
+	{
+		return;
+	}
+
+	CBaseAnimating* pAnimating = dynamic_cast< CBaseAnimating* >( FindPickerEntity( UTIL_GetCommandClient() ) );
+	if( !pAnimating || !pAnimating->GetModelPtr() )
+	{
+		Msg( "No animating entity under the crosshair.\n" );
+		return;
+	}
+
+	int nCount = args.ArgC() > 1 ? MAX( 1, atoi( args[1] ) ) : 200;
+	int nFrames = args.ArgC() > 2 ? MAX( 1, atoi( args[2] ) ) : 100;
+
+	MDLCACHE_CRITICAL_SECTION();
+
+	CStudioHdr* pStudioHdr = pAnimating->GetModelPtr();
+	int nSequence = pAnimating->GetSequence();
+	float flCycleRate = pAnimating->GetSequenceCycleRate( nSequence ) * gpGlobals->interval_per_tick;
+
+	Vector pos[MAXSTUDIOBONES];
+	Quaternion q[MAXSTUDIOBONES];
+	matrix3x4_t boneToWorld[MAXSTUDIOBONES];
+
+	ConVarRef anim_framecache( "anim_framecache" );
+	bool bWasEnabled = anim_framecache.GetBool();
+
+	double flTime[2];
+	for( int nPass = 0; nPass < 2; nPass++ )
+	{
+		anim_framecache.SetValue( nPass );
+		Studio_FlushAnimFrameCache();
+		Studio_ResetAnimFrameCacheStats();
+
+		double flStart = Plat_FloatTime();
+		for( int nFrame = 0; nFrame < nFrames; nFrame++ )
+		{
+			for( int i = 0; i < nCount; i++ )
+			{
+				// Spread the crowd over a handful of phases like real NPCs sharing a sequence
+				float flCycle = fmodf( ( i % 16 ) * 0.0625f + nFrame * flCycleRate, 1.0f );
+
+				IBoneSetup boneSetup( pStudioHdr, BONE_USED_BY_ANYTHING, pAnimating->GetPoseParameterArray() );
+				boneSetup.InitPose( pos, q );
+				boneSetup.AccumulatePose( pos, q, nSequence, flCycle, 1.0f, gpGlobals->curtime, NULL );
+				Studio_BuildMatrices( pStudioHdr, pAnimating->GetAbsAngles(), pAnimating->GetAbsOrigin(), pos, q, -1, 1.0f, boneToWorld, BONE_USED_BY_ANYTHING );
+			}
+		}
+		flTime[nPass] = ( Plat_FloatTime() - flStart ) * 1000.0;
+
+		Msg( "%s: %.3f ms per frame for %d NPCs (%.0f SetupBones/sec)\n", nPass ? "Frame cache" : "No cache   ",
+			 flTime[nPass] / nFrames, nCount, flTime[nPass] > 0.0 ? nCount * nFrames * 1000.0 / flTime[nPass] : 0.0 );
+	}
+
+	PrintAnimFrameCacheStats();
+	Msg( "Speedup: %.2fx\n", flTime[1] > 0.0 ? flTime[0] / flTime[1] : 0.0 );
+
+	anim_framecache.SetValue( bWasEnabled );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Builds a studiohdr_t with only sequences and attachments, enough
+//			for the name lookups. Free the result with delete[].
+//-----------------------------------------------------------------------------
+static studiohdr_t* BuildSyntheticLookupModel( int nSequences, int nAttachments )
+{
+	const int nNameLen = 32;
+	int nSeqOffset = sizeof( studiohdr_t );
+	int nAttachmentOffset = nSeqOffset + nSequences * sizeof( mstudioseqdesc_t );
+	int nStringOffset = nAttachmentOffset + nAttachments * sizeof( mstudioattachment_t );
+	int nLength = nStringOffset + ( nSequences * 2 + nAttachments ) * nNameLen;
+
+	byte* pData = new byte[nLength];
+	memset( pData, 0, nLength );
+
+	studiohdr_t* pHdr = ( studiohdr_t* )pData;
+	pHdr->length = nLength;
+	pHdr->numlocalseq = nSequences;
+	pHdr->localseqindex = nSeqOffset;
+	pHdr->numlocalattachments = nAttachments;
+	pHdr->localattachmentindex = nAttachmentOffset;
+
+	char* pString = ( char* )pData + nStringOffset;
+	for( int i = 0; i < nSequences; i++ )
+	{
+		mstudioseqdesc_t* pSeq = pHdr->pLocalSeqdesc( i );
+		pSeq->baseptr = -( nSeqOffset + i * ( int )sizeof( mstudioseqdesc_t ) );
+
+		V_snprintf( pString, nNameLen, "Synthetic_Seq_%05d", i );
+		pSeq->szlabelindex = pString - ( char* )pSeq;
+		pString += nNameLen;
+
+		// A few sequences per activity, like real models
+		V_snprintf( pString, nNameLen, "ACT_SYNTHETIC_%d", i / 4 );
+		pSeq->szactivitynameindex = pString - ( char* )pSeq;
+		pSeq->activity = i / 4;
+		pString += nNameLen;
+	}
+
+	for( int i = 0; i < nAttachments; i++ )
+	{
+		mstudioattachment_t* pAttachment = pHdr->pLocalAttachment( i );
+		V_snprintf( pString, nNameLen, "synthetic_attachment_%d", i );
+		pAttachment->sznameindex = pString - ( char* )pAttachment;
+		pString += nNameLen;
+	}
+
+	return pHdr;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Compares the linear name searches with the hashed lookups on
+//			CStudioHdr over a large synthetic model.
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( anim_lookup_bench, "Usage: anim_lookup_bench [sequences] [attachments] [lookups]. Times sequence, activity and attachment lookups by name, linear vs. hashed.", FCVAR_CHEAT )
+{
+	if( !UTIL_IsCommandIssuedByServerAdmin() )
+	{
+		return;
+	}
+
+	int nSequences = args.ArgC() > 1 ? MAX( 1, atoi( args[1] ) ) : 2000;
+	int nAttachments = args.ArgC() > 2 ? MAX( 1, atoi( args[2] ) ) : 100;
+	int nLookups = args.ArgC() > 3 ? MAX( 1, atoi( args[3] ) ) : 100000;
+
+	studiohdr_t* pSynthetic = BuildSyntheticLookupModel( nSequences, nAttachments );
+	CStudioHdr studioHdr( pSynthetic );
+
+	// Every name gets looked up, and one in eight lookups misses, as with
+	// scripts probing for optional animations
+	CUtlVector<CUtlString> sequenceNames, activityNames, attachmentNames;
+	for( int i = 0; i < 256; i++ )
+	{
+		bool bMiss = ( i % 8 ) == 7;
+		int iSeq = ( i * 7919 ) % nSequences;
+		sequenceNames.AddToTail( bMiss ? CUtlString( "synthetic_seq_missing" ) : CUtlString( studioHdr.pSeqdesc( iSeq ).pszLabel() ) );
+		activityNames.AddToTail( bMiss ? CUtlString( "ACT_SYNTHETIC_MISSING" ) : CUtlString( studioHdr.pSeqdesc( iSeq ).pszActivityName() ) );
+		attachmentNames.AddToTail( bMiss ? CUtlString( "synthetic_attachment_missing" ) : CUtlString( studioHdr.pAttachment( i % nAttachments ).pszName() ) );
+	}
+
+	const char* pszKind[3] = { "Sequence  ", "Activity  ", "Attachment" };
+	CUtlVector<CUtlString>* pNames[3] = { &sequenceNames, &activityNames, &attachmentNames };
+
+	int nMismatches = 0;
+	for( int nKind = 0; nKind < 3; nKind++ )
+	{
+		double flTime[2];
+		int nChecksum[2];
+		for( int nPass = 0; nPass < 2; nPass++ )
+		{
+			nChecksum[nPass] = 0;
+			double flStart = Plat_FloatTime();
+			for( int nLookup = 0; nLookup < nLookups; nLookup++ )
+			{
+				const char* pszName = ( *pNames[nKind] )[nLookup & 255].Get();
+				int nResult = -1;
+				if( nPass == 0 )
+				{
+					// The searches these lookups used to be
+					int nCount = ( nKind == 2 ) ? studioHdr.GetNumAttachments() : studioHdr.GetNumSeq();
+					for( int i = 0; i < nCount; i++ )
+					{
+						const char* pszCandidate = ( nKind == 0 ) ? studioHdr.pSeqdesc( i ).pszLabel() :
+												   ( nKind == 1 ) ? studioHdr.pSeqdesc( i ).pszActivityName() : studioHdr.pAttachment( i ).pszName();
+						if( !V_stricmp( pszCandidate, pszName ) )
+						{
+							nResult = i;
+							break;
+						}
+					}
+				}
+				else
+				{
+					nResult = ( nKind == 0 ) ? studioHdr.FindSequence( pszName ) :
+							  ( nKind == 1 ) ? studioHdr.FindSequenceForActivityName( pszName ) : studioHdr.FindAttachment( pszName );
+				}
+				nChecksum[nPass] += nResult;
+			}
+			flTime[nPass] = ( Plat_FloatTime() - flStart ) * 1000000.0;
+		}
+
+		if( nChecksum[0] != nChecksum[1] )
+		{
+			++nMismatches;
+		}
+
+		Msg( "%s: linear %.1f ns, hashed %.1f ns per lookup (%.1fx)\n", pszKind[nKind],
+			 flTime[0] * 1000.0 / nLookups, flTime[1] * 1000.0 / nLookups, flTime[1] > 0.0 ? flTime[0] / flTime[1] : 0.0 );
+	}
+
+	Msg( "%d sequences, %d attachments, %d lookups each%s\n", nSequences, nAttachments, nLookups,
+		 nMismatches ? " -- RESULTS DIFFER" : "" );
+
+	studioHdr.Term();
+	delete[]( byte* )pSynthetic;
+}
+
 //=========================================================
 //=========================================================
 int CBaseAnimating::GetNumBones( void )
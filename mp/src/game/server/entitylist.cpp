@@ -156,10 +156,19 @@ void AimTarget_ForceRepopulateList()
 }
 
 
+static ConVar sv_thinkschedule( "sv_thinkschedule", "1", 0, "Find the entities due to think or simulate each tick through a timing wheel instead of scanning every thinking entity." );
+static ConVar sv_thinkschedule_validate( "sv_thinkschedule_validate", "0", FCVAR_CHEAT, "Also run the full scan each tick and warn if the think schedule picks different entities or a different order." );
+
 // Manages a list of all entities currently doing game simulation or thinking
 // NOTE: This is usually a small subset of the global entity list, so it's
 // an optimization to maintain this list incrementally rather than polling each
 // frame.
+//
+// On top of the list, entries are hashed by next think tick into a timing
+// wheel, with everything already due (including everything that simulates)
+// on a separate due list. Each tick only the wheel buckets for the ticks that
+// passed get visited, so entities waiting to think cost nothing until they're
+// due. Due entries come out in list order, same as scanning the whole list.
 struct simthinkentry_t
 {
 	unsigned short	entEntry;
@@ -179,7 +188,13 @@ public:
 		for( int i = 0; i < ARRAYSIZE( m_entinfoIndex ); i++ )
 		{
 			m_entinfoIndex[i] = 0xFFFF;
+			m_wheelBucket[i] = 0xFFFF;
+		}
+		for( int i = 0; i < ARRAYSIZE( m_wheelHead ); i++ )
+		{
+			m_wheelHead[i] = 0xFFFF;
 		}
+		m_nWheelTick = 0;
 	}
 	void LevelInitPreEntity()
 	{
@@ -208,6 +223,7 @@ public:
 		if( listHandle != 0xFFFF )
 		{
 			Assert( m_simThinkList[listHandle].entEntry == index );
+			UnlinkFromWheel( index );
 			m_simThinkList.FastRemove( listHandle );
 			m_entinfoIndex[index] = 0xFFFF;
 
@@ -225,22 +241,41 @@ public:
 
 	int ListCopy( CBaseEntity* pList[], int listMax )
 	{
+		if( !sv_thinkschedule.GetBool() )
+		{
+			return ScanCopy( pList, listMax );
+		}
+
+		AdvanceWheel();
+
+		// Everything due, in list order
 		int count = MIN( listMax, ListCount() );
-		int out = 0;
-		for( int i = 0; i < count; i++ )
+		m_dueHandles.RemoveAll();
+		for( unsigned short index = m_wheelHead[WHEEL_DUE]; index != 0xFFFF; index = m_wheelNext[index] )
 		{
-			// only copy out entities that will simulate or think this frame
-			if( m_simThinkList[i].nextThinkTick <= gpGlobals->tickcount )
+			if( m_entinfoIndex[index] < count )
 			{
-				Assert( m_simThinkList[i].nextThinkTick >= 0 );
-				int entinfoIndex = m_simThinkList[i].entEntry;
-				const CEntInfo* pInfo = gEntList.GetEntInfoPtrByIndex( entinfoIndex );
-				pList[out] = ( CBaseEntity* )pInfo->m_pEntity;
-				Assert( m_simThinkList[i].nextThinkTick == 0 || pList[out]->GetFirstThinkTick() == m_simThinkList[i].nextThinkTick );
-				Assert( gEntList.IsEntityPtr( pList[out] ) );
-				out++;
+				m_dueHandles.AddToTail( m_entinfoIndex[index] );
 			}
 		}
+		m_dueHandles.Sort( CompareHandles );
+
+		int out = 0;
+		for( int i = 0; i < m_dueHandles.Count(); i++ )
+		{
+			const simthinkentry_t& entry = m_simThinkList[m_dueHandles[i]];
+			Assert( entry.nextThinkTick <= gpGlobals->tickcount );
+			const CEntInfo* pInfo = gEntList.GetEntInfoPtrByIndex( entry.entEntry );
+			pList[out] = ( CBaseEntity* )pInfo->m_pEntity;
+			Assert( entry.nextThinkTick == 0 || pList[out]->GetFirstThinkTick() == entry.nextThinkTick );
+			Assert( gEntList.IsEntityPtr( pList[out] ) );
+			out++;
+		}
+
+		if( sv_thinkschedule_validate.GetBool() )
+		{
+			ValidateAgainstScan( pList, out, listMax );
+		}
 
 		return out;
 	}
@@ -291,13 +326,179 @@ public:
 				{
 					m_simThinkList[m_entinfoIndex[index]].nextThinkTick = 0;
 				}
+				UnlinkFromWheel( index );
 			}
+			LinkIntoWheel( index );
 		}
 	}
 
 private:
+	enum
+	{
+		WHEEL_BITS = 8,
+		WHEEL_SIZE = 1 << WHEEL_BITS,
+		WHEEL_MASK = WHEEL_SIZE - 1,
+
+		// The extra list past the buckets holds everything that's due
+		WHEEL_DUE = WHEEL_SIZE,
+	};
+
+	// The old way: check every entry
+	int ScanCopy( CBaseEntity* pList[], int listMax )
+	{
+		int count = MIN( listMax, ListCount() );
+		int out = 0;
+		for( int i = 0; i < count; i++ )
+		{
+			// only copy out entities that will simulate or think this frame
+			if( m_simThinkList[i].nextThinkTick <= gpGlobals->tickcount )
+			{
+				Assert( m_simThinkList[i].nextThinkTick >= 0 );
+				int entinfoIndex = m_simThinkList[i].entEntry;
+				const CEntInfo* pInfo = gEntList.GetEntInfoPtrByIndex( entinfoIndex );
+				pList[out] = ( CBaseEntity* )pInfo->m_pEntity;
+				Assert( m_simThinkList[i].nextThinkTick == 0 || pList[out]->GetFirstThinkTick() == m_simThinkList[i].nextThinkTick );
+				Assert( gEntList.IsEntityPtr( pList[out] ) );
+				out++;
+			}
+		}
+
+		return out;
+	}
+
+	void ValidateAgainstScan( CBaseEntity* pList[], int count, int listMax )
+	{
+		CBaseEntity** pScan = ( CBaseEntity** )stackalloc( sizeof( CBaseEntity* ) * MAX( listMax, 1 ) );
+		int scanCount = ScanCopy( pScan, listMax );
+
+		int firstDiff = -1;
+		for( int i = 0; i < MIN( count, scanCount ); i++ )
+		{
+			if( pList[i] != pScan[i] )
+			{
+				firstDiff = i;
+				break;
+			}
+		}
+
+		if( scanCount != count || firstDiff >= 0 )
+		{
+			Warning( "Think schedule mismatch on tick %d: %d due entities, full scan found %d", gpGlobals->tickcount, count, scanCount );
+			if( firstDiff >= 0 )
+			{
+				Warning( "; #%d is %s, scan has %s", firstDiff,
+						 pList[firstDiff] ? pList[firstDiff]->GetDebugName() : "NULL", pScan[firstDiff] ? pScan[firstDiff]->GetDebugName() : "NULL" );
+			}
+			Warning( "\n" );
+		}
+
+		stackfree( pScan );
+	}
+
+	static int CompareHandles( const unsigned short* a, const unsigned short* b )
+	{
+		return ( int )*a - ( int )*b;
+	}
+
+	void LinkIntoWheel( int index )
+	{
+		int tick = m_simThinkList[m_entinfoIndex[index]].nextThinkTick;
+		unsigned short bucket = ( tick <= m_nWheelTick ) ? WHEEL_DUE : ( tick & WHEEL_MASK );
+
+		m_wheelBucket[index] = bucket;
+		m_wheelPrev[index] = 0xFFFF;
+		m_wheelNext[index] = m_wheelHead[bucket];
+		if( m_wheelHead[bucket] != 0xFFFF )
+		{
+			m_wheelPrev[m_wheelHead[bucket]] = index;
+		}
+		m_wheelHead[bucket] = index;
+	}
+
+	void UnlinkFromWheel( int index )
+	{
+		unsigned short bucket = m_wheelBucket[index];
+		if( bucket == 0xFFFF )
+		{
+			return;
+		}
+
+		if( m_wheelPrev[index] != 0xFFFF )
+		{
+			m_wheelNext[m_wheelPrev[index]] = m_wheelNext[index];
+		}
+		else
+		{
+			m_wheelHead[bucket] = m_wheelNext[index];
+		}
+
+		if( m_wheelNext[index] != 0xFFFF )
+		{
+			m_wheelPrev[m_wheelNext[index]] = m_wheelPrev[index];
+		}
+
+		m_wheelBucket[index] = 0xFFFF;
+	}
+
+	// Move everything that came due since the last call onto the due list
+	void AdvanceWheel()
+	{
+		int tick = gpGlobals->tickcount;
+		if( tick == m_nWheelTick )
+		{
+			return;
+		}
+
+		if( tick < m_nWheelTick )
+		{
+			// The clock went backwards; sort everything out again
+			m_nWheelTick = tick;
+			for( int i = 0; i < m_simThinkList.Count(); i++ )
+			{
+				UnlinkFromWheel( m_simThinkList[i].entEntry );
+				LinkIntoWheel( m_simThinkList[i].entEntry );
+			}
+			return;
+		}
+
+		// Past WHEEL_SIZE ticks every bucket has been visited once
+		int steps = MIN( tick - m_nWheelTick, ( int )WHEEL_SIZE );
+		for( int t = m_nWheelTick + 1; t <= m_nWheelTick + steps; t++ )
+		{
+			unsigned short index = m_wheelHead[t & WHEEL_MASK];
+			while( index != 0xFFFF )
+			{
+				unsigned short next = m_wheelNext[index];
+				if( m_simThinkList[m_entinfoIndex[index]].nextThinkTick <= tick )
+				{
+					UnlinkFromWheel( index );
+
+					m_wheelBucket[index] = WHEEL_DUE;
+					m_wheelPrev[index] = 0xFFFF;
+					m_wheelNext[index] = m_wheelHead[WHEEL_DUE];
+					if( m_wheelHead[WHEEL_DUE] != 0xFFFF )
+					{
+						m_wheelPrev[m_wheelHead[WHEEL_DUE]] = index;
+					}
+					m_wheelHead[WHEEL_DUE] = index;
+				}
+				index = next;
+			}
+		}
+
+		m_nWheelTick = tick;
+	}
+
 	unsigned short m_entinfoIndex[NUM_ENT_ENTRIES];
 	CUtlVector<simthinkentry_t>	m_simThinkList;
+
+	// Timing wheel, by entinfo index like m_entinfoIndex since list handles move
+	unsigned short m_wheelHead[WHEEL_SIZE + 1];
+	unsigned short m_wheelNext[NUM_ENT_ENTRIES];
+	unsigned short m_wheelPrev[NUM_ENT_ENTRIES];
+	unsigned short m_wheelBucket[NUM_ENT_ENTRIES];	// 0xFFFF = not linked
+	int m_nWheelTick;								// tick the wheel was last advanced to
+	CUtlVector<unsigned short> m_dueHandles;
 };
 
 CSimThinkManager g_SimThinkManager;
@@ -56,6 +56,7 @@
 #include "props.h"
 #include "timedeventmgr.h"
 #include "gameinterface.h"
+#include "tier0/fasttimer.h"
 #include "eventqueue.h"
 #include "hltvdirector.h"
 #if defined( REPLAY_ENABLED )
@@ -222,6 +223,8 @@ ConVar sv_massreport( "sv_massreport", "0" );
 ConVar sv_force_transmit_ents( "sv_force_transmit_ents", "0", FCVAR_CHEAT | FCVAR_DEVELOPMENTONLY, "Will transmit all entities to client, regardless of PVS conditions (will still skip based on transmit flags, however)." );
 
 ConVar sv_autosave( "sv_autosave", "1", 0, "Set to 1 to autosave game on level transition. Does not affect autosave triggers." );
+ConVar sv_autosave_min_interval( "sv_autosave_min_interval", "0", 0, "Autosaves requested by map logic within this many seconds of the previous autosave are held back until it has passed." );
+ConVar sv_save_report( "sv_save_report", "0", 0, "Report how long the game spent serializing each save and how much it wrote." );
 ConVar* sv_maxreplay = NULL;
 static ConVar*  g_pcv_commentary = NULL;
 static ConVar* g_pcv_ThreadMode = NULL;
@@ -1180,6 +1183,7 @@ bool CServerGameDLL::LevelInit( const char* pMapName, char const* pMapEntities,
 	// clear any pending autosavedangerous
 	m_fAutoSaveDangerousTime = 0.0f;
 	m_fAutoSaveDangerousMinHealthToCommit = 0.0f;
+	m_bAutosavePending = false;
 	return true;
 }
 
@@ -1361,19 +1365,28 @@ void CServerGameDLL::GameFrame( bool simulating )
 	UpdateQueryCache();
 	g_pServerBenchmark->UpdateBenchmark();
 
-	Physics_RunThinkFunctions( simulating );
+	{
+		CTimeAdder timer( ServerBenchmarkTimer( SERVER_BENCHMARK_THINK ) );
+		Physics_RunThinkFunctions( simulating );
+	}
 
 	IGameSystem::FrameUpdatePostEntityThinkAllSystems();
 
 	// UNDONE: Make these systems IGameSystems and move these calls into FrameUpdatePostEntityThink()
 	// service event queue, firing off any actions whos time has come
-	ServiceEventQueue();
+	{
+		CTimeAdder timer( ServerBenchmarkTimer( SERVER_BENCHMARK_ENTITY_IO ) );
+		ServiceEventQueue();
+	}
 
 	// free all ents marked in think functions
 	gEntList.CleanupDeleteList();
 
 	// FIXME:  Should this only occur on the final tick?
-	UpdateAllClientData();
+	{
+		CTimeAdder timer( ServerBenchmarkTimer( SERVER_BENCHMARK_NETWORK ) );
+		UpdateAllClientData();
+	}
 
 	if( g_pGameRules )
 	{
@@ -1399,7 +1412,10 @@ void CServerGameDLL::GameFrame( bool simulating )
 	}
 
 	// Any entities that detect network state changes on a timer do it here.
-	g_NetworkPropertyEventMgr.FireEvents();
+	{
+		CTimeAdder timer( ServerBenchmarkTimer( SERVER_BENCHMARK_NETWORK ) );
+		g_NetworkPropertyEventMgr.FireEvents();
+	}
 
 	gpGlobals->frametime = oldframetime;
 }
@@ -1488,6 +1504,72 @@ void CServerGameDLL::Think( bool finalTick )
 		m_fAutoSaveDangerousTime = 0.0f;
 		m_fAutoSaveDangerousMinHealthToCommit = 0.0f;
 	}
+
+	if( m_bAutosavePending && Plat_FloatTime() - m_flLastAutosaveRealTime >= sv_autosave_min_interval.GetFloat() )
+	{
+		m_bAutosavePending = false;
+
+		if( CanIssueDeferredAutosave() )
+		{
+			m_flLastAutosaveRealTime = Plat_FloatTime();
+			engine->ServerCommand( "autosave\n" );
+		}
+		else
+		{
+			DevMsg( "Deferred autosave dropped, the player is no longer in a state to be saved\n" );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Autosave triggers only fire for a live player; a held back autosave
+//			has to still meet that when it is finally issued.
+//-----------------------------------------------------------------------------
+bool CServerGameDLL::CanIssueDeferredAutosave( void )
+{
+	CBasePlayer* pPlayer = UTIL_PlayerByIndex( 1 );
+	if( !pPlayer || !pPlayer->IsAlive() || pPlayer->IsSinglePlayerGameEnding() )
+	{
+		return false;
+	}
+
+	if( pPlayer->GetDeathTime() != 0.0f && pPlayer->GetDeathTime() <= gpGlobals->curtime )
+	{
+		return false;
+	}
+
+	// a dangerous autosave is waiting to become safe, don't save over it
+	if( m_fAutoSaveDangerousTime != 0.0f )
+	{
+		return false;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Issues an autosave, or holds it back while the previous autosave
+//			was issued less than sv_autosave_min_interval seconds ago. The
+//			engine queues save_async writes itself. Any number of
+//			requests in the meantime collapse into one autosave issued from
+//			Think, once the player has been checked again.
+//-----------------------------------------------------------------------------
+void CServerGameDLL::RequestAutosave( void )
+{
+	bool bTooSoon = m_flLastAutosaveRealTime != 0.0 && Plat_FloatTime() - m_flLastAutosaveRealTime < sv_autosave_min_interval.GetFloat();
+	if( bTooSoon )
+	{
+		if( !m_bAutosavePending )
+		{
+			DevMsg( "Autosave deferred, previous autosave was too recent\n" );
+		}
+		m_bAutosavePending = true;
+		return;
+	}
+
+	m_bAutosavePending = false;
+	m_flLastAutosaveRealTime = Plat_FloatTime();
+	engine->ServerCommand( "autosave\n" );
 }
 
 void CServerGameDLL::OnQueryCvarValueFinished( QueryCvarCookie_t iCookie, edict_t* pPlayerEntity, EQueryCvarValueStatus eStatus, const char* pCvarName, const char* pCvarValue )
@@ -1649,8 +1731,19 @@ void CServerGameDLL::RestoreGlobalState( CSaveRestoreData* s )
 
 void CServerGameDLL::Save( CSaveRestoreData* s )
 {
+	CFastTimer timer;
+	timer.Start();
+	int nStartPos = s->GetCurPos();
+
 	CSave saveHelper( s );
 	g_pGameSaveRestoreBlockSet->Save( &saveHelper );
+
+	timer.End();
+
+	if( sv_save_report.GetBool() )
+	{
+		Msg( "Save: serialized %d bytes in %.2f ms, %s write\n", s->GetCurPos() - nStartPos, timer.GetDuration().GetMillisecondsF(), s->bAsync ? "async" : "sync" );
+	}
 }
 
 void CServerGameDLL::Restore( CSaveRestoreData* s, bool b )
@@ -2783,6 +2876,7 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo* pInfo, const unsigned s
 	}
 
 	MDLCACHE_CRITICAL_SECTION();
+	CTimeAdder timer( ServerBenchmarkTimer( SERVER_BENCHMARK_NETWORK ) );
 	CBasePlayer* pRecipientPlayer = static_cast<CBasePlayer*>( pRecipientEntity );
 	const int skyBoxArea = pRecipientPlayer->m_Local.m_skybox3d.area;
 
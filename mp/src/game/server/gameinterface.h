@@ -126,6 +126,10 @@ public:
 	float	m_fAutoSaveDangerousMinHealthToCommit;
 	bool	m_bIsHibernating;
 
+	// Autosaves issued by map logic go through here, so bursts of them are
+	// held back to one per sv_autosave_min_interval.
+	void	RequestAutosave( void );
+
 	// Called after the steam API has been activated post-level startup
 	virtual void			GameServerSteamAPIActivated( void ) OVERRIDE;
 
@@ -160,6 +164,11 @@ private:
 	void LevelInit_ParseAllEntities( const char* pMapEntities );
 	void LoadMessageOfTheDay();
 	void LoadSpecificMOTDMsg( const ConVar& convar, const char* pszStringName );
+
+	bool CanIssueDeferredAutosave( void );
+
+	double	m_flLastAutosaveRealTime;
+	bool	m_bAutosavePending;
 };
 
 
@@ -3337,7 +3337,7 @@ DEFINE_KEYFIELD( m_bForceNewLevelUnit, FIELD_BOOLEAN, "NewLevelUnit" ),
 		engine->ClearSaveDir();
 	}
 
-	engine->ServerCommand( "autosave\n" );
+	g_ServerGameDLL.RequestAutosave();
 }
 
 //-----------------------------------------------------------------------------
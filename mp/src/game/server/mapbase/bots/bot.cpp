@@ -162,7 +162,7 @@ void CBot::Spawn()
 
 	if( GetMemory() )
 	{
-		GetMemory()->UpdateDataMemory( MEMORY_SPAWN_POSITION, GetAbsOrigin() );
+		GetMemory()->UpdateDataMemory( MEMORY_KEY_SPAWN_POSITION, GetAbsOrigin() );
 	}
 }
 
@@ -192,7 +192,14 @@ void CBot::Update()
 
 	if( CanRunAI() )
 	{
-		RunAI();
+		if( IsAITurn() )
+		{
+			RunAI();
+		}
+		else
+		{
+			RepeatLastMovement();
+		}
 	}
 
 	PlayerMove( m_cmd );
@@ -266,12 +273,20 @@ bool CBot::CanRunAI()
 		}
 	}
 
-	if( ( ( gpGlobals->tickcount + GetHost()->entindex() ) % 2 ) == 0 )
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns if this tick is our turn to run the AI
+//-----------------------------------------------------------------------------
+bool CBot::IsAITurn()
+{
+	if( TheBots->IsSchedulerEnabled() )
 	{
-		return true;
+		return TheBots->IsThinkScheduled( GetHost() );
 	}
 
-	return false;
+	return ( ( ( gpGlobals->tickcount + GetHost()->entindex() ) % 2 ) == 0 );
 }
 
 //-----------------------------------------------------------------------------
@@ -287,6 +302,7 @@ void CBot::Upkeep()
 void CBot::RunAI()
 {
 	m_RunTimer.Start();
+	++m_iThinkCount;
 
 	BlockConditions();
 
@@ -307,12 +323,37 @@ void CBot::RunAI()
 	DebugDisplay();
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Keeps moving the way we were while the scheduler has us waiting,
+// far bots can go several ticks between thinks.
+//-----------------------------------------------------------------------------
+void CBot::RepeatLastMovement()
+{
+	if( !TheBots->IsSchedulerEnabled() || GetThinkLOD() == BOT_LOD_SLEEP )
+	{
+		return;
+	}
+
+	if( !m_lastCmd )
+	{
+		return;
+	}
+
+	m_cmd->forwardmove = m_lastCmd->forwardmove;
+	m_cmd->sidemove = m_lastCmd->sidemove;
+	m_cmd->upmove = m_lastCmd->upmove;
+
+	// Only the buttons that are held, not the ones that do something when pressed
+	m_cmd->buttons = m_lastCmd->buttons & ( IN_FORWARD | IN_BACK | IN_MOVELEFT | IN_MOVERIGHT | IN_DUCK | IN_WALK | IN_SPEED );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
 void CBot::UpdateComponents( bool important )
 {
 	CFastTimer timer;
+	int turn = 0;
 
 	FOR_EACH_COMPONENT
 	{
@@ -325,6 +366,12 @@ void CBot::UpdateComponents( bool important )
 			continue;
 		}
 
+		// Nobody is around, the lesser components take turns between thinks.
+		if( !important && GetThinkLOD() >= BOT_LOD_LOW && ( ( turn++ + m_iThinkCount ) & 1 ) )
+		{
+			continue;
+		}
+
 		timer.Start();
 		m_nComponents[it]->Update();
 		timer.End();
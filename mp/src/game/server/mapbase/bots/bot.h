@@ -37,8 +37,10 @@ public:
 	virtual void PlayerMove( CUserCmd* cmd );
 
 	virtual bool CanRunAI();
+	virtual bool IsAITurn();
 	virtual void Upkeep();
 	virtual void RunAI();
+	virtual void RepeatLastMovement();
 
 	virtual void UpdateComponents( bool important = false );
 
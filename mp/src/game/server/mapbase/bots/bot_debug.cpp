@@ -189,8 +189,8 @@ void CBot::DebugDisplay()
 		DebugScreenText( "" );
 		DebugScreenText( msg.sprintf( "Memory (Ents: %i) (%.3f ms):", GetMemory()->GetKnownCount(), GetMemory()->GetUpdateCost() ), red );
 
-		DebugScreenText( msg.sprintf( "    Threats: %i (Nearby: %i - Dangerous: %i)", GetMemory()->GetThreatCount(), GetDataMemoryInt( "NearbyThreats" ), GetDataMemoryInt( "NearbyDangerousThreats" ) ), red );
-		DebugScreenText( msg.sprintf( "    Friends: %i (Nearby: %i)", GetMemory()->GetFriendCount(), GetDataMemoryInt( "NearbyFriends" ) ), green );
+		DebugScreenText( msg.sprintf( "    Threats: %i (Nearby: %i - Dangerous: %i)", GetMemory()->GetThreatCount(), GetDataMemoryInt( MEMORY_KEY_NEARBY_THREATS ), GetDataMemoryInt( MEMORY_KEY_NEARBY_DANGEROUS_THREATS ) ), red );
+		DebugScreenText( msg.sprintf( "    Friends: %i (Nearby: %i)", GetMemory()->GetFriendCount(), GetDataMemoryInt( MEMORY_KEY_NEARBY_FRIENDS ) ), green );
 
 		if( GetEnemy() )
 		{
@@ -361,7 +361,7 @@ void CBot::DebugDisplay()
 	// Deep Memory
 	if( bot_debug_memory.GetBool() && GetMemory() )
 	{
-		FOR_EACH_MAP_FAST( GetMemory()->m_Memory, it )
+		FOR_EACH_VEC( GetMemory()->m_Memory, it )
 		{
 			CEntityMemory* memory = GetMemory()->m_Memory[it];
 			Assert( memory );
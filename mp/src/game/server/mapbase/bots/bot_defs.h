@@ -493,6 +493,27 @@ enum BotPerformance
 	LAST_PERFORMANCE
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: How much thinking the bot scheduler gives a bot
+//-----------------------------------------------------------------------------
+enum BotThinkLOD
+{
+	BOT_LOD_HIGH = 0,	// In combat or close to a human
+	BOT_LOD_MEDIUM,		// In the PVS of a human or not too far
+	BOT_LOD_LOW,		// Far away from everyone, the lesser components take turns
+	BOT_LOD_SLEEP,		// Like BOT_LOD_LOW but for BOT_PERFORMANCE_PVS bots, no AI at all
+
+	LAST_BOT_LOD
+};
+
+static const char* g_BotThinkLODNames[LAST_BOT_LOD] =
+{
+	"HIGH",
+	"MEDIUM",
+	"LOW",
+	"SLEEP"
+};
+
 //-----------------------------------------------------------------------------
 // Purpose: Stores the assigned Hitbox number for each body part
 //-----------------------------------------------------------------------------
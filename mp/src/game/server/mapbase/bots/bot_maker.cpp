@@ -203,7 +203,7 @@ void CBotSpawn::SetUpBot()
 	{
 		if( pBot->GetMemory() )
 		{
-			pBot->GetMemory()->UpdateDataMemory( "BlockLookAround", m_iBlockLookAround, m_iBlockLookAround );
+			pBot->GetMemory()->UpdateDataMemory( MEMORY_KEY_BLOCK_LOOK_AROUND, m_iBlockLookAround, m_iBlockLookAround );
 		}
 	}
 
@@ -243,7 +243,7 @@ void CBotSpawn::SetUpBot()
 	{
 		if( pBot->GetMemory() )
 		{
-			pBot->GetMemory()->UpdateDataMemory( "SpawnPosition", GetAbsOrigin(), -1.0f );
+			pBot->GetMemory()->UpdateDataMemory( MEMORY_KEY_SPAWN_POSITION, GetAbsOrigin(), -1.0f );
 		}
 
 		GetPlayer()->Teleport( &GetAbsOrigin(), &GetAbsAngles(), NULL );
@@ -343,7 +343,7 @@ void CBotSpawn::InputBlockLook( inputdata_t& inputdata )
 
 	if( GetPlayer() && GetPlayer()->GetBotController() && GetPlayer()->GetBotController()->GetMemory() )
 	{
-		GetPlayer()->GetBotController()->GetMemory()->UpdateDataMemory( "BlockLookAround", m_iBlockLookAround, -1.0f );
+		GetPlayer()->GetBotController()->GetMemory()->UpdateDataMemory( MEMORY_KEY_BLOCK_LOOK_AROUND, m_iBlockLookAround, -1.0f );
 	}
 }
 
@@ -13,24 +13,48 @@
 CBotManager g_BotManager;
 CBotManager* TheBots = &g_BotManager;
 
-void Bot_RunAll()
+extern ConVar bot_far_distance;
+
+//-----------------------------------------------------------------------------
+// Commands
+//-----------------------------------------------------------------------------
+
+ConVar bot_scheduler( "bot_scheduler", "1", FCVAR_ADMIN_ONLY | FCVAR_CHEAT | FCVAR_NOTIFY, "Gives each bot a think rate based on how close it is to the action, within a per-tick time budget." );
+ConVar bot_scheduler_budget( "bot_scheduler_budget", "2.0", FCVAR_ADMIN_ONLY | FCVAR_CHEAT | FCVAR_NOTIFY, "Milliseconds per tick the bots may spend thinking. Bots that do not fit wait for the next tick." );
+ConVar bot_scheduler_near_distance( "bot_scheduler_near_distance", "1000", FCVAR_ADMIN_ONLY | FCVAR_CHEAT | FCVAR_NOTIFY, "Bots this close to a human think at the full rate." );
+ConVar bot_scheduler_interval_medium( "bot_scheduler_interval_medium", "4", FCVAR_ADMIN_ONLY | FCVAR_CHEAT | FCVAR_NOTIFY, "Ticks between thinks for bots that a human can see or that are within bot_far_distance." );
+ConVar bot_scheduler_interval_low( "bot_scheduler_interval_low", "8", FCVAR_ADMIN_ONLY | FCVAR_CHEAT | FCVAR_NOTIFY, "Ticks between thinks for bots far from every human." );
+ConVar bot_scheduler_max_starve( "bot_scheduler_max_starve", "16", FCVAR_ADMIN_ONLY | FCVAR_CHEAT | FCVAR_NOTIFY, "Bots that have waited this many ticks past their turn think regardless of the budget." );
+ConVar bot_scheduler_stats( "bot_scheduler_stats", "0", FCVAR_ADMIN_ONLY | FCVAR_CHEAT | FCVAR_NOTIFY, "Shows the budget use and starvation of the bot scheduler." );
+
+// Bots that have their turn and are not in combat, sorted by how late they are
+struct BotThinkCandidate_t
 {
-	for( int it = 0; it <= gpGlobals->maxClients; ++it )
+	CPlayer* pPlayer;
+	IBot* pBot;
+	BotThinkLOD lod;
+	bool due;
+	int delay;
+};
+
+static int __cdecl BotThinkCandidateSort( const BotThinkCandidate_t* a, const BotThinkCandidate_t* b )
+{
+	if( a->due != b->due )
 	{
-		CPlayer* pPlayer = ToInPlayer( UTIL_PlayerByIndex( it ) );
+		return ( a->due ) ? -1 : 1;
+	}
 
-		if( !pPlayer )
-		{
-			continue;
-		}
+	if( a->delay != b->delay )
+	{
+		return b->delay - a->delay;
+	}
 
-		if( !pPlayer->IsBot() )
-		{
-			continue;
-		}
+	return a->lod - b->lod;
+}
 
-		pPlayer->GetBotController()->Update();
-	}
+void Bot_RunAll()
+{
+	TheBots->RunBots();
 }
 
 //-----------------------------------------------------------------------------
@@ -38,6 +62,10 @@ void Bot_RunAll()
 //-----------------------------------------------------------------------------
 CBotManager::CBotManager() : CAutoGameSystemPerFrame( "BotManager" )
 {
+	memset( m_ThinkState, 0, sizeof( m_ThinkState ) );
+
+	m_flStatAvgSpent = 0.0f;
+	m_flStatAvgStarved = 0.0f;
 }
 
 //-----------------------------------------------------------------------------
@@ -54,7 +82,11 @@ bool CBotManager::Init()
 //-----------------------------------------------------------------------------
 void CBotManager::LevelInitPostEntity()
 {
+	// The tick count starts over with the map
+	memset( m_ThinkState, 0, sizeof( m_ThinkState ) );
 
+	m_flStatAvgSpent = 0.0f;
+	m_flStatAvgStarved = 0.0f;
 }
 
 //-----------------------------------------------------------------------------
@@ -96,4 +128,280 @@ void CBotManager::FrameUpdatePreEntityThink()
 void CBotManager::FrameUpdatePostEntityThink()
 {
 
-}
\ No newline at end of file
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Updates every bot. Each bot still sends its command every tick, but
+// the AI itself only runs on the ticks the scheduler gives it.
+//-----------------------------------------------------------------------------
+void CBotManager::RunBots()
+{
+	VPROF_BUDGET( "CBotManager::RunBots", VPROF_BUDGETGROUP_BOTS );
+
+	CUtlVectorFixed<BotThinkCandidate_t, MAX_PLAYERS> candidates;
+
+	for( int it = 1; it <= gpGlobals->maxClients; ++it )
+	{
+		CPlayer* pPlayer = ToInPlayer( UTIL_PlayerByIndex( it ) );
+
+		if( !pPlayer )
+		{
+			continue;
+		}
+
+		if( !pPlayer->IsBot() || !pPlayer->GetBotController() )
+		{
+			continue;
+		}
+
+		BotThinkCandidate_t& candidate = candidates[candidates.AddToTail()];
+		candidate.pPlayer = pPlayer;
+		candidate.pBot = pPlayer->GetBotController();
+		candidate.lod = BOT_LOD_HIGH;
+		candidate.due = false;
+		candidate.delay = 0;
+	}
+
+	if( !IsSchedulerEnabled() )
+	{
+		FOR_EACH_VEC( candidates, it )
+		{
+			candidates[it].pBot->Update();
+		}
+
+		return;
+	}
+
+	GatherViewpoints();
+
+	int tick = gpGlobals->tickcount;
+
+	m_iStatBots = candidates.Count();
+	m_iStatThinks = 0;
+	m_iStatStarved = 0;
+	m_iStatForced = 0;
+	m_iStatWorstDelay = 0;
+	m_flStatSpent = 0.0f;
+	memset( m_iStatLODCount, 0, sizeof( m_iStatLODCount ) );
+
+	FOR_EACH_VEC( candidates, it )
+	{
+		BotThinkCandidate_t& candidate = candidates[it];
+		BotThinkState_t& state = m_ThinkState[candidate.pPlayer->entindex()];
+
+		candidate.lod = ComputeThinkLOD( candidate.pPlayer, candidate.pBot );
+		candidate.pBot->SetThinkLOD( candidate.lod );
+		++m_iStatLODCount[candidate.lod];
+
+		if( candidate.lod == BOT_LOD_SLEEP )
+		{
+			continue;
+		}
+
+		int interval = GetThinkInterval( candidate.lod );
+
+		// New bot in this slot, or the map changed under us. Its first think is
+		// offset by its entindex, so bots that join on the same tick don't all
+		// come due on the same ticks
+		if( state.userID != candidate.pPlayer->GetUserID() || tick < state.lastThinkTick )
+		{
+			state.userID = candidate.pPlayer->GetUserID();
+			state.lastThinkTick = tick - interval + ( candidate.pPlayer->entindex() % interval );
+		}
+
+		candidate.delay = ( tick - state.lastThinkTick ) - interval;
+		candidate.due = ( candidate.delay >= 0 );
+	}
+
+	// Whoever has waited the longest goes first
+	candidates.Sort( BotThinkCandidateSort );
+
+	float budget = bot_scheduler_budget.GetFloat();
+	int maxStarve = bot_scheduler_max_starve.GetInt();
+	CFastTimer timer;
+
+	FOR_EACH_VEC( candidates, it )
+	{
+		BotThinkCandidate_t& candidate = candidates[it];
+		BotThinkState_t& state = m_ThinkState[candidate.pPlayer->entindex()];
+
+		state.scheduled = false;
+
+		if( candidate.due )
+		{
+			if( m_flStatSpent < budget )
+			{
+				state.scheduled = true;
+			}
+			else if( candidate.delay >= maxStarve )
+			{
+				state.scheduled = true;
+				++m_iStatForced;
+			}
+			else
+			{
+				++m_iStatStarved;
+			}
+
+			m_iStatWorstDelay = MAX( m_iStatWorstDelay, candidate.delay );
+		}
+
+		timer.Start();
+		candidate.pBot->Update();
+		timer.End();
+
+		if( state.scheduled )
+		{
+			state.lastThinkTick = tick;
+			state.scheduled = false;
+
+			m_flStatSpent += timer.GetDuration().GetMillisecondsF();
+			++m_iStatThinks;
+		}
+	}
+
+	m_flStatAvgSpent = m_flStatAvgSpent * 0.95f + m_flStatSpent * 0.05f;
+	m_flStatAvgStarved = m_flStatAvgStarved * 0.95f + m_iStatStarved * 0.05f;
+
+	if( bot_scheduler_stats.GetBool() )
+	{
+		DisplaySchedulerStats();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+bool CBotManager::IsSchedulerEnabled() const
+{
+	return bot_scheduler.GetBool();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns if the bot was given a turn to think this tick
+//-----------------------------------------------------------------------------
+bool CBotManager::IsThinkScheduled( CBasePlayer* pPlayer ) const
+{
+	int index = pPlayer->entindex();
+
+	if( index <= 0 || index > MAX_PLAYERS )
+	{
+		return false;
+	}
+
+	return m_ThinkState[index].scheduled;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Collects the position and PVS of every human, once per tick
+//-----------------------------------------------------------------------------
+void CBotManager::GatherViewpoints()
+{
+	const int pvsSize = MAX_MAP_CLUSTERS / 8;
+
+	m_Viewpoints.RemoveAll();
+	m_ViewpointPVS.RemoveAll();
+
+	for( int it = 1; it <= gpGlobals->maxClients; ++it )
+	{
+		CBasePlayer* pPlayer = UTIL_PlayerByIndex( it );
+
+		if( !pPlayer || pPlayer->IsBot() || !pPlayer->IsConnected() )
+		{
+			continue;
+		}
+
+		Vector vecEyes = pPlayer->EyePosition();
+		m_Viewpoints.AddToTail( vecEyes );
+
+		int offset = m_ViewpointPVS.AddMultipleToTail( pvsSize );
+		engine->GetPVSForCluster( engine->GetClusterForOrigin( vecEyes ), pvsSize, m_ViewpointPVS.Base() + offset );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Decides how much thinking a bot deserves this tick
+//-----------------------------------------------------------------------------
+BotThinkLOD CBotManager::ComputeThinkLOD( CBasePlayer* pPlayer, IBot* pBot ) const
+{
+	// Fighting or about to, it needs to react
+	if( !pBot->IsIdle() || pBot->GetEnemy() )
+	{
+		return BOT_LOD_HIGH;
+	}
+
+	const int pvsSize = MAX_MAP_CLUSTERS / 8;
+
+	Vector vecEyes = pPlayer->EyePosition();
+	float nearest = FLT_MAX;
+	bool visible = false;
+
+	FOR_EACH_VEC( m_Viewpoints, it )
+	{
+		nearest = MIN( nearest, vecEyes.DistToSqr( m_Viewpoints[it] ) );
+
+		if( !visible && engine->CheckOriginInPVS( vecEyes, m_ViewpointPVS.Base() + it * pvsSize, pvsSize ) )
+		{
+			visible = true;
+		}
+	}
+
+	float nearDistance = bot_scheduler_near_distance.GetFloat();
+
+	if( nearest <= nearDistance * nearDistance )
+	{
+		return BOT_LOD_HIGH;
+	}
+
+	float farDistance = bot_far_distance.GetFloat();
+
+	if( visible || nearest <= farDistance * farDistance )
+	{
+		return BOT_LOD_MEDIUM;
+	}
+
+	if( pBot->GetPerformance() == BOT_PERFORMANCE_PVS )
+	{
+		return BOT_LOD_SLEEP;
+	}
+
+	return BOT_LOD_LOW;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Ticks between thinks for the given LOD
+//-----------------------------------------------------------------------------
+int CBotManager::GetThinkInterval( BotThinkLOD lod ) const
+{
+	switch( lod )
+	{
+		case BOT_LOD_HIGH:
+			// Same rate the bots had before there was a scheduler
+			return 2;
+
+		case BOT_LOD_MEDIUM:
+			return MAX( 1, bot_scheduler_interval_medium.GetInt() );
+
+		case BOT_LOD_LOW:
+		default:
+			return MAX( 1, bot_scheduler_interval_low.GetInt() );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CBotManager::DisplaySchedulerStats()
+{
+	float budget = bot_scheduler_budget.GetFloat();
+	int line = 0;
+
+	engine->Con_NPrintf( line++, "Bot scheduler: %d bots, %d thinks this tick", m_iStatBots, m_iStatThinks );
+	engine->Con_NPrintf( line++, "  Budget: %.2f / %.2f ms (%.0f%%), average %.2f ms", m_flStatSpent, budget, ( budget > 0.0f ) ? 100.0f * m_flStatSpent / budget : 0.0f, m_flStatAvgSpent );
+	engine->Con_NPrintf( line++, "  Starved: %d (average %.1f), forced past the budget: %d, worst delay: %d ticks", m_iStatStarved, m_flStatAvgStarved, m_iStatForced, m_iStatWorstDelay );
+
+	for( int it = 0; it < LAST_BOT_LOD; ++it )
+	{
+		engine->Con_NPrintf( line++, "  %-6s %d", g_BotThinkLODNames[it], m_iStatLODCount[it] );
+	}
+}
@@ -9,6 +9,10 @@
 	#pragma once
 #endif
 
+#include "bot_defs.h"
+
+class IBot;
+
 //-----------------------------------------------------------------------------
 // Purpose: Bot Manager
 //-----------------------------------------------------------------------------
@@ -24,6 +28,43 @@ public:
 
 	virtual void FrameUpdatePreEntityThink();
 	virtual void FrameUpdatePostEntityThink();
+
+	virtual void RunBots();
+
+	virtual bool IsSchedulerEnabled() const;
+	virtual bool IsThinkScheduled( CBasePlayer* pPlayer ) const;
+
+protected:
+	virtual void GatherViewpoints();
+	virtual BotThinkLOD ComputeThinkLOD( CBasePlayer* pPlayer, IBot* pBot ) const;
+	virtual int GetThinkInterval( BotThinkLOD lod ) const;
+	virtual void DisplaySchedulerStats();
+
+protected:
+	// Scheduler state of each player slot
+	struct BotThinkState_t
+	{
+		int userID;
+		int lastThinkTick;
+		bool scheduled;
+	};
+
+	BotThinkState_t m_ThinkState[MAX_PLAYERS + 1];
+
+	// Where the humans are looking from this tick, and what they can see
+	CUtlVector<Vector> m_Viewpoints;
+	CUtlVector<byte> m_ViewpointPVS;
+
+	// Stats for bot_scheduler_stats
+	int m_iStatBots;
+	int m_iStatThinks;
+	int m_iStatStarved;
+	int m_iStatForced;
+	int m_iStatWorstDelay;
+	int m_iStatLODCount[LAST_BOT_LOD];
+	float m_flStatSpent;
+	float m_flStatAvgSpent;
+	float m_flStatAvgStarved;
 };
 
 extern CBotManager* TheBots;
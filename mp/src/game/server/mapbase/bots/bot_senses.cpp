@@ -93,7 +93,7 @@ void CBot::OnLooked( CBaseEntity* pSightEnt )
 
 			if( GetDecision()->ShouldGrabWeapon( pWeapon ) )
 			{
-				GetMemory()->UpdateDataMemory( "BestWeapon", pSightEnt, 30.0f );
+				GetMemory()->UpdateDataMemory( MEMORY_KEY_BEST_WEAPON, pSightEnt, 30.0f );
 				SetCondition( BCOND_BETTER_WEAPON_AVAILABLE );
 			}
 		}
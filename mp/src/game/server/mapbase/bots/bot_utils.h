@@ -37,6 +37,12 @@ public:
 		return ( GetEntity() == pEntity );
 	}
 
+	// Slot of the entity in the entity list, still valid after the entity is gone.
+	virtual int GetEntryIndex() const
+	{
+		return m_hEntity.GetEntryIndex();
+	}
+
 	virtual CBaseEntity* GetInformer() const
 	{
 		return m_hInformer.Get();
@@ -257,6 +263,17 @@ public:
 		return m_LastUpdate.GetStartTime();
 	}
 
+	// Returns the time at which IsExpired() starts returning true, -1 if never.
+	float GetExpireTime() const
+	{
+		if( m_flForget <= 0.0f || !m_LastUpdate.HasStarted() )
+		{
+			return -1.0f;
+		}
+
+		return m_LastUpdate.GetStartTime() + m_flForget;
+	}
+
 	void ForgetIn( float time )
 	{
 		m_flForget = time;
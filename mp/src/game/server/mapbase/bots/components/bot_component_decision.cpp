@@ -453,7 +453,7 @@ bool CBotDecision::CanHuntThreat() const
 		}
 
 		// There are several more dangerous enemies, we should not go
-		if( GetDataMemoryInt( "NearbyDangerousThreats" ) >= 3 )
+		if( GetDataMemoryInt( MEMORY_KEY_NEARBY_DANGEROUS_THREATS ) >= 3 )
 		{
 			return false;
 		}
@@ -1019,7 +1019,7 @@ bool CBotDecision::ShouldMustBeCareful() const
 		return false;
 	}
 
-	if( GetDataMemoryInt( "NearbyDangerousThreats" ) >= 2 )
+	if( GetDataMemoryInt( MEMORY_KEY_NEARBY_DANGEROUS_THREATS ) >= 2 )
 	{
 		return true;
 	}
@@ -11,10 +11,78 @@
 #include "bot.h"
 #include "bot_manager.h"
 #include "in_utils.h"
+#include "mathlib/ssemath.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
+//================================================================================
+// Data memory keys
+//================================================================================
+
+static const char* g_BuiltinMemoryKeys[NUM_BUILTIN_MEMORY_KEYS] =
+{
+	"NearbyThreats",
+	"NearbyFriends",
+	"NearbyDangerousThreats",
+	MEMORY_BLOCK_LOOK_AROUND,
+	MEMORY_SPAWN_POSITION,
+	MEMORY_BEST_WEAPON,
+	"NextSchedule",
+	"SavedPosition",
+	"InvestigateLocation"
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the global key table, with the builtin keys registered first
+// so their ids match the MEMORY_KEY_* values.
+//-----------------------------------------------------------------------------
+static CUtlHashSymbolTable& GetBotMemoryKeys()
+{
+	static CUtlHashSymbolTable s_Keys( 64 );
+
+	if( s_Keys.GetNumStrings() == 0 )
+	{
+		for( int i = 0; i < NUM_BUILTIN_MEMORY_KEYS; ++i )
+		{
+			BotMemoryKey_t key = s_Keys.AddString( g_BuiltinMemoryKeys[i] );
+			Assert( key == ( BotMemoryKey_t )i );
+			NOTE_UNUSED( key );
+		}
+	}
+
+	return s_Keys;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+BotMemoryKey_t AllocBotMemoryKey( const char* name )
+{
+	if( !name )
+	{
+		return INVALID_BOT_MEMORY_KEY;
+	}
+
+	return GetBotMemoryKeys().AddString( name );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+BotMemoryKey_t FindBotMemoryKey( const char* name )
+{
+	return GetBotMemoryKeys().Find( name );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+const char* GetBotMemoryKeyName( BotMemoryKey_t key )
+{
+	return GetBotMemoryKeys().String( key );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
@@ -41,25 +109,10 @@ void CBotMemory::UpdateMemory()
 	int nearbyFriends = 0;
 	int nearbyDangerousThreats = 0;
 
-	UpdateDataMemory( "NearbyThreats", 0 );
-	UpdateDataMemory( "NearbyFriends", 0 );
-	UpdateDataMemory( "NearbyDangerousThreats", 0 );
-
-	FOR_EACH_MAP_FAST( m_DataMemory, it )
-	{
-		CDataMemory* memory = m_DataMemory[it];
-		Assert( memory );
-
-		if( memory->IsExpired() )
-		{
-			m_DataMemory.RemoveAt( it );
-			delete memory;
-			memory = NULL;
-			continue;
-		}
-	}
+	ForgetExpiredData();
 
-	FOR_EACH_MAP_FAST( m_Memory, it )
+	// Backwards, ForgetEntity() moves the last memory into the removed one's place.
+	for( int it = m_Memory.Count() - 1; it >= 0; --it )
 	{
 		CEntityMemory* memory = m_Memory[it];
 		Assert( memory );
@@ -76,13 +129,18 @@ void CBotMemory::UpdateMemory()
 		// New frame, we need to recheck if we can see it.
 		memory->UpdateVisibility( false );
 
+		// Relationships can change at any time, refresh what the queries below work with.
+		ClassifyEntityMemory( it );
+
 		if( !memory->IsLost() )
 		{
 			// The last known position of this entity is close to us.
 			// We mark how many allied/enemy entities are close to us to make better decisions.
 			if( memory->IsInRange( m_flNearbyDistance ) )
 			{
-				if( memory->IsEnemy() )
+				const EntityMemoryBlock_t& block = m_MemoryBlocks[it >> 2];
+
+				if( block.enemy[it & 3] )
 				{
 					if( GetDecision()->IsDangerousEnemy( pEntity ) )
 					{
@@ -91,7 +149,7 @@ void CBotMemory::UpdateMemory()
 
 					++nearbyThreats;
 				}
-				else if( memory->IsFriend() )
+				else if( block.friendly[it & 3] )
 				{
 					++nearbyFriends;
 				}
@@ -99,9 +157,9 @@ void CBotMemory::UpdateMemory()
 		}
 	}
 
-	UpdateDataMemory( "NearbyThreats", nearbyThreats );
-	UpdateDataMemory( "NearbyFriends", nearbyFriends );
-	UpdateDataMemory( "NearbyDangerousThreats", nearbyDangerousThreats );
+	UpdateDataMemory( MEMORY_KEY_NEARBY_THREATS, nearbyThreats );
+	UpdateDataMemory( MEMORY_KEY_NEARBY_FRIENDS, nearbyFriends );
+	UpdateDataMemory( MEMORY_KEY_NEARBY_DANGEROUS_THREATS, nearbyDangerousThreats );
 
 	// We see, we smell, we feel
 	if( GetHost()->GetSenses() )
@@ -117,17 +175,17 @@ void CBotMemory::UpdateIdealThreat()
 {
 	CEntityMemory* pIdeal = NULL;
 
-	FOR_EACH_MAP_FAST( m_Memory, it )
+	FOR_EACH_VEC( m_Memory, it )
 	{
-		CEntityMemory* memory = m_Memory[it];
-		Assert( memory );
-
-		if( memory->IsLost() )
+		if( !m_MemoryBlocks[it >> 2].enemy[it & 3] )
 		{
 			continue;
 		}
 
-		if( !memory->IsEnemy() )
+		CEntityMemory* memory = m_Memory[it];
+		Assert( memory );
+
+		if( memory->IsLost() )
 		{
 			continue;
 		}
@@ -280,6 +338,15 @@ CEntityMemory* CBotMemory::UpdateEntityMemory( CBaseEntity* pEnt, const Vector&
 		return NULL;
 	}
 
+	int entry = pEnt->GetRefEHandle().GetEntryIndex();
+	int index = GetMemoryIndex( entry );
+
+	// The slot still holds the memory of a deleted entity.
+	if( m_Memory.IsValidIndex( index ) && !m_Memory[index]->Is( pEnt ) )
+	{
+		ForgetEntity( index );
+	}
+
 	CEntityMemory* memory = GetEntityMemory( pEnt );
 
 	if( memory )
@@ -318,13 +385,31 @@ CEntityMemory* CBotMemory::UpdateEntityMemory( CBaseEntity* pEnt, const Vector&
 	if( !memory )
 	{
 		memory = new CEntityMemory( GetBot(), pEnt, pInformer );
-		m_Memory.Insert( pEnt->entindex(), memory );
+		index = m_Memory.AddToTail( memory );
+		m_MemoryIndex.InsertOrReplace( entry, index );
+
+		// Start a new block, its unused lanes must never pass a range test.
+		if( ( index & 3 ) == 0 )
+		{
+			EntityMemoryBlock_t& block = m_MemoryBlocks[m_MemoryBlocks.AddToTail()];
+
+			for( int lane = 0; lane < 4; ++lane )
+			{
+				block.x[lane] = block.y[lane] = block.z[lane] = FLT_MAX;
+				block.team[lane] = TEAM_INVALID;
+				block.enemy[lane] = block.friendly[lane] = 0;
+			}
+		}
+
+		ClassifyEntityMemory( index );
 	}
 
 	memory->UpdatePosition( vecPosition );
 	memory->SetInformer( pInformer );
 	memory->MarkLastFrame();
 
+	SetMemoryBlockPosition( GetMemoryIndex( entry ), vecPosition );
+
 	return memory;
 }
 
@@ -333,8 +418,14 @@ CEntityMemory* CBotMemory::UpdateEntityMemory( CBaseEntity* pEnt, const Vector&
 //================================================================================
 void CBotMemory::ForgetEntity( CBaseEntity* pEnt )
 {
-	int index = m_Memory.Find( pEnt->entindex() );
-	ForgetEntity( index );
+	CEntityMemory* memory = GetEntityMemory( pEnt );
+
+	if( !memory )
+	{
+		return;
+	}
+
+	ForgetEntity( GetMemoryIndex( memory->GetEntryIndex() ) );
 }
 
 //================================================================================
@@ -342,6 +433,7 @@ void CBotMemory::ForgetEntity( CBaseEntity* pEnt )
 // Notes:
 // 1. It is the index in the array, not the index of the entity.
 // 2. Always use this function to safely remove an entity from memory and its known pointers.
+// 3. The last memory is moved into the removed one's place.
 //================================================================================
 void CBotMemory::ForgetEntity( int index )
 {
@@ -353,8 +445,40 @@ void CBotMemory::ForgetEntity( int index )
 	CEntityMemory* memory = m_Memory.Element( index );
 	Assert( memory );
 
-	// Remove from array
-	m_Memory.RemoveAt( index );
+	m_MemoryIndex.Remove( memory->GetEntryIndex() );
+
+	// Move the last memory into this slot, and its block lane along with it
+	int last = m_Memory.Count() - 1;
+
+	if( index != last )
+	{
+		CEntityMemory* moved = m_Memory[last];
+		m_Memory[index] = moved;
+		m_MemoryIndex.InsertOrReplace( moved->GetEntryIndex(), index );
+
+		const EntityMemoryBlock_t& from = m_MemoryBlocks[last >> 2];
+		EntityMemoryBlock_t& to = m_MemoryBlocks[index >> 2];
+		to.x[index & 3] = from.x[last & 3];
+		to.y[index & 3] = from.y[last & 3];
+		to.z[index & 3] = from.z[last & 3];
+		to.team[index & 3] = from.team[last & 3];
+		to.enemy[index & 3] = from.enemy[last & 3];
+		to.friendly[index & 3] = from.friendly[last & 3];
+	}
+
+	m_Memory.Remove( last );
+
+	if( ( last & 3 ) == 0 )
+	{
+		m_MemoryBlocks.Remove( last >> 2 );
+	}
+	else
+	{
+		EntityMemoryBlock_t& block = m_MemoryBlocks[last >> 2];
+		block.x[last & 3] = block.y[last & 3] = block.z[last & 3] = FLT_MAX;
+		block.team[last & 3] = TEAM_INVALID;
+		block.enemy[last & 3] = block.friendly[last & 3] = 0;
+	}
 
 	// We check and set null all known pointers
 	// Iv�n: Noob question...
@@ -370,12 +494,8 @@ void CBotMemory::ForgetEntity( int index )
 		m_pIdealThreat = NULL;
 	}
 
-	//m_Threats.FindAndRemove( memory );
-	//m_Friends.FindAndRemove( memory );
-
 	DevMsg( 2, "Deleting index %i from memory...\n", index );
 
-	// Delete pointer ???
 	delete memory;
 	memory = NULL;
 }
@@ -389,510 +509,603 @@ void CBotMemory::ForgetAllEntities()
 }
 
 //-----------------------------------------------------------------------------
-// Purpose:
+// Purpose: Updates the position a memory has in the blocks used by the queries.
 //-----------------------------------------------------------------------------
-CEntityMemory* CBotMemory::GetEntityMemory( CBaseEntity* pEnt ) const
+void CBotMemory::SetMemoryBlockPosition( int index, const Vector& vecPosition )
 {
-	if( pEnt == NULL )
-	{
-		if( GetPrimaryThreat() == NULL )
-		{
-			return NULL;
-		}
-
-		return GetPrimaryThreat();
-	}
-
-	Assert( pEnt );
-
-	if( pEnt == NULL )
-	{
-		return NULL;
-	}
+	Assert( m_Memory.IsValidIndex( index ) );
 
-	return GetEntityMemory( pEnt->entindex() );
+	EntityMemoryBlock_t& block = m_MemoryBlocks[index >> 2];
+	block.x[index & 3] = vecPosition.x;
+	block.y[index & 3] = vecPosition.y;
+	block.z[index & 3] = vecPosition.z;
 }
 
 //-----------------------------------------------------------------------------
-// Purpose:
+// Purpose: Caches the team and relationship of a memory for the queries.
 //-----------------------------------------------------------------------------
-CEntityMemory* CBotMemory::GetEntityMemory( int entindex ) const
+void CBotMemory::ClassifyEntityMemory( int index )
 {
-	int index = m_Memory.Find( entindex );
+	Assert( m_Memory.IsValidIndex( index ) );
 
-	if( !m_Memory.IsValidIndex( index ) )
+	CEntityMemory* memory = m_Memory[index];
+	CBaseEntity* pEntity = memory->GetEntity();
+
+	EntityMemoryBlock_t& block = m_MemoryBlocks[index >> 2];
+
+	if( pEntity == NULL )
 	{
-		return NULL;
+		block.team[index & 3] = TEAM_INVALID;
+		block.enemy[index & 3] = block.friendly[index & 3] = 0;
+		return;
 	}
 
-	return m_Memory.Element( index );
-}
+	bool enemy = memory->IsEnemy();
 
-//-----------------------------------------------------------------------------
-// Purpose:
-//-----------------------------------------------------------------------------
-float CBotMemory::GetMemoryDuration() const
-{
-	return GetProfile()->GetMemoryDuration();
+	block.team[index & 3] = pEntity->GetTeamNumber();
+	block.enemy[index & 3] = enemy ? ~0u : 0;
+	block.friendly[index & 3] = ( !enemy && memory->IsFriend() ) ? ~0u : 0;
 }
 
 //-----------------------------------------------------------------------------
-// Purpose:
+// Purpose: Counts the memories of the given type in [range], four at a time.
+// Optionally returns the closest one of them.
 //-----------------------------------------------------------------------------
-CEntityMemory* CBotMemory::GetClosestThreat( float* distance ) const
+int CBotMemory::ScanEntityMemories( int type, int teamnum, float range, CEntityMemory** closestMemory, float* closestDistance ) const
 {
-	float closest = MAX_TRACE_LENGTH;
-	CEntityMemory* closestMemory = NULL;
+	VPROF_BUDGET( "CBotMemory::ScanEntityMemories", VPROF_BUDGETGROUP_BOTS );
+
+	FourVectors origin;
+	origin.DuplicateVector( GetHost()->GetAbsOrigin() );
+
+	fltx4 rangeSqr = ReplicateX4( range * range );
+	fltx4 team = ReplicateX4( ( float )teamnum );
+
+	int count = 0;
+	float closestSqr = range * range;
+	CEntityMemory* closest = NULL;
 
-	FOR_EACH_MAP_FAST( m_Memory, it )
+	FOR_EACH_VEC( m_MemoryBlocks, b )
 	{
-		CEntityMemory* memory = m_Memory[it];
-		Assert( memory );
+		const EntityMemoryBlock_t& block = m_MemoryBlocks[b];
 
-		if( memory->IsLost() )
+		FourVectors delta;
+		delta.x = LoadAlignedSIMD( block.x );
+		delta.y = LoadAlignedSIMD( block.y );
+		delta.z = LoadAlignedSIMD( block.z );
+		delta -= origin;
+
+		fltx4 distSqr = delta * delta;
+		fltx4 match = CmpLeSIMD( distSqr, rangeSqr );
+
+		switch( type )
 		{
-			continue;
+			case SCAN_ENEMIES:
+				match = AndSIMD( match, LoadAlignedSIMD( block.enemy ) );
+				break;
+
+			case SCAN_FRIENDS:
+				match = AndSIMD( match, LoadAlignedSIMD( block.friendly ) );
+				break;
+
+			case SCAN_TEAM:
+			default:
+				match = AndSIMD( match, CmpEqSIMD( LoadAlignedSIMD( block.team ), team ) );
+				break;
 		}
 
-		if( !memory->IsEnemy() )
+		int mask = TestSignSIMD( match );
+
+		if( !mask )
 		{
 			continue;
 		}
 
-		float distance = memory->GetDistance();
-
-		if( distance < closest )
+		for( int lane = 0; lane < 4; ++lane )
 		{
-			closest = distance;
-			closestMemory = memory;
+			if( !( mask & ( 1 << lane ) ) )
+			{
+				continue;
+			}
+
+			CEntityMemory* memory = m_Memory[b * 4 + lane];
+
+			// Whether it is lost depends on the clock and on the entity itself,
+			// so it is only checked for the few memories that got this far.
+			if( memory->IsLost() )
+			{
+				continue;
+			}
+
+			++count;
+
+			if( SubFloat( distSqr, lane ) < closestSqr )
+			{
+				closestSqr = SubFloat( distSqr, lane );
+				closest = memory;
+			}
 		}
 	}
 
-	if( distance )
+	if( closestMemory )
 	{
-		distance = &closest;
+		*closestMemory = closest;
 	}
 
-	return closestMemory;
+	if( closestDistance )
+	{
+		*closestDistance = ( closest ) ? sqrtf( closestSqr ) : range;
+	}
+
+	return count;
 }
 
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
-int CBotMemory::GetThreatCount( float range ) const
+CEntityMemory* CBotMemory::GetEntityMemory( CBaseEntity* pEnt ) const
 {
-	int count = 0;
-
-	FOR_EACH_MAP_FAST( m_Memory, it )
+	if( pEnt == NULL )
 	{
-		CEntityMemory* memory = m_Memory[it];
-		Assert( memory );
-
-		if( memory->IsLost() )
+		if( GetPrimaryThreat() == NULL )
 		{
-			continue;
+			return NULL;
 		}
 
-		if( !memory->IsEnemy() )
-		{
-			continue;
-		}
+		return GetPrimaryThreat();
+	}
 
-		float distance = memory->GetDistance();
+	int index = GetMemoryIndex( pEnt->GetRefEHandle().GetEntryIndex() );
 
-		if( distance > range )
-		{
-			continue;
-		}
+	if( !m_Memory.IsValidIndex( index ) )
+	{
+		return NULL;
+	}
 
-		++count;
+	CEntityMemory* memory = m_Memory.Element( index );
+
+	// Left behind by a deleted entity that used the same slot
+	if( !memory->Is( pEnt ) )
+	{
+		return NULL;
 	}
 
-	return count;
+	return memory;
 }
 
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
-int CBotMemory::GetThreatCount() const
+CEntityMemory* CBotMemory::GetEntityMemory( int entindex ) const
 {
-	int count = 0;
-
-	FOR_EACH_MAP_FAST( m_Memory, it )
+	if( entindex < 0 || entindex >= NUM_ENT_ENTRIES )
 	{
-		CEntityMemory* memory = m_Memory[it];
-		Assert( memory );
+		return NULL;
+	}
 
-		if( memory->IsLost() )
-		{
-			continue;
-		}
+	int index = GetMemoryIndex( entindex );
 
-		if( !memory->IsEnemy() )
-		{
-			continue;
-		}
+	if( !m_Memory.IsValidIndex( index ) )
+	{
+		return NULL;
+	}
+
+	CEntityMemory* memory = m_Memory.Element( index );
 
-		++count;
+	// Left behind by a deleted entity that used the same slot
+	CBaseEntity* pEnt = UTIL_EntityByIndex( entindex );
+	if( !pEnt || !memory->Is( pEnt ) )
+	{
+		return NULL;
 	}
 
-	return count;
+	return memory;
 }
 
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
-CEntityMemory* CBotMemory::GetClosestFriend( float* distance ) const
+float CBotMemory::GetMemoryDuration() const
 {
-	float closest = MAX_TRACE_LENGTH;
-	CEntityMemory* closestMemory = NULL;
+	return GetProfile()->GetMemoryDuration();
+}
 
-	FOR_EACH_MAP_FAST( m_Memory, it )
-	{
-		CEntityMemory* memory = m_Memory[it];
-		Assert( memory );
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CEntityMemory* CBotMemory::GetClosestThreat( float* distance ) const
+{
+	CEntityMemory* closestMemory = NULL;
+	ScanEntityMemories( SCAN_ENEMIES, TEAM_INVALID, MAX_TRACE_LENGTH, &closestMemory, distance );
+	return closestMemory;
+}
 
-		if( memory->IsLost() )
-		{
-			continue;
-		}
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int CBotMemory::GetThreatCount( float range ) const
+{
+	return ScanEntityMemories( SCAN_ENEMIES, TEAM_INVALID, range );
+}
 
-		if( !memory->IsFriend() )
-		{
-			continue;
-		}
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int CBotMemory::GetThreatCount() const
+{
+	return ScanEntityMemories( SCAN_ENEMIES, TEAM_INVALID, MAX_TRACE_LENGTH );
+}
 
-		float distance = memory->GetDistance();
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CEntityMemory* CBotMemory::GetClosestFriend( float* distance ) const
+{
+	CEntityMemory* closestMemory = NULL;
+	ScanEntityMemories( SCAN_FRIENDS, TEAM_INVALID, MAX_TRACE_LENGTH, &closestMemory, distance );
+	return closestMemory;
+}
 
-		if( distance < closest )
-		{
-			closest = distance;
-			closestMemory = memory;
-		}
-	}
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int CBotMemory::GetFriendCount( float range ) const
+{
+	return ScanEntityMemories( SCAN_FRIENDS, TEAM_INVALID, range );
+}
 
-	if( distance )
-	{
-		distance = &closest;
-	}
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int CBotMemory::GetFriendCount() const
+{
+	return ScanEntityMemories( SCAN_FRIENDS, TEAM_INVALID, MAX_TRACE_LENGTH );
+}
 
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CEntityMemory* CBotMemory::GetClosestKnown( int teamnum, float* distance ) const
+{
+	CEntityMemory* closestMemory = NULL;
+	ScanEntityMemories( SCAN_TEAM, teamnum, MAX_TRACE_LENGTH, &closestMemory, distance );
 	return closestMemory;
 }
 
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
-int CBotMemory::GetFriendCount( float range ) const
+int CBotMemory::GetKnownCount( int teamnum, float range ) const
 {
-	int count = 0;
+	return ScanEntityMemories( SCAN_TEAM, teamnum, range );
+}
 
-	FOR_EACH_MAP_FAST( m_Memory, it )
-	{
-		CEntityMemory* memory = m_Memory[it];
-		Assert( memory );
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+float CBotMemory::GetTimeSinceVisible( int teamnum ) const
+{
+	float closest = -1.0f;
 
-		if( memory->IsLost() )
+	FOR_EACH_VEC( m_Memory, it )
+	{
+		if( m_MemoryBlocks[it >> 2].team[it & 3] != teamnum )
 		{
 			continue;
 		}
 
-		if( !memory->IsFriend() )
+		CEntityMemory* memory = m_Memory[it];
+		Assert( memory );
+
+		if( memory->IsLost() )
 		{
 			continue;
 		}
 
-		float distance = memory->GetDistance();
+		float time = memory->GetTimeLastVisible();
 
-		if( distance > range )
+		if( time > closest )
 		{
-			continue;
+			closest = time;
 		}
-
-		++count;
 	}
 
-	return count;
+	return closest;
 }
 
 //-----------------------------------------------------------------------------
-// Purpose:
+// Purpose: Returns the slot for [key], activating it if it was empty.
 //-----------------------------------------------------------------------------
-int CBotMemory::GetFriendCount() const
+CDataMemory* CBotMemory::AllocDataMemory( BotMemoryKey_t key )
 {
-	int count = 0;
+	Assert( key != INVALID_BOT_MEMORY_KEY );
 
-	FOR_EACH_MAP_FAST( m_Memory, it )
+	if( key >= ( BotMemoryKey_t )m_DataMemory.Count() )
 	{
-		CEntityMemory* memory = m_Memory[it];
-		Assert( memory );
-
-		if( memory->IsLost() )
-		{
-			continue;
-		}
+		m_DataMemory.EnsureCount( key + 1 );
+	}
 
-		if( !memory->IsFriend() )
-		{
-			continue;
-		}
+	DataMemorySlot_t& slot = m_DataMemory[key];
 
-		++count;
+	if( !slot.active )
+	{
+		slot.memory.Reset();
+		slot.active = true;
 	}
 
-	return count;
+	return &slot.memory;
 }
 
 //-----------------------------------------------------------------------------
-// Purpose:
+// Purpose: Makes sure the expiry queue wakes up in time for [key].
 //-----------------------------------------------------------------------------
-CEntityMemory* CBotMemory::GetClosestKnown( int teamnum, float* distance ) const
+void CBotMemory::QueueDataMemoryExpiry( BotMemoryKey_t key )
 {
-	float closest = MAX_TRACE_LENGTH;
-	CEntityMemory* closestMemory = NULL;
+	DataMemorySlot_t& slot = m_DataMemory[key];
+	float expireTime = slot.memory.GetExpireTime();
 
-	FOR_EACH_MAP_FAST( m_Memory, it )
+	if( expireTime < 0.0f )
 	{
-		CEntityMemory* memory = m_Memory[it];
-		Assert( memory );
-
-		if( memory->IsLost() )
-		{
-			continue;
-		}
-
-		if( memory->GetEntity()->GetTeamNumber() != teamnum )
-		{
-			continue;
-		}
-
-		float distance = memory->GetDistance();
-
-		if( distance < closest )
-		{
-			closest = distance;
-			closestMemory = memory;
-		}
+		return;
 	}
 
-	if( distance )
+	// The pending entry fires first and will queue the slot again if it was updated since.
+	if( slot.queuedExpireTime >= 0.0f && slot.queuedExpireTime <= expireTime )
 	{
-		distance = &closest;
+		return;
 	}
 
-	return closestMemory;
+	DataMemoryExpiry_t expiry;
+	expiry.time = expireTime;
+	expiry.key = key;
+
+	m_DataMemoryExpiry.Insert( expiry );
+	slot.queuedExpireTime = expireTime;
 }
 
 //-----------------------------------------------------------------------------
-// Purpose:
+// Purpose: Forgets the data memories whose time is up. Only looks at the
+// head of the expiry queue, not at every memory.
 //-----------------------------------------------------------------------------
-int CBotMemory::GetKnownCount( int teamnum, float range ) const
+void CBotMemory::ForgetExpiredData()
 {
-	int count = 0;
+	float now = gpGlobals->curtime;
 
-	FOR_EACH_MAP_FAST( m_Memory, it )
+	while( m_DataMemoryExpiry.Count() > 0 && m_DataMemoryExpiry.ElementAtHead().time <= now )
 	{
-		CEntityMemory* memory = m_Memory[it];
-		Assert( memory );
+		DataMemoryExpiry_t expiry = m_DataMemoryExpiry.ElementAtHead();
+		m_DataMemoryExpiry.RemoveAtHead();
 
-		if( memory->IsLost() )
+		DataMemorySlot_t& slot = m_DataMemory[expiry.key];
+
+		// Forgotten already, or replaced by an entry that expires sooner.
+		if( !slot.active || slot.queuedExpireTime != expiry.time )
 		{
 			continue;
 		}
 
-		if( memory->GetEntity()->GetTeamNumber() != teamnum )
+		slot.queuedExpireTime = -1.0f;
+
+		float expireTime = slot.memory.GetExpireTime();
+
+		if( expireTime < 0.0f )
 		{
 			continue;
 		}
 
-		float distance = memory->GetDistance();
-
-		if( distance > range )
+		if( expireTime <= now )
 		{
+			ForgetData( expiry.key );
 			continue;
 		}
 
-		++count;
+		// It was updated after being queued.
+		QueueDataMemoryExpiry( expiry.key );
 	}
-
-	return count;
 }
 
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
-float CBotMemory::GetTimeSinceVisible( int teamnum ) const
+CDataMemory* CBotMemory::UpdateDataMemory( BotMemoryKey_t key, const Vector& value, float forgetTime )
 {
-	float closest = -1.0f;
-
-	FOR_EACH_MAP_FAST( m_Memory, it )
-	{
-		CEntityMemory* memory = m_Memory[it];
-		Assert( memory );
+	CDataMemory* memory = AllocDataMemory( key );
+	memory->SetVector( value );
+	memory->ForgetIn( forgetTime );
 
-		if( memory->IsLost() )
-		{
-			continue;
-		}
+	QueueDataMemoryExpiry( key );
+	return memory;
+}
 
-		if( memory->GetEntity()->GetTeamNumber() != teamnum )
-		{
-			continue;
-		}
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CDataMemory* CBotMemory::UpdateDataMemory( BotMemoryKey_t key, float value, float forgetTime )
+{
+	CDataMemory* memory = AllocDataMemory( key );
+	memory->SetFloat( value );
+	memory->ForgetIn( forgetTime );
 
-		float time = memory->GetTimeLastVisible();
+	QueueDataMemoryExpiry( key );
+	return memory;
+}
 
-		if( time > closest )
-		{
-			closest = time;
-		}
-	}
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CDataMemory* CBotMemory::UpdateDataMemory( BotMemoryKey_t key, int value, float forgetTime )
+{
+	CDataMemory* memory = AllocDataMemory( key );
+	memory->SetInt( value );
+	memory->ForgetIn( forgetTime );
 
-	return closest;
+	QueueDataMemoryExpiry( key );
+	return memory;
 }
 
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
-CDataMemory* CBotMemory::UpdateDataMemory( const char* name, const Vector& value, float forgetTime )
+CDataMemory* CBotMemory::UpdateDataMemory( BotMemoryKey_t key, const char* value, float forgetTime )
 {
-	CDataMemory* memory = GetDataMemory( name );
+	CDataMemory* memory = AllocDataMemory( key );
+	memory->SetString( value );
+	memory->ForgetIn( forgetTime );
 
-	if( memory )
-	{
-		memory->SetVector( value );
-	}
-	else
+	QueueDataMemoryExpiry( key );
+	return memory;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CDataMemory* CBotMemory::UpdateDataMemory( BotMemoryKey_t key, CBaseEntity* value, float forgetTime )
+{
+	if( value == NULL || value->IsMarkedForDeletion() )
 	{
-		memory = new CDataMemory( value );
-		m_DataMemory.Insert( AllocPooledString( name ), memory );
+		return NULL;
 	}
 
+	CDataMemory* memory = AllocDataMemory( key );
+	memory->SetEntity( value );
 	memory->ForgetIn( forgetTime );
+
+	QueueDataMemoryExpiry( key );
 	return memory;
 }
 
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
-CDataMemory* CBotMemory::UpdateDataMemory( const char* name, float value, float forgetTime )
+CDataMemory* CBotMemory::AddDataMemoryList( BotMemoryKey_t key, CDataMemory* value, float forgetTime )
 {
-	CDataMemory* memory = GetDataMemory( name );
+	CDataMemory* memory = GetDataMemory( key );
 
-	if( memory )
-	{
-		memory->SetFloat( value );
-	}
-	else
+	if( !memory )
 	{
-		memory = new CDataMemory( value );
-		m_DataMemory.Insert( AllocPooledString( name ), memory );
+		memory = AllocDataMemory( key );
+		memory->ForgetIn( forgetTime );
 	}
 
-	memory->ForgetIn( forgetTime );
+	memory->Add( value );
+
+	QueueDataMemoryExpiry( key );
 	return memory;
 }
 
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
-CDataMemory* CBotMemory::UpdateDataMemory( const char* name, int value, float forgetTime )
+CDataMemory* CBotMemory::RemoveDataMemoryList( BotMemoryKey_t key, CDataMemory* value, float forgetTime )
 {
-	CDataMemory* memory = GetDataMemory( name );
+	CDataMemory* memory = GetDataMemory( key );
 
-	if( memory )
-	{
-		memory->SetInt( value );
-	}
-	else
+	if( !memory )
 	{
-		memory = new CDataMemory( value );
-		m_DataMemory.Insert( AllocPooledString( name ), memory );
+		return NULL;
 	}
 
-	memory->ForgetIn( forgetTime );
+	memory->Remove( value );
 	return memory;
 }
 
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
-CDataMemory* CBotMemory::UpdateDataMemory( const char* name, const char* value, float forgetTime )
+CDataMemory* CBotMemory::GetDataMemory( BotMemoryKey_t key, bool forceIfNotExists ) const
 {
-	CDataMemory* memory = GetDataMemory( name );
-
-	if( memory )
+	if( key < ( BotMemoryKey_t )m_DataMemory.Count() && m_DataMemory[key].active )
 	{
-		memory->SetString( value );
+		return const_cast<CDataMemory*>( &m_DataMemory[key].memory );
 	}
-	else
+
+	if( !forceIfNotExists )
 	{
-		memory = new CDataMemory( value );
-		m_DataMemory.Insert( AllocPooledString( name ), memory );
+		return NULL;
 	}
 
-	memory->ForgetIn( forgetTime );
-	return memory;
+	// Only read through the GetDataMemory* macros, so everyone can share one blank memory.
+	static CDataMemory s_EmptyMemory;
+	s_EmptyMemory.Reset();
+	return &s_EmptyMemory;
 }
 
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
-CDataMemory* CBotMemory::UpdateDataMemory( const char* name, CBaseEntity* value, float forgetTime )
+void CBotMemory::ForgetData( BotMemoryKey_t key )
 {
-	if( value == NULL || value->IsMarkedForDeletion() )
+	if( key >= ( BotMemoryKey_t )m_DataMemory.Count() )
 	{
-		return NULL;
+		return;
 	}
 
-	CDataMemory* memory = GetDataMemory( name );
+	DataMemorySlot_t& slot = m_DataMemory[key];
 
-	if( memory )
+	if( !slot.active )
 	{
-		memory->SetEntity( value );
-	}
-	else
-	{
-		memory = new CDataMemory( value );
-		m_DataMemory.Insert( AllocPooledString( name ), memory );
+		return;
 	}
 
-	memory->ForgetIn( forgetTime );
-	return memory;
+	slot.memory.Reset();
+	slot.active = false;
+	slot.queuedExpireTime = -1.0f;
 }
 
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
-CDataMemory* CBotMemory::AddDataMemoryList( const char* name, CDataMemory* value, float forgetTime )
+CDataMemory* CBotMemory::UpdateDataMemory( const char* name, const Vector& value, float forgetTime )
 {
-	CDataMemory* memory = GetDataMemory( name );
+	return UpdateDataMemory( AllocBotMemoryKey( name ), value, forgetTime );
+}
 
-	if( !memory )
-	{
-		memory = new CDataMemory();
-		memory->ForgetIn( forgetTime );
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CDataMemory* CBotMemory::UpdateDataMemory( const char* name, float value, float forgetTime )
+{
+	return UpdateDataMemory( AllocBotMemoryKey( name ), value, forgetTime );
+}
 
-		m_DataMemory.Insert( AllocPooledString( name ), memory );
-	}
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CDataMemory* CBotMemory::UpdateDataMemory( const char* name, int value, float forgetTime )
+{
+	return UpdateDataMemory( AllocBotMemoryKey( name ), value, forgetTime );
+}
 
-	memory->Add( value );
-	return memory;
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CDataMemory* CBotMemory::UpdateDataMemory( const char* name, const char* value, float forgetTime )
+{
+	return UpdateDataMemory( AllocBotMemoryKey( name ), value, forgetTime );
 }
 
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
-CDataMemory* CBotMemory::RemoveDataMemoryList( const char* name, CDataMemory* value, float forgetTime )
+CDataMemory* CBotMemory::UpdateDataMemory( const char* name, CBaseEntity* value, float forgetTime )
 {
-	CDataMemory* memory = GetDataMemory( name );
+	return UpdateDataMemory( AllocBotMemoryKey( name ), value, forgetTime );
+}
 
-	if( !memory )
-	{
-		return NULL;
-	}
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CDataMemory* CBotMemory::AddDataMemoryList( const char* name, CDataMemory* value, float forgetTime )
+{
+	return AddDataMemoryList( AllocBotMemoryKey( name ), value, forgetTime );
+}
 
-	memory->Remove( value );
-	return memory;
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CDataMemory* CBotMemory::RemoveDataMemoryList( const char* name, CDataMemory* value, float forgetTime )
+{
+	return RemoveDataMemoryList( FindBotMemoryKey( name ), value, forgetTime );
 }
 
 //-----------------------------------------------------------------------------
@@ -900,22 +1113,7 @@ CDataMemory* CBotMemory::RemoveDataMemoryList( const char* name, CDataMemory* va
 //-----------------------------------------------------------------------------
 CDataMemory* CBotMemory::GetDataMemory( const char* name, bool forceIfNotExists ) const
 {
-	string_t szName = AllocPooledString( name );
-	int index = m_DataMemory.Find( szName );
-
-	if( !m_DataMemory.IsValidIndex( index ) )
-	{
-		if( forceIfNotExists )
-		{
-			return new CDataMemory();
-		}
-		else
-		{
-			return NULL;
-		}
-	}
-
-	return m_DataMemory.Element( index );
+	return GetDataMemory( FindBotMemoryKey( name ), forceIfNotExists );
 }
 
 //-----------------------------------------------------------------------------
@@ -923,8 +1121,7 @@ CDataMemory* CBotMemory::GetDataMemory( const char* name, bool forceIfNotExists
 //-----------------------------------------------------------------------------
 void CBotMemory::ForgetData( const char* name )
 {
-	string_t szName = AllocPooledString( name );
-	m_DataMemory.Remove( szName );
+	ForgetData( FindBotMemoryKey( name ) );
 }
 
 //-----------------------------------------------------------------------------
@@ -932,5 +1129,10 @@ void CBotMemory::ForgetData( const char* name )
 //-----------------------------------------------------------------------------
 void CBotMemory::ForgetAllData()
 {
-	m_DataMemory.Purge();
-}
\ No newline at end of file
+	FOR_EACH_VEC( m_DataMemory, key )
+	{
+		ForgetData( ( BotMemoryKey_t )key );
+	}
+
+	m_DataMemoryExpiry.RemoveAll();
+}
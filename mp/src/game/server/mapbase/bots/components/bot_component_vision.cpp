@@ -429,7 +429,7 @@ void CBotVision::LookAround()
 {
 	if( GetMemory() )
 	{
-		int blocked = GetDataMemoryInt( "BlockLookAround" );
+		int blocked = GetDataMemoryInt( MEMORY_KEY_BLOCK_LOOK_AROUND );
 
 		if( blocked == 1 )
 		{
@@ -205,9 +205,9 @@ public:
 
 	CBotMemory( IBot* bot ) : BaseClass( bot )
 	{
-		UpdateDataMemory( "NearbyThreats", 0 );
-		UpdateDataMemory( "NearbyFriends", 0 );
-		UpdateDataMemory( "NearbyDangerousThreats", 0 );
+		UpdateDataMemory( MEMORY_KEY_NEARBY_THREATS, 0 );
+		UpdateDataMemory( MEMORY_KEY_NEARBY_FRIENDS, 0 );
+		UpdateDataMemory( MEMORY_KEY_NEARBY_DANGEROUS_THREATS, 0 );
 	}
 
 	virtual void Update();
@@ -246,6 +246,19 @@ public:
 
 	virtual float GetTimeSinceVisible( int teamnum ) const;
 
+protected:
+	enum
+	{
+		SCAN_ENEMIES = 0,
+		SCAN_FRIENDS,
+		SCAN_TEAM
+	};
+
+	virtual int ScanEntityMemories( int type, int teamnum, float range, CEntityMemory** closestMemory = NULL, float* closestDistance = NULL ) const;
+
+	virtual void SetMemoryBlockPosition( int index, const Vector& vecPosition );
+	virtual void ClassifyEntityMemory( int index );
+
 public:
 	virtual CDataMemory* UpdateDataMemory( const char* name, const Vector& value, float forgetTime = -1.0f );
 	virtual CDataMemory* UpdateDataMemory( const char* name, float value, float forgetTime = -1.0f );
@@ -260,6 +273,24 @@ public:
 
 	virtual void ForgetData( const char* name );
 	virtual void ForgetAllData();
+
+	virtual CDataMemory* UpdateDataMemory( BotMemoryKey_t key, const Vector& value, float forgetTime = -1.0f );
+	virtual CDataMemory* UpdateDataMemory( BotMemoryKey_t key, float value, float forgetTime = -1.0f );
+	virtual CDataMemory* UpdateDataMemory( BotMemoryKey_t key, int value, float forgetTime = -1.0f );
+	virtual CDataMemory* UpdateDataMemory( BotMemoryKey_t key, const char* value, float forgetTime = -1.0f );
+	virtual CDataMemory* UpdateDataMemory( BotMemoryKey_t key, CBaseEntity* value, float forgetTime = -1.0f );
+
+	virtual CDataMemory* AddDataMemoryList( BotMemoryKey_t key, CDataMemory* value, float forgetTime = -1.0f );
+	virtual CDataMemory* RemoveDataMemoryList( BotMemoryKey_t key, CDataMemory* value, float forgetTime = -1.0f );
+
+	virtual CDataMemory* GetDataMemory( BotMemoryKey_t key, bool forceIfNotExists = false ) const;
+
+	virtual void ForgetData( BotMemoryKey_t key );
+
+protected:
+	virtual CDataMemory* AllocDataMemory( BotMemoryKey_t key );
+	virtual void QueueDataMemoryExpiry( BotMemoryKey_t key );
+	virtual void ForgetExpiredData();
 };
 
 //================================================================================
@@ -52,6 +52,8 @@ public:
 
 		m_pProfile = new CBotProfile();
 		m_iPerformance = BOT_PERFORMANCE_AWAKE;
+		m_iThinkLOD = BOT_LOD_HIGH;
+		m_iThinkCount = 0;
 		m_pParent = parent;
 	}
 
@@ -69,6 +71,17 @@ public:
 		m_iPerformance = value;
 	}
 
+	virtual BotThinkLOD GetThinkLOD() const
+	{
+		return m_iThinkLOD;
+	}
+
+	// Set by the bot scheduler every tick
+	virtual void SetThinkLOD( BotThinkLOD value )
+	{
+		m_iThinkLOD = value;
+	}
+
 	virtual CUserCmd * GetUserCommand()
 	{
 		return m_cmd;
@@ -127,6 +140,7 @@ public:
 	virtual void PlayerMove( CUserCmd * cmd ) = 0;
 
 	virtual bool CanRunAI() = 0;
+	virtual bool IsAITurn() = 0;
 	virtual void Upkeep() = 0;
 	virtual void RunAI() = 0;
 
@@ -228,6 +242,8 @@ protected:
 	CBotProfile* m_pProfile;
 	int m_iTacticalMode;
 	BotPerformance m_iPerformance;
+	BotThinkLOD m_iThinkLOD;
+	int m_iThinkCount;
 	CountdownTimer m_iStateTimer;
 
 	// Components
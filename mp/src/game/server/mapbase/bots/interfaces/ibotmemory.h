@@ -7,9 +7,47 @@
 
 #pragma once
 
+#include "bot_utils.h"
+#include "tier1/utlhashsymbol.h"
+#include "tier1/utlpriorityqueue.h"
+#include "tier1/utlmap.h"
+
 class CEntityMemory;
 class CDataMemory;
 
+//================================================================================
+// Data memory keys
+// Names are interned once into a global table and the resulting id indexes
+// straight into each bot's data memory slots. The keys below are always
+// registered first, in this order, so code can use them without a lookup.
+//================================================================================
+typedef UtlHashSymId_t BotMemoryKey_t;
+
+#define INVALID_BOT_MEMORY_KEY UTL_INVAL_HASHSYMBOL
+
+enum
+{
+	MEMORY_KEY_NEARBY_THREATS = 0,
+	MEMORY_KEY_NEARBY_FRIENDS,
+	MEMORY_KEY_NEARBY_DANGEROUS_THREATS,
+	MEMORY_KEY_BLOCK_LOOK_AROUND,
+	MEMORY_KEY_SPAWN_POSITION,
+	MEMORY_KEY_BEST_WEAPON,
+	MEMORY_KEY_NEXT_SCHEDULE,
+	MEMORY_KEY_SAVED_POSITION,
+	MEMORY_KEY_INVESTIGATE_LOCATION,
+
+	NUM_BUILTIN_MEMORY_KEYS
+};
+
+// Returns the key for [name], registering it if needed.
+extern BotMemoryKey_t AllocBotMemoryKey( const char* name );
+
+// Returns the key for [name] or INVALID_BOT_MEMORY_KEY if nobody has used it yet.
+extern BotMemoryKey_t FindBotMemoryKey( const char* name );
+
+extern const char* GetBotMemoryKeyName( BotMemoryKey_t key );
+
 //================================================================================
 // Useful macros
 //================================================================================
@@ -35,8 +73,13 @@ public:
 
 	IBotMemory( IBot * bot ) : BaseClass( bot )
 	{
-		SetDefLessFunc( m_Memory );
-		SetDefLessFunc( m_DataMemory );
+		m_DataMemoryExpiry.SetLessFunc( DataMemoryExpiryLessFunc );
+		m_MemoryIndex.SetLessFunc( DefLessFunc( int ) );
+	}
+
+	virtual ~IBotMemory()
+	{
+		m_Memory.PurgeAndDeleteElements();
 	}
 
 public:
@@ -91,6 +134,21 @@ public:
 	virtual void ForgetData( const char* name ) = 0;
 	virtual void ForgetAllData() = 0;
 
+	// Same as above but without the name lookup, use these on hot paths.
+	virtual CDataMemory * UpdateDataMemory( BotMemoryKey_t key, const Vector & value, float forgetTime = -1.0f ) = 0;
+	virtual CDataMemory * UpdateDataMemory( BotMemoryKey_t key, float value, float forgetTime = -1.0f ) = 0;
+	virtual CDataMemory * UpdateDataMemory( BotMemoryKey_t key, int value, float forgetTime = -1.0f ) = 0;
+	virtual CDataMemory * UpdateDataMemory( BotMemoryKey_t key, const char* value, float forgetTime = -1.0f ) = 0;
+	virtual CDataMemory * UpdateDataMemory( BotMemoryKey_t key, CBaseEntity * value, float forgetTime = -1.0f ) = 0;
+
+	virtual CDataMemory * AddDataMemoryList( BotMemoryKey_t key, CDataMemory * value, float forgetTime = -1.0f ) = 0;
+	virtual CDataMemory * RemoveDataMemoryList( BotMemoryKey_t key, CDataMemory * value, float forgetTime = -1.0f ) = 0;
+
+	// The returned pointer stays valid until the memory is reset.
+	virtual CDataMemory * GetDataMemory( BotMemoryKey_t key, bool forceIfNotExists = false ) const = 0;
+
+	virtual void ForgetData( BotMemoryKey_t key ) = 0;
+
 public:
 	virtual void Reset()
 	{
@@ -101,8 +159,12 @@ public:
 		m_pIdealThreat = NULL;
 		m_flNearbyDistance = 1000.0;
 
-		m_Memory.Purge();
+		m_Memory.PurgeAndDeleteElements();
+		m_MemoryBlocks.Purge();
+		m_MemoryIndex.Purge();
+
 		m_DataMemory.Purge();
+		m_DataMemoryExpiry.Purge();
 	}
 
 	virtual bool ItsImportant() const {
@@ -152,8 +214,57 @@ protected:
 
 	float m_flNearbyDistance;
 
-	CUtlMap<int, CEntityMemory*> m_Memory;
-	CUtlMap<string_t, CDataMemory*> m_DataMemory;
+	// Returns the m_Memory index of the memory in this entity handle entry, -1 if none
+	int GetMemoryIndex( int entry ) const
+	{
+		unsigned short i = m_MemoryIndex.Find( entry );
+		return ( i != m_MemoryIndex.InvalidIndex() ) ? m_MemoryIndex[i] : -1;
+	}
+
+	// Hot fields of m_Memory, four memories to a block so range and "closest"
+	// queries can test four of them at once. Lane (i & 3) of block (i >> 2)
+	// belongs to m_Memory[i], lanes past the end never pass a range test.
+	struct EntityMemoryBlock_t
+	{
+		float x[4];
+		float y[4];
+		float z[4];
+		float team[4];
+		uint32 enemy[4];	// ~0 if IsEnemy() when the memory was last classified
+		uint32 friendly[4];	// ~0 if IsFriend() when the memory was last classified
+	};
+
+	CUtlVector<CEntityMemory*> m_Memory;
+	CUtlVector< EntityMemoryBlock_t, CUtlMemoryAligned< EntityMemoryBlock_t, 16 > > m_MemoryBlocks;
+	CUtlMap<int, int> m_MemoryIndex;	// entity handle entry -> m_Memory index, only for known entities
+
+	struct DataMemorySlot_t
+	{
+		DataMemorySlot_t() : active( false ), queuedExpireTime( -1.0f )
+		{
+		}
+
+		CDataMemory memory;
+		bool active;
+		float queuedExpireTime;	// time of this slot's pending m_DataMemoryExpiry entry, -1 if none
+	};
+
+	struct DataMemoryExpiry_t
+	{
+		float time;
+		BotMemoryKey_t key;
+	};
+
+	static bool DataMemoryExpiryLessFunc( const DataMemoryExpiry_t& a, const DataMemoryExpiry_t& b )
+	{
+		// Soonest at the head
+		return ( a.time > b.time );
+	}
+
+	// Indexed by BotMemoryKey_t. Block storage so slots never move when a new key grows it,
+	// callers hold on to the CDataMemory pointers (and data memory lists store them).
+	CUtlBlockVector<DataMemorySlot_t> m_DataMemory;
+	CUtlPriorityQueue<DataMemoryExpiry_t> m_DataMemoryExpiry;
 
 	friend class CBot;
 };
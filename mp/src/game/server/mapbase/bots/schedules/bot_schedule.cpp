@@ -92,7 +92,7 @@ void IBotSchedule::Fail( const char* pWhy )
 
 	if( m_iScheduleOnFail != SCHEDULE_NONE )
 	{
-		GetMemory()->UpdateDataMemory( "NextSchedule", m_iScheduleOnFail );
+		GetMemory()->UpdateDataMemory( MEMORY_KEY_NEXT_SCHEDULE, m_iScheduleOnFail );
 	}
 
 	GetBot()->DebugAddMessage( "[%s:%s] Failed: %s", g_BotSchedules[GetID()], GetActiveTaskName(), pWhy );
@@ -187,12 +187,12 @@ float IBotSchedule::GetInternalDesire()
 
 		if( GetMemory() )
 		{
-			int nextSchedule = GetDataMemoryInt( "NextSchedule" );
+			int nextSchedule = GetDataMemoryInt( MEMORY_KEY_NEXT_SCHEDULE );
 
 			// Another schedule has asked to activate this
 			if( GetID() == nextSchedule )
 			{
-				GetMemory()->ForgetData( "NextSchedule" );
+				GetMemory()->ForgetData( MEMORY_KEY_NEXT_SCHEDULE );
 
 				m_flLastDesire = BOT_DESIRE_FORCED;
 				return m_flLastDesire;
@@ -246,7 +246,7 @@ bool IBotSchedule::SavePosition( const Vector& position, float duration )
 		return false;
 	}
 
-	GetMemory()->UpdateDataMemory( "SavedPosition", position, duration );
+	GetMemory()->UpdateDataMemory( MEMORY_KEY_SAVED_POSITION, position, duration );
 	return true;
 }
 
@@ -263,7 +263,7 @@ const Vector& IBotSchedule::GetSavedPosition()
 		return vec3_invalid;
 	}
 
-	return GetDataMemoryVector( "SavedPosition" );
+	return GetDataMemoryVector( MEMORY_KEY_SAVED_POSITION );
 }
 
 //-----------------------------------------------------------------------------
@@ -377,7 +377,7 @@ void IBotSchedule::TaskStart()
 				return;
 			}
 
-			SavePosition( GetDataMemoryVector( "SpawnPosition" ) );
+			SavePosition( GetDataMemoryVector( MEMORY_KEY_SPAWN_POSITION ) );
 			break;
 		}
 
@@ -640,7 +640,7 @@ void IBotSchedule::TaskStart()
 				return;
 			}
 
-			GetMemory()->UpdateDataMemory( "NextSchedule", pTask->iValue );
+			GetMemory()->UpdateDataMemory( MEMORY_KEY_NEXT_SCHEDULE, pTask->iValue );
 
 			TaskComplete();
 			break;
@@ -893,7 +893,7 @@ void IBotSchedule::TaskRun()
 			{
 				if( GetMemory() )
 				{
-					GetMemory()->UpdateDataMemory( "BlockLookAround", 1, 5.0f );
+					GetMemory()->UpdateDataMemory( MEMORY_KEY_BLOCK_LOOK_AROUND, 1, 5.0f );
 				}
 
 				TaskComplete();
@@ -16,7 +16,7 @@
 //-----------------------------------------------------------------------------
 SET_SCHEDULE_TASKS( CChangeWeaponSchedule )
 {
-	CDataMemory* memory = GetMemory()->GetDataMemory( "BestWeapon" );
+	CDataMemory* memory = GetMemory()->GetDataMemory( MEMORY_KEY_BEST_WEAPON );
 	Assert( memory );
 
 	ADD_TASK( BTASK_SAVE_POSITION, NULL );
@@ -53,7 +53,7 @@ float CChangeWeaponSchedule::GetDesire() const
 		return BOT_DESIRE_NONE;
 	}
 
-	CDataMemory* memory = GetMemory()->GetDataMemory( "BestWeapon" );
+	CDataMemory* memory = GetMemory()->GetDataMemory( MEMORY_KEY_BEST_WEAPON );
 
 	if( memory == NULL )
 	{
@@ -101,7 +101,7 @@ void CChangeWeaponSchedule::TaskStart()
 //-----------------------------------------------------------------------------
 void CChangeWeaponSchedule::TaskRun()
 {
-	CDataMemory* memory = GetMemory()->GetDataMemory( "BestWeapon" );
+	CDataMemory* memory = GetMemory()->GetDataMemory( MEMORY_KEY_BEST_WEAPON );
 
 	if( !memory )
 	{
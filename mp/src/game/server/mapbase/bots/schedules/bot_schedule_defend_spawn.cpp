@@ -51,7 +51,7 @@ float CDefendSpawnSchedule::GetDesire() const
 		return BOT_DESIRE_NONE;
 	}
 
-	CDataMemory* memory = GetMemory()->GetDataMemory( "SpawnPosition" );
+	CDataMemory* memory = GetMemory()->GetDataMemory( MEMORY_KEY_SPAWN_POSITION );
 
 	if( memory == NULL )
 	{
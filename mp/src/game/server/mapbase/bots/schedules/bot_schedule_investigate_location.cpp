@@ -14,7 +14,7 @@
 //-----------------------------------------------------------------------------
 SET_SCHEDULE_TASKS( CInvestigateLocationSchedule )
 {
-	CDataMemory* memory = GetMemory()->GetDataMemory( "InvestigateLocation" );
+	CDataMemory* memory = GetMemory()->GetDataMemory( MEMORY_KEY_INVESTIGATE_LOCATION );
 	Assert( memory );
 
 	ADD_TASK( BTASK_SAVE_POSITION, NULL );
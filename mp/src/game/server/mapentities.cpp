@@ -18,6 +18,7 @@
 #include "datacache/imdlcache.h"
 #include "world.h"
 #include "toolframework/iserverenginetools.h"
+#include "tier0/fasttimer.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -627,3 +628,154 @@ const char* MapEntity_ParseEntity( CBaseEntity*& pEntity, const char* pEntData,
 }
 
 
+
+//-----------------------------------------------------------------------------
+// symbol_bench: runs every key and value in the current map's entity lump
+// through the symbol tables, the way a map load feeds them.
+//-----------------------------------------------------------------------------
+struct SymbolBenchConcurrent_t
+{
+	CUtlHashSymbolTable*	m_pTable;
+	const CUtlVector< const char* >* m_pStrings;
+	int						m_nCount;		// strings added before the thread started
+	volatile bool			m_bDone;
+	int						m_nMissed;
+};
+
+static unsigned SymbolBenchLookupThread( void* pParam )
+{
+	SymbolBenchConcurrent_t* pBench = ( SymbolBenchConcurrent_t* )pParam;
+	while( !pBench->m_bDone )
+	{
+		for( int i = 0; i < pBench->m_nCount; i++ )
+		{
+			const char* pszString = ( *pBench->m_pStrings )[i];
+			UtlHashSymId_t id = pBench->m_pTable->Find( pszString );
+			if( id == UTL_INVAL_HASHSYMBOL || V_strcmp( pBench->m_pTable->String( id ), pszString ) )
+			{
+				pBench->m_nMissed++;
+			}
+		}
+	}
+	return 0;
+}
+
+template < class T >
+static void SymbolBenchRun( const char* pszName, T& table, const CUtlVector< const char* >& strings, int nPasses )
+{
+	CFastTimer timer;
+	timer.Start();
+	for( int i = 0; i < strings.Count(); i++ )
+	{
+		table.AddString( strings[i] );
+	}
+	timer.End();
+	double flInsert = timer.GetDuration().GetMillisecondsF();
+
+	int nFound = 0;
+	timer.Start();
+	for( int nPass = 0; nPass < nPasses; nPass++ )
+	{
+		for( int i = 0; i < strings.Count(); i++ )
+		{
+			nFound += ( table.Find( strings[i] ) != ( UtlSymId_t )UTL_INVAL_SYMBOL );
+		}
+	}
+	timer.End();
+	double flFind = timer.GetDuration().GetMillisecondsF();
+
+	double flLookups = ( double )strings.Count() * nPasses;
+	Msg( "  %-22s insert %8.3f ms   find %8.3f ms (%6.1f ns/lookup, %d/%d found)\n", pszName, flInsert, flFind,
+		 flLookups > 0 ? flFind * 1e6 / flLookups : 0.0, nFound, ( int )flLookups );
+}
+
+CON_COMMAND( symbol_bench, "Time the symbol tables against the strings in the current map's entity lump. Usage: symbol_bench [passes]" )
+{
+	if( !UTIL_IsCommandIssuedByServerAdmin() )
+	{
+		return;
+	}
+
+	const char* pMapData = engine->GetMapEntitiesString();
+	if( !pMapData || !pMapData[0] )
+	{
+		Msg( "symbol_bench: no map loaded\n" );
+		return;
+	}
+
+	int nPasses = args.ArgC() > 1 ? MAX( atoi( args[1] ), 1 ) : 20;
+
+	// Every key and value token, duplicates included
+	CUtlStringList tokens;
+	CUtlVector< const char* > strings;
+	char szToken[MAPKEY_MAXLENGTH];
+	while( ( pMapData = MapEntity_ParseToken( pMapData, szToken ) ) != NULL )
+	{
+		if( ( szToken[0] == '{' || szToken[0] == '}' ) && !szToken[1] )
+		{
+			continue;
+		}
+
+		tokens.CopyAndAddToTail( szToken );
+		strings.AddToTail( tokens.Tail() );
+	}
+
+	CUtlHashSymbolTable hashTable;
+	Msg( "symbol_bench: %d strings from the entity lump, %d passes\n", strings.Count(), nPasses );
+
+	struct HashTableAdapter_t
+	{
+		CUtlHashSymbolTable* m_pTable;
+		void AddString( const char* pszString )
+		{
+			m_pTable->AddString( pszString );
+		}
+		UtlSymId_t Find( const char* pszString )
+		{
+			UtlHashSymId_t id = m_pTable->Find( pszString );
+			return id == UTL_INVAL_HASHSYMBOL ? UTL_INVAL_SYMBOL : ( UtlSymId_t )id;
+		}
+	} hashAdapter = { &hashTable };
+	SymbolBenchRun( "CUtlHashSymbolTable", hashAdapter, strings, nPasses );
+
+	int nUnique = hashTable.GetNumStrings();
+	Msg( "  %d unique strings, %u bytes in the hash table\n", nUnique, ( unsigned int )hashTable.GetMemoryUsage() );
+
+	if( nUnique < UTL_INVAL_SYMBOL - 1 )
+	{
+		CUtlSymbolTable rbTable;
+		SymbolBenchRun( "CUtlSymbolTable", rbTable, strings, nPasses );
+		CUtlSymbolTableMT rbTableMT;
+		SymbolBenchRun( "CUtlSymbolTableMT", rbTableMT, strings, nPasses );
+	}
+	else
+	{
+		Msg( "  too many unique strings for CUtlSymbolTable, skipping it\n" );
+	}
+
+	// Look up the first half from another thread while this one adds the second half
+	CUtlHashSymbolTable concurrentTable;
+	int nHalf = strings.Count() / 2;
+	for( int i = 0; i < nHalf; i++ )
+	{
+		concurrentTable.AddString( strings[i] );
+	}
+
+	SymbolBenchConcurrent_t bench;
+	bench.m_pTable = &concurrentTable;
+	bench.m_pStrings = &strings;
+	bench.m_nCount = nHalf;
+	bench.m_bDone = false;
+	bench.m_nMissed = 0;
+
+	ThreadHandle_t hThread = CreateSimpleThread( SymbolBenchLookupThread, &bench );
+	for( int i = nHalf; i < strings.Count(); i++ )
+	{
+		concurrentTable.AddString( strings[i] );
+	}
+	bench.m_bDone = true;
+	ThreadJoin( hThread );
+	ReleaseThreadHandle( hThread );
+
+	Msg( "  concurrent lookups while inserting: %s (%d misses)\n", bench.m_nMissed ? "FAILED" : "ok", bench.m_nMissed );
+}
@@ -19,6 +19,9 @@
 #endif
 
 #include "tier1/lzmaDecoder.h"
+#include "checksum_crc.h"
+#include "vstdlib/random.h"
+#include "nav_pathfind.h"
 
 #ifdef CSTRIKE_DLL
 	#include "cs_shareddefs.h"
@@ -182,11 +185,18 @@ PlaceDirectory placeDirectory;
 #if defined( _X360 )
 	#define FORMAT_BSPFILE "maps\\%s.360.bsp"
 	#define FORMAT_NAVFILE "maps\\%s.360.nav"
+	#define FORMAT_NAVBINFILE "maps\\%s.360.navb"
 #else
 	#define FORMAT_BSPFILE "maps\\%s.bsp"
 	#define FORMAT_NAVFILE "maps\\%s.nav"
+	#define FORMAT_NAVBINFILE "maps\\%s.navb"
 #endif
 
+ConVar nav_load_binary( "nav_load_binary", "1", FCVAR_GAMEDLL, "Load the map's .navb instead of its .nav when the .navb is up to date." );
+
+static bool NavBinaryFileExists( void );
+static bool s_navLoadedFromBinary = false;		// true if the last load used the .navb
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Replace extension with "bsp"
@@ -714,6 +724,12 @@ NavErrorType CNavArea::Load( CUtlBuffer& fileBuffer, unsigned int version, unsig
  */
 NavErrorType CNavArea::PostLoad( void )
 {
+	// A .navb already holds everything below, see CNavMesh::LoadBinary()
+	if( s_navLoadedFromBinary )
+	{
+		return NAV_OK;
+	}
+
 	NavErrorType error = NAV_OK;
 
 	for( int dir = 0; dir < CNavLadder::NUM_LADDER_DIRECTIONS; ++dir )
@@ -1145,6 +1161,36 @@ bool CNavMesh::Save( void ) const
 
 	CUtlBuffer fileBuffer( 4096, 1024 * 1024 );
 
+	unsigned int bspSize = filesystem->Size( bspFilename );
+	DevMsg( "Size of bsp file '%s' is %u bytes.\n", bspFilename, bspSize );
+
+	SaveToBuffer( fileBuffer, bspSize );
+
+	if( !filesystem->WriteFile( filename, "MOD", fileBuffer ) )
+	{
+		Warning( "Unable to save %d bytes to %s\n", fileBuffer.Size(), filename );
+		return false;
+	}
+
+	unsigned int navSize = filesystem->Size( filename );
+	DevMsg( "Size of nav file '%s' is %u bytes.\n", filename, navSize );
+
+	// keep an existing .navb in step with the .nav
+	if( NavBinaryFileExists() )
+	{
+		SaveBinary();
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Write the mesh in .nav format
+ */
+void CNavMesh::SaveToBuffer( CUtlBuffer& fileBuffer, unsigned int bspSize ) const
+{
 	// store "magic number" to help identify this kind of file
 	unsigned int magic = NAV_MAGIC_NUMBER;
 	fileBuffer.PutUnsignedInt( magic );
@@ -1176,9 +1222,6 @@ bool CNavMesh::Save( void ) const
 
 	// store the size of source bsp file in the nav file
 	// so we can test if the bsp changed since the nav file was made
-	unsigned int bspSize = filesystem->Size( bspFilename );
-	DevMsg( "Size of bsp file '%s' is %u bytes.\n", bspFilename, bspSize );
-
 	fileBuffer.PutUnsignedInt( bspSize );
 
 	// Store the analysis state
@@ -1238,17 +1281,6 @@ bool CNavMesh::Save( void ) const
 	// Store derived class mesh info
 	//
 	SaveCustomData( fileBuffer );
-
-	if( !filesystem->WriteFile( filename, "MOD", fileBuffer ) )
-	{
-		Warning( "Unable to save %d bytes to %s\n", fileBuffer.Size(), filename );
-		return false;
-	}
-
-	unsigned int navSize = filesystem->Size( filename );
-	DevMsg( "Size of nav file '%s' is %u bytes.\n", filename, navSize );
-
-	return true;
 }
 
 
@@ -1454,6 +1486,17 @@ NavErrorType CNavMesh::Load( void )
 	char filename[256];
 	Q_snprintf( filename, sizeof( filename ), FORMAT_NAVFILE, STRING( gpGlobals->mapname ) );
 
+	s_navLoadedFromBinary = false;
+	if( nav_load_binary.GetBool() )
+	{
+		// Once the .navb has been used, a failed PostLoad() can't fall back to the .nav
+		NavErrorType binaryResult = LoadBinary();
+		if( binaryResult == NAV_OK || s_navLoadedFromBinary )
+		{
+			return binaryResult;
+		}
+	}
+
 	bool navIsInBsp = false;
 	CUtlBuffer fileBuffer( 4096, 1024 * 1024, CUtlBuffer::READ_ONLY );
 	if( !filesystem->ReadFile( filename, "MOD", fileBuffer ) )	// this ignores .nav files embedded in the .bsp ...
@@ -1673,88 +1716,1080 @@ NavErrorType CNavMesh::PostLoad( unsigned int version )
 		area->PostLoad();
 	}
 
-	// allow hiding spots to compute information
-	FOR_EACH_VEC( TheHidingSpots, hit )
+	// A .navb already holds the rest of the binding, see LoadBinary()
+	if( !s_navLoadedFromBinary )
 	{
-		HidingSpot* spot = TheHidingSpots[ hit ];
-		spot->PostLoad();
+		// allow hiding spots to compute information
+		FOR_EACH_VEC( TheHidingSpots, hit )
+		{
+			HidingSpot* spot = TheHidingSpots[ hit ];
+			spot->PostLoad();
+		}
+
+		if( version < 8 )
+		{
+			// Old nav meshes need to compute earliest occupy times
+			FOR_EACH_VEC( TheNavAreas, nit )
+			{
+				CNavArea* area = TheNavAreas[ nit ];
+				area->ComputeEarliestOccupyTimes();
+			}
+		}
 	}
 
-	if( version < 8 )
+	ComputeBattlefrontAreas();
+
+	if( !s_navLoadedFromBinary )
 	{
-		// Old nav meshes need to compute earliest occupy times
-		FOR_EACH_VEC( TheNavAreas, nit )
+		//
+		// Allow each nav area to know what other areas have one-way connections to it. Need to gather
+		// then sort due to allocation restrictions on the 360
+		//
+
+
+		OneWayLink_t oneWayLink;
+		CUtlVectorFixedGrowable<OneWayLink_t, 512> oneWayLinks;
+
+		FOR_EACH_VEC( TheNavAreas, oit )
 		{
-			CNavArea* area = TheNavAreas[ nit ];
-			area->ComputeEarliestOccupyTimes();
+			oneWayLink.area = TheNavAreas[ oit ];
+
+			for( int d = 0; d < NUM_DIRECTIONS; d++ )
+			{
+				const NavConnectVector* connectList = oneWayLink.area->GetAdjacentAreas( ( NavDirType )d );
+
+				FOR_EACH_VEC( ( *connectList ), it )
+				{
+					NavConnect connect = ( *connectList )[ it ];
+					oneWayLink.destArea = connect.area;
+
+					// if the area we connect to has no connection back to us, allow that area to remember us as an incoming connection
+					oneWayLink.backD = OppositeDirection( ( NavDirType )d );
+					const NavConnectVector* backConnectList = oneWayLink.destArea->GetAdjacentAreas( ( NavDirType )oneWayLink.backD );
+					bool isOneWay = true;
+					FOR_EACH_VEC( ( *backConnectList ), bit )
+					{
+						NavConnect backConnect = ( *backConnectList )[ bit ];
+						if( backConnect.area->GetID() == oneWayLink.area->GetID() )
+						{
+							isOneWay = false;
+							break;
+						}
+					}
+
+					if( isOneWay )
+					{
+						oneWayLinks.AddToTail( oneWayLink );
+					}
+				}
+			}
 		}
+
+		oneWayLinks.Sort( &OneWayLink_t::Compare );
+
+		for( int i = 0; i < oneWayLinks.Count(); i++ )
+		{
+			// add this one-way connection
+			oneWayLinks[i].destArea->AddIncomingConnection( oneWayLinks[i].area, ( NavDirType )oneWayLinks[i].backD );
+		}
+
+		ValidateNavAreaConnections();
 	}
 
-	ComputeBattlefrontAreas();
+	// TERROR: loading into a map directly creates entities before the mesh is loaded.  Tell the preexisting
+	// entities now that the mesh is loaded so they can update areas.
+	for( int i = 0; i < m_avoidanceObstacles.Count(); ++i )
+	{
+		m_avoidanceObstacles[i]->OnNavMeshLoaded();
+	}
 
-	//
-	// Allow each nav area to know what other areas have one-way connections to it. Need to gather
-	// then sort due to allocation restrictions on the 360
-	//
+	// the Navigation Mesh has been successfully loaded
+	m_isLoaded = true;
+
+	return NAV_OK;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------------
+//
+// Binary nav files (.navb)
+//
+// A .navb holds the same mesh as the .nav, as it is after loading: flat arrays of fixed-size records that
+// refer to each other by array index rather than by ID, plus what PostLoad(), CheckWaterLevel() and
+// MarkStairAreas() would otherwise compute (connection lengths, incoming connections, encounter paths,
+// hiding spot areas, underwater and stair flags). Loading one is a single file read, a bounds check of
+// every index, then one pass that fills in the areas. There are no ID lookups, traces or per-field reads.
+//
+// Records are in native byte order. The file only stands in for the .nav and .bsp it was made from, and
+// meshes with derived-class data (a non-zero sub-version) always load the .nav.
+//
+
+/// The current version of the binary nav format
+const unsigned int NavBinaryVersion = 1;
 
+#define NAV_BINARY_MAGIC_NUMBER 0x4256414E	// "NAVB"
 
-	OneWayLink_t oneWayLink;
-	CUtlVectorFixedGrowable<OneWayLink_t, 512> oneWayLinks;
+enum NavBinarySectionType
+{
+	NAV_BINARY_AREAS,
+	NAV_BINARY_CONNECTIONS,				// per area: outgoing in direction order, then incoming
+	NAV_BINARY_LADDER_CONNECTIONS,		// per area: up, then down
+	NAV_BINARY_HIDING_SPOTS,
+	NAV_BINARY_ENCOUNTERS,
+	NAV_BINARY_SPOT_ORDERS,
+	NAV_BINARY_VISIBLE_AREAS,
+	NAV_BINARY_LADDERS,
+	NAV_BINARY_PLACES,					// the place directory in .nav format; count is in bytes
+
+	NUM_NAV_BINARY_SECTIONS
+};
 
-	FOR_EACH_VEC( TheNavAreas, oit )
+struct NavBinaryHeader_t
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int bspSize;				// size of the .bsp the mesh was made for
+	unsigned int navSize;				// size of the .nav it was converted from, 0 if there wasn't one
+	unsigned int isAnalyzed;
+	unsigned int sectionOffset[ NUM_NAV_BINARY_SECTIONS ];
+	unsigned int sectionCount[ NUM_NAV_BINARY_SECTIONS ];
+};
+
+// Fields that may be empty hold an index + 1, with 0 for none
+struct NavBinaryArea_t
+{
+	unsigned int id;
+	int attributeFlags;
+	float nwCorner[3];
+	float seCorner[3];
+	float neZ;
+	float swZ;
+	float earliestOccupyTime[ MAX_NAV_TEAMS ];
+	float lightIntensity[ NUM_CORNERS ];
+	unsigned int place;					// place directory index
+	unsigned int isUnderwater;
+	unsigned int firstConnect;
+	unsigned int connectCount[ NUM_DIRECTIONS ];
+	unsigned int incomingCount[ NUM_DIRECTIONS ];
+	unsigned int firstLadderConnect;
+	unsigned int ladderCount[ CNavLadder::NUM_LADDER_DIRECTIONS ];
+	unsigned int firstHidingSpot;
+	unsigned int hidingSpotCount;
+	unsigned int firstEncounter;
+	unsigned int encounterCount;
+	unsigned int firstVisibleArea;
+	unsigned int visibleAreaCount;
+	unsigned int inheritVisibilityFrom;	// area index + 1
+};
+
+struct NavBinaryConnect_t
+{
+	unsigned int area;
+	float length;
+};
+
+struct NavBinaryHidingSpot_t
+{
+	unsigned int id;
+	float pos[3];
+	unsigned int flags;
+	unsigned int area;					// area index + 1
+};
+
+struct NavBinaryEncounter_t
+{
+	unsigned int from;					// area index + 1
+	unsigned int fromDir;
+	unsigned int to;					// area index + 1
+	unsigned int toDir;
+	float pathFrom[3];
+	float pathTo[3];
+	unsigned int firstSpotOrder;
+	unsigned int spotOrderCount;
+};
+
+struct NavBinarySpotOrder_t
+{
+	unsigned int spot;					// hiding spot index + 1
+	float t;
+};
+
+struct NavBinaryVisibleArea_t
+{
+	unsigned int area;
+	unsigned int attributes;
+};
+
+enum { NAV_BINARY_LADDER_AREAS = 5 };	// top forward, left, right, behind, then bottom
+
+struct NavBinaryLadder_t
+{
+	unsigned int id;
+	float width;
+	float top[3];
+	float bottom[3];
+	float length;
+	unsigned int dir;
+	float normal[3];
+	unsigned int area[ NAV_BINARY_LADDER_AREAS ];	// area index + 1
+};
+
+static const unsigned int s_navBinaryRecordSize[ NUM_NAV_BINARY_SECTIONS ] =
+{
+	sizeof( NavBinaryArea_t ),
+	sizeof( NavBinaryConnect_t ),
+	sizeof( unsigned int ),
+	sizeof( NavBinaryHidingSpot_t ),
+	sizeof( NavBinaryEncounter_t ),
+	sizeof( NavBinarySpotOrder_t ),
+	sizeof( NavBinaryVisibleArea_t ),
+	sizeof( NavBinaryLadder_t ),
+	1,
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+static void GetNavBinaryFilename( char* filename, int maxLen )
+{
+	Q_snprintf( filename, maxLen, FORMAT_NAVBINFILE, STRING( gpGlobals->mapname ) );
+}
+
+static bool NavBinaryFileExists( void )
+{
+	char filename[256];
+	GetNavBinaryFilename( filename, sizeof( filename ) );
+	return filesystem->FileExists( filename, "MOD" );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Maps areas, ladders and hiding spots to their record index while saving
+ */
+class CNavBinaryIndexMap
+{
+public:
+	CNavBinaryIndexMap() : m_map( DefLessFunc( const void* ) ) { }
+
+	void Add( const void* p )
+	{
+		m_map.Insert( p, m_map.Count() );
+	}
+
+	// index, or -1 if p isn't in the map
+	int Find( const void* p ) const
+	{
+		unsigned short i = m_map.Find( p );
+		return m_map.IsValidIndex( i ) ? m_map[i] : -1;
+	}
+
+	// index + 1, or 0 for NULL or anything not in the map
+	unsigned int FindOptional( const void* p ) const
+	{
+		return p ? Find( p ) + 1 : 0;
+	}
+
+private:
+	CUtlMap< const void*, int > m_map;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Store the loaded mesh as a .navb
+ */
+bool CNavMesh::SaveBinary( void ) const
+{
+	if( GetSubVersionNumber() != 0 )
 	{
-		oneWayLink.area = TheNavAreas[ oit ];
+		Warning( "This Navigation Mesh has custom data that can't be stored in a .navb.\n" );
+		return false;
+	}
 
-		for( int d = 0; d < NUM_DIRECTIONS; d++ )
+	CNavBinaryIndexMap areaIndex, ladderIndex, spotIndex;
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		areaIndex.Add( TheNavAreas[ it ] );
+	}
+
+	FOR_EACH_VEC( m_ladders, it )
+	{
+		ladderIndex.Add( m_ladders[ it ] );
+	}
+
+	// hiding spots are stored with the area that holds them, in the same order the .nav loads them
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		const HidingSpotVector* spots = TheNavAreas[ it ]->GetHidingSpots();
+		FOR_EACH_VEC( ( *spots ), sit )
 		{
-			const NavConnectVector* connectList = oneWayLink.area->GetAdjacentAreas( ( NavDirType )d );
+			spotIndex.Add( ( *spots )[ sit ] );
+		}
+	}
+
+	placeDirectory.Reset();
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		placeDirectory.AddPlace( TheNavAreas[ it ]->GetPlace() );
+	}
+
+	CUtlVector< NavBinaryArea_t > areas;
+	CUtlVector< NavBinaryConnect_t > connections;
+	CUtlVector< unsigned int > ladderConnections;
+	CUtlVector< NavBinaryHidingSpot_t > hidingSpots;
+	CUtlVector< NavBinaryEncounter_t > encounters;
+	CUtlVector< NavBinarySpotOrder_t > spotOrders;
+	CUtlVector< NavBinaryVisibleArea_t > visibleAreas;
+	CUtlVector< NavBinaryLadder_t > ladders;
+
+	areas.SetCount( TheNavAreas.Count() );
+	V_memset( areas.Base(), 0, areas.Count() * sizeof( NavBinaryArea_t ) );
 
-			FOR_EACH_VEC( ( *connectList ), it )
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		const CNavArea* area = TheNavAreas[ it ];
+		NavBinaryArea_t& out = areas[ it ];
+
+		out.id = area->m_id;
+		out.attributeFlags = area->m_attributeFlags;
+		area->m_nwCorner.CopyToArray( out.nwCorner );
+		area->m_seCorner.CopyToArray( out.seCorner );
+		out.neZ = area->m_neZ;
+		out.swZ = area->m_swZ;
+
+		for( int i = 0; i < MAX_NAV_TEAMS; ++i )
+		{
+			out.earliestOccupyTime[i] = area->m_earliestOccupyTime[i];
+		}
+
+		for( int i = 0; i < NUM_CORNERS; ++i )
+		{
+			out.lightIntensity[i] = area->m_lightIntensity[i];
+		}
+
+		out.place = placeDirectory.GetIndex( area->GetPlace() );
+		out.isUnderwater = area->m_isUnderwater;
+
+		out.firstConnect = connections.Count();
+		for( int pass = 0; pass < 2; ++pass )
+		{
+			for( int d = 0; d < NUM_DIRECTIONS; d++ )
 			{
-				NavConnect connect = ( *connectList )[ it ];
-				oneWayLink.destArea = connect.area;
-
-				// if the area we connect to has no connection back to us, allow that area to remember us as an incoming connection
-				oneWayLink.backD = OppositeDirection( ( NavDirType )d );
-				const NavConnectVector* backConnectList = oneWayLink.destArea->GetAdjacentAreas( ( NavDirType )oneWayLink.backD );
-				bool isOneWay = true;
-				FOR_EACH_VEC( ( *backConnectList ), bit )
+				const NavConnectVector& connectList = pass ? area->m_incomingConnect[d] : area->m_connect[d];
+				( pass ? out.incomingCount : out.connectCount )[d] = connectList.Count();
+
+				FOR_EACH_VEC( connectList, cit )
 				{
-					NavConnect backConnect = ( *backConnectList )[ bit ];
-					if( backConnect.area->GetID() == oneWayLink.area->GetID() )
+					NavBinaryConnect_t connect;
+					connect.area = areaIndex.Find( connectList[ cit ].area );
+					connect.length = connectList[ cit ].length;
+					if( connect.area == ( unsigned int ) - 1 )
 					{
-						isOneWay = false;
-						break;
+						Warning( "NavArea #%d is connected to an area that isn't in the mesh, can't save a .navb.\n", area->GetID() );
+						return false;
 					}
+					connections.AddToTail( connect );
 				}
+			}
+		}
 
-				if( isOneWay )
+		out.firstLadderConnect = ladderConnections.Count();
+		for( int dir = 0; dir < CNavLadder::NUM_LADDER_DIRECTIONS; ++dir )
+		{
+			out.ladderCount[dir] = area->m_ladder[dir].Count();
+			FOR_EACH_VEC( area->m_ladder[dir], lit )
+			{
+				int ladder = ladderIndex.Find( area->m_ladder[dir][ lit ].ladder );
+				if( ladder < 0 )
 				{
-					oneWayLinks.AddToTail( oneWayLink );
+					Warning( "NavArea #%d is connected to a ladder that isn't in the mesh, can't save a .navb.\n", area->GetID() );
+					return false;
 				}
+				ladderConnections.AddToTail( ladder );
 			}
 		}
+
+		out.firstHidingSpot = hidingSpots.Count();
+		out.hidingSpotCount = area->m_hidingSpots.Count();
+		FOR_EACH_VEC( area->m_hidingSpots, sit )
+		{
+			const HidingSpot* spot = area->m_hidingSpots[ sit ];
+
+			NavBinaryHidingSpot_t& spotOut = hidingSpots[ hidingSpots.AddToTail() ];
+			spotOut.id = spot->m_id;
+			spot->m_pos.CopyToArray( spotOut.pos );
+			spotOut.flags = spot->m_flags;
+			spotOut.area = areaIndex.FindOptional( spot->m_area );
+		}
+
+		out.firstEncounter = encounters.Count();
+		out.encounterCount = area->m_spotEncounters.Count();
+		FOR_EACH_VEC( area->m_spotEncounters, eit )
+		{
+			const SpotEncounter* e = area->m_spotEncounters[ eit ];
+
+			NavBinaryEncounter_t& encounterOut = encounters[ encounters.AddToTail() ];
+			encounterOut.from = areaIndex.FindOptional( e->from.area );
+			encounterOut.fromDir = e->fromDir;
+			encounterOut.to = areaIndex.FindOptional( e->to.area );
+			encounterOut.toDir = e->toDir;
+			e->path.from.CopyToArray( encounterOut.pathFrom );
+			e->path.to.CopyToArray( encounterOut.pathTo );
+			encounterOut.firstSpotOrder = spotOrders.Count();
+			encounterOut.spotOrderCount = e->spots.Count();
+
+			FOR_EACH_VEC( e->spots, oit )
+			{
+				NavBinarySpotOrder_t order;
+				order.spot = spotIndex.FindOptional( e->spots[ oit ].spot );
+				order.t = e->spots[ oit ].t;
+				spotOrders.AddToTail( order );
+			}
+		}
+
+		out.firstVisibleArea = visibleAreas.Count();
+		for( int vit = 0; vit < area->m_potentiallyVisibleAreas.Count(); ++vit )
+		{
+			const CNavArea::AreaBindInfo& info = area->m_potentiallyVisibleAreas[ vit ];
+
+			// PostLoad drops visible areas that aren't in the mesh, so do the same
+			int visibleArea = areaIndex.Find( info.area );
+			if( visibleArea >= 0 )
+			{
+				NavBinaryVisibleArea_t visibleOut;
+				visibleOut.area = visibleArea;
+				visibleOut.attributes = info.attributes;
+				visibleAreas.AddToTail( visibleOut );
+			}
+		}
+		out.visibleAreaCount = visibleAreas.Count() - out.firstVisibleArea;
+
+		out.inheritVisibilityFrom = areaIndex.FindOptional( area->m_inheritVisibilityFrom.area );
+	}
+
+	FOR_EACH_VEC( m_ladders, it )
+	{
+		const CNavLadder* ladder = m_ladders[ it ];
+
+		NavBinaryLadder_t& out = ladders[ ladders.AddToTail() ];
+		out.id = ladder->m_id;
+		out.width = ladder->m_width;
+		ladder->m_top.CopyToArray( out.top );
+		ladder->m_bottom.CopyToArray( out.bottom );
+		out.length = ladder->m_length;
+		out.dir = ladder->m_dir;
+		ladder->m_normal.CopyToArray( out.normal );
+		out.area[0] = areaIndex.FindOptional( ladder->m_topForwardArea );
+		out.area[1] = areaIndex.FindOptional( ladder->m_topLeftArea );
+		out.area[2] = areaIndex.FindOptional( ladder->m_topRightArea );
+		out.area[3] = areaIndex.FindOptional( ladder->m_topBehindArea );
+		out.area[4] = areaIndex.FindOptional( ladder->m_bottomArea );
 	}
 
-	oneWayLinks.Sort( &OneWayLink_t::Compare );
+	CUtlBuffer places;
+	placeDirectory.Save( places );
 
-	for( int i = 0; i < oneWayLinks.Count(); i++ )
+	//
+	// Lay the sections out after the header
+	//
+	const void* sectionData[ NUM_NAV_BINARY_SECTIONS ] =
+	{
+		areas.Base(), connections.Base(), ladderConnections.Base(), hidingSpots.Base(),
+		encounters.Base(), spotOrders.Base(), visibleAreas.Base(), ladders.Base(), places.Base(),
+	};
+
+	NavBinaryHeader_t header;
+	V_memset( &header, 0, sizeof( header ) );
+	header.magic = NAV_BINARY_MAGIC_NUMBER;
+	header.version = NavBinaryVersion;
+	header.isAnalyzed = m_isAnalyzed;
+	header.sectionCount[ NAV_BINARY_AREAS ] = areas.Count();
+	header.sectionCount[ NAV_BINARY_CONNECTIONS ] = connections.Count();
+	header.sectionCount[ NAV_BINARY_LADDER_CONNECTIONS ] = ladderConnections.Count();
+	header.sectionCount[ NAV_BINARY_HIDING_SPOTS ] = hidingSpots.Count();
+	header.sectionCount[ NAV_BINARY_ENCOUNTERS ] = encounters.Count();
+	header.sectionCount[ NAV_BINARY_SPOT_ORDERS ] = spotOrders.Count();
+	header.sectionCount[ NAV_BINARY_VISIBLE_AREAS ] = visibleAreas.Count();
+	header.sectionCount[ NAV_BINARY_LADDERS ] = ladders.Count();
+	header.sectionCount[ NAV_BINARY_PLACES ] = places.TellPut();
+
+	unsigned int offset = sizeof( header );
+	for( int i = 0; i < NUM_NAV_BINARY_SECTIONS; ++i )
+	{
+		offset = AlignValue( offset, 16 );
+		header.sectionOffset[i] = offset;
+		offset += header.sectionCount[i] * s_navBinaryRecordSize[i];
+	}
+
+	char navFilename[256];
+	Q_snprintf( navFilename, sizeof( navFilename ), FORMAT_NAVFILE, STRING( gpGlobals->mapname ) );
+	char* bspFilename = GetBspFilename( navFilename );
+	if( bspFilename == NULL )
 	{
-		// add this one-way connection
-		oneWayLinks[i].destArea->AddIncomingConnection( oneWayLinks[i].area, ( NavDirType )oneWayLinks[i].backD );
+		return false;
 	}
+	header.bspSize = filesystem->Size( bspFilename );
+	header.navSize = filesystem->FileExists( navFilename, "MOD" ) ? filesystem->Size( navFilename, "MOD" ) : 0;
 
-	ValidateNavAreaConnections();
+	CUtlBuffer fileBuffer( 0, offset );
+	fileBuffer.Put( &header, sizeof( header ) );
+	for( int i = 0; i < NUM_NAV_BINARY_SECTIONS; ++i )
+	{
+		while( ( unsigned int )fileBuffer.TellPut() < header.sectionOffset[i] )
+		{
+			fileBuffer.PutChar( 0 );
+		}
 
-	// TERROR: loading into a map directly creates entities before the mesh is loaded.  Tell the preexisting
-	// entities now that the mesh is loaded so they can update areas.
-	for( int i = 0; i < m_avoidanceObstacles.Count(); ++i )
+		fileBuffer.Put( sectionData[i], header.sectionCount[i] * s_navBinaryRecordSize[i] );
+	}
+	Assert( ( unsigned int )fileBuffer.TellPut() == offset );
+
+	// same as Save(), the path has to be local to the game dir
+	char gamePath[256];
+	engine->GetGameDir( gamePath, sizeof( gamePath ) );
+
+	char filename[256], fullFilename[MAX_PATH];
+	GetNavBinaryFilename( filename, sizeof( filename ) );
+	Q_snprintf( fullFilename, sizeof( fullFilename ), "%s\\%s", gamePath, filename );
+	COM_FixSlashes( fullFilename );
+
+	if( !filesystem->WriteFile( fullFilename, "MOD", fileBuffer ) )
 	{
-		m_avoidanceObstacles[i]->OnNavMeshLoaded();
+		Warning( "Unable to save %d bytes to %s\n", fileBuffer.TellPut(), fullFilename );
+		return false;
 	}
 
-	// the Navigation Mesh has been successfully loaded
-	m_isLoaded = true;
+	DevMsg( "Size of binary nav file '%s' is %u bytes.\n", fullFilename, offset );
+	return true;
+}
 
-	return NAV_OK;
+
+//--------------------------------------------------------------------------------------------------------------
+static inline bool NavBinaryRangeIsValid( unsigned int first, unsigned int count, unsigned int total )
+{
+	return first <= total && count <= total - first;
+}
+
+/**
+ * Load the .navb. Everything in it is checked before the mesh is touched, so when this
+ * fails the caller can go on to load the .nav.
+ */
+NavErrorType CNavMesh::LoadBinary( void )
+{
+	s_navLoadedFromBinary = false;
+
+	if( GetSubVersionNumber() != 0 )
+	{
+		return NAV_INVALID_FILE;
+	}
+
+	char filename[256];
+	GetNavBinaryFilename( filename, sizeof( filename ) );
+
+	CUtlBuffer fileBuffer( 0, 0, CUtlBuffer::READ_ONLY );
+	if( !filesystem->ReadFile( filename, "MOD", fileBuffer ) && !filesystem->ReadFile( filename, "BSP", fileBuffer ) )
+	{
+		return NAV_CANT_ACCESS_FILE;
+	}
+
+	const byte* base = ( const byte* )fileBuffer.Base();
+	unsigned int fileSize = fileBuffer.TellMaxPut();
+	const NavBinaryHeader_t* header = ( const NavBinaryHeader_t* )base;
+	if( fileSize < sizeof( NavBinaryHeader_t ) || header->magic != NAV_BINARY_MAGIC_NUMBER )
+	{
+		Msg( "Invalid binary navigation file '%s'.\n", filename );
+		return NAV_INVALID_FILE;
+	}
+
+	if( header->version != NavBinaryVersion )
+	{
+		DevMsg( "'%s' is from a different version, loading the .nav instead.\n", filename );
+		return NAV_BAD_FILE_VERSION;
+	}
+
+	// only stand in for the .nav and .bsp it was made from
+	char navFilename[256];
+	Q_snprintf( navFilename, sizeof( navFilename ), FORMAT_NAVFILE, STRING( gpGlobals->mapname ) );
+	char* bspFilename = GetBspFilename( navFilename );
+	if( bspFilename == NULL || filesystem->Size( bspFilename ) != header->bspSize )
+	{
+		DevMsg( "'%s' was made for a different version of this map, loading the .nav instead.\n", filename );
+		return NAV_FILE_OUT_OF_DATE;
+	}
+
+	if( filesystem->FileExists( navFilename, "MOD" ) &&
+		( filesystem->Size( navFilename, "MOD" ) != header->navSize || filesystem->GetFileTime( navFilename, "MOD" ) > filesystem->GetFileTime( filename, "MOD" ) ) )
+	{
+		DevMsg( "'%s' is older than '%s', loading the .nav instead.\n", filename, navFilename );
+		return NAV_FILE_OUT_OF_DATE;
+	}
+
+	//
+	// Check every section and index before building anything
+	//
+	for( int i = 0; i < NUM_NAV_BINARY_SECTIONS; ++i )
+	{
+		unsigned int offset = header->sectionOffset[i];
+		if( offset % 4 || offset > fileSize || header->sectionCount[i] > ( fileSize - offset ) / s_navBinaryRecordSize[i] )
+		{
+			Msg( "Corrupt binary navigation file '%s'.\n", filename );
+			return NAV_CORRUPT_DATA;
+		}
+	}
+
+	const NavBinaryArea_t* areas = ( const NavBinaryArea_t* )( base + header->sectionOffset[ NAV_BINARY_AREAS ] );
+	const NavBinaryConnect_t* connections = ( const NavBinaryConnect_t* )( base + header->sectionOffset[ NAV_BINARY_CONNECTIONS ] );
+	const unsigned int* ladderConnections = ( const unsigned int* )( base + header->sectionOffset[ NAV_BINARY_LADDER_CONNECTIONS ] );
+	const NavBinaryHidingSpot_t* hidingSpots = ( const NavBinaryHidingSpot_t* )( base + header->sectionOffset[ NAV_BINARY_HIDING_SPOTS ] );
+	const NavBinaryEncounter_t* encounters = ( const NavBinaryEncounter_t* )( base + header->sectionOffset[ NAV_BINARY_ENCOUNTERS ] );
+	const NavBinarySpotOrder_t* spotOrders = ( const NavBinarySpotOrder_t* )( base + header->sectionOffset[ NAV_BINARY_SPOT_ORDERS ] );
+	const NavBinaryVisibleArea_t* visibleAreas = ( const NavBinaryVisibleArea_t* )( base + header->sectionOffset[ NAV_BINARY_VISIBLE_AREAS ] );
+	const NavBinaryLadder_t* ladders = ( const NavBinaryLadder_t* )( base + header->sectionOffset[ NAV_BINARY_LADDERS ] );
+
+	const unsigned int areaCount = header->sectionCount[ NAV_BINARY_AREAS ];
+	const unsigned int connectCount = header->sectionCount[ NAV_BINARY_CONNECTIONS ];
+	const unsigned int ladderConnectCount = header->sectionCount[ NAV_BINARY_LADDER_CONNECTIONS ];
+	const unsigned int hidingSpotCount = header->sectionCount[ NAV_BINARY_HIDING_SPOTS ];
+	const unsigned int encounterCount = header->sectionCount[ NAV_BINARY_ENCOUNTERS ];
+	const unsigned int spotOrderCount = header->sectionCount[ NAV_BINARY_SPOT_ORDERS ];
+	const unsigned int visibleAreaCount = header->sectionCount[ NAV_BINARY_VISIBLE_AREAS ];
+	const unsigned int ladderCount = header->sectionCount[ NAV_BINARY_LADDERS ];
+
+	PlaceDirectory places;
+	CUtlBuffer placeBuffer( base + header->sectionOffset[ NAV_BINARY_PLACES ], header->sectionCount[ NAV_BINARY_PLACES ], CUtlBuffer::READ_ONLY );
+	places.Load( placeBuffer, NavCurrentVersion );
+
+	bool isValid = areaCount > 0 && placeBuffer.IsValid();
+
+	for( unsigned int i = 0; i < areaCount && isValid; ++i )
+	{
+		const NavBinaryArea_t& area = areas[i];
+
+		isValid = area.place <= ( unsigned int )places.GetPlaces()->Count() && area.inheritVisibilityFrom <= areaCount;
+
+		unsigned int connect = area.firstConnect;
+		for( int d = 0; d < NUM_DIRECTIONS && isValid; d++ )
+		{
+			isValid = NavBinaryRangeIsValid( connect, area.connectCount[d], connectCount );
+			connect += isValid ? area.connectCount[d] : 0;
+			isValid = isValid && NavBinaryRangeIsValid( connect, area.incomingCount[d], connectCount );
+			connect += isValid ? area.incomingCount[d] : 0;
+		}
+
+		for( unsigned int c = area.firstConnect; c < connect && isValid; ++c )
+		{
+			isValid = connections[c].area < areaCount;
+		}
+
+		unsigned int ladderConnect = area.firstLadderConnect;
+		for( int dir = 0; dir < CNavLadder::NUM_LADDER_DIRECTIONS && isValid; ++dir )
+		{
+			isValid = NavBinaryRangeIsValid( ladderConnect, area.ladderCount[dir], ladderConnectCount );
+			ladderConnect += isValid ? area.ladderCount[dir] : 0;
+		}
+
+		for( unsigned int c = area.firstLadderConnect; c < ladderConnect && isValid; ++c )
+		{
+			isValid = ladderConnections[c] < ladderCount;
+		}
+
+		isValid = isValid && NavBinaryRangeIsValid( area.firstHidingSpot, area.hidingSpotCount, hidingSpotCount );
+		isValid = isValid && NavBinaryRangeIsValid( area.firstEncounter, area.encounterCount, encounterCount );
+		for( unsigned int e = 0; e < area.encounterCount && isValid; ++e )
+		{
+			const NavBinaryEncounter_t& encounter = encounters[ area.firstEncounter + e ];
+			isValid = encounter.from <= areaCount && encounter.to <= areaCount &&
+					  encounter.fromDir < NUM_DIRECTIONS && encounter.toDir < NUM_DIRECTIONS &&
+					  NavBinaryRangeIsValid( encounter.firstSpotOrder, encounter.spotOrderCount, spotOrderCount );
+
+			for( unsigned int s = 0; s < encounter.spotOrderCount && isValid; ++s )
+			{
+				isValid = spotOrders[ encounter.firstSpotOrder + s ].spot <= hidingSpotCount;
+			}
+		}
+
+		isValid = isValid && NavBinaryRangeIsValid( area.firstVisibleArea, area.visibleAreaCount, visibleAreaCount );
+		for( unsigned int v = 0; v < area.visibleAreaCount && isValid; ++v )
+		{
+			isValid = visibleAreas[ area.firstVisibleArea + v ].area < areaCount;
+		}
+	}
+
+	for( unsigned int i = 0; i < hidingSpotCount && isValid; ++i )
+	{
+		isValid = hidingSpots[i].area <= areaCount;
+	}
+
+	for( unsigned int i = 0; i < ladderCount && isValid; ++i )
+	{
+		isValid = ladders[i].dir < NUM_DIRECTIONS;
+		for( int a = 0; a < NAV_BINARY_LADDER_AREAS && isValid; ++a )
+		{
+			isValid = ladders[i].area[a] <= areaCount;
+		}
+	}
+
+	if( !isValid )
+	{
+		Msg( "Corrupt binary navigation file '%s'.\n", filename );
+		return NAV_CORRUPT_DATA;
+	}
+
+	//
+	// Build the mesh. Everything is allocated first so records can point at each other.
+	//
+	m_isAnalyzed = header->isAnalyzed != 0;
+	placeDirectory = places;
+
+	PreLoadAreas( areaCount );
+	TheNavAreas.EnsureCapacity( areaCount );
+	for( unsigned int i = 0; i < areaCount; ++i )
+	{
+		TheNavAreas.AddToTail( CreateArea() );
+	}
+
+	m_ladders.EnsureCapacity( ladderCount );
+	for( unsigned int i = 0; i < ladderCount; ++i )
+	{
+		m_ladders.AddToTail( new CNavLadder );
+	}
+
+	CUtlVector< HidingSpot* > spots;
+	spots.EnsureCapacity( hidingSpotCount );
+	for( unsigned int i = 0; i < hidingSpotCount; ++i )
+	{
+		const NavBinaryHidingSpot_t& in = hidingSpots[i];
+
+		HidingSpot* spot = CreateHidingSpot();
+		spot->m_id = in.id;
+		spot->m_pos.Init( in.pos[0], in.pos[1], in.pos[2] );
+		spot->m_flags = in.flags;
+		spot->m_area = in.area ? TheNavAreas[ in.area - 1 ] : NULL;
+		if( spot->m_id >= HidingSpot::m_nextID )
+		{
+			HidingSpot::m_nextID = spot->m_id + 1;
+		}
+		spots.AddToTail( spot );
+	}
+
+	Extent extent;
+	extent.lo.x = 9999999999.9f;
+	extent.lo.y = 9999999999.9f;
+	extent.hi.x = -9999999999.9f;
+	extent.hi.y = -9999999999.9f;
+
+	for( unsigned int i = 0; i < areaCount; ++i )
+	{
+		const NavBinaryArea_t& in = areas[i];
+		CNavArea* area = TheNavAreas[i];
+
+		area->m_id = in.id;
+		if( area->m_id >= CNavArea::m_nextID )
+		{
+			CNavArea::m_nextID = area->m_id + 1;
+		}
+
+		area->m_attributeFlags = in.attributeFlags;
+		area->m_nwCorner.Init( in.nwCorner[0], in.nwCorner[1], in.nwCorner[2] );
+		area->m_seCorner.Init( in.seCorner[0], in.seCorner[1], in.seCorner[2] );
+		area->m_center = ( area->m_nwCorner + area->m_seCorner ) / 2.0f;
+
+		if( ( area->m_seCorner.x - area->m_nwCorner.x ) > 0.0f && ( area->m_seCorner.y - area->m_nwCorner.y ) > 0.0f )
+		{
+			area->m_invDxCorners = 1.0f / ( area->m_seCorner.x - area->m_nwCorner.x );
+			area->m_invDyCorners = 1.0f / ( area->m_seCorner.y - area->m_nwCorner.y );
+		}
+		else
+		{
+			area->m_invDxCorners = area->m_invDyCorners = 0;
+		}
+
+		area->m_neZ = in.neZ;
+		area->m_swZ = in.swZ;
+		area->m_isUnderwater = in.isUnderwater != 0;
+
+		const NavBinaryConnect_t* connect = &connections[ in.firstConnect ];
+		for( int pass = 0; pass < 2; ++pass )
+		{
+			for( int d = 0; d < NUM_DIRECTIONS; d++ )
+			{
+				NavConnectVector& connectList = pass ? area->m_incomingConnect[d] : area->m_connect[d];
+				unsigned int count = pass ? in.incomingCount[d] : in.connectCount[d];
+
+				connectList.EnsureCapacity( count );
+				for( unsigned int c = 0; c < count; ++c, ++connect )
+				{
+					NavConnect navConnect;
+					navConnect.area = TheNavAreas[ connect->area ];
+					navConnect.length = connect->length;
+					connectList.AddToTail( navConnect );
+				}
+			}
+		}
+
+		const unsigned int* ladderConnect = &ladderConnections[ in.firstLadderConnect ];
+		for( int dir = 0; dir < CNavLadder::NUM_LADDER_DIRECTIONS; ++dir )
+		{
+			area->m_ladder[dir].EnsureCapacity( in.ladderCount[dir] );
+			for( unsigned int c = 0; c < in.ladderCount[dir]; ++c, ++ladderConnect )
+			{
+				NavLadderConnect navLadderConnect;
+				navLadderConnect.ladder = m_ladders[ *ladderConnect ];
+				area->m_ladder[dir].AddToTail( navLadderConnect );
+			}
+		}
+
+		area->m_hidingSpots.EnsureCapacity( in.hidingSpotCount );
+		for( unsigned int s = 0; s < in.hidingSpotCount; ++s )
+		{
+			area->m_hidingSpots.AddToTail( spots[ in.firstHidingSpot + s ] );
+		}
+
+		area->m_spotEncounters.EnsureCapacity( in.encounterCount );
+		for( unsigned int e = 0; e < in.encounterCount; ++e )
+		{
+			const NavBinaryEncounter_t& encounterIn = encounters[ in.firstEncounter + e ];
+
+			SpotEncounter* encounter = new SpotEncounter;
+			encounter->from.area = encounterIn.from ? TheNavAreas[ encounterIn.from - 1 ] : NULL;
+			encounter->fromDir = ( NavDirType )encounterIn.fromDir;
+			encounter->to.area = encounterIn.to ? TheNavAreas[ encounterIn.to - 1 ] : NULL;
+			encounter->toDir = ( NavDirType )encounterIn.toDir;
+			encounter->path.from.Init( encounterIn.pathFrom[0], encounterIn.pathFrom[1], encounterIn.pathFrom[2] );
+			encounter->path.to.Init( encounterIn.pathTo[0], encounterIn.pathTo[1], encounterIn.pathTo[2] );
+
+			encounter->spots.EnsureCapacity( encounterIn.spotOrderCount );
+			for( unsigned int s = 0; s < encounterIn.spotOrderCount; ++s )
+			{
+				const NavBinarySpotOrder_t& orderIn = spotOrders[ encounterIn.firstSpotOrder + s ];
+
+				SpotOrder order;
+				order.spot = orderIn.spot ? spots[ orderIn.spot - 1 ] : NULL;
+				order.t = orderIn.t;
+				encounter->spots.AddToTail( order );
+			}
+
+			area->m_spotEncounters.AddToTail( encounter );
+		}
+
+		area->SetPlace( placeDirectory.IndexToPlace( in.place ) );
+
+		for( int t = 0; t < MAX_NAV_TEAMS; ++t )
+		{
+			area->m_earliestOccupyTime[t] = in.earliestOccupyTime[t];
+		}
+
+		for( int c = 0; c < NUM_CORNERS; ++c )
+		{
+			area->m_lightIntensity[c] = in.lightIntensity[c];
+		}
+
+		area->m_potentiallyVisibleAreas.EnsureCapacity( in.visibleAreaCount );
+		for( unsigned int v = 0; v < in.visibleAreaCount; ++v )
+		{
+			const NavBinaryVisibleArea_t& visibleIn = visibleAreas[ in.firstVisibleArea + v ];
+
+			CNavArea::AreaBindInfo info;
+			info.area = TheNavAreas[ visibleIn.area ];
+			info.attributes = ( unsigned char )visibleIn.attributes;
+			area->m_potentiallyVisibleAreas.AddToTail( info );
+		}
+
+		area->m_inheritVisibilityFrom.area = in.inheritVisibilityFrom ? TheNavAreas[ in.inheritVisibilityFrom - 1 ] : NULL;
+
+		// func avoid/prefer attributes are controlled by func_nav_cost entities
+		area->ClearAllNavCostEntities();
+
+		Extent areaExtent;
+		area->GetExtent( &areaExtent );
+		extent.lo.x = MIN( extent.lo.x, areaExtent.lo.x );
+		extent.lo.y = MIN( extent.lo.y, areaExtent.lo.y );
+		extent.hi.x = MAX( extent.hi.x, areaExtent.hi.x );
+		extent.hi.y = MAX( extent.hi.y, areaExtent.hi.y );
+	}
+
+	// add the areas to the grid
+	AllocateGrid( extent.lo.x, extent.hi.x, extent.lo.y, extent.hi.y );
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		AddNavArea( TheNavAreas[ it ] );
+	}
+
+	for( unsigned int i = 0; i < ladderCount; ++i )
+	{
+		const NavBinaryLadder_t& in = ladders[i];
+		CNavLadder* ladder = m_ladders[i];
+
+		ladder->m_id = in.id;
+		if( ladder->m_id >= CNavLadder::m_nextID )
+		{
+			CNavLadder::m_nextID = ladder->m_id + 1;
+		}
+
+		ladder->m_width = in.width;
+		ladder->m_top.Init( in.top[0], in.top[1], in.top[2] );
+		ladder->m_bottom.Init( in.bottom[0], in.bottom[1], in.bottom[2] );
+		ladder->m_length = in.length;
+		ladder->m_dir = ( NavDirType )in.dir;
+		ladder->m_normal.Init( in.normal[0], in.normal[1], in.normal[2] );
+
+		CNavArea** connectAreas[ NAV_BINARY_LADDER_AREAS ] =
+		{
+			&ladder->m_topForwardArea, &ladder->m_topLeftArea, &ladder->m_topRightArea, &ladder->m_topBehindArea, &ladder->m_bottomArea
+		};
+		for( int a = 0; a < NAV_BINARY_LADDER_AREAS; ++a )
+		{
+			*connectAreas[a] = in.area[a] ? TheNavAreas[ in.area[a] - 1 ] : NULL;
+		}
+
+		ladder->FindLadderEntity();
+	}
+
+	//
+	// Run the same PostLoad() chain as a .nav load, so derived meshes and areas get their
+	// fixups. The base versions skip the binding that's already in the file.
+	//
+	s_navLoadedFromBinary = true;
+	NavErrorType loadResult = PostLoad( NavCurrentVersion );
+
+	WarnIfMeshNeedsAnalysis( NavCurrentVersion );
+
+	return loadResult;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+static void CommandNavSaveBinary( void )
+{
+	if( !UTIL_IsCommandIssuedByServerAdmin() )
+	{
+		return;
+	}
+
+	char filename[256];
+	GetNavBinaryFilename( filename, sizeof( filename ) );
+
+	if( !TheNavMesh->IsLoaded() )
+	{
+		Msg( "ERROR: No Navigation Mesh is loaded.\n" );
+	}
+	else if( TheNavMesh->SaveBinary() )
+	{
+		Msg( "Navigation map saved to '%s'.\n", filename );
+	}
+	else
+	{
+		Msg( "ERROR: Cannot save navigation map '%s'.\n", filename );
+	}
+}
+static ConCommand nav_save_binary( "nav_save_binary", CommandNavSaveBinary, "Converts the current Navigation Mesh to a .navb, which loads faster than the .nav.", FCVAR_GAMEDLL | FCVAR_CHEAT );
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * What nav_test_binary compares: a CRC of the mesh in .nav format, then random path and nearest-area queries
+ */
+static void NavBinaryRunQueries( int queryCount, CUtlVector< unsigned int >& results )
+{
+	results.RemoveAll();
+
+	CUtlBuffer navBuffer( 4096, 1024 * 1024 );
+	TheNavMesh->SaveToBuffer( navBuffer, 0 );
+	results.AddToTail( CRC32_ProcessSingleBuffer( navBuffer.Base(), navBuffer.TellPut() ) );
+
+	CUniformRandomStream random;
+	random.SetSeed( 1 );
+	ShortestPathCost cost;
+	int areaCount = TheNavAreas.Count();
+
+	for( int i = 0; i < queryCount; ++i )
+	{
+		CNavArea* startArea = TheNavAreas[ random.RandomInt( 0, areaCount - 1 ) ];
+		CNavArea* goalArea = TheNavAreas[ random.RandomInt( 0, areaCount - 1 ) ];
+		Vector goalPos = goalArea->GetCenter();
+
+		CNavArea* closestArea = NULL;
+		results.AddToTail( NavAreaBuildPath( startArea, goalArea, &goalPos, cost, &closestArea ) );
+
+		// the path back from where it ended, and what it cost
+		int length = 0;
+		for( CNavArea* area = closestArea; area && length < areaCount; area = area->GetParent(), ++length )
+		{
+			results.AddToTail( area->GetID() );
+		}
+
+		float pathCost = closestArea ? closestArea->GetCostSoFar() : -1.0f;
+		unsigned int pathCostBits;
+		V_memcpy( &pathCostBits, &pathCost, sizeof( pathCostBits ) );
+		results.AddToTail( pathCostBits );
+
+		Vector pos = goalPos + Vector( random.RandomFloat( -256.0f, 256.0f ), random.RandomFloat( -256.0f, 256.0f ), random.RandomFloat( 0.0f, 64.0f ) );
+		CNavArea* nearArea = TheNavMesh->GetNearestNavArea( pos );
+		results.AddToTail( nearArea ? nearArea->GetID() : 0 );
+	}
+}
+
+CON_COMMAND_F( nav_test_binary, "Converts the mesh to a .navb, times loading the .nav and the .navb, and checks that both give the same mesh and path queries. Usage: nav_test_binary [queries]", FCVAR_GAMEDLL | FCVAR_CHEAT )
+{
+	if( !UTIL_IsCommandIssuedByServerAdmin() )
+	{
+		return;
+	}
+
+	if( !TheNavMesh->IsLoaded() )
+	{
+		Msg( "nav_test_binary: no Navigation Mesh is loaded\n" );
+		return;
+	}
+
+	int queryCount = args.ArgC() > 1 ? MAX( atoi( args[1] ), 1 ) : 1000;
+
+	if( !TheNavMesh->SaveBinary() )
+	{
+		Msg( "nav_test_binary: couldn't write the .navb\n" );
+		return;
+	}
+
+	int wasBinary = nav_load_binary.GetInt();
+
+	nav_load_binary.SetValue( 0 );
+	double startTime = Plat_FloatTime();
+	NavErrorType navResult = TheNavMesh->Load();
+	double navTime = Plat_FloatTime() - startTime;
+
+	CUtlVector< unsigned int > navResults;
+	if( navResult == NAV_OK )
+	{
+		NavBinaryRunQueries( queryCount, navResults );
+	}
+
+	nav_load_binary.SetValue( 1 );
+	startTime = Plat_FloatTime();
+	NavErrorType binaryResult = TheNavMesh->Load();
+	double binaryTime = Plat_FloatTime() - startTime;
+	bool loadedFromBinary = s_navLoadedFromBinary;
+
+	nav_load_binary.SetValue( wasBinary );
+
+	if( navResult != NAV_OK || binaryResult != NAV_OK || !loadedFromBinary )
+	{
+		Msg( "nav_test_binary: FAILED, .nav load %s, .navb load %s\n", navResult == NAV_OK ? "ok" : "failed",
+			 binaryResult != NAV_OK ? "failed" : ( loadedFromBinary ? "ok" : "fell back to the .nav" ) );
+		return;
+	}
+
+	CUtlVector< unsigned int > binaryResults;
+	NavBinaryRunQueries( queryCount, binaryResults );
+
+	bool sameMesh = navResults[0] == binaryResults[0];
+	bool sameQueries = navResults.Count() == binaryResults.Count() &&
+					   !V_memcmp( navResults.Base(), binaryResults.Base(), navResults.Count() * sizeof( unsigned int ) );
+
+	Msg( "nav_test_binary: %d areas, %d ladders, %d hiding spots\n", TheNavAreas.Count(), TheNavMesh->GetLadders().Count(), TheHidingSpots.Count() );
+	Msg( "  .nav  load %8.2f ms\n", navTime * 1000.0 );
+	Msg( "  .navb load %8.2f ms\n", binaryTime * 1000.0 );
+	Msg( "  mesh contents: %s\n", sameMesh ? "identical" : "DIFFERENT" );
+	Msg( "  %d path queries: %s\n", queryCount, sameQueries ? "identical" : "DIFFERENT" );
 }
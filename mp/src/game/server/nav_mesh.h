@@ -296,6 +296,8 @@ public:
 	const CUtlVector< Place >* GetPlacesFromNavFile( bool* hasUnnamedPlaces );	// Reads the used place names from the nav file (can be used to selectively precache before the nav is loaded)
 
 	virtual bool Save( void ) const;									// store Navigation Mesh to a file
+	void SaveToBuffer( CUtlBuffer& fileBuffer, unsigned int bspSize ) const;	// write the mesh in .nav format
+	bool SaveBinary( void ) const;										// store the mesh as a .navb for fast loading
 	bool IsOutOfDate( void ) const
 	{
 		return m_isOutOfDate;    // return true if the Navigation Mesh is older than the current map version
@@ -1178,6 +1180,8 @@ private:
 
 	void ComputeBattlefrontAreas( void );						// determine areas where rushing teams will first meet
 
+	NavErrorType LoadBinary( void );							// load the .navb if it matches the map and .nav; leaves the mesh alone if not
+
 	//----------------------------------------------------------------------------------
 	// Place directory
 	//
@@ -10,9 +10,10 @@
 #include "igamesystem.h"
 #include "ilagcompensationmanager.h"
 #include "inetchannelinfo.h"
-#include "utllinkedlist.h"
+#include "utlvector.h"
 #include "BaseAnimatingOverlay.h"
 #include "tier0/vprof.h"
+#include "mathlib/ssemath.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -38,6 +39,10 @@ ConVar sv_showlagcompensation( "sv_showlagcompensation", "0", FCVAR_CHEAT, "Show
 
 ConVar sv_unlag_fixstuck( "sv_unlag_fixstuck", "0", FCVAR_DEVELOPMENTONLY, "Disallow backtracking a player for lag compensation if it will cause them to become stuck" );
 
+ConVar sv_unlag_cone( "sv_unlag_cone", "0", FCVAR_DEVELOPMENTONLY, "Only backtrack players inside the shooter's aim cone or close to the shooter. The cone is built from the command's view angles, not the fired direction, so sv_unlag_cone_angle must cover punch and spread" );
+ConVar sv_unlag_cone_angle( "sv_unlag_cone_angle", "30", FCVAR_DEVELOPMENTONLY, "Half angle in degrees of the aim cone used to pick players to backtrack", true, 1.0f, true, 89.0f );
+ConVar sv_unlag_cone_near( "sv_unlag_cone_near", "256", FCVAR_DEVELOPMENTONLY, "Players closer than this to the shooter are always backtracked" );
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
@@ -117,6 +122,175 @@ public:
 	float					m_poseParameters[MAX_POSE_PARAMETERS];
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: Fixed capacity ring buffer of a player's lag records, newest first.
+//			Simulation times strictly decrease from the head, so the record for
+//			a given time is found with a binary search, and the records that
+//			break the track (dead, or teleported) are tracked as they're added
+//			instead of being searched for on every backtrack.
+//-----------------------------------------------------------------------------
+class CLagRecordTrack
+{
+public:
+	CLagRecordTrack()
+	{
+		m_nHead = 0;
+		m_nCount = 0;
+		m_nHeadSerial = 0;
+		m_nNewestBreakSerial = -1;
+	}
+
+	void Purge()
+	{
+		m_Records.Purge();
+		m_flNewerDistSqr.Purge();
+		RemoveAll();
+	}
+
+	void RemoveAll()
+	{
+		m_nHead = 0;
+		m_nCount = 0;
+		m_nNewestBreakSerial = m_nHeadSerial;
+	}
+
+	int Count() const
+	{
+		return m_nCount;
+	}
+
+	// 0 is the newest record, Count() - 1 the oldest
+	LagRecord& Element( int i )
+	{
+		Assert( i >= 0 && i < m_nCount );
+		return m_Records[Slot( i )];
+	}
+
+	const LagRecord& Element( int i ) const
+	{
+		Assert( i >= 0 && i < m_nCount );
+		return m_Records[Slot( i )];
+	}
+
+	// Make room for a new newest record, dropping the oldest one if the track is full.
+	// Call CommitHead() once it's filled in.
+	LagRecord& AddToHead()
+	{
+		if( !m_Records.Count() )
+		{
+			// sv_maxunlag is capped at one second, and a player gets at most one record per tick
+			int nCapacity = TIME_TO_TICKS( 1.0f ) + 2;
+			m_Records.SetCount( nCapacity );
+			m_flNewerDistSqr.SetCount( nCapacity );
+		}
+
+		m_nHead = ( m_nHead + 1 ) % m_Records.Count();
+		m_nCount = MIN( m_nCount + 1, m_Records.Count() );
+		m_nHeadSerial++;
+
+		m_flNewerDistSqr[m_nHead] = 0.0f;
+		return m_Records[m_nHead];
+	}
+
+	void CommitHead( float flTeleportDistanceSqr )
+	{
+		const LagRecord& head = Element( 0 );
+		if( m_nCount > 1 )
+		{
+			int nPrevSlot = Slot( 1 );
+			m_flNewerDistSqr[nPrevSlot] = ( m_Records[nPrevSlot].m_vecOrigin - head.m_vecOrigin ).Length2DSqr();
+			if( m_flNewerDistSqr[nPrevSlot] > flTeleportDistanceSqr )
+			{
+				m_nNewestBreakSerial = MAX( m_nNewestBreakSerial, m_nHeadSerial - 1 );
+			}
+		}
+
+		if( !( head.m_fFlags & LC_ALIVE ) )
+		{
+			m_nNewestBreakSerial = m_nHeadSerial;
+		}
+	}
+
+	void RemoveTail()
+	{
+		Assert( m_nCount > 0 );
+		m_nCount--;
+	}
+
+	// Recompute the track breaks after the teleport distance changed
+	void UpdateBreaks( float flTeleportDistanceSqr )
+	{
+		m_nNewestBreakSerial = m_nHeadSerial - m_nCount;
+		for( int i = m_nCount - 1; i >= 0; i-- )
+		{
+			int nSlot = Slot( i );
+			if( !( m_Records[nSlot].m_fFlags & LC_ALIVE ) || ( i > 0 && m_flNewerDistSqr[nSlot] > flTeleportDistanceSqr ) )
+			{
+				m_nNewestBreakSerial = m_nHeadSerial - i;
+			}
+		}
+	}
+
+	// Returns the newest record at or before flTargetTime (or the oldest one if
+	// they're all newer), -1 if the track was lost between it and vecCurOrigin.
+	int FindRecord( float flTargetTime, const Vector& vecCurOrigin, float flTeleportDistanceSqr ) const
+	{
+		if( !m_nCount )
+		{
+			return -1;
+		}
+
+		int lo = 0;
+		int hi = m_nCount - 1;
+		if( Element( hi ).m_flSimulationTime <= flTargetTime )
+		{
+			while( lo < hi )
+			{
+				int mid = ( lo + hi ) / 2;
+				if( Element( mid ).m_flSimulationTime <= flTargetTime )
+				{
+					hi = mid;
+				}
+				else
+				{
+					lo = mid + 1;
+				}
+			}
+		}
+		else
+		{
+			lo = hi;
+		}
+
+		// player must be alive and not teleported anywhere between now and the record
+		if( m_nNewestBreakSerial >= m_nHeadSerial - lo )
+		{
+			return -1;
+		}
+
+		if( ( Element( 0 ).m_vecOrigin - vecCurOrigin ).Length2DSqr() > flTeleportDistanceSqr )
+		{
+			return -1;
+		}
+
+		return lo;
+	}
+
+private:
+	int Slot( int i ) const
+	{
+		int nSlot = m_nHead - i;
+		return nSlot < 0 ? nSlot + m_Records.Count() : nSlot;
+	}
+
+	CUtlVector< LagRecord >	m_Records;
+	CUtlVector< float >		m_flNewerDistSqr;	// 2D distance squared to the next newer record, per slot
+	int						m_nHead;			// slot of the newest record
+	int						m_nCount;
+	int						m_nHeadSerial;		// serial of the newest record, older ones count down from it
+	int						m_nNewestBreakSerial;	// newest record that's dead or teleported away from its newer record
+};
+
 
 //
 // Try to take the player from his current origin to vWantedPos.
@@ -180,6 +354,7 @@ public:
 	CLagCompensationManager( char const* name ) : CAutoGameSystemPerFrame( name ), m_flTeleportDistanceSqr( 64 * 64 )
 	{
 		m_isCurrentlyDoingCompensation = false;
+		ResetStats();
 	}
 
 	// IServerSystem stuff
@@ -209,6 +384,8 @@ public:
 
 private:
 	void			BacktrackPlayer( CBasePlayer* player, float flTargetTime );
+	bool			GetBacktrackBounds( CBasePlayer* pPlayer, float flTargetTime, Vector& vecCenter, float& flRadius );
+	void			CullToAimCone( CBasePlayer* pShooter, CUserCmd* cmd, CBasePlayer** ppPlayers, int& nPlayers, float flTargetTime );
 
 	void ClearHistory()
 	{
@@ -218,8 +395,13 @@ private:
 		}
 	}
 
+public:
+	void			PrintStats();
+	void			ResetStats();
+
+private:
 	// keep a list of lag records for each player
-	CUtlFixedLinkedList< LagRecord >	m_PlayerTrack[ MAX_PLAYERS ];
+	CLagRecordTrack			m_PlayerTrack[ MAX_PLAYERS ];
 
 	// Scratchpad for determining what needs to be restored
 	CBitVec<MAX_PLAYERS>	m_RestorePlayer;
@@ -233,6 +415,13 @@ private:
 	float					m_flTeleportDistanceSqr;
 
 	bool					m_isCurrentlyDoingCompensation;	// Sentinel to prevent calling StartLagCompensation a second time before a Finish.
+
+	// Backtracking counters for sv_unlag_stats
+	int						m_nStatCommands;	// commands that were lag compensated
+	int						m_nStatCandidates;	// players that wanted lag compensation
+	int						m_nStatCulled;		// ... skipped because they were outside the aim cone
+	int						m_nStatRewound;		// ... actually moved back in time
+	int						m_nStatMaxRewound;	// most players moved back by a single command
 };
 
 static CLagCompensationManager g_LagCompensationManager( "CLagCompensationManager" );
@@ -250,7 +439,15 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 		return;
 	}
 
-	m_flTeleportDistanceSqr = sv_lagcompensation_teleport_dist.GetFloat() * sv_lagcompensation_teleport_dist.GetFloat();
+	float flTeleportDistanceSqr = sv_lagcompensation_teleport_dist.GetFloat() * sv_lagcompensation_teleport_dist.GetFloat();
+	if( flTeleportDistanceSqr != m_flTeleportDistanceSqr )
+	{
+		m_flTeleportDistanceSqr = flTeleportDistanceSqr;
+		for( int i = 0; i < MAX_PLAYERS; i++ )
+		{
+			m_PlayerTrack[i].UpdateBreaks( m_flTeleportDistanceSqr );
+		}
+	}
 
 	VPROF_BUDGET( "FrameUpdatePostEntityThink", "CLagCompensationManager" );
 
@@ -262,7 +459,7 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 	{
 		CBasePlayer* pPlayer = UTIL_PlayerByIndex( i );
 
-		CUtlFixedLinkedList< LagRecord >* track = &m_PlayerTrack[i - 1];
+		CLagRecordTrack* track = &m_PlayerTrack[i - 1];
 
 		if( !pPlayer )
 		{
@@ -274,13 +471,10 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 			continue;
 		}
 
-		Assert( track->Count() < 1000 ); // insanity check
-
 		// remove tail records that are too old
-		int tailIndex = track->Tail();
-		while( track->IsValidIndex( tailIndex ) )
+		while( track->Count() > 0 )
 		{
-			LagRecord& tail = track->Element( tailIndex );
+			LagRecord& tail = track->Element( track->Count() - 1 );
 
 			// if tail is within limits, stop
 			if( tail.m_flSimulationTime >= flDeadtime )
@@ -289,14 +483,13 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 			}
 
 			// remove tail, get new tail
-			track->Remove( tailIndex );
-			tailIndex = track->Tail();
+			track->RemoveTail();
 		}
 
 		// check if head has same simulation time
 		if( track->Count() > 0 )
 		{
-			LagRecord& head = track->Element( track->Head() );
+			LagRecord& head = track->Element( 0 );
 
 			// check if player changed simulation time since last time updated
 			if( head.m_flSimulationTime >= pPlayer->GetSimulationTime() )
@@ -306,7 +499,7 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 		}
 
 		// add new record to player track
-		LagRecord& record = track->Element( track->AddToHead() );
+		LagRecord& record = track->AddToHead();
 
 		record.m_fFlags = 0;
 		if( pPlayer->IsAlive() )
@@ -343,6 +536,8 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 				record.m_poseParameters[paramIndex] = pPlayer->GetPoseParameter( paramIndex );
 			}
 		}
+
+		track->CommitHead( m_flTeleportDistanceSqr );
 	}
 
 	//Clear the current player.
@@ -422,6 +617,9 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer* player, CUserCm
 	}
 
 	// Iterate all active players
+	CBasePlayer* pCandidates[ MAX_PLAYERS ];
+	int nCandidates = 0;
+
 	const CBitVec<MAX_EDICTS>* pEntityTransmitBits = engine->GetEntityTransmitBitsForClient( player->entindex() - 1 );
 	for( int i = 1; i <= gpGlobals->maxClients; i++ )
 	{
@@ -444,83 +642,212 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer* player, CUserCm
 			continue;
 		}
 
+		pCandidates[ nCandidates++ ] = pPlayer;
+	}
+
+	m_nStatCommands++;
+	m_nStatCandidates += nCandidates;
+
+	// Don't bother moving players the command can't possibly hit
+	if( sv_unlag_cone.GetBool() )
+	{
+		int nBefore = nCandidates;
+		CullToAimCone( player, cmd, pCandidates, nCandidates, TICKS_TO_TIME( targettick ) );
+		m_nStatCulled += nBefore - nCandidates;
+	}
+
+	for( int i = 0; i < nCandidates; i++ )
+	{
 		// Move other player back in time
-		BacktrackPlayer( pPlayer, TICKS_TO_TIME( targettick ) );
+		BacktrackPlayer( pCandidates[i], TICKS_TO_TIME( targettick ) );
+	}
+
+	int nRewound = 0;
+	for( int i = 0; i < gpGlobals->maxClients; i++ )
+	{
+		if( m_RestorePlayer.Get( i ) )
+		{
+			nRewound++;
+		}
 	}
+	m_nStatRewound += nRewound;
+	m_nStatMaxRewound = MAX( m_nStatMaxRewound, nRewound );
 }
 
-void CLagCompensationManager::BacktrackPlayer( CBasePlayer* pPlayer, float flTargetTime )
+//-----------------------------------------------------------------------------
+// Purpose: Get a sphere bounding the player wherever BacktrackPlayer() would
+//			move him for this time. Returns false if he won't be moved at all.
+//-----------------------------------------------------------------------------
+bool CLagCompensationManager::GetBacktrackBounds( CBasePlayer* pPlayer, float flTargetTime, Vector& vecCenter, float& flRadius )
 {
-	Vector org;
-	Vector minsPreScaled;
-	Vector maxsPreScaled;
-	QAngle ang;
-
-	VPROF_BUDGET( "BacktrackPlayer", "CLagCompensationManager" );
-	int pl_index = pPlayer->entindex() - 1;
+	const CLagRecordTrack& track = m_PlayerTrack[ pPlayer->entindex() - 1 ];
 
-	// get track history of this player
-	CUtlFixedLinkedList< LagRecord >* track = &m_PlayerTrack[ pl_index ];
-
-	// check if we have at leat one entry
-	if( track->Count() <= 0 )
+	int iRecord = track.FindRecord( flTargetTime, pPlayer->GetLocalOrigin(), m_flTeleportDistanceSqr );
+	if( iRecord < 0 )
 	{
-		return;
+		return false;
 	}
 
-	int curr = track->Head();
+	// The player ends up somewhere between this record and the next newer one
+	const LagRecord& record = track.Element( iRecord );
+	const LagRecord& newer = track.Element( MAX( iRecord - 1, 0 ) );
 
-	LagRecord* prevRecord = NULL;
-	LagRecord* record = NULL;
+	Vector vecMins, vecMaxs;
+	VectorMin( record.m_vecMinsPreScaled, newer.m_vecMinsPreScaled, vecMins );
+	VectorMax( record.m_vecMaxsPreScaled, newer.m_vecMaxsPreScaled, vecMaxs );
 
-	Vector prevOrg = pPlayer->GetLocalOrigin();
+	vecCenter = ( record.m_vecOrigin + newer.m_vecOrigin ) * 0.5f + ( vecMins + vecMaxs ) * ( 0.5f * pPlayer->GetModelScale() );
+	flRadius = ( record.m_vecOrigin - newer.m_vecOrigin ).Length() * 0.5f + ( vecMaxs - vecMins ).Length() * ( 0.5f * pPlayer->GetModelScale() );
+	return true;
+}
 
-	// Walk context looking for any invalidating event
-	while( track->IsValidIndex( curr ) )
-	{
-		// remember last record
-		prevRecord = record;
+//-----------------------------------------------------------------------------
+// Purpose: Remove the players whose backtracked bounds are neither inside the
+//			shooter's aim cone nor close to the shooter. Four players are
+//			tested at a time.
+//-----------------------------------------------------------------------------
+void CLagCompensationManager::CullToAimCone( CBasePlayer* pShooter, CUserCmd* cmd, CBasePlayer** ppPlayers, int& nPlayers, float flTargetTime )
+{
+	VPROF_BUDGET( "CullToAimCone", "CLagCompensationManager" );
 
-		// get next record
-		record = &track->Element( curr );
+	ALIGN16 float flCenterX[ MAX_PLAYERS ] ALIGN16_POST;
+	ALIGN16 float flCenterY[ MAX_PLAYERS ] ALIGN16_POST;
+	ALIGN16 float flCenterZ[ MAX_PLAYERS ] ALIGN16_POST;
+	ALIGN16 float flRadius[ MAX_PLAYERS ] ALIGN16_POST;
 
-		if( !( record->m_fFlags & LC_ALIVE ) )
+	// Players with no valid history won't be moved anyway
+	int nCount = 0;
+	for( int i = 0; i < nPlayers; i++ )
+	{
+		Vector vecCenter;
+		if( GetBacktrackBounds( ppPlayers[i], flTargetTime, vecCenter, flRadius[nCount] ) )
 		{
-			// player most be alive, lost track
-			return;
+			flCenterX[nCount] = vecCenter.x;
+			flCenterY[nCount] = vecCenter.y;
+			flCenterZ[nCount] = vecCenter.z;
+			ppPlayers[nCount++] = ppPlayers[i];
 		}
+	}
 
-		Vector delta = record->m_vecOrigin - prevOrg;
-		if( delta.Length2DSqr() > m_flTeleportDistanceSqr )
-		{
-			// lost track, too much difference
-			return;
-		}
+	// pad out the last group of four with points that never pass
+	for( int i = nCount; i < ALIGN_VALUE( nCount, 4 ); i++ )
+	{
+		flCenterX[i] = flCenterY[i] = flCenterZ[i] = 0.0f;
+		flRadius[i] = -FLT_MAX;
+	}
+
+	Vector vecForward;
+	AngleVectors( cmd->viewangles, &vecForward );
 
-		// did we find a context smaller than target time ?
-		if( record->m_flSimulationTime <= flTargetTime )
+	float flConeAngle = DEG2RAD( sv_unlag_cone_angle.GetFloat() );
+
+	FourVectors apex, dir;
+	apex.DuplicateVector( pShooter->Weapon_ShootPosition() );
+	dir.DuplicateVector( vecForward );
+
+	fltx4 tanAngle = ReplicateX4( tanf( flConeAngle ) );
+	fltx4 invCosAngle = ReplicateX4( 1.0f / cosf( flConeAngle ) );
+	fltx4 nearDist = ReplicateX4( sv_unlag_cone_near.GetFloat() );
+
+	int nKept = 0;
+	for( int i = 0; i < nCount; i += 4 )
+	{
+		FourVectors delta;
+		delta.x = LoadAlignedSIMD( &flCenterX[i] );
+		delta.y = LoadAlignedSIMD( &flCenterY[i] );
+		delta.z = LoadAlignedSIMD( &flCenterZ[i] );
+		delta -= apex;
+
+		fltx4 radius = LoadAlignedSIMD( &flRadius[i] );
+		fltx4 proj = delta * dir;
+		fltx4 lenSqr = delta * delta;
+		fltx4 perpSqr = SubSIMD( lenSqr, MulSIMD( proj, proj ) );
+
+		// Sphere against the cone widened by the radius
+		fltx4 coneRadius = MaddSIMD( proj, tanAngle, MulSIMD( radius, invCosAngle ) );
+		fltx4 inCone = AndSIMD( CmpGeSIMD( coneRadius, Four_Zeros ), CmpLeSIMD( perpSqr, MulSIMD( coneRadius, coneRadius ) ) );
+		inCone = AndSIMD( inCone, CmpGtSIMD( AddSIMD( proj, radius ), Four_Zeros ) );
+
+		// Sphere against the sphere around the shooter
+		fltx4 nearRadius = AddSIMD( nearDist, radius );
+		fltx4 isNear = AndSIMD( CmpGeSIMD( nearRadius, Four_Zeros ), CmpLeSIMD( lenSqr, MulSIMD( nearRadius, nearRadius ) ) );
+
+		int nMask = TestSignSIMD( OrSIMD( inCone, isNear ) );
+		for( int j = 0; j < 4 && i + j < nCount; j++ )
 		{
-			break;    // hurra, stop
+			if( nMask & ( 1 << j ) )
+			{
+				ppPlayers[nKept++] = ppPlayers[i + j];
+			}
 		}
+	}
+
+	nPlayers = nKept;
+}
+
+void CLagCompensationManager::PrintStats()
+{
+	float flCommands = MAX( m_nStatCommands, 1 );
+	Msg( "Lag compensated commands: %d\n", m_nStatCommands );
+	Msg( "  candidates per command: %.2f\n", m_nStatCandidates / flCommands );
+	Msg( "  culled per command:     %.2f\n", m_nStatCulled / flCommands );
+	Msg( "  rewound per command:    %.2f (max %d)\n", m_nStatRewound / flCommands, m_nStatMaxRewound );
+}
 
-		prevOrg = record->m_vecOrigin;
+void CLagCompensationManager::ResetStats()
+{
+	m_nStatCommands = 0;
+	m_nStatCandidates = 0;
+	m_nStatCulled = 0;
+	m_nStatRewound = 0;
+	m_nStatMaxRewound = 0;
+}
 
-		// go one step back
-		curr = track->Next( curr );
+CON_COMMAND( sv_unlag_stats, "Show how many players get backtracked per lag compensated command. 'sv_unlag_stats reset' clears the counters." )
+{
+	if( !UTIL_IsCommandIssuedByServerAdmin() )
+	{
+		return;
 	}
 
-	Assert( record );
+	g_LagCompensationManager.PrintStats();
 
-	if( !record )
+	if( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
 	{
-		if( sv_unlag_debug.GetBool() )
-		{
-			DevMsg( "No valid positions in history for BacktrackPlayer client ( %s )\n", pPlayer->GetPlayerName() );
-		}
+		g_LagCompensationManager.ResetStats();
+	}
+}
 
-		return; // that should never happen
+void CLagCompensationManager::BacktrackPlayer( CBasePlayer* pPlayer, float flTargetTime )
+{
+	Vector org;
+	Vector minsPreScaled;
+	Vector maxsPreScaled;
+	QAngle ang;
+
+	VPROF_BUDGET( "BacktrackPlayer", "CLagCompensationManager" );
+	int pl_index = pPlayer->entindex() - 1;
+
+	// get track history of this player
+	CLagRecordTrack* track = &m_PlayerTrack[ pl_index ];
+
+	// check if we have at leat one entry
+	if( track->Count() <= 0 )
+	{
+		return;
 	}
 
+	// find the first record at or before the target time, the player must have
+	// been alive and not teleported since then or we lost track
+	int iRecord = track->FindRecord( flTargetTime, pPlayer->GetLocalOrigin(), m_flTeleportDistanceSqr );
+	if( iRecord < 0 )
+	{
+		return;
+	}
+
+	LagRecord* record = &track->Element( iRecord );
+	LagRecord* prevRecord = iRecord > 0 ? &track->Element( iRecord - 1 ) : NULL;
+
 	float frac = 0.0f;
 	if( prevRecord &&
 			( record->m_flSimulationTime < flTargetTime ) &&
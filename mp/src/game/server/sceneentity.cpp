@@ -3957,23 +3957,162 @@ bool CSceneEntity::ShouldNetwork() const
 	return false;
 }
 
-CChoreoScene* CSceneEntity::LoadScene( const char* filename, IChoreoEventCallback* pCallback )
+//-----------------------------------------------------------------------------
+// Purpose: Keeps recently loaded scenes in their compiled binary form, so starting
+//  one again only has to restore it rather than pull it back out of scenes.image
+//  (and decompress it) or re-tokenize a loose .vcd. Every load still gets its
+//  own CChoreoScene since playback state lives in the scene and its events.
+//-----------------------------------------------------------------------------
+static ConVar scene_cache_budget( "scene_cache_budget", "8192", 0, "Kilobytes of compiled scenes LoadScene keeps around for reuse (0 disables the cache)." );
+
+// Strings for loose .vcds that were compiled at load time
+class CSceneCacheStringPool : public IChoreoStringPool
 {
-	ChoreoMsg1( 2, "Blocking load of scene from '%s'\n", filename );
+public:
+	short FindOrAddString( const char* pString )
+	{
+		return ( short )( UtlSymId_t )m_Strings.AddString( pString );
+	}
 
-	char loadfile[MAX_PATH];
-	Q_strncpy( loadfile, filename, sizeof( loadfile ) );
-	Q_SetExtension( loadfile, ".vcd", sizeof( loadfile ) );
-	Q_FixSlashes( loadfile );
+	bool GetString( short stringId, char* buff, int buffSize )
+	{
+		V_strncpy( buff, m_Strings.String( CUtlSymbol( ( unsigned short )stringId ) ), buffSize );
+		return true;
+	}
+
+	int Count() const
+	{
+		return m_Strings.GetNumStrings();
+	}
+
+	void RemoveAll()
+	{
+		m_Strings.RemoveAll();
+	}
+
+private:
+	CUtlSymbolTable m_Strings;
+};
+
+class CSceneDataCache : public CAutoGameSystem
+{
+public:
+	CSceneDataCache() : CAutoGameSystem( "CSceneDataCache" )
+	{
+		m_nSerial = 0;
+		m_nBytes = 0;
+		ResetStats();
+	}
+
+	virtual void LevelShutdownPostEntity()
+	{
+		Flush();
+	}
+
+	virtual void Shutdown()
+	{
+		Flush();
+	}
+
+	CChoreoScene* LoadScene( const char* loadfile );
+	void Flush();
+	void ResetStats();
+	void PrintStats();
+
+private:
+	struct CachedScene_t
+	{
+		CUtlBuffer			m_Data;
+		IChoreoStringPool*	m_pStringPool;
+		unsigned int		m_nLastUse;
+	};
+
+	CChoreoScene* RestoreScene( const char* loadfile, CachedScene_t* pCached );
+	CChoreoScene* LoadSceneUncached( const char* loadfile, CachedScene_t* pCached );
+	void EnforceBudget( int nBudget );
+
+	CUtlDict< CachedScene_t*, int >	m_Scenes;
+	CSceneCacheStringPool			m_LooseStrings;
+	unsigned int					m_nSerial;
+	int								m_nBytes;
+
+	int		m_nLoads;
+	int		m_nHits;
+	int		m_nEvictions;
+	float	m_flHitMs;
+	float	m_flMissMs;
+};
+
+static CSceneDataCache g_SceneDataCache;
+
+CChoreoScene* CSceneDataCache::LoadScene( const char* loadfile )
+{
+	CFastTimer timer;
+	timer.Start();
+
+	++m_nLoads;
+
+	int nBudget = scene_cache_budget.GetInt() * 1024;
+	int i = m_Scenes.Find( loadfile );
+	if( i != m_Scenes.InvalidIndex() )
+	{
+		CachedScene_t* pCached = m_Scenes[ i ];
+		pCached->m_nLastUse = ++m_nSerial;
+
+		CChoreoScene* pScene = RestoreScene( loadfile, pCached );
+
+		++m_nHits;
+		timer.End();
+		m_flHitMs += timer.GetDuration().GetMillisecondsF();
+		return pScene;
+	}
+
+	CachedScene_t* pCached = ( nBudget > 0 ) ? new CachedScene_t : NULL;
+	CChoreoScene* pScene = LoadSceneUncached( loadfile, pCached );
+	if( pCached )
+	{
+		int nSize = pCached->m_Data.TellPut();
+		if( pScene && nSize > 0 && nSize <= nBudget )
+		{
+			pCached->m_nLastUse = ++m_nSerial;
+			m_Scenes.Insert( loadfile, pCached );
+			m_nBytes += nSize;
+			EnforceBudget( nBudget );
+		}
+		else
+		{
+			delete pCached;
+		}
+	}
+
+	timer.End();
+	m_flMissMs += timer.GetDuration().GetMillisecondsF();
+	return pScene;
+}
+
+CChoreoScene* CSceneDataCache::RestoreScene( const char* loadfile, CachedScene_t* pCached )
+{
+	CChoreoScene* pScene = new CChoreoScene( NULL );
+	CUtlBuffer buf( pCached->m_Data.Base(), pCached->m_Data.TellPut(), CUtlBuffer::READ_ONLY );
+	if( !pScene->RestoreFromBinaryBuffer( buf, loadfile, pCached->m_pStringPool ) )
+	{
+		Warning( "CSceneEntity::LoadScene: Unable to load binary scene '%s'\n", loadfile );
+		delete pScene;
+		pScene = NULL;
+	}
+	return pScene;
+}
 
+//-----------------------------------------------------------------------------
+// Purpose: Loads the scene from scenes.image (or a loose file), filling in
+//  pCached with its compiled form when it's non-NULL
+//-----------------------------------------------------------------------------
+CChoreoScene* CSceneDataCache::LoadSceneUncached( const char* loadfile, CachedScene_t* pCached )
+{
 	// binary compiled vcd
 	void* pBuffer = NULL;
-#ifdef MAPBASE
-	//
-	// Raw scene file support
-	//
-	CChoreoScene* pScene;
 	int fileSize;
+	CChoreoScene* pScene;
 
 	// First, check if it's in scenes.image...
 	if( CopySceneFileIntoMemory( loadfile, &pBuffer, &fileSize ) )
@@ -3986,14 +4125,31 @@ CChoreoScene* CSceneEntity::LoadScene( const char* filename, IChoreoEventCallbac
 			delete pScene;
 			pScene = NULL;
 		}
+		else if( pCached )
+		{
+			pCached->m_Data.Put( pBuffer, fileSize );
+			pCached->m_pStringPool = &g_ChoreoStringPool;
+		}
 	}
+#ifdef MAPBASE
+	//
+	// Raw scene file support
+	//
 	// Next, check if it's a loose file...
 	else if( filesystem->ReadFileEx( loadfile, "MOD", &pBuffer, true ) )
 	{
 		g_TokenProcessor.SetBuffer( ( char* )pBuffer );
 		pScene = ChoreoLoadScene( loadfile, NULL, &g_TokenProcessor, LocalScene_Printf );
 		g_TokenProcessor.SetBuffer( NULL );
+
+		// Compile it so the next load skips the tokenizer; string ids are shorts
+		if( pScene && pCached && m_LooseStrings.Count() < SHRT_MAX / 2 )
+		{
+			pScene->SaveToBinaryBuffer( pCached->m_Data, 0, &m_LooseStrings );
+			pCached->m_pStringPool = &m_LooseStrings;
+		}
 	}
+#endif
 	// Okay, it's definitely missing.
 	else
 	{
@@ -4001,35 +4157,82 @@ CChoreoScene* CSceneEntity::LoadScene( const char* filename, IChoreoEventCallbac
 		pScene = NULL;
 	}
 
-	if( pScene )
-	{
-		pScene->SetPrintFunc( LocalScene_Printf );
-		pScene->SetEventCallbackInterface( pCallback );
-	}
-#else
-	int fileSize;
-	if( !CopySceneFileIntoMemory( loadfile, &pBuffer, &fileSize ) )
+	FreeSceneFileMemory( pBuffer );
+	return pScene;
+}
+
+void CSceneDataCache::EnforceBudget( int nBudget )
+{
+	while( m_nBytes > nBudget && m_Scenes.Count() )
 	{
-		MissingSceneWarning( loadfile );
-		return NULL;
+		// Least recently used goes first
+		int nOldest = m_Scenes.First();
+		for( int i = m_Scenes.Next( nOldest ); i != m_Scenes.InvalidIndex(); i = m_Scenes.Next( i ) )
+		{
+			if( m_Scenes[ i ]->m_nLastUse < m_Scenes[ nOldest ]->m_nLastUse )
+			{
+				nOldest = i;
+			}
+		}
+
+		m_nBytes -= m_Scenes[ nOldest ]->m_Data.TellPut();
+		delete m_Scenes[ nOldest ];
+		m_Scenes.RemoveAt( nOldest );
+		++m_nEvictions;
 	}
+}
 
-	CChoreoScene* pScene = new CChoreoScene( NULL );
-	CUtlBuffer buf( pBuffer, fileSize, CUtlBuffer::READ_ONLY );
-	if( !pScene->RestoreFromBinaryBuffer( buf, loadfile, &g_ChoreoStringPool ) )
+void CSceneDataCache::Flush()
+{
+	m_Scenes.PurgeAndDeleteElements();
+	m_LooseStrings.RemoveAll();
+	m_nBytes = 0;
+}
+
+void CSceneDataCache::ResetStats()
+{
+	m_nLoads = 0;
+	m_nHits = 0;
+	m_nEvictions = 0;
+	m_flHitMs = 0.0f;
+	m_flMissMs = 0.0f;
+}
+
+void CSceneDataCache::PrintStats()
+{
+	int nMisses = m_nLoads - m_nHits;
+	Msg( "Scene cache: %d scenes, %d of %d KB\n", m_Scenes.Count(), m_nBytes / 1024, scene_cache_budget.GetInt() );
+	Msg( "  %d loads, %d hits (%.1f%%), %d evictions\n", m_nLoads, m_nHits, m_nLoads ? 100.0f * m_nHits / m_nLoads : 0.0f, m_nEvictions );
+	Msg( "  %.3f ms avg per hit, %.3f ms avg per miss\n", m_nHits ? m_flHitMs / m_nHits : 0.0f, nMisses ? m_flMissMs / nMisses : 0.0f );
+}
+
+CON_COMMAND( scene_cache_stats, "Reports how often LoadScene was served from the compiled scene cache. Pass 'reset' to clear the counters." )
+{
+	if( args.ArgC() > 1 && !V_stricmp( args[ 1 ], "reset" ) )
 	{
-		Warning( "CSceneEntity::LoadScene: Unable to load binary scene '%s'\n", loadfile );
-		delete pScene;
-		pScene = NULL;
+		g_SceneDataCache.ResetStats();
+		return;
 	}
-	else
+
+	g_SceneDataCache.PrintStats();
+}
+
+CChoreoScene* CSceneEntity::LoadScene( const char* filename, IChoreoEventCallback* pCallback )
+{
+	ChoreoMsg1( 2, "Blocking load of scene from '%s'\n", filename );
+
+	char loadfile[MAX_PATH];
+	Q_strncpy( loadfile, filename, sizeof( loadfile ) );
+	Q_SetExtension( loadfile, ".vcd", sizeof( loadfile ) );
+	Q_FixSlashes( loadfile );
+
+	CChoreoScene* pScene = g_SceneDataCache.LoadScene( loadfile );
+	if( pScene )
 	{
 		pScene->SetPrintFunc( LocalScene_Printf );
 		pScene->SetEventCallbackInterface( pCallback );
 	}
-#endif
 
-	FreeSceneFileMemory( pBuffer );
 	return pScene;
 }
 
@@ -6854,5 +7057,6 @@ CON_COMMAND( scene_flush, "Flush all .vcds from the cache and reload from disk."
 
 	Msg( "Reloading\n" );
 	scenefilecache->Reload();
+	g_SceneDataCache.Flush();
 	Msg( "   done\n" );
 }
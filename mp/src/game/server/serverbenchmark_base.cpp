@@ -9,6 +9,11 @@
 #include "props.h"
 #include "filesystem.h"
 #include "tier0/icommandline.h"
+#include "eventqueue.h"
+#include "checksum_crc.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
 
 
 // Server benchmark. Only works on specified maps.
@@ -17,9 +22,30 @@
 // Create 20 players and move them around and have them shoot.
 // At the end, report the # seconds it took to complete the test.
 // Don't start measuring for the first N ticks to account for HD load.
+//
+// A scenario benchmark (-sv_benchmark_scenario <file> or the sv_benchmark_scenario command)
+// runs on any map without a CServerBenchmarkHook. Instead of bots it spawns the NPCs, physics
+// props and entity I/O chains described in a KeyValues file:
+//
+//	"ServerBenchmark"
+//	{
+//		"ticks"		"2000"				// defaults to sv_benchmark_numticks
+//		"seed"		"1111"
+//		"origin"	"0 0 64"			// defaults to the info_player_start
+//		"radius"	"1024"				// spawn area around the origin
+//
+//		"npc"		{ "classname" "npc_citizen" "count" "16" "keyvalues" { "squadname" "bench" } }
+//		"prop"		{ "model" "models/props_junk/wood_crate001a.mdl" "count" "64" "force_interval" "100" }
+//		"iochain"	{ "count" "16" "length" "8" "interval" "1" }	// logic_relay chains, fired every "interval" ticks
+//	}
+//
+// Every tick's time is written to <sv_benchmark_report>.csv, split into the ServerBenchmarkTimer_t
+// buckets, with a summary in <sv_benchmark_report>.json. sv_benchmark_compare checks two reports
+// for regressions.
 
 static ConVar sv_benchmark_numticks( "sv_benchmark_numticks", "3300", 0, "If > 0, then it only runs the benchmark for this # of ticks." );
 static ConVar sv_benchmark_autovprofrecord( "sv_benchmark_autovprofrecord", "0", 0, "If running a benchmark and this is set, it will record a vprof file over the duration of the benchmark with filename benchmark.vprof." );
+static ConVar sv_benchmark_report( "sv_benchmark_report", "sv_benchmark", 0, "Base name of the per-tick benchmark report; the .csv and .json are written to the game directory." );
 
 static float s_flBenchmarkStartWaitSeconds = 3;	// Wait this many seconds after level load before starting the benchmark.
 
@@ -29,6 +55,94 @@ static int s_nBenchmarkBotCreateInterval = 50;	// Create a bot every N ticks.
 static int s_nBenchmarkPhysicsObjects = 100;	// Create this many physics objects.
 
 
+static const char* s_pBenchmarkTimerNames[NUM_SERVER_BENCHMARK_TIMERS] =
+{
+	"think",
+	"ai",
+	"physics",
+	"entity_io",
+	"network",
+};
+
+CCycleCount* g_pServerBenchmarkTimers = NULL;
+
+
+// One row of the benchmark report
+struct ServerBenchmarkTick_t
+{
+	float	m_flFrameMS;		// everything between this tick's update and the next one's
+	float	m_flTimerMS[NUM_SERVER_BENCHMARK_TIMERS];
+	int		m_nEntities;
+};
+
+// Column 0 is the frame time, then the timers
+static float BenchmarkTickColumn( const ServerBenchmarkTick_t& tick, int nColumn )
+{
+	return nColumn ? tick.m_flTimerMS[nColumn - 1] : tick.m_flFrameMS;
+}
+
+static const char* BenchmarkColumnName( int nColumn )
+{
+	return nColumn ? s_pBenchmarkTimerNames[nColumn - 1] : "frame";
+}
+
+// For the .json report. Windows paths are full of backslashes.
+static void BenchmarkJSONEscape( const char* pIn, char* pOut, int nOutSize )
+{
+	int nOut = 0;
+	for( ; *pIn && nOut < nOutSize - 2; pIn++ )
+	{
+		if( *pIn == '\\' || *pIn == '"' )
+		{
+			pOut[nOut++] = '\\';
+		}
+		else if( ( unsigned char )*pIn < ' ' )
+		{
+			continue;
+		}
+		pOut[nOut++] = *pIn;
+	}
+	pOut[nOut] = '\0';
+}
+
+struct ServerBenchmarkStats_t
+{
+	float	m_flMean;
+	float	m_flMedian;
+	float	m_flP95;
+	float	m_flMax;
+};
+
+static int __cdecl CompareBenchmarkValues( const float* pA, const float* pB )
+{
+	return ( *pA < *pB ) ? -1 : ( *pA > *pB );
+}
+
+static void ComputeBenchmarkStats( const CUtlVector<ServerBenchmarkTick_t>& ticks, int nColumn, ServerBenchmarkStats_t* pStats )
+{
+	V_memset( pStats, 0, sizeof( *pStats ) );
+	if( !ticks.Count() )
+	{
+		return;
+	}
+
+	CUtlVector<float> values;
+	values.SetCount( ticks.Count() );
+	double flTotal = 0;
+	for( int i = 0; i < ticks.Count(); i++ )
+	{
+		values[i] = BenchmarkTickColumn( ticks[i], nColumn );
+		flTotal += values[i];
+	}
+	values.Sort( CompareBenchmarkValues );
+
+	pStats->m_flMean = flTotal / values.Count();
+	pStats->m_flMedian = values[values.Count() / 2];
+	pStats->m_flP95 = values[MIN( ( values.Count() * 95 ) / 100, values.Count() - 1 )];
+	pStats->m_flMax = values.Tail();
+}
+
+
 static double Benchmark_ValidTime()
 {
 	bool bOld = Plat_IsInBenchmarkMode();
@@ -49,6 +163,7 @@ public:
 	CServerBenchmark()
 	{
 		m_BenchmarkState = BENCHMARKSTATE_NOT_RUNNING;
+		m_pScenario = NULL;
 
 		// The benchmark should always have the same seed and do exactly the same thing on the same ticks.
 		m_RandomStream.SetSeed( 1111 );
@@ -56,11 +171,50 @@ public:
 
 	virtual bool StartBenchmark()
 	{
+		const char* pScenarioFile = CommandLine()->ParmValue( "-sv_benchmark_scenario", ( const char* )NULL );
+		if( pScenarioFile )
+		{
+			// -sv_benchmark_quit is for build scripts
+			int nMode = CommandLine()->FindParm( "-sv_benchmark_quit" ) ? 2 : 1;
+			return InternalStartScenario( pScenarioFile, nMode, s_flBenchmarkStartWaitSeconds );
+		}
+
 		bool bBenchmark = ( CommandLine()->FindParm( "-sv_benchmark" ) != 0 );
 
 		return InternalStartBenchmark( bBenchmark, s_flBenchmarkStartWaitSeconds );
 	}
 
+	bool InternalStartScenario( const char* pScenarioFile, int nBenchmarkMode, float flCountdown )
+	{
+		KeyValues* pScenario = new KeyValues( "ServerBenchmark" );
+		if( !pScenario->LoadFromFile( filesystem, pScenarioFile, "GAME" ) )
+		{
+			Warning( "Couldn't load server benchmark scenario '%s'.\n", pScenarioFile );
+			pScenario->deleteThis();
+			return false;
+		}
+
+		// Tear down the scenario and run that are already going before replacing them
+		RemoveScenario();
+		if( m_BenchmarkState == BENCHMARKSTATE_RUNNING )
+		{
+			EndVProfRecord();
+		}
+		if( m_BenchmarkState != BENCHMARKSTATE_NOT_RUNNING )
+		{
+			EndBenchmark();
+		}
+
+		if( m_pScenario )
+		{
+			m_pScenario->deleteThis();
+		}
+		m_pScenario = pScenario;
+		Q_strncpy( m_szScenarioFile, pScenarioFile, sizeof( m_szScenarioFile ) );
+
+		return InternalStartBenchmark( nBenchmarkMode, flCountdown );
+	}
+
 	// nBenchmarkMode: 0 = no benchmark
 	//                 1 = benchmark
 	//                 2 = exit out afterwards and write sv_benchmark.txt
@@ -80,7 +234,7 @@ public:
 
 		m_nBenchmarkMode = nBenchmarkMode;
 
-		if( !CServerBenchmarkHook::s_pBenchmarkHook )
+		if( !m_pScenario && !CServerBenchmarkHook::s_pBenchmarkHook )
 		{
 			Error( "This game doesn't support server benchmarks (no CServerBenchmarkHook found)." );
 		}
@@ -95,9 +249,14 @@ public:
 		// Setup the benchmark environment.
 		engine->SetDedicatedServerBenchmarkMode( true );	// Run 1 tick per frame and ignore all timing stuff.
 
+		m_Ticks.Purge();
+
 		// Tell the game-specific hook that we're starting.
-		CServerBenchmarkHook::s_pBenchmarkHook->StartBenchmark();
-		CServerBenchmarkHook::s_pBenchmarkHook->GetPhysicsModelNames( m_PhysicsModelNames );
+		if( CServerBenchmarkHook::s_pBenchmarkHook )
+		{
+			CServerBenchmarkHook::s_pBenchmarkHook->StartBenchmark();
+			CServerBenchmarkHook::s_pBenchmarkHook->GetPhysicsModelNames( m_PhysicsModelNames );
+		}
 
 		return true;
 	}
@@ -130,27 +289,80 @@ public:
 
 				StartVProfRecord();
 
-				RandomSeed( 0 );
-				m_RandomStream.SetSeed( 0 );
+				int nSeed = m_pScenario ? m_pScenario->GetInt( "seed", 1111 ) : 0;
+				RandomSeed( nSeed );
+				m_RandomStream.SetSeed( nSeed );
+
+				if( m_pScenario )
+				{
+					SpawnScenario();
+				}
+
+				// Time from here on goes in the report
+				for( int i = 0; i < NUM_SERVER_BENCHMARK_TIMERS; i++ )
+				{
+					m_Timers[i].Init();
+				}
+				g_pServerBenchmarkTimers = m_Timers;
+				m_flLastTickTime = Benchmark_ValidTime();
 			}
 		}
 
 		int nTicksRunSoFar = gpGlobals->tickcount - m_nBenchmarkStartTick;
 		UpdateBenchmarkCounter();
 
+		if( nTicksRunSoFar > 0 )
+		{
+			RecordTick();
+		}
+
 		// Are we finished with the benchmark?
-		if( nTicksRunSoFar >= sv_benchmark_numticks.GetInt() )
+		if( nTicksRunSoFar >= GetNumTicks() )
 		{
 			EndVProfRecord();
 			OutputResults();
+			RemoveScenario();
 			EndBenchmark();
 			return;
 		}
 
 		// Ok, update whatever we're doing in the benchmark.
-		UpdatePlayerCreation();
-		UpdateVPhysicsObjects();
-		CServerBenchmarkHook::s_pBenchmarkHook->UpdateBenchmark();
+		if( m_pScenario )
+		{
+			UpdateScenario();
+		}
+		else
+		{
+			UpdatePlayerCreation();
+			UpdateVPhysicsObjects();
+		}
+
+		if( CServerBenchmarkHook::s_pBenchmarkHook )
+		{
+			CServerBenchmarkHook::s_pBenchmarkHook->UpdateBenchmark();
+		}
+	}
+
+	int GetNumTicks()
+	{
+		return m_pScenario ? m_pScenario->GetInt( "ticks", sv_benchmark_numticks.GetInt() ) : sv_benchmark_numticks.GetInt();
+	}
+
+	// Closes the row for the tick that just ran
+	void RecordTick()
+	{
+		double flTime = Benchmark_ValidTime();
+
+		ServerBenchmarkTick_t& tick = m_Ticks[m_Ticks.AddToTail()];
+		tick.m_flFrameMS = ( flTime - m_flLastTickTime ) * 1000.0;
+		for( int i = 0; i < NUM_SERVER_BENCHMARK_TIMERS; i++ )
+		{
+			tick.m_flTimerMS[i] = m_Timers[i].GetMillisecondsF();
+			m_Timers[i].Init();
+		}
+		tick.m_nEntities = gEntList.NumberOfEntities();
+
+		m_flLastTickTime = flTime;
 	}
 
 	void StartVProfRecord()
@@ -192,6 +404,16 @@ public:
 
 		m_BenchmarkState = BENCHMARKSTATE_NOT_RUNNING;
 		engine->SetDedicatedServerBenchmarkMode( false );
+		g_pServerBenchmarkTimers = NULL;
+
+		if( m_pScenario )
+		{
+			m_pScenario->deleteThis();
+			m_pScenario = NULL;
+		}
+		m_ScenarioEntities.Purge();
+		m_IOChainHeads.Purge();
+		m_IOChainIntervals.Purge();
 	}
 
 	virtual bool IsLocalBenchmarkPlayer( CBasePlayer* pPlayer )
@@ -209,7 +431,7 @@ public:
 
 	void UpdateVPhysicsObjects()
 	{
-		int nPhysicsObjectInterval = sv_benchmark_numticks.GetInt() / s_nBenchmarkPhysicsObjects;
+		int nPhysicsObjectInterval = GetNumTicks() / s_nBenchmarkPhysicsObjects;
 
 		int nNextSpawnTick = m_nLastPhysicsObjectTick + nPhysicsObjectInterval;
 		if( GetTickOffset() >= nNextSpawnTick )
@@ -255,26 +477,30 @@ public:
 		}
 
 		// Give them all a boost periodically.
-		int nPhysicsForceInterval = sv_benchmark_numticks.GetInt() / 20;
+		int nPhysicsForceInterval = GetNumTicks() / 20;
 
 		int nNextForceTick = m_nLastPhysicsForceTick + nPhysicsForceInterval;
 		if( GetTickOffset() >= nNextForceTick )
 		{
 			m_nLastPhysicsForceTick = nNextForceTick;
+			BoostPhysicsObjects();
+		}
+	}
 
-			for( int i = 0; i < m_PhysicsObjects.Count(); i++ )
+	void BoostPhysicsObjects()
+	{
+		for( int i = 0; i < m_PhysicsObjects.Count(); i++ )
+		{
+			CBaseEntity* pEnt = m_PhysicsObjects[i];
+			if( pEnt )
 			{
-				CBaseEntity* pEnt = m_PhysicsObjects[i];
-				if( pEnt )
+				IPhysicsObject* pPhysicsObject = pEnt->VPhysicsGetObject();
+				if( pPhysicsObject )
 				{
-					IPhysicsObject* pPhysicsObject = pEnt->VPhysicsGetObject();
-					if( pPhysicsObject )
-					{
-						float flAngImpulse = 300000;
-						float flForce = 500000;
-						AngularImpulse vAngularImpulse( this->RandomFloat( -flAngImpulse, flAngImpulse ), this->RandomFloat( -flAngImpulse, flAngImpulse ), this->RandomFloat( flAngImpulse, flAngImpulse ) );
-						pPhysicsObject->ApplyForceCenter( Vector( this->RandomFloat( -flForce, flForce ), this->RandomFloat( -flForce, flForce ), this->RandomFloat( 0, flForce ) ) );
-					}
+					float flAngImpulse = 300000;
+					float flForce = 500000;
+					AngularImpulse vAngularImpulse( this->RandomFloat( -flAngImpulse, flAngImpulse ), this->RandomFloat( -flAngImpulse, flAngImpulse ), this->RandomFloat( flAngImpulse, flAngImpulse ) );
+					pPhysicsObject->ApplyForceCenter( Vector( this->RandomFloat( -flForce, flForce ), this->RandomFloat( -flForce, flForce ), this->RandomFloat( 0, flForce ) ) );
 				}
 			}
 		}
@@ -296,7 +522,7 @@ public:
 		if( ( flCurTime - m_flLastBenchmarkCounterUpdate ) > 3.0f )
 		{
 			m_flLastBenchmarkCounterUpdate = flCurTime;
-			Msg( "Benchmark: %d%% complete.\n", ( ( gpGlobals->tickcount - m_nBenchmarkStartTick ) * 100 ) / sv_benchmark_numticks.GetInt() );
+			Msg( "Benchmark: %d%% complete.\n", ( ( gpGlobals->tickcount - m_nBenchmarkStartTick ) * 100 ) / GetNumTicks() );
 		}
 	}
 
@@ -342,10 +568,298 @@ public:
 
 		Warning( "------------------ SERVER BENCHMARK RESULTS ------------------\n" );
 		Warning( "Total time          : %.2f seconds\n", flRunTime );
-		Warning( "Num ticks simulated : %d\n", sv_benchmark_numticks.GetInt() );
-		Warning( "Ticks per second    : %.2f\n", sv_benchmark_numticks.GetInt() / flRunTime );
+		Warning( "Num ticks simulated : %d\n", GetNumTicks() );
+		Warning( "Ticks per second    : %.2f\n", GetNumTicks() / flRunTime );
 		Warning( "Benchmark CRC       : %d\n", CalculateBenchmarkCRC() );
 		Warning( "--------------------------------------------------------------\n" );
+
+		WriteReport( flRunTime );
+	}
+
+	// <sv_benchmark_report>.csv has a row per tick, <sv_benchmark_report>.json the summary
+	void WriteReport( float flRunTime )
+	{
+		char szFilename[MAX_PATH];
+		Q_snprintf( szFilename, sizeof( szFilename ), "%s.csv", sv_benchmark_report.GetString() );
+
+		FileHandle_t fh = filesystem->Open( szFilename, "wt", "DEFAULT_WRITE_PATH" );
+		if( !fh )
+		{
+			Warning( "Couldn't write the benchmark report %s\n", szFilename );
+			return;
+		}
+
+		filesystem->FPrintf( fh, "tick" );
+		for( int nColumn = 0; nColumn <= NUM_SERVER_BENCHMARK_TIMERS; nColumn++ )
+		{
+			filesystem->FPrintf( fh, ",%s_ms", BenchmarkColumnName( nColumn ) );
+		}
+		filesystem->FPrintf( fh, ",entities\n" );
+
+		for( int i = 0; i < m_Ticks.Count(); i++ )
+		{
+			filesystem->FPrintf( fh, "%d", i );
+			for( int nColumn = 0; nColumn <= NUM_SERVER_BENCHMARK_TIMERS; nColumn++ )
+			{
+				filesystem->FPrintf( fh, ",%.4f", BenchmarkTickColumn( m_Ticks[i], nColumn ) );
+			}
+			filesystem->FPrintf( fh, ",%d\n", m_Ticks[i].m_nEntities );
+		}
+		filesystem->Close( fh );
+
+		Q_snprintf( szFilename, sizeof( szFilename ), "%s.json", sv_benchmark_report.GetString() );
+		fh = filesystem->Open( szFilename, "wt", "DEFAULT_WRITE_PATH" );
+		if( !fh )
+		{
+			Warning( "Couldn't write the benchmark report %s\n", szFilename );
+			return;
+		}
+
+		char szMap[MAX_PATH * 2];
+		char szScenario[MAX_PATH * 2];
+		BenchmarkJSONEscape( STRING( gpGlobals->mapname ), szMap, sizeof( szMap ) );
+		BenchmarkJSONEscape( m_pScenario ? m_szScenarioFile : "", szScenario, sizeof( szScenario ) );
+
+		filesystem->FPrintf( fh, "{\n" );
+		filesystem->FPrintf( fh, "\t\"map\": \"%s\",\n", szMap );
+		filesystem->FPrintf( fh, "\t\"scenario\": \"%s\",\n", szScenario );
+		filesystem->FPrintf( fh, "\t\"seed\": %d,\n", m_pScenario ? m_pScenario->GetInt( "seed", 1111 ) : 0 );
+		filesystem->FPrintf( fh, "\t\"ticks\": %d,\n", m_Ticks.Count() );
+		filesystem->FPrintf( fh, "\t\"total_seconds\": %.4f,\n", flRunTime );
+		filesystem->FPrintf( fh, "\t\"ticks_per_second\": %.2f,\n", m_Ticks.Count() / flRunTime );
+		filesystem->FPrintf( fh, "\t\"crc\": %d,\n", CalculateBenchmarkCRC() );
+		filesystem->FPrintf( fh, "\t\"timers_ms\":\n\t{\n" );
+		for( int nColumn = 0; nColumn <= NUM_SERVER_BENCHMARK_TIMERS; nColumn++ )
+		{
+			ServerBenchmarkStats_t stats;
+			ComputeBenchmarkStats( m_Ticks, nColumn, &stats );
+			filesystem->FPrintf( fh, "\t\t\"%s\": { \"mean\": %.4f, \"median\": %.4f, \"p95\": %.4f, \"max\": %.4f }%s\n",
+								 BenchmarkColumnName( nColumn ), stats.m_flMean, stats.m_flMedian, stats.m_flP95, stats.m_flMax,
+								 nColumn < NUM_SERVER_BENCHMARK_TIMERS ? "," : "" );
+		}
+		filesystem->FPrintf( fh, "\t}\n}\n" );
+		filesystem->Close( fh );
+
+		Msg( "Wrote benchmark report %s.csv and %s.json\n", sv_benchmark_report.GetString(), sv_benchmark_report.GetString() );
+	}
+
+	//-----------------------------------------------------------------------------
+	// Scenario benchmarks
+	//-----------------------------------------------------------------------------
+	void SpawnScenario()
+	{
+		const char* pOrigin = m_pScenario->GetString( "origin", NULL );
+		if( pOrigin )
+		{
+			UTIL_StringToVector( m_vecScenarioOrigin.Base(), pOrigin );
+		}
+		else
+		{
+			CBaseEntity* pStart = gEntList.FindEntityByClassname( NULL, "info_player_start" );
+			m_vecScenarioOrigin = pStart ? pStart->GetAbsOrigin() : vec3_origin;
+		}
+		m_flScenarioRadius = m_pScenario->GetFloat( "radius", 1024.0f );
+		m_nPropForceInterval = 0;
+
+		int nNPCs = 0, nProps = 0;
+		for( KeyValues* pKey = m_pScenario->GetFirstTrueSubKey(); pKey; pKey = pKey->GetNextTrueSubKey() )
+		{
+			if( !Q_stricmp( pKey->GetName(), "npc" ) )
+			{
+				nNPCs += SpawnScenarioNPCs( pKey );
+			}
+			else if( !Q_stricmp( pKey->GetName(), "prop" ) )
+			{
+				nProps += SpawnScenarioProps( pKey );
+			}
+			else if( !Q_stricmp( pKey->GetName(), "iochain" ) )
+			{
+				CreateScenarioIOChains( pKey );
+			}
+			else
+			{
+				Warning( "Unknown server benchmark scenario block '%s'\n", pKey->GetName() );
+			}
+		}
+
+		Msg( "Benchmark scenario: %d NPCs, %d physics props, %d entity I/O chains.\n", nNPCs, nProps, m_IOChainHeads.Count() );
+	}
+
+	Vector RandomScenarioSpot()
+	{
+		return m_vecScenarioOrigin + Vector( m_RandomStream.RandomFloat( -m_flScenarioRadius, m_flScenarioRadius ),
+											 m_RandomStream.RandomFloat( -m_flScenarioRadius, m_flScenarioRadius ), 32.0f );
+	}
+
+	int SpawnScenarioNPCs( KeyValues* pKey )
+	{
+		const char* pClassname = pKey->GetString( "classname", "npc_citizen" );
+		KeyValues* pKeyValues = pKey->FindKey( "keyvalues" );
+
+		int nSpawned = 0;
+		int nCount = pKey->GetInt( "count", 1 );
+		for( int i = 0; i < nCount; i++ )
+		{
+			CBaseEntity* pEnt = CreateEntityByName( pClassname );
+			if( !pEnt )
+			{
+				Warning( "Benchmark scenario: couldn't create a '%s'\n", pClassname );
+				break;
+			}
+
+			pEnt->SetAbsOrigin( RandomScenarioSpot() );
+			pEnt->SetAbsAngles( QAngle( 0, m_RandomStream.RandomFloat( 0, 360 ), 0 ) );
+			if( pKeyValues )
+			{
+				for( KeyValues* pValue = pKeyValues->GetFirstValue(); pValue; pValue = pValue->GetNextValue() )
+				{
+					pEnt->KeyValue( pValue->GetName(), pValue->GetString() );
+				}
+			}
+
+			bool bAllowPrecache = CBaseEntity::IsPrecacheAllowed();
+			CBaseEntity::SetAllowPrecache( true );
+			DispatchSpawn( pEnt );
+			CBaseEntity::SetAllowPrecache( bAllowPrecache );
+			pEnt->Activate();
+
+			// Try a few spots before giving up on this one
+			bool bPlaced = false;
+			for( int nTry = 0; nTry < 15 && !bPlaced; nTry++ )
+			{
+				if( nTry )
+				{
+					UTIL_SetOrigin( pEnt, RandomScenarioSpot() );
+				}
+				bPlaced = ( UTIL_DropToFloor( pEnt, MASK_NPCSOLID ) == 1 );
+			}
+
+			if( !bPlaced )
+			{
+				UTIL_Remove( pEnt );
+				continue;
+			}
+
+			m_ScenarioEntities.AddToTail( pEnt );
+			nSpawned++;
+		}
+
+		return nSpawned;
+	}
+
+	int SpawnScenarioProps( KeyValues* pKey )
+	{
+		const char* pModelName = pKey->GetString( "model", NULL );
+		if( !pModelName )
+		{
+			Warning( "Benchmark scenario: prop block has no model\n" );
+			return 0;
+		}
+
+		if( pKey->GetInt( "force_interval" ) > 0 )
+		{
+			m_nPropForceInterval = pKey->GetInt( "force_interval" );
+		}
+
+		int nSpawned = 0;
+		int nCount = pKey->GetInt( "count", 1 );
+		for( int i = 0; i < nCount; i++ )
+		{
+			// We'll try 15 locations to spawn this thing.
+			for( int nTry = 0; nTry < 15; nTry++ )
+			{
+				Vector vSpawnPos = RandomScenarioSpot();
+				CPhysicsProp* pProp = CreatePhysicsProp( pModelName, vSpawnPos, vSpawnPos - Vector( 0, 0, 1024 ), NULL, false, "prop_physics" );
+				if( pProp )
+				{
+					m_PhysicsObjects.AddToTail( pProp );
+					nSpawned++;
+					break;
+				}
+			}
+		}
+
+		return nSpawned;
+	}
+
+	// Chains of logic_relays that trigger the next one, so firing the head runs
+	// "length" outputs and name lookups through the event queue.
+	void CreateScenarioIOChains( KeyValues* pKey )
+	{
+		int nCount = pKey->GetInt( "count", 1 );
+		int nLength = MAX( pKey->GetInt( "length", 8 ), 1 );
+		int nInterval = MAX( pKey->GetInt( "interval", 1 ), 1 );
+
+		for( int i = 0; i < nCount; i++ )
+		{
+			int nChain = m_IOChainHeads.Count();
+			for( int nLink = 0; nLink < nLength; nLink++ )
+			{
+				CBaseEntity* pRelay = CreateEntityByName( "logic_relay" );
+				if( !pRelay )
+				{
+					return;
+				}
+
+				pRelay->KeyValue( "targetname", UTIL_VarArgs( "sv_benchmark_io_%d_%d", nChain, nLink ) );
+				if( nLink + 1 < nLength )
+				{
+					pRelay->KeyValue( "OnTrigger", UTIL_VarArgs( "sv_benchmark_io_%d_%d,Trigger,,0,-1", nChain, nLink + 1 ) );
+				}
+				DispatchSpawn( pRelay );
+				pRelay->Activate();
+
+				m_ScenarioEntities.AddToTail( pRelay );
+				if( nLink == 0 )
+				{
+					m_IOChainHeads.AddToTail( pRelay );
+					m_IOChainIntervals.AddToTail( nInterval );
+				}
+			}
+		}
+	}
+
+	void UpdateScenario()
+	{
+		int nTick = GetTickOffset();
+
+		for( int i = 0; i < m_IOChainHeads.Count(); i++ )
+		{
+			if( m_IOChainHeads[i] && ( nTick % m_IOChainIntervals[i] ) == 0 )
+			{
+				g_EventQueue.AddEvent( m_IOChainHeads[i], "Trigger", 0.0f, NULL, NULL );
+			}
+		}
+
+		if( m_nPropForceInterval > 0 && nTick > 0 && ( nTick % m_nPropForceInterval ) == 0 )
+		{
+			BoostPhysicsObjects();
+		}
+	}
+
+	void RemoveScenario()
+	{
+		if( !m_pScenario )
+		{
+			return;
+		}
+
+		for( int i = 0; i < m_ScenarioEntities.Count(); i++ )
+		{
+			if( m_ScenarioEntities[i] )
+			{
+				UTIL_Remove( m_ScenarioEntities[i] );
+			}
+		}
+
+		for( int i = 0; i < m_PhysicsObjects.Count(); i++ )
+		{
+			if( m_PhysicsObjects[i] )
+			{
+				UTIL_Remove( m_PhysicsObjects[i] );
+			}
+		}
+		m_PhysicsObjects.Purge();
 	}
 
 	int CalculateBenchmarkCRC()
@@ -363,6 +877,28 @@ public:
 			}
 		}
 
+		// Where the scenario's NPCs and props ended up, so runs with the same seed can be checked against each other
+		for( int i = 0; i < m_ScenarioEntities.Count(); i++ )
+		{
+			if( m_ScenarioEntities[i] && m_ScenarioEntities[i]->MyNPCPointer() )
+			{
+				crc += ( int )m_ScenarioEntities[i]->GetAbsOrigin().x;
+				crc += ( int )m_ScenarioEntities[i]->GetAbsOrigin().y;
+			}
+		}
+
+		if( m_pScenario )
+		{
+			for( int i = 0; i < m_PhysicsObjects.Count(); i++ )
+			{
+				if( m_PhysicsObjects[i] )
+				{
+					crc += ( int )m_PhysicsObjects[i]->GetAbsOrigin().x;
+					crc += ( int )m_PhysicsObjects[i]->GetAbsOrigin().y;
+				}
+			}
+		}
+
 		return crc;
 	}
 
@@ -405,6 +941,21 @@ private:
 	int m_nBenchmarkMode;
 
 	CUniformRandomStream m_RandomStream;
+
+	// Per-tick report
+	CCycleCount m_Timers[NUM_SERVER_BENCHMARK_TIMERS];
+	CUtlVector< ServerBenchmarkTick_t > m_Ticks;
+	double m_flLastTickTime;
+
+	// Scenario benchmarks
+	KeyValues* m_pScenario;
+	char m_szScenarioFile[MAX_PATH];
+	Vector m_vecScenarioOrigin;
+	float m_flScenarioRadius;
+	int m_nPropForceInterval;
+	CUtlVector< EHANDLE > m_ScenarioEntities;		// NPCs and relays; props are in m_PhysicsObjects
+	CUtlVector< EHANDLE > m_IOChainHeads;
+	CUtlVector< int > m_IOChainIntervals;
 };
 
 static CServerBenchmark g_ServerBenchmark;
@@ -420,6 +971,132 @@ CON_COMMAND( sv_benchmark_force_start, "Force start the benchmark. This is only
 	g_ServerBenchmark.InternalStartBenchmark( 1, 1 );
 }
 
+CON_COMMAND( sv_benchmark_scenario, "Run a scripted server benchmark on the current map. Usage: sv_benchmark_scenario <scenario file>" )
+{
+	if( !UTIL_IsCommandIssuedByServerAdmin() )
+	{
+		return;
+	}
+
+	if( args.ArgC() < 2 )
+	{
+		Msg( "Usage: sv_benchmark_scenario <scenario file>\n" );
+		return;
+	}
+
+	g_ServerBenchmark.InternalStartScenario( args[1], 1, 1 );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads the rows of a report written by WriteReport
+//-----------------------------------------------------------------------------
+static bool LoadBenchmarkReport( const char* pFilename, CUtlVector<ServerBenchmarkTick_t>& ticks )
+{
+	CUtlBuffer buf( 0, 0, CUtlBuffer::TEXT_BUFFER );
+	if( !filesystem->ReadFile( pFilename, "GAME", buf ) )
+	{
+		Warning( "Couldn't read benchmark report %s\n", pFilename );
+		return false;
+	}
+
+	ticks.Purge();
+
+	char szLine[1024];
+	while( buf.IsValid() && buf.GetBytesRemaining() > 0 )
+	{
+		buf.GetLine( szLine, sizeof( szLine ) );
+		if( szLine[0] < '0' || szLine[0] > '9' )
+		{
+			// header
+			continue;
+		}
+
+		ServerBenchmarkTick_t tick;
+		int nTick;
+		COMPILE_TIME_ASSERT( NUM_SERVER_BENCHMARK_TIMERS == 5 );
+		if( sscanf( szLine, "%d,%f,%f,%f,%f,%f,%f,%d", &nTick, &tick.m_flFrameMS,
+					&tick.m_flTimerMS[0], &tick.m_flTimerMS[1], &tick.m_flTimerMS[2], &tick.m_flTimerMS[3], &tick.m_flTimerMS[4],
+					&tick.m_nEntities ) == 8 )
+		{
+			ticks.AddToTail( tick );
+		}
+	}
+
+	if( !ticks.Count() )
+	{
+		Warning( "Benchmark report %s has no ticks\n", pFilename );
+		return false;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Flags columns whose median or 95th percentile got worse by more
+//			than the tolerance. Writes sv_benchmark_compare.txt for build scripts.
+//-----------------------------------------------------------------------------
+CON_COMMAND( sv_benchmark_compare, "Compare two server benchmark reports. Usage: sv_benchmark_compare <baseline.csv> <new.csv> [tolerance percent]" )
+{
+	if( !UTIL_IsCommandIssuedByServerAdmin() )
+	{
+		return;
+	}
+
+	if( args.ArgC() < 3 )
+	{
+		Msg( "Usage: sv_benchmark_compare <baseline.csv> <new.csv> [tolerance percent, default 5]\n" );
+		return;
+	}
+
+	CUtlVector<ServerBenchmarkTick_t> baseline, current;
+	if( !LoadBenchmarkReport( args[1], baseline ) || !LoadBenchmarkReport( args[2], current ) )
+	{
+		return;
+	}
+
+	float flTolerance = ( args.ArgC() > 3 ? atof( args[3] ) : 5.0f ) / 100.0f;
+
+	// Anything under this is timer noise
+	const float flMinDeltaMS = 0.01f;
+
+	if( baseline.Count() != current.Count() || baseline[0].m_nEntities != current[0].m_nEntities )
+	{
+		Warning( "The reports don't look like the same scenario (%d ticks/%d entities vs %d ticks/%d entities)\n",
+				 baseline.Count(), baseline[0].m_nEntities, current.Count(), current[0].m_nEntities );
+	}
+
+	Msg( "%-10s %12s %12s %12s %12s\n", "ms", "base median", "new median", "base p95", "new p95" );
+
+	int nRegressions = 0;
+	for( int nColumn = 0; nColumn <= NUM_SERVER_BENCHMARK_TIMERS; nColumn++ )
+	{
+		ServerBenchmarkStats_t base, cur;
+		ComputeBenchmarkStats( baseline, nColumn, &base );
+		ComputeBenchmarkStats( current, nColumn, &cur );
+
+		bool bMedianWorse = cur.m_flMedian > base.m_flMedian * ( 1.0f + flTolerance ) && cur.m_flMedian - base.m_flMedian > flMinDeltaMS;
+		bool bP95Worse = cur.m_flP95 > base.m_flP95 * ( 1.0f + flTolerance ) && cur.m_flP95 - base.m_flP95 > flMinDeltaMS;
+
+		Msg( "%-10s %12.4f %12.4f %12.4f %12.4f%s\n", BenchmarkColumnName( nColumn ),
+			 base.m_flMedian, cur.m_flMedian, base.m_flP95, cur.m_flP95, ( bMedianWorse || bP95Worse ) ? "  REGRESSION" : "" );
+
+		if( bMedianWorse || bP95Worse )
+		{
+			nRegressions++;
+		}
+	}
+
+	Msg( "%d regression%s (tolerance %.1f%%)\n", nRegressions, nRegressions == 1 ? "" : "s", flTolerance * 100.0f );
+
+	FileHandle_t fh = filesystem->Open( "sv_benchmark_compare.txt", "wt", "DEFAULT_WRITE_PATH" );
+	if( fh )
+	{
+		filesystem->FPrintf( fh, "regressions := %d\n", nRegressions );
+		filesystem->Close( fh );
+	}
+}
+
 
 // ---------------------------------------------------------------------------------------------- //
 // CServerBenchmarkHook implementation.
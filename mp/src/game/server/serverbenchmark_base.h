@@ -10,6 +10,8 @@
 	#pragma once
 #endif
 
+#include "tier0/fasttimer.h"
+
 
 // The base server code calls into this.
 class IServerBenchmark
@@ -31,6 +33,32 @@ public:
 extern IServerBenchmark* g_pServerBenchmark;
 
 
+//
+// Per-tick timings for the benchmark report. Wrap the code for a subsystem in
+//
+//     CTimeAdder timer( ServerBenchmarkTimer( SERVER_BENCHMARK_PHYSICS ) );
+//
+// It only adds anything while a benchmark is recording.
+//
+enum ServerBenchmarkTimer_t
+{
+	SERVER_BENCHMARK_THINK,
+	SERVER_BENCHMARK_AI,			// NPC thinks. These are also counted in SERVER_BENCHMARK_THINK.
+	SERVER_BENCHMARK_PHYSICS,
+	SERVER_BENCHMARK_ENTITY_IO,
+	SERVER_BENCHMARK_NETWORK,		// the game's side of it: client data and CheckTransmit
+
+	NUM_SERVER_BENCHMARK_TIMERS
+};
+
+extern CCycleCount* g_pServerBenchmarkTimers;	// NULL unless a benchmark is recording
+
+inline CCycleCount* ServerBenchmarkTimer( ServerBenchmarkTimer_t timer )
+{
+	return g_pServerBenchmarkTimers ? &g_pServerBenchmarkTimers[timer] : NULL;
+}
+
+
 //
 // Each game can derive from this to hook into the server benchmark.
 //
@@ -3388,7 +3388,7 @@ void CTriggerToggleSave::Touch( CBaseEntity* pOther )
 	// Can be re-enabled
 	m_bDisabled = true;
 
-	engine->ServerCommand( "autosave\n" );
+	g_ServerGameDLL.RequestAutosave();
 }
 
 //-----------------------------------------------------------------------------
@@ -3481,7 +3481,7 @@ void CTriggerSave::Touch( CBaseEntity* pOther )
 	}
 	else
 	{
-		engine->ServerCommand( "autosave\n" );
+		g_ServerGameDLL.RequestAutosave();
 	}
 }
 
@@ -23,6 +23,8 @@
 #include "igamesystem.h"
 #include "saverestoretypes.h"
 #include "checksum_crc.h"
+#include "checksum_md5.h"
+#include "tier0/fasttimer.h"
 #include "hierarchy.h"
 #include "iservervehicle.h"
 #include "te_effect_dispatch.h"
@@ -3783,5 +3785,93 @@ void CC_CollisionTest( const CCommand& args )
 static ConCommand collision_test( "collision_test", CC_CollisionTest, "Tests collision system", FCVAR_CHEAT );
 
 
+//-----------------------------------------------------------------------------
+// crc32_bench: CRC32 throughput of the old byte-at-a-time loop against
+// slicing-by-8, PCLMULQDQ folding and the threaded split, on random data.
+//-----------------------------------------------------------------------------
+static CRC32_t CRC32BenchBytewise( const unsigned char* pData, int nBytes )
+{
+	CRC32_t crc;
+	CRC32_Init( &crc );
+	for( int i = 0; i < nBytes; i++ )
+	{
+		crc = CRC32_GetTableEntry( pData[i] ^ ( unsigned char )crc ) ^ ( crc >> 8 );
+	}
+	CRC32_Final( &crc );
+	return crc;
+}
+
+static void CRC32BenchReport( const char* pszName, CFastTimer& timer, int nBytes, CRC32_t crc, CRC32_t crcExpected )
+{
+	double flSeconds = timer.GetDuration().GetSeconds();
+	Msg( "  %-18s %8.2f ms %9.1f MB/s   %08x %s\n", pszName, flSeconds * 1000.0,
+		 flSeconds > 0 ? nBytes / ( flSeconds * 1024.0 * 1024.0 ) : 0.0, crc, crc == crcExpected ? "" : "MISMATCH" );
+}
+
+CON_COMMAND( crc32_bench, "Time CRC32 implementations against each other. Usage: crc32_bench [MB] [threads]" )
+{
+	if( !UTIL_IsCommandIssuedByServerAdmin() )
+	{
+		return;
+	}
+
+	int nMegabytes = args.ArgC() > 1 ? clamp( atoi( args[1] ), 1, 1024 ) : 64;
+	int nThreads = args.ArgC() > 2 ? MAX( atoi( args[2] ), 0 ) : 0;
+	int nBytes = nMegabytes * 1024 * 1024;
+
+	// Odd start and length so the unaligned head and tail are covered
+	CUtlMemory< unsigned char > buffer;
+	buffer.EnsureCapacity( nBytes + 16 );
+	unsigned char* pData = buffer.Base() + 3;
+	nBytes -= 5;
+	CUniformRandomStream random;
+	random.SetSeed( 1 );
+	for( int i = 0; i < nBytes; i++ )
+	{
+		pData[i] = ( unsigned char )random.RandomInt( 0, 255 );
+	}
+
+	Msg( "crc32_bench: %d MB, PCLMULQDQ %s\n", nMegabytes, CRC32_HasHardwareAccel() ? "available" : "not available" );
+
+	CFastTimer timer;
+	timer.Start();
+	CRC32_t crcExpected = CRC32BenchBytewise( pData, nBytes );
+	timer.End();
+	CRC32BenchReport( "byte at a time", timer, nBytes, crcExpected, crcExpected );
+
+	CRC32_EnableHardwareAccel( false );
+	timer.Start();
+	CRC32_t crc = CRC32_ProcessSingleBuffer( pData, nBytes );
+	timer.End();
+	CRC32BenchReport( "slicing-by-8", timer, nBytes, crc, crcExpected );
+
+	if( CRC32_EnableHardwareAccel( true ) )
+	{
+		timer.Start();
+		crc = CRC32_ProcessSingleBuffer( pData, nBytes );
+		timer.End();
+		CRC32BenchReport( "pclmulqdq", timer, nBytes, crc, crcExpected );
+	}
+
+	timer.Start();
+	CRC32_Init( &crc );
+	CRC32_ProcessBufferParallel( &crc, pData, nBytes, nThreads );
+	CRC32_Final( &crc );
+	timer.End();
+	CRC32BenchReport( "threaded", timer, nBytes, crc, crcExpected );
+
+	// For scale; MD5 rounds depend on each other, so it stays scalar
+	unsigned char digest[MD5_DIGEST_LENGTH];
+	MD5Context_t ctx;
+	timer.Start();
+	MD5Init( &ctx );
+	MD5Update( &ctx, pData, nBytes );
+	MD5Final( digest, &ctx );
+	timer.End();
+	double flSeconds = timer.GetDuration().GetSeconds();
+	Msg( "  %-18s %8.2f ms %9.1f MB/s\n", "md5", flSeconds * 1000.0, flSeconds > 0 ? nBytes / ( flSeconds * 1024.0 * 1024.0 ) : 0.0 );
+}
+
+
 
 
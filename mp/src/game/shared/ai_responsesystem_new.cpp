@@ -793,6 +793,19 @@ CON_COMMAND( rr_reloadresponsesystems, "Reload all response system scripts." )
 	defaultresponsesytem.ReloadAllResponseSystems();
 }
 
+CON_COMMAND( rr_bench, "Replay the queries captured by rr_bench_record against the response rules, with and without the rule index. Usage: rr_bench [iterations]" )
+{
+#ifdef GAME_DLL
+	if( !UTIL_IsCommandIssuedByServerAdmin() )
+	{
+		return;
+	}
+#endif
+
+	int nIterations = args.ArgC() > 1 ? atoi( args[1] ) : 100;
+	defaultresponsesytem.BenchmarkRecordedQueries( nIterations );
+}
+
 #if RR_DUMPHASHINFO_ENABLED
 static void CC_RR_DumpHashInfo( const CCommand& args )
 {
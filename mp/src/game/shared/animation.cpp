@@ -503,13 +503,10 @@ int LookupActivity( CStudioHdr* pstudiohdr, const char* label )
 		return 0;
 	}
 
-	for( int i = 0; i < pstudiohdr->GetNumSeq(); i++ )
+	int iSequence = pstudiohdr->FindSequenceForActivityName( label );
+	if( iSequence >= 0 )
 	{
-		mstudioseqdesc_t& seqdesc = pstudiohdr->pSeqdesc( i );
-		if( stricmp( seqdesc.pszActivityName(), label ) == 0 )
-		{
-			return seqdesc.activity;
-		}
+		return pstudiohdr->pSeqdesc( iSequence ).activity;
 	}
 
 	return ACT_INVALID;
@@ -538,13 +535,10 @@ int LookupSequence( CStudioHdr* pstudiohdr, const char* label )
 	//
 	// Look up by sequence name.
 	//
-	for( int i = 0; i < pstudiohdr->GetNumSeq(); i++ )
+	int iSequence = pstudiohdr->FindSequence( label );
+	if( iSequence >= 0 )
 	{
-		mstudioseqdesc_t&	seqdesc = pstudiohdr->pSeqdesc( i );
-		if( stricmp( seqdesc.pszLabel(), label ) == 0 )
-		{
-			return i;
-		}
+		return iSequence;
 	}
 
 	//
@@ -144,6 +144,12 @@ public:
 
 	virtual bool			Interpolate( float currentTime );
 
+	// Interpolate() does more than the batched path knows about
+	virtual bool			BeginBatchedInterpolate( BatchedInterpolate_t& batch )
+	{
+		return false;
+	}
+
 	bool					ShouldFlipViewModel();
 	void					UpdateAnimationParity( void );
 
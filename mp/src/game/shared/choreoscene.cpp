@@ -111,6 +111,7 @@ void CChoreoScene::choreoprintf( int level, const char* fmt, ... )
 //-----------------------------------------------------------------------------
 CChoreoScene::CChoreoScene( IChoreoEventCallback* callback )
 {
+	m_nArenaBlockUsed = ARENA_BLOCK_SIZE;
 	Init( callback );
 }
 
@@ -130,7 +131,7 @@ CChoreoScene& CChoreoScene::operator=( const CChoreoScene& src )
 	{
 		CChoreoActor* a = m_Actors[ i ];
 		Assert( a );
-		delete a;
+		FreeObject( a );
 	}
 
 	m_Actors.RemoveAll();
@@ -139,7 +140,7 @@ CChoreoScene& CChoreoScene::operator=( const CChoreoScene& src )
 	{
 		CChoreoEvent* e = m_Events[ i ];
 		Assert( e );
-		delete e;
+		FreeObject( e );
 	}
 
 	m_Events.RemoveAll();
@@ -148,7 +149,7 @@ CChoreoScene& CChoreoScene::operator=( const CChoreoScene& src )
 	{
 		CChoreoChannel* c = m_Channels[ i ];
 		Assert( c );
-		delete c;
+		FreeObject( c );
 	}
 
 	m_Channels.RemoveAll();
@@ -268,7 +269,7 @@ CChoreoScene::~CChoreoScene( void )
 	{
 		CChoreoActor* a = m_Actors[ i ];
 		Assert( a );
-		delete a;
+		FreeObject( a );
 	}
 
 	m_Actors.RemoveAll();
@@ -277,7 +278,7 @@ CChoreoScene::~CChoreoScene( void )
 	{
 		CChoreoEvent* e = m_Events[ i ];
 		Assert( e );
-		delete e;
+		FreeObject( e );
 	}
 
 	m_Events.RemoveAll();
@@ -286,10 +287,77 @@ CChoreoScene::~CChoreoScene( void )
 	{
 		CChoreoChannel* c = m_Channels[ i ];
 		Assert( c );
-		delete c;
+		FreeObject( c );
 	}
 
 	m_Channels.RemoveAll();
+
+	FreeArena();
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Hands out aligned space from the scene's blocks, or NULL if the
+//  object won't fit in one
+//-----------------------------------------------------------------------------
+void* CChoreoScene::ArenaAlloc( size_t size )
+{
+	size = AlignValue( size, 16 );
+	if( size > ARENA_BLOCK_SIZE )
+	{
+		return NULL;
+	}
+
+	if( m_nArenaBlockUsed + ( int )size > ARENA_BLOCK_SIZE )
+	{
+		MEM_ALLOC_CREDIT_CLASS();
+		m_ArenaBlocks.AddToTail( ( byte* )MemAlloc_AllocAligned( ARENA_BLOCK_SIZE, 16 ) );
+		m_nArenaBlockUsed = 0;
+	}
+
+	void* pMem = m_ArenaBlocks.Tail() + m_nArenaBlockUsed;
+	m_nArenaBlockUsed += size;
+	return pMem;
+}
+
+bool CChoreoScene::IsArenaObject( const void* object ) const
+{
+	for( int i = m_ArenaBlocks.Count(); --i >= 0; )
+	{
+		const byte* pBlock = m_ArenaBlocks[ i ];
+		if( object >= pBlock && object < pBlock + ARENA_BLOCK_SIZE )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Objects copied in from another scene were allocated on the heap,
+//  everything made by Alloc*() lives in the arena until the scene goes away
+//-----------------------------------------------------------------------------
+template< class T >
+void CChoreoScene::FreeObject( T* object )
+{
+	if( IsArenaObject( object ) )
+	{
+		Destruct( object );
+	}
+	else
+	{
+		delete object;
+	}
+}
+
+void CChoreoScene::FreeArena( void )
+{
+	for( int i = 0; i < m_ArenaBlocks.Count(); i++ )
+	{
+		MemAlloc_FreeAligned( m_ArenaBlocks[ i ] );
+	}
+	m_ArenaBlocks.Purge();
+	m_nArenaBlockUsed = ARENA_BLOCK_SIZE;
 }
 
 
@@ -442,8 +510,8 @@ void CChoreoScene::SceneMsg( const char* pFormat, ... )
 //-----------------------------------------------------------------------------
 CChoreoEvent* CChoreoScene::AllocEvent( void )
 {
-	MEM_ALLOC_CREDIT_CLASS();
-	CChoreoEvent* e = new CChoreoEvent( this );
+	void* pMem = ArenaAlloc( sizeof( CChoreoEvent ) );
+	CChoreoEvent* e = pMem ? Construct( ( CChoreoEvent* )pMem, this ) : new CChoreoEvent( this );
 	Assert( e );
 	m_Events.AddToTail( e );
 	return e;
@@ -455,8 +523,8 @@ CChoreoEvent* CChoreoScene::AllocEvent( void )
 //-----------------------------------------------------------------------------
 CChoreoChannel* CChoreoScene::AllocChannel( void )
 {
-	MEM_ALLOC_CREDIT_CLASS();
-	CChoreoChannel* c = new CChoreoChannel();
+	void* pMem = ArenaAlloc( sizeof( CChoreoChannel ) );
+	CChoreoChannel* c = pMem ? Construct( ( CChoreoChannel* )pMem ) : new CChoreoChannel();
 	Assert( c );
 	m_Channels.AddToTail( c );
 	return c;
@@ -468,8 +536,8 @@ CChoreoChannel* CChoreoScene::AllocChannel( void )
 //-----------------------------------------------------------------------------
 CChoreoActor* CChoreoScene::AllocActor( void )
 {
-	MEM_ALLOC_CREDIT_CLASS();
-	CChoreoActor* a = new CChoreoActor;
+	void* pMem = ArenaAlloc( sizeof( CChoreoActor ) );
+	CChoreoActor* a = pMem ? Construct( ( CChoreoActor* )pMem ) : new CChoreoActor;
 	Assert( a );
 	m_Actors.AddToTail( a );
 	return a;
@@ -3081,7 +3149,7 @@ void CChoreoScene::DestroyActor( CChoreoActor* actor )
 		}
 	}
 
-	delete actor;
+	FreeObject( actor );
 }
 
 //-----------------------------------------------------------------------------
@@ -3100,7 +3168,7 @@ void CChoreoScene::DestroyChannel( CChoreoChannel* channel )
 		}
 	}
 
-	delete channel;
+	FreeObject( channel );
 }
 
 //-----------------------------------------------------------------------------
@@ -3119,7 +3187,7 @@ void CChoreoScene::DestroyEvent( CChoreoEvent* event )
 		}
 	}
 
-	delete event;
+	FreeObject( event );
 }
 
 //-----------------------------------------------------------------------------
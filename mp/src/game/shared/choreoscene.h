@@ -339,11 +339,26 @@ private:
 	void			DestroyChannel( CChoreoChannel* channel );
 	void			DestroyEvent( CChoreoEvent* event );
 
+	// Actors, channels and events are carved out of a few blocks owned by the
+	//  scene instead of being allocated one at a time
+	void*			ArenaAlloc( size_t size );
+	bool			IsArenaObject( const void* object ) const;
+	template< class T > void FreeObject( T* object );
+	void			FreeArena( void );
+
 
 	void			AddPauseEventDependency( CChoreoEvent* pauseEvent, CChoreoEvent* suppressed );
 
 	void			InternalDetermineEventTypes();
 
+	enum
+	{
+		ARENA_BLOCK_SIZE = 16 * 1024
+	};
+
+	CUtlVector < byte* >			m_ArenaBlocks;
+	int								m_nArenaBlockUsed;
+
 	// Global object storage
 	CUtlVector < CChoreoEvent* >	m_Events;
 	CUtlVector < CChoreoActor* >	m_Actors;
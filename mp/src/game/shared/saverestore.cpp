@@ -24,6 +24,11 @@
 #include "vphysics/object_hash.h"
 #include "datacache/imdlcache.h"
 #include "tier0/vprof.h"
+#include "tier0/fasttimer.h"
+#include "utlmap.h"
+#include "utldict.h"
+#include "checksum_crc.h"
+#include "physics_saverestore.h"
 
 #if !defined( CLIENT_DLL )
 
@@ -838,8 +843,281 @@ bool CSave::WriteField( const char* pname, void* pData, datamap_t* pRootMap, typ
 
 //-------------------------------------
 
+//-----------------------------------------------------------------------------
+// Save plans
+//
+// Each field list that goes through WriteFields gets a plan built the first
+// time it is saved: the saveable fields in order, with the plain data ones
+// (floats, ints, vectors...) flagged along with their byte size. Plain fields
+// are then written as header + raw bytes straight into the save buffer, with
+// one space check per run of them, instead of going through ShouldSaveField,
+// WriteField and the per-type writers. The output is byte-for-byte what the
+// slow path produces, so saves stay compatible either way.
+//
+// Plans are keyed by the field list's address, but not every list is static:
+// the CUtlVector and CUtlMap save ops build one on the stack for each call,
+// with the element count in fieldSize. So a plan also keeps what it was built
+// from and is rebuilt whenever the list at that address has changed.
+//-----------------------------------------------------------------------------
+
+ConVar save_fastpath( "save_fastpath", "1", 0, "Write plain data fields through precompiled per-datamap save plans." );
+
+struct savefieldplan_t
+{
+	typedescription_t*	pField;
+	int					offset;
+	int					nDataBytes;		// payload size of a plain data field, 0 if it takes the slow path
+	int					nRunBytes;		// record bytes of this and following plain data fields
+	unsigned short		symbol;			// symbol this field's name had in the last save table it was written to
+};
+
+// What a plan depends on in each typedescription_t it was built from
+struct savefieldkey_t
+{
+	fieldtype_t			fieldType;
+	const char*			fieldName;
+	unsigned int		offset;
+	unsigned short		fieldSize;
+	short				flags;
+	int					fieldSizeInBytes;
+	ISaveRestoreOps*	pSaveRestoreOps;
+	datamap_t*			td;
+};
+
+struct savefieldsplan_t
+{
+	CUtlVector<savefieldplan_t> fields;
+	CUtlVector<savefieldkey_t> keys;		// one per field in the list, saved or not
+};
+
+static CUtlMap<const typedescription_t*, savefieldsplan_t*> g_SaveFieldsPlans( DefLessFunc( const typedescription_t* ) );
+
+//-------------------------------------
+
+static int SavePlanDataBytes( const typedescription_t* pField )
+{
+	if( pField->flags & FTYPEDESC_PTR )
+	{
+		return 0;
+	}
+
+	switch( pField->fieldType )
+	{
+		case FIELD_FLOAT:
+		case FIELD_VECTOR:
+		case FIELD_QUATERNION:
+		case FIELD_INTEGER:
+		case FIELD_BOOLEAN:
+		case FIELD_SHORT:
+		case FIELD_CHARACTER:
+		case FIELD_COLOR32:
+			break;
+
+		default:
+			return 0;
+	}
+
+	int nBytes = pField->fieldSize * gSizes[pField->fieldType];
+
+	// Leave mistyped fields to ShouldSaveField so they still get warned about
+	if( nBytes <= 0 || nBytes != pField->fieldSizeInBytes || nBytes > SHRT_MAX )
+	{
+		return 0;
+	}
+
+	return nBytes;
+}
+
+//-------------------------------------
+
+static void MakeSaveFieldKey( const typedescription_t* pField, savefieldkey_t* pKey )
+{
+	pKey->fieldType = pField->fieldType;
+	pKey->fieldName = pField->fieldName;
+	pKey->offset = pField->fieldOffset[ TD_OFFSET_NORMAL ];
+	pKey->fieldSize = pField->fieldSize;
+	pKey->flags = pField->flags;
+	pKey->fieldSizeInBytes = pField->fieldSizeInBytes;
+	pKey->pSaveRestoreOps = pField->pSaveRestoreOps;
+	pKey->td = pField->td;
+}
+
+static bool SaveFieldsPlanMatches( const savefieldsplan_t* pPlan, const typedescription_t* pFields, int fieldCount )
+{
+	if( pPlan->keys.Count() != fieldCount )
+	{
+		return false;
+	}
+
+	for( int i = 0; i < fieldCount; i++ )
+	{
+		const savefieldkey_t& key = pPlan->keys[i];
+		const typedescription_t* pField = &pFields[i];
+		if( key.fieldType != pField->fieldType ||
+			key.fieldName != pField->fieldName ||
+			key.offset != pField->fieldOffset[ TD_OFFSET_NORMAL ] ||
+			key.fieldSize != pField->fieldSize ||
+			key.flags != pField->flags ||
+			key.fieldSizeInBytes != pField->fieldSizeInBytes ||
+			key.pSaveRestoreOps != pField->pSaveRestoreOps ||
+			key.td != pField->td )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void BuildSaveFieldsPlan( savefieldsplan_t* pPlan, typedescription_t* pFields, int fieldCount )
+{
+	pPlan->fields.RemoveAll();
+	pPlan->fields.EnsureCapacity( fieldCount );
+	pPlan->keys.SetCount( fieldCount );
+
+	for( int i = 0; i < fieldCount; i++ )
+	{
+		typedescription_t* pField = &pFields[i];
+		MakeSaveFieldKey( pField, &pPlan->keys[i] );
+
+		if( !( pField->flags & FTYPEDESC_SAVE ) || pField->fieldType == FIELD_VOID )
+		{
+			continue;
+		}
+
+		savefieldplan_t& entry = pPlan->fields[ pPlan->fields.AddToTail() ];
+		entry.pField = pField;
+		entry.offset = pField->fieldOffset[ TD_OFFSET_NORMAL ];
+		entry.nDataBytes = SavePlanDataBytes( pField );
+		entry.nRunBytes = 0;
+		entry.symbol = 0;
+	}
+
+	int nRunBytes = 0;
+	for( int i = pPlan->fields.Count() - 1; i >= 0; i-- )
+	{
+		savefieldplan_t& entry = pPlan->fields[i];
+		nRunBytes = ( entry.nDataBytes ) ? nRunBytes + sizeof( SaveRestoreRecordHeader_t ) + entry.nDataBytes : 0;
+		entry.nRunBytes = nRunBytes;
+	}
+}
+
+//-------------------------------------
+
+static savefieldsplan_t* GetSaveFieldsPlan( typedescription_t* pFields, int fieldCount )
+{
+	unsigned short iPlan = g_SaveFieldsPlans.Find( pFields );
+	if( iPlan != g_SaveFieldsPlans.InvalidIndex() )
+	{
+		savefieldsplan_t* pPlan = g_SaveFieldsPlans[iPlan];
+		if( !SaveFieldsPlanMatches( pPlan, pFields, fieldCount ) )
+		{
+			// A different field list at the same address, e.g. one built on the stack
+			BuildSaveFieldsPlan( pPlan, pFields, fieldCount );
+		}
+		return pPlan;
+	}
+
+	savefieldsplan_t* pPlan = new savefieldsplan_t;
+	BuildSaveFieldsPlan( pPlan, pFields, fieldCount );
+	g_SaveFieldsPlans.Insert( pFields, pPlan );
+	return pPlan;
+}
+
+//-------------------------------------
+
+int CSave::WritePlannedFields( const char* pname, const void* pBaseData, datamap_t* pRootMap, savefieldsplan_t* pPlan )
+{
+	int iHeaderPos = m_pData->GetCurPos();
+	int count = -1;
+	WriteInt( pname, &count, 1 );
+
+	count = 0;
+
+	const int nSymbols = m_pData->SizeSymbolTable();
+	int nRunBytesLeft = 0;
+
+	savefieldplan_t* pEntry = pPlan->fields.Base();
+	savefieldplan_t* pLimit = pEntry + pPlan->fields.Count();
+	for( ; pEntry < pLimit; ++pEntry )
+	{
+		char* pFieldData = ( char* )pBaseData + pEntry->offset;
+
+		if( !pEntry->nDataBytes )
+		{
+			nRunBytesLeft = 0;
+
+			if( !ShouldSaveField( pFieldData, pEntry->pField ) )
+			{
+				continue;
+			}
+
+			if( !WriteField( pname, pFieldData, pRootMap, pEntry->pField ) )
+			{
+				break;
+			}
+			count++;
+			continue;
+		}
+
+		if( DataEmpty( pFieldData, pEntry->nDataBytes ) )
+		{
+			continue;
+		}
+
+		// One space check covers the whole run of plain fields, empty or not
+		if( nRunBytesLeft <= 0 )
+		{
+			nRunBytesLeft = pEntry->nRunBytes;
+			if( nRunBytesLeft > m_pData->BytesAvailable() )
+			{
+				// Let BufferData report the overflow
+				nRunBytesLeft = 0;
+				WriteField( pname, pFieldData, pRootMap, pEntry->pField );
+				count++;
+				continue;
+			}
+		}
+
+		const char* pszFieldName = pEntry->pField->fieldName;
+		if( pEntry->symbol >= nSymbols || m_pData->StringFromSymbol( pEntry->symbol ) != pszFieldName )
+		{
+			pEntry->symbol = m_pData->FindCreateSymbol( pszFieldName );
+		}
+
+		SaveRestoreRecordHeader_t header;
+		header.size = pEntry->nDataBytes;
+		header.symbol = pEntry->symbol;
+
+		char* pDest = m_pData->AccessCurPos();
+		memcpy( pDest, &header, sizeof( header ) );
+		memcpy( pDest + sizeof( header ), pFieldData, pEntry->nDataBytes );
+
+		int nRecordBytes = sizeof( header ) + pEntry->nDataBytes;
+		m_pData->MoveCurPos( nRecordBytes );
+		nRunBytesLeft -= nRecordBytes;
+		count++;
+	}
+
+	int iCurPos = m_pData->GetCurPos();
+	int iRewind = iCurPos - iHeaderPos;
+	m_pData->Rewind( iRewind );
+	WriteInt( pname, &count, 1 );
+	iCurPos = m_pData->GetCurPos();
+	m_pData->MoveCurPos( iRewind - ( iCurPos - iHeaderPos ) );
+
+	return 1;
+}
+
+//-------------------------------------
+
 int CSave::WriteFields( const char* pname, const void* pBaseData, datamap_t* pRootMap, typedescription_t* pFields, int fieldCount )
 {
+	if( m_pData && save_fastpath.GetBool() && !IsLogging() )
+	{
+		return WritePlannedFields( pname, pBaseData, pRootMap, GetSaveFieldsPlan( pFields, fieldCount ) );
+	}
+
 	typedescription_t* pTest;
 	int iHeaderPos = m_pData->GetCurPos();
 	int count = -1;
@@ -3572,3 +3850,286 @@ int CreateEntityTransitionList( CSaveRestoreData* pSaveData, int levelMask )
 	return movedCount;
 }
 #endif
+
+#if !defined( CLIENT_DLL )
+
+//-----------------------------------------------------------------------------
+// Purpose: Times writing every entity's datamap into a scratch save buffer,
+//			with and without save plans, and reports per-class cost.
+//-----------------------------------------------------------------------------
+struct savebenchclass_t
+{
+	const char* pszClassName;
+	int		nEntities;
+	int		nBytes;
+	double	flSlowMs;
+	double	flFastMs;
+};
+
+static bool SaveBenchClassLessFunc( const savebenchclass_t* const& lhs, const savebenchclass_t* const& rhs )
+{
+	return lhs->flSlowMs > rhs->flSlowMs;
+}
+
+CON_COMMAND_F( save_bench, "Time datamap serialisation of all entities with and without save plans. Arguments: [iterations=10] [classes=20]", FCVAR_CHEAT )
+{
+	if( !UTIL_IsCommandIssuedByServerAdmin() )
+	{
+		return;
+	}
+
+	int nIterations = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 10;
+	int nClassesShown = ( args.ArgC() > 2 ) ? MAX( atoi( args[2] ), 1 ) : 20;
+
+	const int nBufferBytes = 4 * 1024 * 1024;
+	const int nTokens = 0xfff;
+
+	CSaveRestoreData* pSaveData = MakeSaveRestoreData( malloc( sizeof( CSaveRestoreData ) ) );
+	char* pBuffer = ( char* )malloc( nBufferBytes );
+	char** pTokens = ( char** )malloc( nTokens * sizeof( char* ) );
+
+	pSaveData->levelInfo.time = gpGlobals->curtime;
+	pSaveData->levelInfo.vecLandmarkOffset = vec3_origin;
+	pSaveData->levelInfo.fUseLandmark = false;
+	pSaveData->levelInfo.connectionCount = 0;
+
+	CUtlDict<savebenchclass_t, int> classes;
+	CUtlVector<CRC32_t> checksums;
+	int nMismatches = 0;
+	int nOverflows = 0;
+
+	bool bOldFastPath = save_fastpath.GetBool();
+
+	for( int iPass = 0; iPass < 2; iPass++ )
+	{
+		save_fastpath.SetValue( iPass );
+
+		for( int iIteration = 0; iIteration < nIterations; iIteration++ )
+		{
+			// Fresh symbol table each iteration, so both passes see the same table fill order
+			pSaveData->DetachSymbolTable();
+			pSaveData->InitSymbolTable( pTokens, nTokens );
+
+			CSave save( pSaveData );
+
+			int iEntity = 0;
+			for( CBaseEntity* pEntity = gEntList.FirstEnt(); pEntity; pEntity = gEntList.NextEnt( pEntity ) )
+			{
+				if( pEntity->ObjectCaps() & FCAP_DONT_SAVE )
+				{
+					continue;
+				}
+
+				pSaveData->Init( pBuffer, nBufferBytes );
+				pSaveData->SetCurrentEntityContext( pEntity );
+
+				CFastTimer timer;
+				timer.Start();
+				save.WriteAll( pEntity, pEntity->GetDataDescMap() );
+				timer.End();
+
+				pSaveData->SetCurrentEntityContext( NULL );
+
+				int nBytes = save.GetWritePos();
+				if( nBytes >= nBufferBytes - 1 )
+				{
+					nOverflows++;
+				}
+
+				int iClass = classes.Find( pEntity->GetClassname() );
+				if( iClass == classes.InvalidIndex() )
+				{
+					iClass = classes.Insert( pEntity->GetClassname() );
+					memset( &classes[iClass], 0, sizeof( savebenchclass_t ) );
+					classes[iClass].pszClassName = classes.GetElementName( iClass );
+				}
+
+				savebenchclass_t& stats = classes[iClass];
+				if( iPass == 0 )
+				{
+					stats.flSlowMs += timer.GetDuration().GetMillisecondsF();
+				}
+				else
+				{
+					stats.flFastMs += timer.GetDuration().GetMillisecondsF();
+				}
+
+				// Both paths must produce identical bytes; only check the first iteration
+				if( iIteration == 0 )
+				{
+					CRC32_t crc = CRC32_ProcessSingleBuffer( pBuffer, nBytes );
+					if( iPass == 0 )
+					{
+						stats.nEntities++;
+						stats.nBytes += nBytes;
+						checksums.AddToTail( crc );
+					}
+					else if( !checksums.IsValidIndex( iEntity ) || checksums[iEntity] != crc )
+					{
+						nMismatches++;
+					}
+				}
+
+				iEntity++;
+			}
+		}
+	}
+
+	save_fastpath.SetValue( bOldFastPath );
+
+	// Physics pointers queue themselves for the physics save block; drop them
+	GetPhysSaveRestoreBlockHandler()->PostSave();
+
+	pSaveData->DetachSymbolTable();
+	free( pTokens );
+	free( pBuffer );
+	free( pSaveData );
+
+	CUtlVector<savebenchclass_t*> sorted;
+	savebenchclass_t totals;
+	memset( &totals, 0, sizeof( totals ) );
+	for( int i = classes.First(); i != classes.InvalidIndex(); i = classes.Next( i ) )
+	{
+		sorted.AddToTail( &classes[i] );
+		totals.nEntities += classes[i].nEntities;
+		totals.nBytes += classes[i].nBytes;
+		totals.flSlowMs += classes[i].flSlowMs;
+		totals.flFastMs += classes[i].flFastMs;
+	}
+	sorted.Sort( SaveBenchClassLessFunc );
+
+	Msg( "Save bench: %d entities, %d iterations, %d bytes per save\n", totals.nEntities, nIterations, totals.nBytes );
+	Msg( "  %-32s %5s %8s %10s %10s %8s\n", "class", "ents", "bytes", "slow ms", "plan ms", "speedup" );
+	for( int i = 0; i < sorted.Count() && i < nClassesShown; i++ )
+	{
+		const savebenchclass_t* pStats = sorted[i];
+		Msg( "  %-32s %5d %8d %10.3f %10.3f %7.2fx\n", pStats->pszClassName, pStats->nEntities, pStats->nBytes / MAX( pStats->nEntities, 1 ),
+			 pStats->flSlowMs / nIterations, pStats->flFastMs / nIterations, pStats->flSlowMs / MAX( pStats->flFastMs, 0.0001 ) );
+	}
+	Msg( "  %-32s %5d %8d %10.3f %10.3f %7.2fx\n", "total", totals.nEntities, totals.nBytes,
+		 totals.flSlowMs / nIterations, totals.flFastMs / nIterations, totals.flSlowMs / MAX( totals.flFastMs, 0.0001 ) );
+
+	if( nMismatches || nOverflows )
+	{
+		Warning( "Save bench: %d entities wrote different bytes with save plans, %d overflowed the scratch buffer\n", nMismatches, nOverflows );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Saves and restores a CUtlVector field with and without save plans
+//			while its size changes between saves. The vector's save op builds its
+//			field list on the stack, so every save lands on the same plan address.
+//-----------------------------------------------------------------------------
+struct saveplantest_t
+{
+	DECLARE_SIMPLE_DATADESC();
+
+	float			m_flValue;
+	CUtlVector<int>	m_Values;
+	int				m_nValue;
+};
+
+BEGIN_SIMPLE_DATADESC( saveplantest_t )
+	DEFINE_FIELD( m_flValue, FIELD_FLOAT ),
+	DEFINE_UTLVECTOR( m_Values, FIELD_INTEGER ),
+	DEFINE_FIELD( m_nValue, FIELD_INTEGER ),
+END_DATADESC()
+
+static int SavePlanTestWrite( CSaveRestoreData* pSaveData, char* pBuffer, int nBufferBytes, saveplantest_t* pTest )
+{
+	pSaveData->Init( pBuffer, nBufferBytes );
+	CSave save( pSaveData );
+	save.WriteAll( pTest, &saveplantest_t::m_DataMap );
+	return save.GetWritePos();
+}
+
+CON_COMMAND_F( save_plan_test, "Save and restore a CUtlVector field of changing size with and without save plans, and check both give the same bytes and values.", FCVAR_CHEAT )
+{
+	if( !UTIL_IsCommandIssuedByServerAdmin() )
+	{
+		return;
+	}
+
+	static const int s_nSizes[] = { 8, 2, 64, 0, 5, 64, 1 };
+
+	const int nBufferBytes = 64 * 1024;
+	const int nTokens = 0xfff;
+
+	CSaveRestoreData* pSaveData = MakeSaveRestoreData( malloc( sizeof( CSaveRestoreData ) ) );
+	char* pSlowBuffer = ( char* )malloc( nBufferBytes );
+	char* pBuffer = ( char* )malloc( nBufferBytes );
+	char** pTokens = ( char** )malloc( nTokens * sizeof( char* ) );
+
+	pSaveData->levelInfo.time = gpGlobals->curtime;
+	pSaveData->levelInfo.vecLandmarkOffset = vec3_origin;
+	pSaveData->levelInfo.fUseLandmark = false;
+	pSaveData->levelInfo.connectionCount = 0;
+	pSaveData->InitSymbolTable( pTokens, nTokens );
+
+	bool bOldFastPath = save_fastpath.GetBool();
+	int nFailures = 0;
+
+	for( int iSave = 0; iSave < ARRAYSIZE( s_nSizes ); iSave++ )
+	{
+		saveplantest_t source;
+		source.m_flValue = 1.5f + iSave;
+		source.m_nValue = 100 + iSave;
+		for( int i = 0; i < s_nSizes[iSave]; i++ )
+		{
+			source.m_Values.AddToTail( iSave * 1000 + i + 1 );
+		}
+
+		save_fastpath.SetValue( 0 );
+		int nSlowBytes = SavePlanTestWrite( pSaveData, pSlowBuffer, nBufferBytes, &source );
+
+		save_fastpath.SetValue( 1 );
+		int nBytes = SavePlanTestWrite( pSaveData, pBuffer, nBufferBytes, &source );
+
+		if( nBytes != nSlowBytes || V_memcmp( pBuffer, pSlowBuffer, nBytes ) )
+		{
+			Warning( "save_plan_test: %d elements: %d bytes with save plans, %d without\n", s_nSizes[iSave], nBytes, nSlowBytes );
+			nFailures++;
+			continue;
+		}
+
+		saveplantest_t restored;
+		restored.m_flValue = 0;
+		restored.m_nValue = 0;
+
+		pSaveData->Init( pBuffer, nBytes );
+		CRestore restore( pSaveData );
+		restore.ReadAll( &restored, &saveplantest_t::m_DataMap );
+
+		bool bSame = restored.m_flValue == source.m_flValue && restored.m_nValue == source.m_nValue &&
+					 restored.m_Values.Count() == source.m_Values.Count();
+		for( int i = 0; bSame && i < source.m_Values.Count(); i++ )
+		{
+			bSame = restored.m_Values[i] == source.m_Values[i];
+		}
+
+		if( !bSame )
+		{
+			Warning( "save_plan_test: %d elements: restored %d elements, values differ\n", s_nSizes[iSave], restored.m_Values.Count() );
+			nFailures++;
+		}
+	}
+
+	save_fastpath.SetValue( bOldFastPath );
+
+	pSaveData->DetachSymbolTable();
+	free( pTokens );
+	free( pBuffer );
+	free( pSlowBuffer );
+	free( pSaveData );
+
+	if( nFailures )
+	{
+		Warning( "save_plan_test: FAILED, %d of %d saves\n", nFailures, ARRAYSIZE( s_nSizes ) );
+	}
+	else
+	{
+		Msg( "save_plan_test: passed, %d saves\n", ARRAYSIZE( s_nSizes ) );
+	}
+}
+
+#endif // !defined( CLIENT_DLL )
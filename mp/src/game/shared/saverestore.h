@@ -28,6 +28,7 @@ struct edict_t;
 struct datamap_t;
 class CBaseEntity;
 struct interval_t;
+struct savefieldsplan_t;
 
 //-----------------------------------------------------------------------------
 //
@@ -166,6 +167,8 @@ private:
 	int				CountFieldsToSave( const void* pBaseData, typedescription_t* pFields, int fieldCount );
 	bool			ShouldSaveField( const void* pData, typedescription_t* pField );
 
+	int				WritePlannedFields( const char* pname, const void* pBaseData, datamap_t* pRootMap, savefieldsplan_t* pPlan );
+
 	//---------------------------------
 	// Game info methods
 	//
@@ -18,6 +18,7 @@
 #include "mathlib/ssequaternion.h"
 #include "bitvec.h"
 #include "datamanager.h"
+#include "utlmap.h"
 #include "convar.h"
 #include "tier0/tslist.h"
 #include "vphysics_interface.h"
@@ -371,25 +372,353 @@ void ExtractAnimValue( int frame, mstudioanimvalue_t* panimvalue, float scale, f
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: return a sub frame rotation for a single bone
+// Decoded animation frame cache
+//
+// Decoding the RLE mstudioanimvalue_t streams dominates CalcAnimation, and
+// crowds of models playing the same sequences decode the same frames over and
+// over. Each cache entry holds the unscaled values of one frame (plus the next
+// frame for blending) for every mstudioanim_t in an animation block, stored
+// channel by channel, so the bone setup code only has to scale and interpolate.
+//
+// Entries are keyed on the animation itself (model checksum, animdesc index,
+// section and frame) rather than on the address of the block, since mdlcache
+// can evict an animation block and load a different one at the same address.
 //-----------------------------------------------------------------------------
-void CalcBoneQuaternion( int frame, float s,
-						 const Quaternion& baseQuat, const RadianEuler& baseRot, const Vector& baseRotScale,
-						 int iBaseFlags, const Quaternion& baseAlignment,
-						 const mstudioanim_t* panim, Quaternion& q )
+static void AnimFrameCacheSizeChanged( IConVar* var, const char* pOldValue, float flOldValue );
+
+static ConVar anim_framecache( "anim_framecache", "1", 0, "Share decoded animation frames between all models playing the same animation." );
+static ConVar anim_framecache_kb( "anim_framecache_kb", "2048", 0, "Memory budget of the decoded animation frame cache, in kilobytes.", true, 64, true, 65536, AnimFrameCacheSizeChanged );
+
+enum
+{
+	ANIMFRAME_ROT1 = 0,		// x, y, z euler values at the frame
+	ANIMFRAME_ROT2 = 3,		// x, y, z euler values at the next frame
+	ANIMFRAME_POS1 = 6,		// x, y, z position values at the frame
+	ANIMFRAME_POS2 = 9,		// x, y, z position values at the next frame
+
+	ANIMFRAME_NUM_CHANNELS = 12,
+};
+
+class CAnimFrameCache;
+
+struct animframecacheparams_t
+{
+	int						checksum;	// owning studiohdr_t checksum
+	int						iAnimDesc;	// index of the animdesc in its studiohdr_t
+	int						iSection;	// animation section the block was fetched for
+	int						iFrame;		// frame, local to the section
+
+	CAnimFrameCache*		pDecoded;	// frame decoded outside the cache lock, not part of the key
+};
+
+static bool AnimFrameCacheLessFunc( const animframecacheparams_t& lhs, const animframecacheparams_t& rhs )
+{
+	if( lhs.checksum != rhs.checksum )
+	{
+		return lhs.checksum < rhs.checksum;
+	}
+	if( lhs.iAnimDesc != rhs.iAnimDesc )
+	{
+		return lhs.iAnimDesc < rhs.iAnimDesc;
+	}
+	if( lhs.iSection != rhs.iSection )
+	{
+		return lhs.iSection < rhs.iSection;
+	}
+	return lhs.iFrame < rhs.iFrame;
+}
+
+class CAnimFrameCache
+{
+public:
+	// you must implement these static functions for the ResourceManager
+	// -----------------------------------------------------------
+	static CAnimFrameCache* CreateResource( const animframecacheparams_t& params );
+	static unsigned int EstimatedSize( const animframecacheparams_t& params );
+	// -----------------------------------------------------------
+	// member functions that must be present for the ResourceManager
+	void DestroyResource()
+	{
+		free( this );
+	}
+	CAnimFrameCache* GetData()
+	{
+		return this;
+	}
+	unsigned int Size()
+	{
+		return m_size;
+	}
+	// -----------------------------------------------------------
+
+	// Decodes one frame of an animation block, the result is owned by the caller until handed to the cache
+	static CAnimFrameCache* Decode( const mstudioanim_t* pAnim, int iFrame );
+
+	// Unscaled values of one channel, indexed by the position of the mstudioanim_t in the block
+	inline const float* Channel( int nChannel ) const
+	{
+		return ( const float* )( this + 1 ) + nChannel * m_nAnims;
+	}
+
+private:
+	static int CountAnims( const mstudioanim_t* panim )
+	{
+		int nAnims = 0;
+		for( ; panim; panim = panim->pNext() )
+		{
+			nAnims++;
+		}
+		return nAnims;
+	}
+
+	unsigned int	m_size;
+	int				m_nAnims;
+};
+
+CAnimFrameCache* CAnimFrameCache::CreateResource( const animframecacheparams_t& params )
+{
+	// frames are decoded before the cache is locked, creating one only takes ownership
+	Assert( params.pDecoded );
+	return params.pDecoded;
+}
+
+unsigned int CAnimFrameCache::EstimatedSize( const animframecacheparams_t& params )
+{
+	return params.pDecoded->m_size;
+}
+
+CAnimFrameCache* CAnimFrameCache::Decode( const mstudioanim_t* pAnim, int iFrame )
+{
+	int nAnims = CountAnims( pAnim );
+	unsigned int size = sizeof( CAnimFrameCache ) + nAnims * ANIMFRAME_NUM_CHANNELS * sizeof( float );
+
+	CAnimFrameCache* pMem = ( CAnimFrameCache* )malloc( size );
+	pMem->m_size = size;
+	pMem->m_nAnims = nAnims;
+
+	float* pData = ( float* )( pMem + 1 );
+	memset( pData, 0, nAnims * ANIMFRAME_NUM_CHANNELS * sizeof( float ) );
+
+	int i = 0;
+	for( const mstudioanim_t* panim = pAnim; panim; panim = panim->pNext(), i++ )
+	{
+		if( panim->flags & STUDIO_ANIM_ANIMROT )
+		{
+			mstudioanim_valueptr_t* pRotV = panim->pRotV();
+			for( int j = 0; j < 3; j++ )
+			{
+				ExtractAnimValue( iFrame, pRotV->pAnimvalue( j ), 1.0f, pData[( ANIMFRAME_ROT1 + j ) * nAnims + i], pData[( ANIMFRAME_ROT2 + j ) * nAnims + i] );
+			}
+		}
+
+		if( panim->flags & STUDIO_ANIM_ANIMPOS )
+		{
+			mstudioanim_valueptr_t* pPosV = panim->pPosV();
+			for( int j = 0; j < 3; j++ )
+			{
+				ExtractAnimValue( iFrame, pPosV->pAnimvalue( j ), 1.0f, pData[( ANIMFRAME_POS1 + j ) * nAnims + i], pData[( ANIMFRAME_POS2 + j ) * nAnims + i] );
+			}
+		}
+	}
+
+	return pMem;
+}
+
+static CDataManager<CAnimFrameCache, animframecacheparams_t, CAnimFrameCache*, CThreadFastMutex> g_AnimFrameCache( 2048 * 1024L );
+static CUtlMap<animframecacheparams_t, memhandle_t, int> g_AnimFrameCacheLookup( 0, 0, AnimFrameCacheLessFunc );
+static int g_nAnimFrameCacheHits = 0;
+static int g_nAnimFrameCacheMisses = 0;
+
+// Lookups whose frames were evicted are only dropped once the map gets this big
+#define ANIMFRAMECACHE_LOOKUP_PRUNE_SIZE	8192
+
+static void AnimFrameCacheSizeChanged( IConVar* var, const char* pOldValue, float flOldValue )
+{
+	AUTO_LOCK( g_AnimFrameCache.AccessMutex() );
+	g_AnimFrameCache.SetTargetSize( anim_framecache_kb.GetInt() * 1024 );
+	g_AnimFrameCache.FlushToTargetSize();
+}
+
+static void PruneAnimFrameCacheLookup()
+{
+	for( int i = g_AnimFrameCacheLookup.FirstInorder(); i != g_AnimFrameCacheLookup.InvalidIndex(); )
+	{
+		int iNext = g_AnimFrameCacheLookup.NextInorder( i );
+		if( !g_AnimFrameCache.GetResource_NoLockNoLRUTouch( g_AnimFrameCacheLookup[i] ) )
+		{
+			g_AnimFrameCacheLookup.RemoveAt( i );
+		}
+		i = iNext;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds or decodes the given frame of an animation block and keeps it
+//			locked in the cache for the lifetime of this object. The cache mutex
+//			is taken once to find the frame (or claim its key on a miss) and once
+//			to release it; a missed frame is decoded outside the lock and handed
+//			to the cache on release, in place of the unlock.
+//-----------------------------------------------------------------------------
+class CAnimFrameCacheLock
+{
+public:
+	CAnimFrameCacheLock( const mstudioanimdesc_t& animdesc, const mstudioanim_t* panim, int iSection, int iFrame )
+		: m_hFrame( INVALID_MEMHANDLE ), m_pFrame( NULL ), m_bOwned( false )
+	{
+		if( !panim || iSection < 0 || !anim_framecache.GetBool() )
+		{
+			return;
+		}
+
+		const studiohdr_t* pAnimStudioHdr = animdesc.pStudiohdr();
+
+		m_params.checksum = pAnimStudioHdr->checksum;
+		m_params.iAnimDesc = ( int )( &animdesc - pAnimStudioHdr->pLocalAnimdesc( 0 ) );
+		m_params.iSection = iSection;
+		m_params.iFrame = iFrame;
+		m_params.pDecoded = NULL;
+
+		if( FindOrInsert() )
+		{
+			return;
+		}
+
+		m_pFrame = CAnimFrameCache::Decode( panim, iFrame );
+		m_bOwned = true;
+	}
+
+	~CAnimFrameCacheLock()
+	{
+		if( m_bOwned )
+		{
+			Publish();
+		}
+		else if( m_pFrame )
+		{
+			g_AnimFrameCache.UnlockResource( m_hFrame );
+		}
+	}
+
+	const CAnimFrameCache* Get() const
+	{
+		return m_pFrame;
+	}
+
+private:
+	// Locks the cached frame and returns true, or claims the key for this
+	// thread's decode and returns false. A claimed key has no frame yet.
+	bool FindOrInsert()
+	{
+		AUTO_LOCK( g_AnimFrameCache.AccessMutex() );
+
+		int i = g_AnimFrameCacheLookup.Find( m_params );
+		if( i != g_AnimFrameCacheLookup.InvalidIndex() )
+		{
+			m_pFrame = g_AnimFrameCache.LockResource( g_AnimFrameCacheLookup[i] );
+			if( m_pFrame )
+			{
+				m_hFrame = g_AnimFrameCacheLookup[i];
+				g_nAnimFrameCacheHits++;
+				return true;
+			}
+		}
+		else
+		{
+			if( g_AnimFrameCacheLookup.Count() >= ANIMFRAMECACHE_LOOKUP_PRUNE_SIZE )
+			{
+				PruneAnimFrameCacheLookup();
+			}
+			g_AnimFrameCacheLookup.Insert( m_params, INVALID_MEMHANDLE );
+		}
+
+		g_nAnimFrameCacheMisses++;
+		return false;
+	}
+
+	// Hands the frame decoded by this thread to the cache, unless another
+	// thread got there first
+	void Publish()
+	{
+		AUTO_LOCK( g_AnimFrameCache.AccessMutex() );
+
+		int i = g_AnimFrameCacheLookup.Find( m_params );
+		if( i != g_AnimFrameCacheLookup.InvalidIndex() && g_AnimFrameCache.GetResource_NoLockNoLRUTouch( g_AnimFrameCacheLookup[i] ) )
+		{
+			m_pFrame->DestroyResource();
+			return;
+		}
+
+		m_params.pDecoded = m_pFrame;
+		memhandle_t hFrame = g_AnimFrameCache.CreateResource( m_params );
+
+		if( i != g_AnimFrameCacheLookup.InvalidIndex() )
+		{
+			g_AnimFrameCacheLookup[i] = hFrame;
+		}
+		else
+		{
+			// the claimed key was pruned while the frame was decoded
+			g_AnimFrameCacheLookup.Insert( m_params, hFrame );
+		}
+	}
+
+	animframecacheparams_t	m_params;
+	memhandle_t			m_hFrame;
+	CAnimFrameCache*	m_pFrame;
+	bool				m_bOwned;
+};
+
+void Studio_GetAnimFrameCacheStats( animframecachestats_t& stats )
+{
+	AUTO_LOCK( g_AnimFrameCache.AccessMutex() );
+	stats.nHits = g_nAnimFrameCacheHits;
+	stats.nMisses = g_nAnimFrameCacheMisses;
+	stats.nLookups = g_AnimFrameCacheLookup.Count();
+	stats.nFrames = 0;
+	FOR_EACH_MAP_FAST( g_AnimFrameCacheLookup, i )
+	{
+		if( g_AnimFrameCache.GetResource_NoLockNoLRUTouch( g_AnimFrameCacheLookup[i] ) )
+		{
+			stats.nFrames++;
+		}
+	}
+	stats.nBytesUsed = g_AnimFrameCache.UsedSize();
+	stats.nBytesTarget = g_AnimFrameCache.TargetSize();
+}
+
+void Studio_ResetAnimFrameCacheStats()
+{
+	AUTO_LOCK( g_AnimFrameCache.AccessMutex() );
+	g_nAnimFrameCacheHits = 0;
+	g_nAnimFrameCacheMisses = 0;
+}
+
+void Studio_FlushAnimFrameCache()
+{
+	AUTO_LOCK( g_AnimFrameCache.AccessMutex() );
+	g_AnimFrameCache.FlushAllUnlocked();
+	PruneAnimFrameCacheLookup();
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: handle bones whose rotation doesn't need any decoding, returns false
+//			if the rotation is animated
+//-----------------------------------------------------------------------------
+static inline bool CalcBoneQuaternionConstant( const Quaternion& baseQuat, const mstudioanim_t* panim, Quaternion& q )
 {
 	if( panim->flags & STUDIO_ANIM_RAWROT )
 	{
 		q = *( panim->pQuat48() );
 		Assert( q.IsValid() );
-		return;
+		return true;
 	}
 
 	if( panim->flags & STUDIO_ANIM_RAWROT2 )
 	{
 		q = *( panim->pQuat64() );
 		Assert( q.IsValid() );
-		return;
+		return true;
 	}
 
 	if( !( panim->flags & STUDIO_ANIM_ANIMROT ) )
@@ -402,19 +731,23 @@ void CalcBoneQuaternion( int frame, float s,
 		{
 			q = baseQuat;
 		}
-		return;
+		return true;
 	}
 
-	mstudioanim_valueptr_t* pValuesPtr = panim->pRotV();
+	return false;
+}
 
+//-----------------------------------------------------------------------------
+// Purpose: turn the decoded euler angles of a frame (and of the next frame when
+//			s > 0.001) into the bone's rotation
+//-----------------------------------------------------------------------------
+static inline void CalcBoneQuaternionFromAngles( float s,
+		const RadianEuler& baseRot, int iBaseFlags, const Quaternion& baseAlignment,
+		const mstudioanim_t* panim, RadianEuler& angle1, RadianEuler& angle2, Quaternion& q )
+{
 	if( s > 0.001f )
 	{
 		QuaternionAligned	q1, q2;
-		RadianEuler			angle1, angle2;
-
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle1.x, angle2.x );
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle1.y, angle2.y );
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle1.z, angle2.z );
 
 		if( !( panim->flags & STUDIO_ANIM_DELTA ) )
 		{
@@ -449,21 +782,15 @@ void CalcBoneQuaternion( int frame, float s,
 	}
 	else
 	{
-		RadianEuler			angle;
-
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle.x );
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle.y );
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle.z );
-
 		if( !( panim->flags & STUDIO_ANIM_DELTA ) )
 		{
-			angle.x = angle.x + baseRot.x;
-			angle.y = angle.y + baseRot.y;
-			angle.z = angle.z + baseRot.z;
+			angle1.x = angle1.x + baseRot.x;
+			angle1.y = angle1.y + baseRot.y;
+			angle1.z = angle1.z + baseRot.z;
 		}
 
-		Assert( angle.IsValid() );
-		AngleQuaternion( angle, q );
+		Assert( angle1.IsValid() );
+		AngleQuaternion( angle1, q );
 	}
 
 	Assert( q.IsValid() );
@@ -475,6 +802,64 @@ void CalcBoneQuaternion( int frame, float s,
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: return a sub frame rotation for a single bone
+//-----------------------------------------------------------------------------
+void CalcBoneQuaternion( int frame, float s,
+						 const Quaternion& baseQuat, const RadianEuler& baseRot, const Vector& baseRotScale,
+						 int iBaseFlags, const Quaternion& baseAlignment,
+						 const mstudioanim_t* panim, Quaternion& q )
+{
+	if( CalcBoneQuaternionConstant( baseQuat, panim, q ) )
+	{
+		return;
+	}
+
+	mstudioanim_valueptr_t* pValuesPtr = panim->pRotV();
+
+	RadianEuler			angle1, angle2;
+
+	if( s > 0.001f )
+	{
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle1.x, angle2.x );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle1.y, angle2.y );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle1.z, angle2.z );
+	}
+	else
+	{
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle1.x );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle1.y );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle1.z );
+	}
+
+	CalcBoneQuaternionFromAngles( s, baseRot, iBaseFlags, baseAlignment, panim, angle1, angle2, q );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: return a sub frame rotation for a single bone from a cached frame
+//-----------------------------------------------------------------------------
+static void CalcBoneQuaternion( float s,
+								const Quaternion& baseQuat, const RadianEuler& baseRot, const Vector& baseRotScale,
+								int iBaseFlags, const Quaternion& baseAlignment,
+								const mstudioanim_t* panim, const CAnimFrameCache* pFrame, int iAnim, Quaternion& q )
+{
+	if( CalcBoneQuaternionConstant( baseQuat, panim, q ) )
+	{
+		return;
+	}
+
+	RadianEuler			angle1, angle2;
+
+	angle1.x = pFrame->Channel( ANIMFRAME_ROT1 + 0 )[iAnim] * baseRotScale.x;
+	angle1.y = pFrame->Channel( ANIMFRAME_ROT1 + 1 )[iAnim] * baseRotScale.y;
+	angle1.z = pFrame->Channel( ANIMFRAME_ROT1 + 2 )[iAnim] * baseRotScale.z;
+	angle2.x = pFrame->Channel( ANIMFRAME_ROT2 + 0 )[iAnim] * baseRotScale.x;
+	angle2.y = pFrame->Channel( ANIMFRAME_ROT2 + 1 )[iAnim] * baseRotScale.y;
+	angle2.z = pFrame->Channel( ANIMFRAME_ROT2 + 2 )[iAnim] * baseRotScale.z;
+
+	CalcBoneQuaternionFromAngles( s, baseRot, iBaseFlags, baseAlignment, panim, angle1, angle2, q );
+}
+
 inline void CalcBoneQuaternion( int frame, float s,
 								const mstudiobone_t* pBone,
 								const mstudiolinearbone_t* pLinearBones,
@@ -490,23 +875,37 @@ inline void CalcBoneQuaternion( int frame, float s,
 	}
 }
 
+inline void CalcBoneQuaternion( float s,
+								const mstudiobone_t* pBone,
+								const mstudiolinearbone_t* pLinearBones,
+								const mstudioanim_t* panim, const CAnimFrameCache* pFrame, int iAnim, Quaternion& q )
+{
+	if( pLinearBones )
+	{
+		CalcBoneQuaternion( s, pLinearBones->quat( panim->bone ), pLinearBones->rot( panim->bone ), pLinearBones->rotscale( panim->bone ), pLinearBones->flags( panim->bone ), pLinearBones->qalignment( panim->bone ), panim, pFrame, iAnim, q );
+	}
+	else
+	{
+		CalcBoneQuaternion( s, pBone->quat, pBone->rot, pBone->rotscale, pBone->flags, pBone->qAlignment, panim, pFrame, iAnim, q );
+	}
+}
+
 
 
 
 
 //-----------------------------------------------------------------------------
-// Purpose: return a sub frame position for a single bone
+// Purpose: handle bones whose position doesn't need any decoding, returns false
+//			if the position is animated
 //-----------------------------------------------------------------------------
-void CalcBonePosition(	int frame, float s,
-						const Vector& basePos, const Vector& baseBoneScale,
-						const mstudioanim_t* panim, Vector& pos	)
+static inline bool CalcBonePositionConstant( const Vector& basePos, const mstudioanim_t* panim, Vector& pos )
 {
 	if( panim->flags & STUDIO_ANIM_RAWPOS )
 	{
 		pos = *( panim->pPos() );
 		Assert( pos.IsValid() );
 
-		return;
+		return true;
 	}
 	else if( !( panim->flags & STUDIO_ANIM_ANIMPOS ) )
 	{
@@ -518,6 +917,21 @@ void CalcBonePosition(	int frame, float s,
 		{
 			pos = basePos;
 		}
+		return true;
+	}
+
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: return a sub frame position for a single bone
+//-----------------------------------------------------------------------------
+void CalcBonePosition(	int frame, float s,
+						const Vector& basePos, const Vector& baseBoneScale,
+						const mstudioanim_t* panim, Vector& pos	)
+{
+	if( CalcBonePositionConstant( basePos, panim, pos ) )
+	{
 		return;
 	}
 
@@ -551,6 +965,47 @@ void CalcBonePosition(	int frame, float s,
 	Assert( pos.IsValid() );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: return a sub frame position for a single bone from a cached frame
+//-----------------------------------------------------------------------------
+static void CalcBonePosition( float s,
+							  const Vector& basePos, const Vector& baseBoneScale,
+							  const mstudioanim_t* panim, const CAnimFrameCache* pFrame, int iAnim, Vector& pos )
+{
+	if( CalcBonePositionConstant( basePos, panim, pos ) )
+	{
+		return;
+	}
+
+	int					j;
+
+	if( s > 0.001f )
+	{
+		for( j = 0; j < 3; j++ )
+		{
+			float v1 = pFrame->Channel( ANIMFRAME_POS1 + j )[iAnim] * baseBoneScale[j];
+			float v2 = pFrame->Channel( ANIMFRAME_POS2 + j )[iAnim] * baseBoneScale[j];
+			pos[j] = v1 * ( 1.0 - s ) + v2 * s;
+		}
+	}
+	else
+	{
+		for( j = 0; j < 3; j++ )
+		{
+			pos[j] = pFrame->Channel( ANIMFRAME_POS1 + j )[iAnim] * baseBoneScale[j];
+		}
+	}
+
+	if( !( panim->flags & STUDIO_ANIM_DELTA ) )
+	{
+		pos.x = pos.x + basePos.x;
+		pos.y = pos.y + basePos.y;
+		pos.z = pos.z + basePos.z;
+	}
+
+	Assert( pos.IsValid() );
+}
+
 
 inline void CalcBonePosition( int frame, float s,
 							  const mstudiobone_t* pBone,
@@ -567,6 +1022,21 @@ inline void CalcBonePosition( int frame, float s,
 	}
 }
 
+inline void CalcBonePosition( float s,
+							  const mstudiobone_t* pBone,
+							  const mstudiolinearbone_t* pLinearBones,
+							  const mstudioanim_t* panim, const CAnimFrameCache* pFrame, int iAnim, Vector& pos )
+{
+	if( pLinearBones )
+	{
+		CalcBonePosition( s, pLinearBones->pos( panim->bone ), pLinearBones->posscale( panim->bone ), panim, pFrame, iAnim, pos );
+	}
+	else
+	{
+		CalcBonePosition( s, pBone->pos, pBone->posscale, panim, pFrame, iAnim, pos );
+	}
+}
+
 
 
 void SetupSingleBoneMatrix(
@@ -941,8 +1411,9 @@ static void CalcVirtualAnimation( virtualmodel_t* pVModel, const CStudioHdr* pSt
 	s = ( fFrame - iFrame );
 
 	int iLocalFrame = iFrame;
+	int iSection;
 	float flStall;
-	panim = animdesc.pAnim( &iLocalFrame, flStall );
+	panim = animdesc.pAnim( &iLocalFrame, flStall, iSection );
 
 	float* pweight = seqdesc.pBoneweight( 0 );
 	pbone = pStudioHdr->pBone( 0 );
@@ -983,8 +1454,11 @@ static void CalcVirtualAnimation( virtualmodel_t* pVModel, const CStudioHdr* pSt
 		return;
 	}
 
+	CAnimFrameCacheLock frameCache( animdesc, panim, iSection, iLocalFrame );
+	const CAnimFrameCache* pFrame = frameCache.Get();
+
 	// FIXME: change encoding so that bone -1 is never the case
-	while( panim && panim->bone < 255 )
+	for( int iAnim = 0; panim && panim->bone < 255; iAnim++ )
 	{
 		j = pAnimGroup->masterBone[panim->bone];
 		if( j >= 0 && ( pStudioHdr->boneFlags( j ) & boneMask ) )
@@ -993,8 +1467,16 @@ static void CalcVirtualAnimation( virtualmodel_t* pVModel, const CStudioHdr* pSt
 
 			if( k >= 0 && pweight[k] > 0.0f )
 			{
-				CalcBoneQuaternion( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, q[j] );
-				CalcBonePosition( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, pos[j] );
+				if( pFrame )
+				{
+					CalcBoneQuaternion( s, &pAnimbone[panim->bone], pAnimLinearBones, panim, pFrame, iAnim, q[j] );
+					CalcBonePosition( s, &pAnimbone[panim->bone], pAnimLinearBones, panim, pFrame, iAnim, pos[j] );
+				}
+				else
+				{
+					CalcBoneQuaternion( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, q[j] );
+					CalcBonePosition( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, pos[j] );
+				}
 #ifdef STUDIO_ENABLE_PERF_COUNTERS
 				pStudioHdr->m_nPerfAnimatedBones++;
 #endif
@@ -1082,8 +1564,9 @@ static void CalcAnimation( const CStudioHdr* pStudioHdr,	Vector* pos, Quaternion
 	s = ( fFrame - iFrame );
 
 	int iLocalFrame = iFrame;
+	int iSection;
 	float flStall;
-	mstudioanim_t* panim = animdesc.pAnim( &iLocalFrame, flStall );
+	mstudioanim_t* panim = animdesc.pAnim( &iLocalFrame, flStall, iSection );
 
 	float* pweight = seqdesc.pBoneweight( 0 );
 
@@ -1114,6 +1597,10 @@ static void CalcAnimation( const CStudioHdr* pStudioHdr,	Vector* pos, Quaternion
 		return;
 	}
 
+	CAnimFrameCacheLock frameCache( animdesc, panim, iSection, iLocalFrame );
+	const CAnimFrameCache* pFrame = frameCache.Get();
+	int iAnim = 0;
+
 	// BUGBUG: the sequence, the anim, and the model can have all different bone mappings.
 	for( int i = 0; i < pStudioHdr->numbones(); i++, pbone++, pweight++ )
 	{
@@ -1121,14 +1608,23 @@ static void CalcAnimation( const CStudioHdr* pStudioHdr,	Vector* pos, Quaternion
 		{
 			if( *pweight > 0 && ( pStudioHdr->boneFlags( i ) & boneMask ) )
 			{
-				CalcBoneQuaternion( iLocalFrame, s, pbone, pLinearBones, panim, q[i] );
-				CalcBonePosition( iLocalFrame, s, pbone, pLinearBones, panim, pos[i] );
+				if( pFrame )
+				{
+					CalcBoneQuaternion( s, pbone, pLinearBones, panim, pFrame, iAnim, q[i] );
+					CalcBonePosition( s, pbone, pLinearBones, panim, pFrame, iAnim, pos[i] );
+				}
+				else
+				{
+					CalcBoneQuaternion( iLocalFrame, s, pbone, pLinearBones, panim, q[i] );
+					CalcBonePosition( iLocalFrame, s, pbone, pLinearBones, panim, pos[i] );
+				}
 #ifdef STUDIO_ENABLE_PERF_COUNTERS
 				pStudioHdr->m_nPerfAnimatedBones++;
 				pStudioHdr->m_nPerfUsedBones++;
 #endif
 			}
 			panim = panim->pNext();
+			iAnim++;
 		}
 		else if( *pweight > 0 && ( pStudioHdr->boneFlags( i ) & boneMask ) )
 		{
@@ -6052,13 +6548,7 @@ int Studio_FindAttachment( const CStudioHdr* pStudioHdr, const char* pAttachment
 	if( pStudioHdr && pStudioHdr->SequencesAvailable() )
 	{
 		// Extract the bone index from the name
-		for( int i = 0; i < pStudioHdr->GetNumAttachments(); i++ )
-		{
-			if( !V_stricmp( pAttachmentName, ( ( CStudioHdr* )pStudioHdr )->pAttachment( i ).pszName( ) ) )
-			{
-				return i;
-			}
-		}
+		return ( ( CStudioHdr* )pStudioHdr )->FindAttachment( pAttachmentName );
 	}
 
 	return -1;
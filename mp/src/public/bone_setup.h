@@ -448,6 +448,21 @@ memhandle_t Studio_CreateBoneCache( bonecacheparams_t& params );
 void Studio_DestroyBoneCache( memhandle_t cacheHandle );
 void Studio_InvalidateBoneCache( memhandle_t cacheHandle );
 
+// Decoded animation frames shared by every model playing the same animation
+struct animframecachestats_t
+{
+	int				nHits;
+	int				nMisses;
+	int				nLookups;		// keys in the lookup, including evicted frames
+	int				nFrames;		// frames currently in the cache
+	unsigned int	nBytesUsed;
+	unsigned int	nBytesTarget;
+};
+
+void Studio_GetAnimFrameCacheStats( animframecachestats_t& stats );
+void Studio_ResetAnimFrameCacheStats();
+void Studio_FlushAnimFrameCache();
+
 // Given a ray, trace for an intersection with this studiomodel.  Get the array of bones from StudioSetupHitboxBones
 bool TraceToStudio( class IPhysicsSurfaceProps* pProps, const Ray_t& ray, CStudioHdr* pStudioHdr, mstudiohitboxset_t* set, matrix3x4_t** hitboxbones, int fContentsMask, const Vector& vecOrigin, float flScale, trace_t& trace );
 
@@ -165,6 +165,10 @@ CChunkFile::CChunkFile( void )
 	m_szIndent[0] = '\0';
 	m_nHandlerStackDepth = 0;
 	m_DefaultChunkHandler = 0;
+	m_szToken[0][0] = '\0';
+	m_szToken[1][0] = '\0';
+	m_nTokenBuffer = 0;
+	m_pTokens = NULL;
 }
 
 
@@ -236,6 +240,8 @@ ChunkFileResult_t CChunkFile::Close( void )
 		m_hFile = NULL;
 	}
 
+	m_pTokens = NULL;
+
 	return( ChunkFile_Ok );
 }
 
@@ -297,6 +303,14 @@ const char* CChunkFile::GetErrorText( ChunkFileResult_t eResult )
 		}
 	}
 
+	if( m_pTokens != NULL )
+	{
+		// Same format as TokenReader::Error
+		static char szErrorBuf[256];
+		Q_snprintf( szErrorBuf, sizeof( szErrorBuf ), "File %s, line %d: %s", m_pTokens->GetFileName(), m_nTokenLine, szError );
+		return( szErrorBuf );
+	}
+
 	return( m_TokenReader.Error( szError ) );
 }
 
@@ -362,10 +376,10 @@ ChunkFileResult_t CChunkFile::HandleChunk( const char* szChunkName )
 			do
 			{
 				ChunkType_t eChunkType;
-				char szKey[MAX_KEYVALUE_LEN];
-				char szValue[MAX_KEYVALUE_LEN];
+				const char* pszKey;
+				const char* pszValue;
 
-				while( ( eResult = ReadNext( szKey, szValue, sizeof( szValue ), eChunkType ) ) == ChunkFile_Ok )
+				while( ( eResult = ReadNextTerm( pszKey, pszValue, eChunkType ) ) == ChunkFile_Ok )
 				{
 					if( eChunkType == ChunkType_Chunk )
 					{
@@ -430,6 +444,24 @@ ChunkFileResult_t CChunkFile::Open( const char* pszFileName, ChunkFileOpenMode_t
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Opens a chunk file that has been read into memory for reading. The
+//			tokens must outlive the chunk file, or at least its reads.
+// Input  : pTokens - File loaded with CChunkFileTokens::Load. Segments that
+//				haven't been tokenized yet are tokenized as they are reached.
+//-----------------------------------------------------------------------------
+ChunkFileResult_t CChunkFile::Open( CChunkFileTokens* pTokens )
+{
+	m_pTokens = pTokens;
+	m_nTokenSegment = 0;
+	m_nTokenIndex = 0;
+	m_nTokenLine = 1;
+	m_nCurrentDepth = 0;
+
+	return( ChunkFile_Ok );
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Removes the topmost set of chunk handlers.
 //-----------------------------------------------------------------------------
@@ -463,6 +495,26 @@ void CChunkFile::PushHandlers( CChunkHandlerMap* pHandlerMap )
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Returns the next token from memory or from the token reader.
+// Input  : pszToken - Receives the token. TokenReader's tokens go into
+//				alternating buffers, so only the last two read are valid.
+//-----------------------------------------------------------------------------
+trtoken_t CChunkFile::NextToken( const char*& pszToken )
+{
+	if( m_pTokens != NULL )
+	{
+		return( m_pTokens->ReadToken( m_nTokenSegment, m_nTokenIndex, pszToken, m_nTokenLine ) );
+	}
+
+	char* pszBuffer = m_szToken[m_nTokenBuffer];
+	m_nTokenBuffer ^= 1;
+
+	pszToken = pszBuffer;
+	return( m_TokenReader.NextToken( pszBuffer, MAX_KEYVALUE_LEN ) );
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Reads the next term from the chunk file. The type of term read is
 //			returned in the eChunkType parameter.
@@ -474,8 +526,31 @@ void CChunkFile::PushHandlers( CChunkHandlerMap* pHandlerMap )
 //-----------------------------------------------------------------------------
 ChunkFileResult_t CChunkFile::ReadNext( char* szName, char* szValue, int nValueSize, ChunkType_t& eChunkType )
 {
-	// HACK: pass in buffer sizes?
-	trtoken_t eTokenType = m_TokenReader.NextToken( szName, MAX_KEYVALUE_LEN );
+	const char* pszName;
+	const char* pszValue;
+
+	ChunkFileResult_t eResult = ReadNextTerm( pszName, pszValue, eChunkType );
+	Q_strncpy( szName, pszName, MAX_KEYVALUE_LEN );
+
+	if( eResult == ChunkFile_Ok )
+	{
+		Q_strncpy( szValue, pszValue, nValueSize );
+	}
+
+	return( eResult );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Same as ReadNext, but hands back the tokens instead of copying them.
+//			They stay valid until the next read from TokenReader, and for as
+//			long as the CChunkFileTokens when reading from memory.
+//-----------------------------------------------------------------------------
+ChunkFileResult_t CChunkFile::ReadNextTerm( const char*& pszName, const char*& pszValue, ChunkType_t& eChunkType )
+{
+	pszValue = "";
+
+	trtoken_t eTokenType = NextToken( pszName );
 
 	if( eTokenType != TOKENEOF )
 	{
@@ -484,30 +559,29 @@ ChunkFileResult_t CChunkFile::ReadNext( char* szName, char* szValue, int nValueS
 			case IDENT:
 			case STRING:
 			{
-				char szNext[MAX_KEYVALUE_LEN];
+				const char* pszNext;
 				trtoken_t eNextTokenType;
 
 				//
 				// Read the next token to determine what we have.
 				//
-				eNextTokenType = m_TokenReader.NextToken( szNext, sizeof( szNext ) );
+				eNextTokenType = NextToken( pszNext );
 
 				switch( eNextTokenType )
 				{
 					case OPERATOR:
 					{
-						if( !stricmp( szNext, "{" ) )
+						if( !stricmp( pszNext, "{" ) )
 						{
 							// Beginning of new chunk.
 							m_nCurrentDepth++;
 							eChunkType = ChunkType_Chunk;
-							szValue[0] = '\0';
 							return( ChunkFile_Ok );
 						}
 						else
 						{
 							// Unexpected symbol.
-							Q_strncpy( m_szErrorToken, szNext, sizeof( m_szErrorToken ) );
+							Q_strncpy( m_szErrorToken, pszNext, sizeof( m_szErrorToken ) );
 							return( ChunkFile_UnexpectedSymbol );
 						}
 					}
@@ -516,7 +590,7 @@ ChunkFileResult_t CChunkFile::ReadNext( char* szName, char* szValue, int nValueS
 					case IDENT:
 					{
 						// Key value pair.
-						Q_strncpy( szValue, szNext, nValueSize );
+						pszValue = pszNext;
 						eChunkType = ChunkType_Key;
 						return( ChunkFile_Ok );
 					}
@@ -537,7 +611,7 @@ ChunkFileResult_t CChunkFile::ReadNext( char* szName, char* szValue, int nValueS
 
 			case OPERATOR:
 			{
-				if( !stricmp( szName, "}" ) )
+				if( !stricmp( pszName, "}" ) )
 				{
 					// End of current chunk.
 					m_nCurrentDepth--;
@@ -546,7 +620,7 @@ ChunkFileResult_t CChunkFile::ReadNext( char* szName, char* szValue, int nValueS
 				else
 				{
 					// Unexpected symbol.
-					Q_strncpy( m_szErrorToken, szName, sizeof( m_szErrorToken ) );
+					Q_strncpy( m_szErrorToken, pszName, sizeof( m_szErrorToken ) );
 					return( ChunkFile_UnexpectedSymbol );
 				}
 			}
@@ -586,9 +660,22 @@ ChunkFileResult_t CChunkFile::ReadChunk( KeyHandler_t pfnKeyHandler, void* pData
 	{
 		char szName[MAX_KEYVALUE_LEN];
 		char szValue[MAX_KEYVALUE_LEN];
+		const char* pszName = szName;
+		const char* pszValue = szValue;
 		ChunkType_t eChunkType;
 
-		eResult = ReadNext( szName, szValue, sizeof( szValue ), eChunkType );
+		//
+		// Tokens read from memory stay put, so handlers can be given them as they
+		// are. TokenReader's get overwritten by the handler's own reads.
+		//
+		if( m_pTokens != NULL )
+		{
+			eResult = ReadNextTerm( pszName, pszValue, eChunkType );
+		}
+		else
+		{
+			eResult = ReadNext( szName, szValue, sizeof( szValue ), eChunkType );
+		}
 
 		if( eResult == ChunkFile_Ok )
 		{
@@ -597,14 +684,14 @@ ChunkFileResult_t CChunkFile::ReadChunk( KeyHandler_t pfnKeyHandler, void* pData
 				//
 				// Dispatch sub-chunks to the appropriate handler.
 				//
-				eResult = HandleChunk( szName );
+				eResult = HandleChunk( pszName );
 			}
 			else if( ( eChunkType == ChunkType_Key ) && ( pfnKeyHandler != NULL ) )
 			{
 				//
 				// Dispatch keys to the key value handler.
 				//
-				eResult = pfnKeyHandler( szName, szValue, pData );
+				eResult = pfnKeyHandler( pszName, pszValue, pData );
 			}
 		}
 	}
@@ -986,3 +1073,553 @@ ChunkFileResult_t CChunkFile::WriteLine( const char* pszLine )
 	return( ChunkFile_Ok );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Character classes TokenReader uses, for plain ASCII.
+//-----------------------------------------------------------------------------
+static inline bool IsTokenDigit( char ch )
+{
+	return ( ch >= '0' ) && ( ch <= '9' );
+}
+
+static inline bool IsTokenAlpha( char ch )
+{
+	return ( ( ch >= 'a' ) && ( ch <= 'z' ) ) || ( ( ch >= 'A' ) && ( ch <= 'Z' ) );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Constructor.
+//-----------------------------------------------------------------------------
+CChunkFileTokens::CChunkFileTokens( void )
+{
+	m_szFileName[0] = '\0';
+	m_pBuffer = NULL;
+	m_nSize = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Destructor. Frees the file and its tokens.
+//-----------------------------------------------------------------------------
+CChunkFileTokens::~CChunkFileTokens( void )
+{
+	delete [] m_pBuffer;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads the whole file and splits it into segments. Nothing is
+//			tokenized yet.
+// Input  : pszFileName - Path of file to read.
+// Output : Returns false if the file couldn't be read.
+//-----------------------------------------------------------------------------
+bool CChunkFileTokens::Load( const char* pszFileName )
+{
+	FILE* fp = fopen( pszFileName, "rb" );
+	if( fp == NULL )
+	{
+		return( false );
+	}
+
+	fseek( fp, 0, SEEK_END );
+	long nSize = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+
+	delete [] m_pBuffer;
+	m_pBuffer = NULL;
+	m_nSize = 0;
+	m_Segments.Purge();
+
+	if( nSize < 0 )
+	{
+		fclose( fp );
+		return( false );
+	}
+
+	m_pBuffer = new char[nSize + 1];
+	bool bRead = ( fread( m_pBuffer, 1, nSize, fp ) == ( size_t )nSize );
+	fclose( fp );
+
+	if( !bRead )
+	{
+		delete [] m_pBuffer;
+		m_pBuffer = NULL;
+		return( false );
+	}
+
+	m_pBuffer[nSize] = '\0';
+	m_nSize = nSize;
+	Q_strncpy( m_szFileName, pszFileName, sizeof( m_szFileName ) );
+
+	Split();
+	return( true );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Cuts the file after a close brace every CHUNKFILE_SEGMENT_SIZE
+//			bytes, skipping strings and comments the way TokenReader does.
+//-----------------------------------------------------------------------------
+void CChunkFileTokens::Split( void )
+{
+	int nStart = 0;
+	int nStartLine = 1;
+	int nLine = 1;
+	int nPos = 0;
+
+	while( true )
+	{
+		bool bLast = ( nPos >= m_nSize );
+		if( !bLast )
+		{
+			char ch = m_pBuffer[nPos++];
+
+			if( ch == '\n' )
+			{
+				nLine++;
+				continue;
+			}
+
+			if( ch == '\"' )
+			{
+				// Strings run to the next quote. Newlines in them don't bump the line.
+				const char* pszQuote = ( const char* )memchr( m_pBuffer + nPos, '\"', m_nSize - nPos );
+				nPos = pszQuote ? ( pszQuote - m_pBuffer ) + 1 : m_nSize;
+				continue;
+			}
+
+			if( ( ch == '/' ) && ( nPos < m_nSize ) && ( m_pBuffer[nPos] == '/' ) )
+			{
+				nPos = SkipComment( nPos );
+				nLine++;
+				continue;
+			}
+
+			if( ( ch != '}' ) || ( nPos - nStart < CHUNKFILE_SEGMENT_SIZE ) )
+			{
+				continue;
+			}
+		}
+
+		Segment_t& segment = m_Segments[m_Segments.AddToTail()];
+		segment.m_nStart = nStart;
+		segment.m_nStartLine = nStartLine;
+		segment.m_nEnd = nPos;
+		segment.m_bTokenized = false;
+
+		if( bLast )
+		{
+			break;
+		}
+
+		nStart = nPos;
+		nStartLine = nLine;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Tokenizes a segment from where Load() split it. Only touches that
+//			segment, so different segments can be done on different threads.
+//-----------------------------------------------------------------------------
+void CChunkFileTokens::TokenizeSegment( int nSegment )
+{
+	Segment_t& segment = m_Segments[nSegment];
+	Tokenize( nSegment, segment.m_nStart, segment.m_nStartLine );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads tokens from nStart until the token that reaches the end of
+//			the segment, or to the end of the file for the last segment.
+//-----------------------------------------------------------------------------
+void CChunkFileTokens::Tokenize( int nSegment, int nStart, int nStartLine )
+{
+	Segment_t& segment = m_Segments[nSegment];
+	bool bLast = ( nSegment == m_Segments.Count() - 1 );
+
+	// VMFs average a token every 16 or so bytes
+	int nLength = MAX( segment.m_nEnd - nStart, 0 );
+	segment.m_Tokens.RemoveAll();
+	segment.m_Tokens.EnsureCapacity( nLength / 16 + 1 );
+	segment.m_Text.RemoveAll();
+	segment.m_Text.EnsureCapacity( nLength + 1 );
+
+	int nPos = nStart;
+	int nLine = nStartLine;
+	char szToken[MAX_KEYVALUE_LEN];
+
+	do
+	{
+		trtoken_t eType = NextToken( nPos, nLine, szToken );
+
+		Token_t& token = segment.m_Tokens[segment.m_Tokens.AddToTail()];
+		token.m_nType = eType;
+		token.m_nLine = nLine;
+		token.m_nText = segment.m_Text.AddMultipleToTail( V_strlen( szToken ) + 1, szToken );
+
+		if( eType == TOKENEOF )
+		{
+			break;
+		}
+	}
+	while( bLast || ( nPos < segment.m_nEnd ) );
+
+	segment.m_nTokenStart = nStart;
+	segment.m_nTokenStartLine = nStartLine;
+	segment.m_nTokenEnd = nPos;
+	segment.m_nTokenEndLine = nLine;
+	segment.m_bTokenized = true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the token at the cursor and moves the cursor past it.
+// Input  : nSegment, nToken - Cursor, both 0 to start from the beginning.
+//			pszToken - Receives the token text.
+//			nLine - Receives the line TokenReader would be on after this token.
+//-----------------------------------------------------------------------------
+trtoken_t CChunkFileTokens::ReadToken( int& nSegment, int& nToken, const char*& pszToken, int& nLine )
+{
+	Segment_t* pSegment = &m_Segments[nSegment];
+	if( !pSegment->m_bTokenized )
+	{
+		Assert( nSegment == 0 );
+		TokenizeSegment( nSegment );
+	}
+
+	while( nToken >= pSegment->m_Tokens.Count() )
+	{
+		// The last segment ends in TOKENEOF, which is never moved past
+		Assert( nSegment < m_Segments.Count() - 1 );
+
+		// Carry on from where the last segment's tokens really stopped. If the
+		// next segment was read from anywhere else, it has to be done again.
+		int nEnd = pSegment->m_nTokenEnd;
+		int nEndLine = pSegment->m_nTokenEndLine;
+
+		nSegment++;
+		nToken = 0;
+		pSegment = &m_Segments[nSegment];
+
+		if( !pSegment->m_bTokenized || ( pSegment->m_nTokenStart != nEnd ) || ( pSegment->m_nTokenStartLine != nEndLine ) )
+		{
+			Tokenize( nSegment, nEnd, nEndLine );
+		}
+	}
+
+	const Token_t& token = pSegment->m_Tokens[nToken];
+	if( token.m_nType != TOKENEOF )
+	{
+		nToken++;
+	}
+
+	pszToken = pSegment->m_Text.Base() + token.m_nText;
+	nLine = token.m_nLine;
+	return( ( trtoken_t )token.m_nType );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Skips the rest of a // comment like ignore( 1024, '\n' ) does.
+// Input  : nPos - Position of the second slash.
+// Output : Returns the position after the comment.
+//-----------------------------------------------------------------------------
+int CChunkFileTokens::SkipComment( int nPos ) const
+{
+	int nEnd = MIN( nPos + 1024, m_nSize );
+	const char* pszNewline = ( const char* )memchr( m_pBuffer + nPos, '\n', nEnd - nPos );
+	return( pszNewline ? ( pszNewline - m_pBuffer ) + 1 : nEnd );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Same as TokenReader::SkipWhiteSpace.
+// Output : Returns true if the whitespace contained the combine strings
+//			character '+'.
+//-----------------------------------------------------------------------------
+bool CChunkFileTokens::SkipWhiteSpace( int& nPos, int& nLine ) const
+{
+	bool bCombineStrings = false;
+
+	while( nPos < m_nSize )
+	{
+		char ch = m_pBuffer[nPos++];
+
+		if( ( ch == ' ' ) || ( ch == '\t' ) || ( ch == '\r' ) || ( ch == 0 ) )
+		{
+			continue;
+		}
+
+		if( ch == '+' )
+		{
+			bCombineStrings = true;
+			continue;
+		}
+
+		if( ch == '\n' )
+		{
+			nLine++;
+			continue;
+		}
+
+		//
+		// A single slash is dropped, two start a comment.
+		//
+		if( ch == '/' )
+		{
+			if( ( nPos < m_nSize ) && ( m_pBuffer[nPos] == '/' ) )
+			{
+				nPos = SkipComment( nPos );
+				nLine++;
+			}
+			continue;
+		}
+
+		nPos--;
+		break;
+	}
+
+	return( bCombineStrings );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Same as TokenReader::GetString with a MAX_KEYVALUE_LEN buffer. It
+//			reads the string in pieces of up to 1023 characters that stop
+//			before a quote, which decides where its errors leave the file.
+// Input  : nPos - Position after the open quote.
+//			pszStore - MAX_KEYVALUE_LEN buffer.
+//-----------------------------------------------------------------------------
+trtoken_t CChunkFileTokens::GetString( int& nPos, int& nLine, char* pszStore ) const
+{
+	char* pszDest = pszStore;
+	int nSize = MAX_KEYVALUE_LEN;
+
+	while( true )
+	{
+		int nPiece = MIN( 1023, m_nSize - nPos );
+		const char* pszQuote = ( const char* )memchr( m_pBuffer + nPos, '\"', nPiece );
+		const char* pszSrc = m_pBuffer + nPos;
+		const char* pszSrcEnd = pszQuote ? pszQuote : pszSrc + nPiece;
+
+		nPos = pszSrcEnd - m_pBuffer;
+		if( nPos >= m_nSize )
+		{
+			*pszDest = '\0';
+			return TOKENEOF;
+		}
+
+		//
+		// Transfer the text up to the first null, like TokenReader does.
+		//
+		while( ( pszSrc < pszSrcEnd ) && ( *pszSrc != '\0' ) && ( nSize > 1 ) )
+		{
+			if( *pszSrc == 0x0d )
+			{
+				//
+				// Newline encountered before closing quote -- unterminated string.
+				//
+				*pszDest = '\0';
+				return TOKENSTRINGTOOLONG;
+			}
+			else if( *pszSrc != '\\' )
+			{
+				*pszDest = *pszSrc;
+				pszSrc++;
+			}
+			else
+			{
+				//
+				// Backslash sequence. TokenReader reads past its buffer when the
+				// backslash ends a piece and leaves garbage for anything but \n;
+				// drop the backslash and keep the character instead.
+				//
+				pszSrc++;
+				if( ( pszSrc == pszSrcEnd ) || ( *pszSrc == '\0' ) )
+				{
+					break;
+				}
+
+				*pszDest = ( *pszSrc == 'n' ) ? '\n' : *pszSrc;
+				pszSrc++;
+			}
+
+			pszDest++;
+			nSize--;
+		}
+
+		if( ( pszSrc < pszSrcEnd ) && ( *pszSrc != '\0' ) )
+		{
+			//
+			// Ran out of room in the destination buffer. Skip to the close-quote
+			// like ignore( 1024, '"' ), terminate the string, and exit.
+			//
+			int nEnd = MIN( nPos + 1024, m_nSize );
+			const char* pszClose = ( const char* )memchr( m_pBuffer + nPos, '\"', nEnd - nPos );
+			nPos = pszClose ? ( pszClose - m_pBuffer ) + 1 : nEnd;
+			*pszDest = '\0';
+			return TOKENSTRINGTOOLONG;
+		}
+
+		//
+		// Check for closing quote.
+		//
+		if( m_pBuffer[nPos] == '\"' )
+		{
+			//
+			// Eat the close quote and any whitespace, then combine consecutive
+			// quoted strings if there was a '+' between them.
+			//
+			nPos++;
+			bool bCombineStrings = SkipWhiteSpace( nPos, nLine );
+
+			if( bCombineStrings && ( nPos < m_nSize ) && ( m_pBuffer[nPos] == '\"' ) )
+			{
+				nPos++;
+			}
+			else
+			{
+				*pszDest = '\0';
+				return STRING;
+			}
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Same as TokenReader::NextToken with a MAX_KEYVALUE_LEN buffer.
+//-----------------------------------------------------------------------------
+trtoken_t CChunkFileTokens::NextToken( int& nPos, int& nLine, char* pszStore ) const
+{
+	char* pszDest = pszStore;
+
+	SkipWhiteSpace( nPos, nLine );
+
+	if( nPos >= m_nSize )
+	{
+		*pszDest = '\0';
+		return TOKENEOF;
+	}
+
+	char ch = m_pBuffer[nPos++];
+
+	//
+	// Look for all the valid operators.
+	//
+	switch( ch )
+	{
+		case '@':
+		case ',':
+		case '!':
+		case '+':
+		case '&':
+		case '*':
+		case '$':
+		case '.':
+		case '=':
+		case ':':
+		case '[':
+		case ']':
+		case '(':
+		case ')':
+		case '{':
+		case '}':
+		case '\\':
+		{
+			pszStore[0] = ch;
+			pszStore[1] = 0;
+			return OPERATOR;
+		}
+	}
+
+	//
+	// Look for the start of a quoted string.
+	//
+	if( ch == '\"' )
+	{
+		return GetString( nPos, nLine, pszStore );
+	}
+
+	//
+	// Integers consist of numbers with an optional leading minus sign.
+	//
+	if( IsTokenDigit( ch ) || ( ch == '-' ) )
+	{
+		while( true )
+		{
+			if( ( pszDest - pszStore + 1 ) < MAX_KEYVALUE_LEN )
+			{
+				*pszDest = ch;
+				pszDest++;
+			}
+
+			if( nPos >= m_nSize )
+			{
+				break;
+			}
+
+			ch = m_pBuffer[nPos++];
+			if( ch == '-' )
+			{
+				*pszDest = '\0';
+				return TOKENERROR;
+			}
+
+			if( !IsTokenDigit( ch ) )
+			{
+				//
+				// No identifier characters are allowed contiguous with numbers.
+				//
+				if( IsTokenAlpha( ch ) || ( ch == '_' ) )
+				{
+					*pszDest = '\0';
+					return TOKENERROR;
+				}
+
+				nPos--;
+				break;
+			}
+		}
+
+		*pszDest = '\0';
+		return INTEGER;
+	}
+
+	//
+	// Identifiers consist of a consecutive string of alphanumeric
+	// characters and underscores.
+	//
+	while( IsTokenAlpha( ch ) || IsTokenDigit( ch ) || ( ch == '_' ) )
+	{
+		if( ( pszDest - pszStore + 1 ) < MAX_KEYVALUE_LEN )
+		{
+			*pszDest = ch;
+			pszDest++;
+		}
+
+		if( nPos >= m_nSize )
+		{
+			*pszDest = '\0';
+			return IDENT;
+		}
+
+		ch = m_pBuffer[nPos++];
+	}
+
+	*pszDest = '\0';
+
+	//
+	// TokenReader puts anything else back and returns an empty identifier,
+	// forever. Stop on it instead.
+	//
+	if( pszDest == pszStore )
+	{
+		return TOKENERROR;
+	}
+
+	nPos--;
+	return IDENT;
+}
+
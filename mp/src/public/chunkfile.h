@@ -14,6 +14,7 @@
 
 #include <stdio.h>
 #include "tokenreader.h"
+#include "tier1/utlvector.h"
 
 
 #define MAX_INDENT_DEPTH		80
@@ -83,6 +84,85 @@ struct ChunkHandlerInfoNode_t
 };
 
 
+//-----------------------------------------------------------------------------
+// A chunk file read into memory in one go and cut into segments (after a '}',
+// every CHUNKFILE_SEGMENT_SIZE bytes or so) that can be tokenized separately,
+// on as many threads as there are segments. CChunkFile::Open( CChunkFileTokens* )
+// then reads the tokens instead of going through TokenReader.
+//
+// The tokens are exactly the ones TokenReader would return, including its
+// error cases. Segments are only split where the previous segment's tokens
+// should end; if a segment really ended somewhere else (a brace inside
+// something TokenReader doesn't treat as a string), the next one is
+// tokenized again from where it actually starts when it's read.
+//-----------------------------------------------------------------------------
+#define CHUNKFILE_SEGMENT_SIZE	( 64 * 1024 )
+
+class CChunkFileTokens
+{
+public:
+
+	CChunkFileTokens( void );
+	~CChunkFileTokens( void );
+
+	bool Load( const char* pszFileName );
+	const char* GetFileName( void ) const
+	{
+		return m_szFileName;
+	}
+
+	// Different segments may be tokenized at the same time on different threads.
+	int GetSegmentCount( void ) const
+	{
+		return m_Segments.Count();
+	}
+	void TokenizeSegment( int nSegment );
+
+	// Returns the token at nSegment/nToken and moves past it. TOKENEOF is
+	// returned again on every call once the end of the file is reached.
+	trtoken_t ReadToken( int& nSegment, int& nToken, const char*& pszToken, int& nLine );
+
+private:
+
+	struct Token_t
+	{
+		int m_nType;			// trtoken_t
+		int m_nText;			// offset into the segment's m_Text
+		int m_nLine;			// TokenReader's line number after reading this token
+	};
+
+	struct Segment_t
+	{
+		int m_nStart;			// where Load() split the file
+		int m_nStartLine;
+		int m_nEnd;
+
+		bool m_bTokenized;
+		int m_nTokenStart;		// where the tokens below were read from
+		int m_nTokenStartLine;
+		int m_nTokenEnd;		// and where reading them stopped
+		int m_nTokenEndLine;
+
+		CUtlVector<Token_t> m_Tokens;
+		CUtlVector<char> m_Text;
+	};
+
+	void Split( void );
+	void Tokenize( int nSegment, int nStart, int nStartLine );
+
+	bool SkipWhiteSpace( int& nPos, int& nLine ) const;
+	int SkipComment( int nPos ) const;
+	trtoken_t GetString( int& nPos, int& nLine, char* pszStore ) const;
+	trtoken_t NextToken( int& nPos, int& nLine, char* pszStore ) const;
+
+	char m_szFileName[128];
+	char* m_pBuffer;
+	int m_nSize;
+
+	CUtlVector<Segment_t> m_Segments;
+};
+
+
 //
 // Consider handling chunks with handler objects instead of callbacks.
 //
@@ -123,6 +203,7 @@ public:
 	~CChunkFile( void );
 
 	ChunkFileResult_t Open( const char* pszFileName, ChunkFileOpenMode_t eMode );
+	ChunkFileResult_t Open( CChunkFileTokens* pTokens );
 	ChunkFileResult_t Close( void );
 	const char* GetErrorText( ChunkFileResult_t eResult );
 
@@ -178,7 +259,18 @@ protected:
 
 	void BuildIndentString( char* pszDest, int nDepth );
 
+	trtoken_t NextToken( const char*& pszToken );
+	ChunkFileResult_t ReadNextTerm( const char*& pszName, const char*& pszValue, ChunkType_t& eChunkType );
+
 	TokenReader m_TokenReader;
+	char m_szToken[2][MAX_KEYVALUE_LEN];
+	int m_nTokenBuffer;
+
+	// Set when reading from memory instead of m_TokenReader
+	CChunkFileTokens* m_pTokens;
+	int m_nTokenSegment;
+	int m_nTokenIndex;
+	int m_nTokenLine;
 
 	FILE* m_hFile;
 	char m_szErrorToken[80];
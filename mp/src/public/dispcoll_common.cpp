@@ -53,6 +53,8 @@ public:
 
 CUtlHash<DispCollPlaneIndex_t, CPlaneIndexHashFuncs, CPlaneIndexHashFuncs> g_DispCollPlaneIndexHash( 512 );
 
+bool g_bDispCollScalarTriTests = false;
+
 
 //=============================================================================
 //	Displacement Collision Triangle
@@ -259,6 +261,110 @@ FORCEINLINE int IntersectFourBoxSpherePairs( const FourVectors& center, const fl
 	return TestSignSIMD( active );
 }
 
+// Same as the box offset IntersectRayWithTriangle uses to fudge swept boxes
+static float ComputeDispCollBoxOffset( const Ray_t& ray )
+{
+	if( ray.m_IsRay )
+	{
+		return 1e-3f;
+	}
+
+	float offset = FloatMakePositive( ray.m_Extents[0] * ray.m_Delta[0] ) +
+				   FloatMakePositive( ray.m_Extents[1] * ray.m_Delta[1] ) +
+				   FloatMakePositive( ray.m_Extents[2] * ray.m_Delta[2] );
+	offset *= InvRSquared( ray.m_Delta );
+
+	return offset + 1e-3;
+}
+
+// This does IntersectRayWithTriangle against the four triangles of a packet at once
+// Returns a mask of the triangles hit, with the barycentric coordinates and unclamped
+// parametric distance of each hit
+FORCEINLINE int IntersectRayWithFourTriangles( const FourVectors& rayStart, const FourVectors& rayDelta, const fltx4& boxT, const CDispCollTriPacket& packet,
+		bool bOneSided, fltx4& u, fltx4& v, fltx4& t )
+{
+	fltx4 active = LoadAlignedSIMD( g_SIMD_AllOnesMask );
+
+	// Cull out one-sided stuff
+	if( bOneSided )
+	{
+		FourVectors normal = packet.m_edge1 ^ packet.m_edge2;
+		active = CmpLtSIMD( normal * rayDelta, Four_Zeros );
+	}
+
+	// Cramer's rule, see IntersectRayWithTriangle
+	FourVectors dirCrossEdge2 = rayDelta ^ packet.m_edge2;
+	fltx4 denom = dirCrossEdge2 * packet.m_edge1;
+	fltx4 absDenom = MaxSIMD( denom, NegSIMD( denom ) );
+	active = AndSIMD( active, CmpGeSIMD( absDenom, ReplicateX4( 1e-6f ) ) );
+	if( !TestSignSIMD( active ) )
+	{
+		return 0;
+	}
+
+	// Lanes with a zero denominator are already inactive
+	fltx4 invDenom = DivSIMD( Four_Ones, denom );
+
+	FourVectors org = rayStart;
+	org -= packet.m_v0;
+	u = MulSIMD( dirCrossEdge2 * org, invDenom );
+	active = AndSIMD( active, AndSIMD( CmpGeSIMD( u, Four_Zeros ), CmpLeSIMD( u, Four_Ones ) ) );
+
+	FourVectors orgCrossEdge1 = org ^ packet.m_edge1;
+	v = MulSIMD( orgCrossEdge1 * rayDelta, invDenom );
+	active = AndSIMD( active, AndSIMD( CmpGeSIMD( v, Four_Zeros ), CmpLeSIMD( AddSIMD( u, v ), Four_Ones ) ) );
+
+	t = MulSIMD( orgCrossEdge1 * packet.m_edge2, invDenom );
+	active = AndSIMD( active, AndSIMD( CmpGeSIMD( t, NegSIMD( boxT ) ), CmpLeSIMD( t, AddSIMD( Four_Ones, boxT ) ) ) );
+
+	return TestSignSIMD( active );
+}
+
+// This does the early outs of CDispCollTree::SweepAABBTriIntersect for four triangles at once:
+// the box must be moving toward each face, and must not stay entirely outside the triangle's
+// bounds or entirely in front of its plane over the whole sweep. These only reject what the
+// scalar test clearly would (with some slack for rounding), so the surviving triangles still
+// get the full test and the result is unchanged.
+FORCEINLINE int SweepBoxFourTrianglesCandidates( const FourVectors& rayStart, const FourVectors& rayDelta, const FourVectors& rayExtents, const CDispCollTriPacket& packet )
+{
+	static const fltx4 slack = ReplicateX4( 0.01f );
+	static const fltx4 towardEpsilon = ReplicateX4( DISPCOLL_DIST_EPSILON + 0.001f );
+
+	// Moving away from the faces
+	fltx4 reject = CmpGtSIMD( packet.m_normal * rayDelta, towardEpsilon );
+
+	// Outside the triangle bounds at both ends of the sweep, per axis
+	FourVectors rayEnd = rayStart;
+	rayEnd += rayDelta;
+
+	FourVectors expandedMins = packet.m_mins;
+	expandedMins -= rayExtents;
+	FourVectors expandedMaxs = packet.m_maxs;
+	expandedMaxs += rayExtents;
+
+	fltx4 belowX = AndSIMD( CmpGtSIMD( SubSIMD( expandedMins.x, rayStart.x ), slack ), CmpGtSIMD( SubSIMD( expandedMins.x, rayEnd.x ), slack ) );
+	fltx4 belowY = AndSIMD( CmpGtSIMD( SubSIMD( expandedMins.y, rayStart.y ), slack ), CmpGtSIMD( SubSIMD( expandedMins.y, rayEnd.y ), slack ) );
+	fltx4 belowZ = AndSIMD( CmpGtSIMD( SubSIMD( expandedMins.z, rayStart.z ), slack ), CmpGtSIMD( SubSIMD( expandedMins.z, rayEnd.z ), slack ) );
+	fltx4 aboveX = AndSIMD( CmpGtSIMD( SubSIMD( rayStart.x, expandedMaxs.x ), slack ), CmpGtSIMD( SubSIMD( rayEnd.x, expandedMaxs.x ), slack ) );
+	fltx4 aboveY = AndSIMD( CmpGtSIMD( SubSIMD( rayStart.y, expandedMaxs.y ), slack ), CmpGtSIMD( SubSIMD( rayEnd.y, expandedMaxs.y ), slack ) );
+	fltx4 aboveZ = AndSIMD( CmpGtSIMD( SubSIMD( rayStart.z, expandedMaxs.z ), slack ), CmpGtSIMD( SubSIMD( rayEnd.z, expandedMaxs.z ), slack ) );
+	reject = OrSIMD( reject, OrSIMD( OrSIMD( belowX, belowY ), belowZ ) );
+	reject = OrSIMD( reject, OrSIMD( OrSIMD( aboveX, aboveY ), aboveZ ) );
+
+	// In front of the face plane, pushed out by the box, at both ends of the sweep
+	fltx4 absNormalX = MaxSIMD( packet.m_normal.x, NegSIMD( packet.m_normal.x ) );
+	fltx4 absNormalY = MaxSIMD( packet.m_normal.y, NegSIMD( packet.m_normal.y ) );
+	fltx4 absNormalZ = MaxSIMD( packet.m_normal.z, NegSIMD( packet.m_normal.z ) );
+	fltx4 expandDist = MaddSIMD( absNormalX, rayExtents.x, packet.m_dist );
+	expandDist = MaddSIMD( absNormalY, rayExtents.y, expandDist );
+	expandDist = MaddSIMD( absNormalZ, rayExtents.z, expandDist );
+	fltx4 startDist = SubSIMD( packet.m_normal * rayStart, expandDist );
+	fltx4 endDist = SubSIMD( packet.m_normal * rayEnd, expandDist );
+	reject = OrSIMD( reject, AndSIMD( CmpGtSIMD( startDist, slack ), CmpGtSIMD( endDist, slack ) ) );
+
+	return TestSignSIMD( reject ) ^ 0xf;
+}
+
 
 int FORCEINLINE CDispCollTree::BuildRayLeafList( int iNode, rayleaflist_t& list )
 {
@@ -306,6 +412,24 @@ int FORCEINLINE CDispCollTree::BuildRayLeafList( int iNode, rayleaflist_t& list
 	return listIndex;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Step through the leaves found by BuildRayLeafList a triangle packet
+//          at a time. Sibling leaves come out of the list next to each other, so
+//          they share one packet. Returns the packet index and sets the mask of
+//          its lanes whose leaf was actually in the list.
+//-----------------------------------------------------------------------------
+int FORCEINLINE CDispCollTree::NextLeafPacket( const rayleaflist_t& list, int& listIndex, int& laneMask )
+{
+	int leafIndex = list.nodeList[listIndex] - m_nodes.Count();
+	laneMask = ( leafIndex & 1 ) ? 0xc : 0x3;
+	if( !( leafIndex & 1 ) && ( listIndex < list.maxIndex ) && ( list.nodeList[listIndex + 1] == list.nodeList[listIndex] + 1 ) )
+	{
+		laneMask = 0xf;
+		listIndex++;
+	}
+	return leafIndex >> 1;
+}
+
 
 //-----------------------------------------------------------------------------
 // Purpose: Create the AABB tree.
@@ -320,6 +444,7 @@ bool CDispCollTree::AABBTree_Create( CCoreDispInfo* pDisp )
 
 	// Setup/create the leaf nodes first so the recusion can use this data to stop.
 	AABBTree_CreateLeafs();
+	AABBTree_CreateTriPackets();
 
 	// Create the bounding box of the displacement surface + the base face.
 	AABBTree_CalcBounds();
@@ -447,6 +572,57 @@ void CDispCollTree::AABBTree_CreateLeafs( void )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Lay out the leaf triangles four to a packet for the SIMD tests.
+//-----------------------------------------------------------------------------
+void CDispCollTree::AABBTree_CreateTriPackets( void )
+{
+	int numPackets = m_leaves.Count() >> 1;
+	{
+		MEM_ALLOC_CREDIT();
+		m_triPackets.SetCount( numPackets );
+	}
+	m_nSize += sizeof( CDispCollTriPacket ) * numPackets;
+
+	for( int iPacket = 0; iPacket < numPackets; ++iPacket )
+	{
+		CDispCollTriPacket& packet = m_triPackets[iPacket];
+		for( int iLane = 0; iLane < 4; ++iLane )
+		{
+			const CDispCollTri& tri = m_aTris[GetPacketTri( iPacket, iLane )];
+			const Vector& v0 = m_aVerts[tri.GetVert( 0 )];
+			const Vector& v1 = m_aVerts[tri.GetVert( 1 )];
+			const Vector& v2 = m_aVerts[tri.GetVert( 2 )];
+
+			Vector vecMins, vecMaxs;
+			ClearBounds( vecMins, vecMaxs );
+			AddPointToBounds( v0, vecMins, vecMaxs );
+			AddPointToBounds( v1, vecMins, vecMaxs );
+			AddPointToBounds( v2, vecMins, vecMaxs );
+
+			packet.m_v0.X( iLane ) = v0.x;
+			packet.m_v0.Y( iLane ) = v0.y;
+			packet.m_v0.Z( iLane ) = v0.z;
+			packet.m_edge1.X( iLane ) = v2.x - v0.x;
+			packet.m_edge1.Y( iLane ) = v2.y - v0.y;
+			packet.m_edge1.Z( iLane ) = v2.z - v0.z;
+			packet.m_edge2.X( iLane ) = v1.x - v0.x;
+			packet.m_edge2.Y( iLane ) = v1.y - v0.y;
+			packet.m_edge2.Z( iLane ) = v1.z - v0.z;
+			packet.m_normal.X( iLane ) = tri.m_vecNormal.x;
+			packet.m_normal.Y( iLane ) = tri.m_vecNormal.y;
+			packet.m_normal.Z( iLane ) = tri.m_vecNormal.z;
+			SubFloat( packet.m_dist, iLane ) = tri.m_flDist;
+			packet.m_mins.X( iLane ) = vecMins.x;
+			packet.m_mins.Y( iLane ) = vecMins.y;
+			packet.m_mins.Z( iLane ) = vecMins.z;
+			packet.m_maxs.X( iLane ) = vecMaxs.x;
+			packet.m_maxs.Y( iLane ) = vecMaxs.y;
+			packet.m_maxs.Z( iLane ) = vecMaxs.z;
+		}
+	}
+}
+
 void CDispCollTree::AABBTree_GenerateBoxes_r( int nodeIndex, Vector* pMins, Vector* pMaxs )
 {
 	// leaf
@@ -629,6 +805,33 @@ void CDispCollTree::AABBTree_TreeTrisRayBarycentricTest( const Ray_t& ray, const
 	list.rayExtents.DuplicateVector( ext );
 	int listIndex = BuildRayLeafList( iNode, list );
 
+	if( !g_bDispCollScalarTriTests )
+	{
+		FourVectors rayDelta;
+		rayDelta.DuplicateVector( ray.m_Delta );
+		fltx4 boxT = ReplicateX4( ComputeDispCollBoxOffset( ray ) );
+
+		fltx4 u4, v4, t4;
+		for( ; listIndex <= list.maxIndex; listIndex++ )
+		{
+			int laneMask;
+			int iPacket = NextLeafPacket( list, listIndex, laneMask );
+			int hitMask = IntersectRayWithFourTriangles( list.rayStart, rayDelta, boxT, m_triPackets[iPacket], false, u4, v4, t4 ) & laneMask;
+			for( int iLane = 0; hitMask; ++iLane, hitMask >>= 1 )
+			{
+				float flT = SubFloat( t4, iLane );
+				if( ( hitMask & 1 ) && ( flT > 0.0f ) && ( flT < output.dist ) )
+				{
+					( *pImpactTri ) = &m_aTris[GetPacketTri( iPacket, iLane )];
+					output.u = SubFloat( u4, iLane );
+					output.v = SubFloat( v4, iLane );
+					output.dist = flT;
+				}
+			}
+		}
+		return;
+	}
+
 	float flU, flV, flT;
 	for( ; listIndex <= list.maxIndex; listIndex++ )
 	{
@@ -667,6 +870,181 @@ void CDispCollTree::AABBTree_TreeTrisRayBarycentricTest( const Ray_t& ray, const
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Trace a batch of rays against this displacement, four at a time.
+//-----------------------------------------------------------------------------
+int CDispCollTree::AABBTree_RayBatch( const Ray_t* pRays, int nRays, RayDispOutput_t* pOutputs )
+{
+	VPROF( "DispRayBatchTest" );
+
+	// Check for ray test.
+	if( CheckFlags( CCoreDispInfo::SURF_NORAY_COLL ) )
+	{
+		return 0;
+	}
+
+	// Check for opacity.
+	if( !( m_nContents & MASK_OPAQUE ) )
+	{
+		return 0;
+	}
+
+	int nHits = 0;
+	for( int iFirst = 0; iFirst < nRays; iFirst += 4 )
+	{
+		nHits += AABBTree_RayPacketBarycentricTest( &pRays[iFirst], MIN( 4, nRays - iFirst ), &pOutputs[iFirst] );
+	}
+	return nHits;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Up to four rays against the tree at once. The rays are culled
+//          against the displacement bounds in one SIMD test, then walked down
+//          the tree together: each node is visited once for all the rays that
+//          entered it, and each triangle packet is loaded once for all the rays
+//          that reached its leaves. Leaves and triangles are tested in the same
+//          order as AABBTree_TreeTrisRayBarycentricTest, so ties resolve the same.
+//-----------------------------------------------------------------------------
+int CDispCollTree::AABBTree_RayPacketBarycentricTest( const Ray_t* pRays, int nRays, RayDispOutput_t* pOutputs )
+{
+	Assert( nRays > 0 && nRays <= 4 );
+
+	// Each ray in all four lanes, for testing it against four children or triangles,
+	// and the rays one per lane, for testing them all against one box
+	FourVectors rayStart[4], rayDelta[4], invDelta[4], rayExtents[4];
+	fltx4 boxT[4];
+	FourVectors packetStart, packetInvDelta, packetExtents;
+	for( int iLane = 0; iLane < 4; ++iLane )
+	{
+		// Pad a short packet with copies of its first ray
+		int iRay = ( iLane < nRays ) ? iLane : 0;
+		const Ray_t& ray = pRays[iRay];
+		Vector vecInvDelta = ray.InvDelta();
+		Vector ext = ray.m_Extents + Vector( DISPCOLL_DIST_EPSILON, DISPCOLL_DIST_EPSILON, DISPCOLL_DIST_EPSILON );
+
+		rayStart[iLane].DuplicateVector( ray.m_Start );
+		rayDelta[iLane].DuplicateVector( ray.m_Delta );
+		invDelta[iLane].DuplicateVector( vecInvDelta );
+		rayExtents[iLane].DuplicateVector( ext );
+		boxT[iLane] = ReplicateX4( ComputeDispCollBoxOffset( ray ) );
+
+		packetStart.X( iLane ) = ray.m_Start.x;
+		packetStart.Y( iLane ) = ray.m_Start.y;
+		packetStart.Z( iLane ) = ray.m_Start.z;
+		packetInvDelta.X( iLane ) = vecInvDelta.x;
+		packetInvDelta.Y( iLane ) = vecInvDelta.y;
+		packetInvDelta.Z( iLane ) = vecInvDelta.z;
+		packetExtents.X( iLane ) = ext.x;
+		packetExtents.Y( iLane ) = ext.y;
+		packetExtents.Z( iLane ) = ext.z;
+	}
+
+	FourVectors boxMins, boxMaxs;
+	boxMins.DuplicateVector( m_mins );
+	boxMaxs.DuplicateVector( m_maxs );
+	int rayMask = IntersectRayWithFourBoxes( packetStart, packetInvDelta, packetExtents, boxMins, boxMaxs ) & ( ( 1 << nRays ) - 1 );
+	if( !rayMask )
+	{
+		return 0;
+	}
+
+	CDispCollTri* pImpactTri[4] = { NULL, NULL, NULL, NULL };
+
+	// Breadth first, like BuildRayLeafList, with the rays still in each node
+	int nodeList[MAX_AABB_LIST];
+	int nodeRays[MAX_AABB_LIST];
+	nodeList[0] = DISPCOLL_ROOTNODE_INDEX;
+	nodeRays[0] = rayMask;
+	int nNodes = 1;
+
+	for( int listIndex = 0; listIndex < nNodes; ++listIndex )
+	{
+		int iNode = nodeList[listIndex];
+		const CDispCollNode& node = m_nodes[iNode];
+
+		// Which rays enter each of the four children
+		int childRays[4] = { 0, 0, 0, 0 };
+		for( int iRay = 0; iRay < nRays; ++iRay )
+		{
+			if( !( nodeRays[listIndex] & ( 1 << iRay ) ) )
+			{
+				continue;
+			}
+
+			int mask = IntersectRayWithFourBoxes( rayStart[iRay], invDelta[iRay], rayExtents[iRay], node.m_mins, node.m_maxs );
+			for( int iChild = 0; mask; ++iChild, mask >>= 1 )
+			{
+				if( mask & 1 )
+				{
+					childRays[iChild] |= ( 1 << iRay );
+				}
+			}
+		}
+
+		int iFirstChild = Nodes_GetChild( iNode, 0 );
+		if( !IsLeafNode( iFirstChild ) )
+		{
+			for( int iChild = 0; iChild < 4; ++iChild )
+			{
+				if( childRays[iChild] )
+				{
+					nodeList[nNodes] = iFirstChild + iChild;
+					nodeRays[nNodes] = childRays[iChild];
+					++nNodes;
+				}
+			}
+			Assert( nNodes <= MAX_AABB_LIST );
+			continue;
+		}
+
+		// The children are leaves, and sibling leaves share a triangle packet
+		int iFirstLeaf = iFirstChild - m_nodes.Count();
+		Assert( !( iFirstLeaf & 1 ) );
+		for( int iChild = 0; iChild < 4; iChild += 2 )
+		{
+			int iPacket = ( iFirstLeaf + iChild ) >> 1;
+			for( int iRay = 0; iRay < nRays; ++iRay )
+			{
+				int laneMask = ( ( childRays[iChild] >> iRay ) & 1 ) ? 0x3 : 0;
+				laneMask |= ( ( childRays[iChild + 1] >> iRay ) & 1 ) ? 0xc : 0;
+				if( !laneMask )
+				{
+					continue;
+				}
+
+				fltx4 u4, v4, t4;
+				RayDispOutput_t& output = pOutputs[iRay];
+				int hitMask = IntersectRayWithFourTriangles( rayStart[iRay], rayDelta[iRay], boxT[iRay], m_triPackets[iPacket], false, u4, v4, t4 ) & laneMask;
+				for( int iLane = 0; hitMask; ++iLane, hitMask >>= 1 )
+				{
+					float flT = SubFloat( t4, iLane );
+					if( ( hitMask & 1 ) && ( flT > 0.0f ) && ( flT < output.dist ) )
+					{
+						pImpactTri[iRay] = &m_aTris[GetPacketTri( iPacket, iLane )];
+						output.u = SubFloat( u4, iLane );
+						output.v = SubFloat( v4, iLane );
+						output.dist = flT;
+					}
+				}
+			}
+		}
+	}
+
+	int nHits = 0;
+	for( int iRay = 0; iRay < nRays; ++iRay )
+	{
+		if( pImpactTri[iRay] )
+		{
+			RayDispOutput_t& output = pOutputs[iRay];
+			output.ndxVerts[0] = pImpactTri[iRay]->GetVert( 0 );
+			output.ndxVerts[1] = pImpactTri[iRay]->GetVert( 2 );
+			output.ndxVerts[2] = pImpactTri[iRay]->GetVert( 1 );
+			++nHits;
+		}
+	}
+	return nHits;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
@@ -719,6 +1097,36 @@ void CDispCollTree::AABBTree_TreeTrisRayTest( const Ray_t& ray, const Vector& ve
 	list.rayExtents.DuplicateVector( ext );
 	int listIndex = BuildRayLeafList( iNode, list );
 
+	if( !g_bDispCollScalarTriTests )
+	{
+		FourVectors rayDelta;
+		rayDelta.DuplicateVector( ray.m_Delta );
+		fltx4 boxT = ReplicateX4( ComputeDispCollBoxOffset( ray ) );
+
+		fltx4 u4, v4, t4;
+		for( ; listIndex <= list.maxIndex; listIndex++ )
+		{
+			int laneMask;
+			int iPacket = NextLeafPacket( list, listIndex, laneMask );
+			int hitMask = IntersectRayWithFourTriangles( list.rayStart, rayDelta, boxT, m_triPackets[iPacket], bSide, u4, v4, t4 ) & laneMask;
+			for( int iLane = 0; hitMask; ++iLane, hitMask >>= 1 )
+			{
+				if( !( hitMask & 1 ) )
+				{
+					continue;
+				}
+
+				float flFrac = clamp( SubFloat( t4, iLane ), 0.f, 1.f );
+				if( flFrac < pTrace->fraction )
+				{
+					pTrace->fraction = flFrac;
+					( *pImpactTri ) = &m_aTris[GetPacketTri( iPacket, iLane )];
+				}
+			}
+		}
+		return;
+	}
+
 	for( ; listIndex <= list.maxIndex; listIndex++ )
 	{
 		int leafIndex = list.nodeList[listIndex] - m_nodes.Count();
@@ -948,7 +1356,31 @@ bool CDispCollTree::AABBTree_SweepAABB( const Ray_t& ray, const Vector& vecInvDe
 	list.rayExtents.DuplicateVector( ext );
 	int listIndex = BuildRayLeafList( 0, list );
 
-	if( listIndex <= list.maxIndex )
+	if( listIndex <= list.maxIndex && !g_bDispCollScalarTriTests )
+	{
+		FourVectors rayDelta;
+		rayDelta.DuplicateVector( ray.m_Delta );
+		FourVectors rayExtents;
+		rayExtents.DuplicateVector( ray.m_Extents );
+
+		LockCache();
+		for( ; listIndex <= list.maxIndex; listIndex++ )
+		{
+			int laneMask;
+			int iPacket = NextLeafPacket( list, listIndex, laneMask );
+			int candidates = SweepBoxFourTrianglesCandidates( list.rayStart, rayDelta, rayExtents, m_triPackets[iPacket] ) & laneMask;
+			for( int iLane = 0; candidates; ++iLane, candidates >>= 1 )
+			{
+				if( candidates & 1 )
+				{
+					int iTri = GetPacketTri( iPacket, iLane );
+					SweepAABBTriIntersect( ray, rayDir, iTri, &m_aTris[iTri], pTrace );
+				}
+			}
+		}
+		UnlockCache();
+	}
+	else if( listIndex <= list.maxIndex )
 	{
 		LockCache();
 		for( ; listIndex <= list.maxIndex; listIndex++ )
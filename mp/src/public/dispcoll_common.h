@@ -41,6 +41,9 @@ extern double g_flDispCollSweepTimer;
 extern double g_flDispCollIntersectTimer;
 extern double g_flDispCollInCallTimer;
 
+// Test leaf triangles one at a time instead of four at a time (for comparison/debugging)
+extern bool g_bDispCollScalarTriTests;
+
 struct RayDispOutput_t
 {
 	short	ndxVerts[4];	// 3 verts and a pad
@@ -162,6 +165,20 @@ public:
 	short	m_tris[2];
 };
 
+// The triangles of two sibling leaves (leaf 2n tris 0,1 then leaf 2n+1 tris 0,1)
+// in SoA form, so rays and sweeps can be tested against four triangles at once.
+class CDispCollTriPacket
+{
+public:
+	FourVectors m_v0;			// Vert 0
+	FourVectors m_edge1;		// Vert 2 - vert 0
+	FourVectors m_edge2;		// Vert 1 - vert 0
+	FourVectors m_normal;		// Plane normal
+	fltx4		m_dist;			// Plane dist
+	FourVectors m_mins;			// Triangle bounds
+	FourVectors m_maxs;
+};
+
 // a power 4 displacement can have 341 nodes, pad out to 344 for 16-byte alignment
 const int MAX_DISP_AABB_NODES = 341;
 const int MAX_AABB_LIST = 344;
@@ -195,6 +212,12 @@ public:
 	// NOTE: Lower perf helper function, should not be used in the game runtime
 	bool AABBTree_Ray( const Ray_t& ray, RayDispOutput_t& output );
 
+	// Batch raycasts: the same test as AABBTree_Ray( ray, output ) for nRays rays against this
+	// displacement. Rays go through the tree four at a time, together. Each pOutputs[i].dist must
+	// be initialized; ndxVerts, u, v and dist are only written on a closer hit. Returns the number
+	// of rays that hit.
+	int AABBTree_RayBatch( const Ray_t* pRays, int nRays, RayDispOutput_t* pOutputs );
+
 	// Hull Sweeps.
 	// NOTE: These assume you've precalculated invDelta as well as culled to the bounds of this disp
 	bool AABBTree_SweepAABB( const Ray_t& ray, const Vector& invDelta, CBaseTrace* pTrace );
@@ -340,6 +363,7 @@ protected:
 	bool AABBTree_Create( CCoreDispInfo* pDisp );
 	void AABBTree_CopyDispData( CCoreDispInfo* pDisp );
 	void AABBTree_CreateLeafs( void );
+	void AABBTree_CreateTriPackets( void );
 	void AABBTree_GenerateBoxes_r( int nodeIndex, Vector* pMins, Vector* pMaxs );
 	void AABBTree_CalcBounds( void );
 
@@ -347,8 +371,11 @@ protected:
 
 	void AABBTree_TreeTrisRayTest( const Ray_t& ray, const Vector& vecInvDelta, int iNode, CBaseTrace* pTrace, bool bSide, CDispCollTri** pImpactTri );
 	void AABBTree_TreeTrisRayBarycentricTest( const Ray_t& ray, const Vector& vecInvDelta, int iNode, RayDispOutput_t& output, CDispCollTri** pImpactTri );
+	int AABBTree_RayPacketBarycentricTest( const Ray_t* pRays, int nRays, RayDispOutput_t* pOutputs );
 
 	int FORCEINLINE BuildRayLeafList( int iNode, rayleaflist_t& list );
+	int FORCEINLINE NextLeafPacket( const rayleaflist_t& list, int& listIndex, int& laneMask );
+	inline int GetPacketTri( int iPacket, int iLane );
 
 	struct AABBTree_TreeTrisSweepTest_Args_t
 	{
@@ -409,6 +436,7 @@ protected:
 	CDispVector<CDispCollTri>		m_aTris;								// Displacement triangles.
 	CDispVector<CDispCollNode>		m_nodes;					// Nodes.
 	CDispVector<CDispCollLeaf>		m_leaves;								// Leaves.
+	CDispVector<CDispCollTriPacket>	m_triPackets;							// Leaf triangles, four per packet.
 	// Cache
 	CUtlVector<CDispCollTriCache>	m_aTrisCache;
 	CUtlVector<Vector> m_aEdgePlanes;
@@ -424,6 +452,14 @@ FORCEINLINE bool CDispCollTree::IsLeafNode( int iNode )
 	return iNode >= m_nodes.Count() ? true : false;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: get the triangle index held in one lane of a leaf triangle packet
+//-----------------------------------------------------------------------------
+inline int CDispCollTree::GetPacketTri( int iPacket, int iLane )
+{
+	return m_leaves[( iPacket << 1 ) + ( iLane >> 1 )].m_tris[iLane & 1];
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: get the child node index given the current node index and direction
 //          of the child (1 of 4)
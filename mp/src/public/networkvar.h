@@ -121,19 +121,32 @@ public:
 	CAutoInitEntPtr()
 	{
 		m_pEnt = NULL;
+		m_bEmbedded = false;
 	}
 	CBaseEntity* m_pEnt;
+	bool m_bEmbedded;	// Lives inside m_pEnt, so its vars can be tracked by offset
 };
 
-//TODO: Currently, these don't get the benefit of tracking changes to individual vars.
-// Would be nice if they did.
+// Chained objects that are members of the entity pass their vars through, which lets
+// the engine send only what changed. Anything allocated elsewhere has no fixed offset
+// from the entity and marks the whole entity changed.
 #define DECLARE_NETWORKVAR_CHAIN() \
 		CAutoInitEntPtr __m_pChainEntity; \
 		void NetworkStateChanged() { CHECK_USENETWORKVARS __m_pChainEntity.m_pEnt->NetworkStateChanged(); } \
-		void NetworkStateChanged( void *pVar ) { CHECK_USENETWORKVARS __m_pChainEntity.m_pEnt->NetworkStateChanged(); }
+		void NetworkStateChanged( void *pVar ) \
+		{ \
+			CHECK_USENETWORKVARS \
+			{ \
+				if ( __m_pChainEntity.m_bEmbedded ) \
+					__m_pChainEntity.m_pEnt->NetworkStateChanged( pVar ); \
+				else \
+					__m_pChainEntity.m_pEnt->NetworkStateChanged(); \
+			} \
+		}
 
 #define IMPLEMENT_NETWORKVAR_CHAIN( varName ) \
-		(varName)->__m_pChainEntity.m_pEnt = this;
+		(varName)->__m_pChainEntity.m_pEnt = this; \
+		(varName)->__m_pChainEntity.m_bEmbedded = ( (char*)(varName) > (char*)this && (char*)(varName) < (char*)this + sizeof( *this ) );
 
 
 
@@ -773,7 +786,7 @@ public:
 	protected: \
 		inline void NetworkStateChanged() \
 		{ \
-		CHECK_USENETWORKVARS ((ThisClass*)(((char*)this) - MyOffsetOf(ThisClass,name)))->NetworkStateChanged(); \
+		CHECK_USENETWORKVARS ((ThisClass*)(((char*)this) - MyOffsetOf(ThisClass,name)))->NetworkStateChanged( m_Value ); \
 		} \
 	private: \
 		char m_Value[length]; \
@@ -323,7 +323,7 @@ private:
 		float		weight;
 	};
 
-	static CUtlSymbolTable sm_CriteriaSymbols;
+	static CUtlHashSymbolTable sm_CriteriaSymbols;
 	typedef CUtlRBTree< CritEntry_t, short > Dict_t;
 	Dict_t m_Lookup;
 	int m_nNumPrefixedContexts; // number of contexts prefixed with kAPPLYTOWORLDPREFIX
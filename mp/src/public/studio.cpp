@@ -10,6 +10,7 @@
 #include "datacache/idatacache.h"
 #include "datacache/imdlcache.h"
 #include "convar.h"
+#include "tier1/generichash.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -72,6 +73,12 @@ mstudioanim_t* mstudioanimdesc_t::pAnim( int* piFrame ) const
 }
 
 mstudioanim_t* mstudioanimdesc_t::pAnim( int* piFrame, float& flStall ) const
+{
+	int iSection;
+	return pAnim( piFrame, flStall, iSection );
+}
+
+mstudioanim_t* mstudioanimdesc_t::pAnim( int* piFrame, float& flStall, int& iSection ) const
 {
 	mstudioanim_t* panim = NULL;
 
@@ -171,6 +178,7 @@ mstudioanim_t* mstudioanimdesc_t::pAnim( int* piFrame, float& flStall ) const
 		Msg( "[%8.3f] stall on %s:%s:%d:%d\n", Plat_FloatTime(), pStudiohdr()->pszName(), pszName(), section, block );
 	}
 
+	iSection = section;
 	return panim;
 }
 
@@ -720,6 +728,7 @@ CStudioHdr::CStudioHdr( void )
 	// set pointer to bogus value
 	m_nFrameUnlockCounter = 0;
 	m_pFrameUnlockCounter = &m_nFrameUnlockCounter;
+	memset( ( void* )m_pNameIndex, 0, sizeof( m_pNameIndex ) );
 	Init( NULL );
 }
 
@@ -728,6 +737,7 @@ CStudioHdr::CStudioHdr( const studiohdr_t* pStudioHdr, IMDLCache* mdlcache )
 	// preset pointer to bogus value (it may be overwritten with legitimate data later)
 	m_nFrameUnlockCounter = 0;
 	m_pFrameUnlockCounter = &m_nFrameUnlockCounter;
+	memset( ( void* )m_pNameIndex, 0, sizeof( m_pNameIndex ) );
 	Init( pStudioHdr, mdlcache );
 }
 
@@ -740,6 +750,7 @@ void CStudioHdr::Init( const studiohdr_t* pStudioHdr, IMDLCache* mdlcache )
 
 	m_pVModel = NULL;
 	m_pStudioHdrCache.RemoveAll();
+	ResetNameIndices();
 
 	if( m_pStudioHdr == NULL )
 	{
@@ -779,6 +790,172 @@ void CStudioHdr::Init( const studiohdr_t* pStudioHdr, IMDLCache* mdlcache )
 
 void CStudioHdr::Term()
 {
+	ResetNameIndices();
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Open-addressed name -> index table for one kind of name
+//-----------------------------------------------------------------------------
+class CStudioHdr::CNameIndex
+{
+public:
+	struct Slot_t
+	{
+		uint32	m_nHash;
+		int		m_nIndex;	// -1 = empty
+	};
+
+	// What the table was built from; rebuilt if any of these change
+	const studiohdr_t*		m_pExpectedStudioHdr;
+	const virtualmodel_t*	m_pExpectedVModel;
+	int						m_nCount;
+
+	uint32					m_nMask;
+	CUtlVector<Slot_t>		m_Slots;
+
+	// A stale table this one replaced. Other threads may still be reading it,
+	// so it lives until the CStudioHdr is reset.
+	CNameIndex*				m_pRetired;
+};
+
+static inline uint32 HashStudioName( const char* pszName )
+{
+	return MurmurHash2LowerCase( pszName, 0x5D1A7C53 );
+}
+
+const char* CStudioHdr::NameForIndex( int nType, int i )
+{
+	switch( nType )
+	{
+	case NAMEINDEX_SEQUENCE:
+		return pSeqdesc( i ).pszLabel();
+	case NAMEINDEX_ACTIVITY:
+		return pSeqdesc( i ).pszActivityName();
+	default:
+		return pAttachment( i ).pszName();
+	}
+}
+
+int CStudioHdr::NumNamesForType( int nType )
+{
+	return ( nType == NAMEINDEX_ATTACHMENT ) ? GetNumAttachments() : GetNumSeq();
+}
+
+CStudioHdr::CNameIndex* CStudioHdr::BuildNameIndex( int nType )
+{
+	CNameIndex* pIndex = new CNameIndex;
+	pIndex->m_pExpectedStudioHdr = m_pStudioHdr;
+	pIndex->m_pExpectedVModel = m_pVModel;
+	pIndex->m_nCount = NumNamesForType( nType );
+	pIndex->m_pRetired = NULL;
+
+	// Keep it at most half full
+	uint32 nSize = 16;
+	while( nSize < ( uint32 )pIndex->m_nCount * 2 )
+	{
+		nSize <<= 1;
+	}
+	pIndex->m_nMask = nSize - 1;
+	pIndex->m_Slots.SetCount( nSize );
+	for( uint32 i = 0; i < nSize; i++ )
+	{
+		pIndex->m_Slots[i].m_nHash = 0;
+		pIndex->m_Slots[i].m_nIndex = -1;
+	}
+
+	for( int i = 0; i < pIndex->m_nCount; i++ )
+	{
+		const char* pszName = NameForIndex( nType, i );
+		uint32 nHash = HashStudioName( pszName );
+
+		uint32 nSlot = nHash & pIndex->m_nMask;
+		for( ; pIndex->m_Slots[nSlot].m_nIndex != -1; nSlot = ( nSlot + 1 ) & pIndex->m_nMask )
+		{
+			const CNameIndex::Slot_t& slot = pIndex->m_Slots[nSlot];
+			if( slot.m_nHash == nHash && !V_stricmp( NameForIndex( nType, slot.m_nIndex ), pszName ) )
+			{
+				// Already have an earlier one by this name
+				break;
+			}
+		}
+
+		if( pIndex->m_Slots[nSlot].m_nIndex == -1 )
+		{
+			pIndex->m_Slots[nSlot].m_nHash = nHash;
+			pIndex->m_Slots[nSlot].m_nIndex = i;
+		}
+	}
+
+	return pIndex;
+}
+
+int CStudioHdr::FindByName( int nType, const char* pszName )
+{
+	if( !pszName || !m_pStudioHdr )
+	{
+		return -1;
+	}
+
+	CNameIndex* pIndex = m_pNameIndex[nType];
+	if( !pIndex || pIndex->m_pExpectedStudioHdr != m_pStudioHdr || pIndex->m_pExpectedVModel != m_pVModel ||
+		pIndex->m_nCount != NumNamesForType( nType ) )
+	{
+		CNameIndex* pNew = BuildNameIndex( nType );
+		pNew->m_pRetired = pIndex;
+		ThreadMemoryBarrier();
+		if( ThreadInterlockedCompareExchangePointer( ( void* volatile* )&m_pNameIndex[nType], pNew, pIndex ) != pIndex )
+		{
+			// Another thread got there first; use theirs
+			delete pNew;
+		}
+		pIndex = m_pNameIndex[nType];
+	}
+
+	uint32 nHash = HashStudioName( pszName );
+	for( uint32 nSlot = nHash & pIndex->m_nMask; ; nSlot = ( nSlot + 1 ) & pIndex->m_nMask )
+	{
+		const CNameIndex::Slot_t& slot = pIndex->m_Slots[nSlot];
+		if( slot.m_nIndex == -1 )
+		{
+			return -1;
+		}
+
+		if( slot.m_nHash == nHash && !V_stricmp( NameForIndex( nType, slot.m_nIndex ), pszName ) )
+		{
+			return slot.m_nIndex;
+		}
+	}
+}
+
+void CStudioHdr::ResetNameIndices()
+{
+	for( int i = 0; i < NAMEINDEX_COUNT; i++ )
+	{
+		CNameIndex* pIndex = m_pNameIndex[i];
+		while( pIndex )
+		{
+			CNameIndex* pRetired = pIndex->m_pRetired;
+			delete pIndex;
+			pIndex = pRetired;
+		}
+		m_pNameIndex[i] = NULL;
+	}
+}
+
+int CStudioHdr::FindSequence( const char* pszLabel )
+{
+	return FindByName( NAMEINDEX_SEQUENCE, pszLabel );
+}
+
+int CStudioHdr::FindSequenceForActivityName( const char* pszActivityName )
+{
+	return FindByName( NAMEINDEX_ACTIVITY, pszActivityName );
+}
+
+int CStudioHdr::FindAttachment( const char* pszName )
+{
+	return FindByName( NAMEINDEX_ATTACHMENT, pszName );
 }
 
 //-----------------------------------------------------------------------------
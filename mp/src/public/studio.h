@@ -857,6 +857,7 @@ struct mstudioanimdesc_t
 	int					animindex;	 // non-zero when anim data isn't in sections
 	mstudioanim_t* pAnimBlock( int block, int index ) const; // returns pointer to a specific anim block (local or external)
 	mstudioanim_t* pAnim( int* piFrame, float& flStall ) const; // returns pointer to data and new frame index
+	mstudioanim_t* pAnim( int* piFrame, float& flStall, int& iSection ) const; // also returns the section the data was fetched for
 	mstudioanim_t* pAnim( int* piFrame ) const; // returns pointer to data and new frame index
 
 	int					numikrules;
@@ -3356,6 +3357,35 @@ public:
 		m_ActivityToSequence.Reinitialize( this );
 	}
 
+	// Case-insensitive lookups by name, through hash tables built the first time
+	// each one is used. They cover every sequence and attachment of a virtual
+	// model, includes and all. When names repeat the lowest index wins, same as
+	// a linear search. Each returns -1 if nothing matches.
+	int FindSequence( const char* pszLabel );
+	int FindSequenceForActivityName( const char* pszActivityName );
+	int FindAttachment( const char* pszName );
+
+private:
+	enum NameIndexType_t
+	{
+		NAMEINDEX_SEQUENCE = 0,
+		NAMEINDEX_ACTIVITY,
+		NAMEINDEX_ATTACHMENT,
+
+		NAMEINDEX_COUNT
+	};
+
+	class CNameIndex;
+
+	const char* NameForIndex( int nType, int i );
+	int NumNamesForType( int nType );
+	CNameIndex* BuildNameIndex( int nType );
+	int FindByName( int nType, const char* pszName );
+	void ResetNameIndices();
+
+	// Published with a compare-exchange so lookups never lock
+	CNameIndex* volatile m_pNameIndex[NAMEINDEX_COUNT];
+
 #ifdef STUDIO_ENABLE_PERF_COUNTERS
 public:
 	inline void			ClearPerfCounters( void )
@@ -17,6 +17,18 @@ void CRC32_ProcessBuffer( CRC32_t* pulCRC, const void* p, int len );
 void CRC32_Final( CRC32_t* pulCRC );
 CRC32_t	CRC32_GetTableEntry( unsigned int slot );
 
+// Finalized CRC of A followed by B, from crc1 = CRC(A), crc2 = CRC(B) and the length of B
+CRC32_t CRC32_Combine( CRC32_t crc1, CRC32_t crc2, int len2 );
+
+// Same result as CRC32_ProcessBuffer. Buffers of a few MB or more are split
+// across up to nThreads threads (0 = one per logical processor).
+void CRC32_ProcessBufferParallel( CRC32_t* pulCRC, const void* p, int len, int nThreads = 0 );
+
+// Large buffers use PCLMULQDQ folding when the CPU has it. Turning it off is
+// only useful for comparing against the table path.
+bool CRC32_HasHardwareAccel();
+bool CRC32_EnableHardwareAccel( bool bEnable );
+
 inline CRC32_t CRC32_ProcessSingleBuffer( const void* p, int len )
 {
 	CRC32_t crc;
@@ -0,0 +1,130 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Defines a hashed symbol table with 32-bit ids and lock-free lookups
+//
+// $Header: $
+// $NoKeywords: $
+//===========================================================================//
+
+#ifndef UTLHASHSYMBOL_H
+#define UTLHASHSYMBOL_H
+
+#ifdef _WIN32
+	#pragma once
+#endif
+
+#include "tier0/threadtools.h"
+#include "tier1/utlvector.h"
+
+
+//-----------------------------------------------------------------------------
+// Symbol ids handed out by CUtlHashSymbolTable
+//-----------------------------------------------------------------------------
+typedef uint32 UtlHashSymId_t;
+
+#define UTL_INVAL_HASHSYMBOL  ((UtlHashSymId_t)~0)
+
+
+//-----------------------------------------------------------------------------
+// CUtlHashSymbolTable:
+// description:
+//    Maps strings to symbols and back like CUtlSymbolTable, with these
+//    differences:
+//
+//    - Strings are found through an open-addressed hash table keyed on the
+//      string's hash (computed once, stored alongside the string) rather than
+//      an rbtree of strcmps.
+//    - Ids are 32 bits, so there is no 64k string limit.
+//    - Find() and String() never lock and are safe to call while another
+//      thread is adding strings. AddString() only locks when the string is new.
+//
+//    Strings live in append-only pools and never move, so the pointer returned
+//    by String() stays valid until RemoveAll(). RemoveAll() and the destructor
+//    must not run concurrently with any other call.
+//-----------------------------------------------------------------------------
+class CUtlHashSymbolTable
+{
+public:
+	// constructor, destructor
+	CUtlHashSymbolTable( int initSize = 32, bool caseInsensitive = false );
+	~CUtlHashSymbolTable();
+
+	// Finds and/or creates a symbol based on the string
+	UtlHashSymId_t AddString( const char* pString );
+	UtlHashSymId_t AddString( const char* pString, uint32 nHash );
+
+	// Finds the symbol for pString, or UTL_INVAL_HASHSYMBOL
+	UtlHashSymId_t Find( const char* pString ) const;
+	UtlHashSymId_t Find( const char* pString, uint32 nHash ) const;
+
+	// Look up the string associated with a particular symbol; "" if invalid
+	const char* String( UtlHashSymId_t id ) const;
+
+	// The hash this table uses for pString, for callers that want to cache it
+	uint32 ComputeHash( const char* pString ) const;
+
+	// Remove all symbols in the table.
+	void RemoveAll();
+
+	int GetNumStrings( void ) const
+	{
+		return m_nNumStrings;
+	}
+
+	// Bytes allocated for strings, ids and the hash table
+	size_t GetMemoryUsage() const;
+
+private:
+	enum
+	{
+		// The id -> string segments double in size, so a fixed directory
+		// covers every 32-bit id without ever moving a segment.
+		FIRST_SEGMENT_BITS = 8,
+		MAX_SEGMENTS = 32 - FIRST_SEGMENT_BITS + 1,
+
+		STRING_POOL_SIZE = 8192,
+	};
+
+	// Stored in the string pools: the hash, then the string
+	struct Entry_t
+	{
+		uint32	m_nHash;
+		char	m_String[1];
+	};
+
+	struct Slot_t
+	{
+		volatile uint32			m_nHash;	// 0 = empty
+		volatile UtlHashSymId_t	m_nId;
+	};
+
+	struct HashTable_t
+	{
+		uint32			m_nMask;
+		HashTable_t*	m_pRetired;		// smaller table this replaced; readers may still be probing it
+		Slot_t			m_Slots[1];
+	};
+
+	static inline void SegmentForId( UtlHashSymId_t id, int& nSegment, uint32& nOffset );
+	static HashTable_t* AllocHashTable( uint32 nSize );
+	static void InsertIntoHashTable( HashTable_t* pTable, uint32 nHash, UtlHashSymId_t id );
+
+	const Entry_t* EntryForId( UtlHashSymId_t id ) const;
+	Entry_t* AllocEntry( int nLen );
+	void GrowHashTable();
+	bool StringsMatch( const char* pA, const char* pB ) const;
+
+	HashTable_t* volatile	m_pHashTable;
+	const Entry_t** volatile m_pSegments[ MAX_SEGMENTS ];
+	volatile int			m_nNumStrings;
+	int						m_nInitSize;
+	bool					m_bInsensitive;
+
+	// Insert-side state, only touched with m_InsertMutex held
+	CThreadFastMutex		m_InsertMutex;
+	CUtlVector< char* >		m_StringPools;
+	int						m_nPoolSpaceLeft;
+	size_t					m_nMemoryUsed;
+};
+
+#endif // UTLHASHSYMBOL_H
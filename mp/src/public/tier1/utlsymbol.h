@@ -19,6 +19,7 @@
 #include "tier1/utlbuffer.h"
 #include "tier1/utllinkedlist.h"
 #include "tier1/stringpool.h"
+#include "tier1/utlhashsymbol.h"
 
 
 //-----------------------------------------------------------------------------
@@ -83,10 +84,11 @@ protected:
 	static void Initialize();
 
 	// returns the current symbol table
-	static CUtlSymbolTableMT* CurrTable();
+	static CUtlHashSymbolTable* CurrTable();
 
-	// The standard global symbol table
-	static CUtlSymbolTableMT* s_pSymbolTable;
+	// The standard global symbol table. Lookups don't lock, which matters
+	// since every CUtlSymbol( const char * ) and String() goes through it.
+	static CUtlHashSymbolTable* s_pSymbolTable;
 
 	static bool s_bAllowStaticSymbolTable;
 
@@ -923,6 +923,12 @@ private:
 	// data
 	VPANEL			_vpanel;	// handle to a vgui panel
 	char*			_panelName;		// string name of the panel - only unique within the current context
+
+	// name -> child lookup for FindChildByName(), only built for panels with lots of children
+	struct ChildNameIndex_t;
+	ChildNameIndex_t*	m_pChildNameIndex;
+	Panel*			FindChildByNameIndexed( const char* childName );
+	void			InvalidateChildNameIndex();
 	IBorder*			_border;
 
 	CUtlFlags< unsigned short > _flags;	// see PanelFlags_t
@@ -22,6 +22,7 @@
 #include "checksum_crc.h"
 #include "byteswap.h"
 #include "utlstring.h"
+#include "tier0/threadtools.h"
 
 #include "tier1/lzmaDecoder.h"
 
@@ -381,6 +382,10 @@ public:
 	void			SetBigEndian( bool bigEndian );
 	void			ActivateByteSwapping( bool bActivate );
 
+	void			SetCompressionThreads( int nThreads );
+	void			SetReuseUnchangedEntries( bool bReuse );
+	void			GetBuildStats( ZipBuildStats_t& stats );
+
 private:
 	enum
 	{
@@ -406,6 +411,7 @@ private:
 	void			SaveDirectory( IWriteStream& stream );
 	int				MakeXZipCommentString( char* pComment );
 	void			ParseXZipCommentString( const char* pComment );
+	void			FlushPendingCompression();
 
 	// Internal entry for faster searching, etc.
 	class CZipEntry
@@ -443,11 +449,28 @@ private:
 
 		// The compression used on the data if any
 		IZip::eCompressionType m_eCompressionType;
+
+		// Uncompressed data waiting for FlushPendingCompression(). Until then the
+		// fields above still describe the entry's previous contents, if any.
+		bool			m_bPending;
+		void*			m_pPendingData;
+		int				m_nPendingSize;
+		CRC32_t			m_PendingCRC;
+		IZip::eCompressionType m_ePendingCompressionType;
 	};
 
+	bool			CanReuseEntry( CZipEntry const& entry ) const;
+	void			StoreEntryData( CZipEntry* pEntry, const void* pData, int nLength, int nUncompressedLength, CRC32_t zipCRC, IZip::eCompressionType compressionType );
+
 	// For fast name lookup and sorting
 	CUtlRBTree< CZipEntry, int > m_Files;
 
+	// Deferred compression and incremental updates
+	int					m_nCompressionThreads;
+	bool				m_bReuseUnchangedEntries;
+	int					m_nPendingEntries;
+	ZipBuildStats_t		m_BuildStats;
+
 	// Used to buffer zip data, instead of ram
 	bool				m_bUseDiskCacheForWrites;
 	HANDLE				m_hDiskCacheWriteFile;
@@ -469,6 +492,11 @@ CZipFile::CZipEntry::CZipEntry( void )
 	m_DiskCacheOffset = 0;
 	m_SourceDiskOffset = 0;
 	m_eCompressionType = IZip::eCompressionType_None;
+	m_bPending = false;
+	m_pPendingData = NULL;
+	m_nPendingSize = 0;
+	m_PendingCRC = 0;
+	m_ePendingCompressionType = IZip::eCompressionType_None;
 }
 
 //-----------------------------------------------------------------------------
@@ -496,6 +524,20 @@ CZipFile::CZipEntry::CZipEntry( const CZipFile::CZipEntry& src )
 	m_ZipCRC = src.m_ZipCRC;
 	m_DiskCacheOffset = src.m_DiskCacheOffset;
 	m_SourceDiskOffset = src.m_SourceDiskOffset;
+
+	m_bPending = src.m_bPending;
+	m_nPendingSize = src.m_nPendingSize;
+	m_PendingCRC = src.m_PendingCRC;
+	m_ePendingCompressionType = src.m_ePendingCompressionType;
+	if( src.m_nPendingSize > 0 && src.m_pPendingData )
+	{
+		m_pPendingData = malloc( src.m_nPendingSize );
+		memcpy( m_pPendingData, src.m_pPendingData, src.m_nPendingSize );
+	}
+	else
+	{
+		m_pPendingData = NULL;
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -507,6 +549,11 @@ CZipFile::CZipEntry::~CZipEntry( void )
 	{
 		free( m_pData );
 	}
+
+	if( m_pPendingData )
+	{
+		free( m_pPendingData );
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -523,6 +570,11 @@ CZipFile::CZipFile( const char* pDiskCacheWritePath, bool bSortByName )
 	m_DiskCacheWritePath = pDiskCacheWritePath;
 	m_hDiskCacheWriteFile = INVALID_HANDLE_VALUE;
 
+	m_nCompressionThreads = 1;
+	m_bReuseUnchangedEntries = false;
+	m_nPendingEntries = 0;
+	memset( &m_BuildStats, 0, sizeof( m_BuildStats ) );
+
 	if( bSortByName )
 	{
 		m_Files.SetLessFunc( CZipEntry::ZipFileLessFunc_CaselessSort );
@@ -548,6 +600,8 @@ CZipFile::~CZipFile( void )
 void CZipFile::Reset( void )
 {
 	m_Files.RemoveAll();
+	m_nPendingEntries = 0;
+	memset( &m_BuildStats, 0, sizeof( m_BuildStats ) );
 
 	if( m_hDiskCacheWriteFile != INVALID_HANDLE_VALUE )
 	{
@@ -619,6 +673,25 @@ void CZipFile::ActivateByteSwapping( bool bActivate )
 	m_Swap.ActivateByteSwapping( bActivate );
 }
 
+void CZipFile::SetCompressionThreads( int nThreads )
+{
+	m_nCompressionThreads = Max( nThreads, 1 );
+	if( m_nCompressionThreads == 1 )
+	{
+		FlushPendingCompression();
+	}
+}
+
+void CZipFile::SetReuseUnchangedEntries( bool bReuse )
+{
+	m_bReuseUnchangedEntries = bReuse;
+}
+
+void CZipFile::GetBuildStats( ZipBuildStats_t& stats )
+{
+	stats = m_BuildStats;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Load pak file from raw buffer
 // Input  : *buffer -
@@ -999,50 +1072,25 @@ static void CopyTextData( char* pDst, const char* pSrc, int dstSize, int srcSize
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: Adds a new lump, or overwrites existing one
-// Input  : *relativename -
-//			*data -
-//			length -
+// Compresses an entry's data into the form stored in the zip. Returns a buffer
+// to free(), or NULL if compression failed.
 //-----------------------------------------------------------------------------
-void CZipFile::AddBufferToZip( const char* relativename, void* data, int length, bool bTextMode, IZip::eCompressionType compressionType )
+static void* CompressZipData( const void* pData, int nLength, IZip::eCompressionType compressionType, int& nCompressedLength )
 {
-	// Lower case only
-	char name[512];
-	Q_strcpy( name, relativename );
-	Q_strlower( name );
-
-	int outLength = length;
-	int uncompressedLength = length;
-	void* outData = data;
-	CUtlBuffer textTransform;
-	CUtlBuffer compressionTransform;
-
-	if( bTextMode )
-	{
-		int textLen = GetLengthOfBinStringAsText( ( const char* )outData, outLength );
-		textTransform.EnsureCapacity( textLen );
-		CopyTextData( ( char* )textTransform.Base(), ( char* )outData, textLen, outLength );
-
-		outData = ( void* )textTransform.Base();
-		outLength = textLen;
-		uncompressedLength = textLen;
-	}
-
-	// uncompressed data final at this point (CRC is before compression)
-	CRC32_t zipCRC;
-	CRC32_Init( &zipCRC );
-	CRC32_ProcessBuffer( &zipCRC, outData, outLength );
-	CRC32_Final( &zipCRC );
+	nCompressedLength = 0;
 
 #ifdef ZIP_SUPPORT_LZMA_ENCODE
 	if( compressionType == IZip::eCompressionType_LZMA )
 	{
 		unsigned int compressedSize = 0;
-		unsigned char* pCompressedOutput = LZMA_Compress( ( unsigned char* )outData, outLength, &compressedSize );
+		unsigned char* pCompressedOutput = LZMA_Compress( ( unsigned char* )pData, nLength, &compressedSize );
 		if( !pCompressedOutput || compressedSize < sizeof( lzma_header_t ) )
 		{
-			Warning( "ZipFile: LZMA compression failed\n" );
-			return;
+			if( pCompressedOutput )
+			{
+				free( pCompressedOutput );
+			}
+			return NULL;
 		}
 
 		// Fixup LZMA header for ZIP payload usage
@@ -1054,6 +1102,7 @@ void CZipFile::AddBufferToZip( const char* relativename, void* data, int length,
 		//  LZMA Properties Data variable, defined by "LZMA Properties Size"
 		unsigned int nZIPHeader = 2 + 2 + sizeof( lzma_header_t().properties );
 		unsigned int finalCompressedSize = compressedSize - sizeof( lzma_header_t ) + nZIPHeader;
+		CUtlBuffer compressionTransform;
 		compressionTransform.EnsureCapacity( finalCompressedSize );
 
 		// LZMA version
@@ -1071,74 +1120,365 @@ void CZipFile::AddBufferToZip( const char* relativename, void* data, int length,
 		free( pCompressedOutput );
 		pCompressedOutput = NULL;
 
-		outData = ( void* )compressionTransform.Base();
-		outLength = finalCompressedSize;
-		// (Not updating uncompressedLength)
+		void* pOut = malloc( finalCompressedSize );
+		memcpy( pOut, compressionTransform.Base(), finalCompressedSize );
+		nCompressedLength = finalCompressedSize;
+		return pOut;
+	}
+#endif
+
+	return NULL;
+}
+
+static bool IsSupportedZipCompression( IZip::eCompressionType compressionType )
+{
+#ifdef ZIP_SUPPORT_LZMA_ENCODE
+	if( compressionType == IZip::eCompressionType_LZMA )
+	{
+		return true;
 	}
-	else
 #endif
-		/* else from ifdef */ if( compressionType != IZip::eCompressionType_None )
+	return compressionType == IZip::eCompressionType_None;
+}
+
+//-----------------------------------------------------------------------------
+// Whether an entry has stored data that can be kept when it's added again
+// with the same contents
+//-----------------------------------------------------------------------------
+bool CZipFile::CanReuseEntry( CZipEntry const& entry ) const
+{
+	// Stored entries would only save a memcpy
+	if( !m_bReuseUnchangedEntries || entry.m_nCompressedSize <= 0 || entry.m_eCompressionType == IZip::eCompressionType_None )
+	{
+		return false;
+	}
+
+	return entry.m_pData != NULL || m_hDiskCacheWriteFile != INVALID_HANDLE_VALUE;
+}
+
+//-----------------------------------------------------------------------------
+// Replaces an entry's stored data
+//-----------------------------------------------------------------------------
+void CZipFile::StoreEntryData( CZipEntry* pEntry, const void* pData, int nLength, int nUncompressedLength, CRC32_t zipCRC, IZip::eCompressionType compressionType )
+{
+	if( pEntry->m_pData )
+	{
+		free( pEntry->m_pData );
+		pEntry->m_pData = NULL;
+	}
+
+	pEntry->m_eCompressionType = compressionType;
+	pEntry->m_nCompressedSize = nLength;
+	pEntry->m_nUncompressedSize = nUncompressedLength;
+	pEntry->m_ZipCRC = zipCRC;
+
+	if( nLength > 0 )
+	{
+		pEntry->m_pData = malloc( nLength );
+		memcpy( pEntry->m_pData, pData, nLength );
+
+		if( m_hDiskCacheWriteFile != INVALID_HANDLE_VALUE )
 		{
-			Error( "Calling AddBufferToZip with unknown compression type\n" );
-			return;
+			pEntry->m_DiskCacheOffset = CWin32File::FileTell( m_hDiskCacheWriteFile );
+			CWin32File::FileWrite( m_hDiskCacheWriteFile, pEntry->m_pData, pEntry->m_nCompressedSize );
+			free( pEntry->m_pData );
+			pEntry->m_pData = NULL;
 		}
+	}
+
+	m_BuildStats.m_nBytesOut += nLength;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Adds a new lump, or overwrites existing one
+// Input  : *relativename -
+//			*data -
+//			length -
+//-----------------------------------------------------------------------------
+void CZipFile::AddBufferToZip( const char* relativename, void* data, int length, bool bTextMode, IZip::eCompressionType compressionType )
+{
+	// Lower case only
+	char name[512];
+	Q_strcpy( name, relativename );
+	Q_strlower( name );
+
+	int outLength = length;
+	int uncompressedLength = length;
+	void* outData = data;
+	CUtlBuffer textTransform;
+
+	if( bTextMode )
+	{
+		int textLen = GetLengthOfBinStringAsText( ( const char* )outData, outLength );
+		textTransform.EnsureCapacity( textLen );
+		CopyTextData( ( char* )textTransform.Base(), ( char* )outData, textLen, outLength );
+
+		outData = ( void* )textTransform.Base();
+		outLength = textLen;
+		uncompressedLength = textLen;
+	}
+
+	if( !IsSupportedZipCompression( compressionType ) )
+	{
+		Error( "Calling AddBufferToZip with unknown compression type\n" );
+		return;
+	}
+
+	m_BuildStats.m_nEntriesAdded++;
+	m_BuildStats.m_nBytesIn += outLength;
 
 	// See if entry is in list already
 	CZipEntry e;
 	e.m_Name = name;
 	int index = m_Files.Find( e );
 
-	// If already existing, throw away old data and update data and length
+	double flStartTime = Plat_FloatTime();
+
+	// uncompressed data final at this point (CRC is before compression)
+	CRC32_t zipCRC;
+	CRC32_Init( &zipCRC );
+	CRC32_ProcessBuffer( &zipCRC, outData, outLength );
+	CRC32_Final( &zipCRC );
+
 	if( index != m_Files.InvalidIndex() )
 	{
 		CZipEntry* update = &m_Files[ index ];
-		if( update->m_pData )
+
+		// This add replaces anything still waiting to be compressed
+		if( update->m_bPending )
 		{
-			free( update->m_pData );
+			if( update->m_pPendingData )
+			{
+				free( update->m_pPendingData );
+				update->m_pPendingData = NULL;
+			}
+			update->m_bPending = false;
+			m_nPendingEntries--;
 		}
 
-		update->m_eCompressionType = compressionType;
-		update->m_pData = malloc( outLength );
-		memcpy( update->m_pData, outData, outLength );
-		update->m_nCompressedSize = outLength;
-		update->m_nUncompressedSize = uncompressedLength;
-		update->m_ZipCRC = zipCRC;
-
-		if( m_hDiskCacheWriteFile != INVALID_HANDLE_VALUE )
+		if( CanReuseEntry( *update ) && update->m_ZipCRC == zipCRC &&
+				update->m_nUncompressedSize == uncompressedLength && update->m_eCompressionType == compressionType )
 		{
-			update->m_DiskCacheOffset = CWin32File::FileTell( m_hDiskCacheWriteFile );
-			CWin32File::FileWrite( m_hDiskCacheWriteFile, update->m_pData, update->m_nCompressedSize );
-			free( update->m_pData );
-			update->m_pData = NULL;
+			m_BuildStats.m_nEntriesReused++;
+			m_BuildStats.m_nBytesOut += update->m_nCompressedSize;
+			m_BuildStats.m_flCompressSeconds += Plat_FloatTime() - flStartTime;
+			return;
 		}
 	}
-	else
+
+	if( m_nCompressionThreads > 1 && compressionType != IZip::eCompressionType_None )
 	{
-		// Create a new entry
-		e.m_nCompressedSize = outLength;
-		e.m_nUncompressedSize = uncompressedLength;
-		e.m_eCompressionType = compressionType;
-		e.m_ZipCRC = zipCRC;
+		// Hold on to the data, FlushPendingCompression() does the rest
+		if( index == m_Files.InvalidIndex() )
+		{
+			index = m_Files.Insert( e );
+		}
+
+		CZipEntry* pending = &m_Files[ index ];
+		pending->m_bPending = true;
+		pending->m_nPendingSize = outLength;
+		pending->m_PendingCRC = zipCRC;
+		pending->m_ePendingCompressionType = compressionType;
+		pending->m_pPendingData = NULL;
 		if( outLength > 0 )
 		{
-			e.m_pData = malloc( outLength );
-			memcpy( e.m_pData, outData, outLength );
+			pending->m_pPendingData = malloc( outLength );
+			memcpy( pending->m_pPendingData, outData, outLength );
+		}
+		m_nPendingEntries++;
+		m_BuildStats.m_flCompressSeconds += Plat_FloatTime() - flStartTime;
+		return;
+	}
 
-			if( m_hDiskCacheWriteFile != INVALID_HANDLE_VALUE )
+	void* pCompressedData = NULL;
+	if( compressionType != IZip::eCompressionType_None )
+	{
+		pCompressedData = CompressZipData( outData, outLength, compressionType, outLength );
+		if( !pCompressedData )
+		{
+			Warning( "ZipFile: LZMA compression failed\n" );
+			return;
+		}
+
+		outData = pCompressedData;
+		m_BuildStats.m_nEntriesCompressed++;
+		// (Not updating uncompressedLength)
+	}
+
+	m_BuildStats.m_flCompressSeconds += Plat_FloatTime() - flStartTime;
+
+	// Create a new entry if it isn't in the list, otherwise throw away old data and update data and length
+	if( index == m_Files.InvalidIndex() )
+	{
+		index = m_Files.Insert( e );
+	}
+	StoreEntryData( &m_Files[ index ], outData, outLength, uncompressedLength, zipCRC, compressionType );
+
+	if( pCompressedData )
+	{
+		free( pCompressedData );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Deferred compression. Each job covers one pending entry; the workers only
+// read the job's inputs and write its outputs, the tree is updated afterwards
+// on the calling thread.
+//-----------------------------------------------------------------------------
+struct ZipCompressJob_t
+{
+	int						m_nEntry;
+	const void*				m_pData;
+	int						m_nSize;
+	CRC32_t					m_CRC;
+	IZip::eCompressionType	m_eCompressionType;
+
+	// Results
+	bool					m_bFailed;
+	void*					m_pCompressedData;
+	int						m_nCompressedSize;
+};
+
+struct ZipCompressWork_t
+{
+	ZipCompressJob_t*		m_pJobs;
+	int						m_nJobs;
+	long volatile			m_nNextJob;
+};
+
+static void RunZipCompressJob( ZipCompressJob_t* pJob )
+{
+	pJob->m_pCompressedData = CompressZipData( pJob->m_pData, pJob->m_nSize, pJob->m_eCompressionType, pJob->m_nCompressedSize );
+	pJob->m_bFailed = ( pJob->m_pCompressedData == NULL );
+}
+
+static unsigned ZipCompressThread( void* pParam )
+{
+	ZipCompressWork_t* pWork = ( ZipCompressWork_t* )pParam;
+	for( ;; )
+	{
+		int nJob = ThreadInterlockedIncrement( &pWork->m_nNextJob ) - 1;
+		if( nJob >= pWork->m_nJobs )
+		{
+			break;
+		}
+
+		RunZipCompressJob( &pWork->m_pJobs[ nJob ] );
+	}
+	return 0;
+}
+
+static int __cdecl CompressJobsLargestFirst( const ZipCompressJob_t* pA, const ZipCompressJob_t* pB )
+{
+	// Start the big ones first so one doesn't finish alone at the end
+	if( pA->m_nSize != pB->m_nSize )
+	{
+		return pA->m_nSize > pB->m_nSize ? -1 : 1;
+	}
+	return pA->m_nEntry - pB->m_nEntry;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Compresses every entry added since the last flush, on up to
+//			m_nCompressionThreads threads. Entries end up exactly as if they had
+//			been added with a single thread.
+//-----------------------------------------------------------------------------
+void CZipFile::FlushPendingCompression()
+{
+	if( !m_nPendingEntries )
+	{
+		return;
+	}
+
+	double flStartTime = Plat_FloatTime();
+
+	CUtlVector< ZipCompressJob_t > jobs;
+	jobs.EnsureCapacity( m_nPendingEntries );
+	for( int i = m_Files.FirstInorder(); i != m_Files.InvalidIndex(); i = m_Files.NextInorder( i ) )
+	{
+		CZipEntry* e = &m_Files[ i ];
+		if( !e->m_bPending )
+		{
+			continue;
+		}
+
+		ZipCompressJob_t& job = jobs[ jobs.AddToTail() ];
+		memset( &job, 0, sizeof( job ) );
+		job.m_nEntry = i;
+		job.m_pData = e->m_pPendingData;
+		job.m_nSize = e->m_nPendingSize;
+		job.m_CRC = e->m_PendingCRC;
+		job.m_eCompressionType = e->m_ePendingCompressionType;
+	}
+	jobs.Sort( CompressJobsLargestFirst );
+
+	ZipCompressWork_t work;
+	work.m_pJobs = jobs.Base();
+	work.m_nJobs = jobs.Count();
+	work.m_nNextJob = 0;
+
+	// This thread works through the jobs too
+	int nThreads = Min( m_nCompressionThreads, jobs.Count() );
+	CUtlVector< ThreadHandle_t > threads;
+	for( int i = 1; i < nThreads; i++ )
+	{
+		ThreadHandle_t hThread = CreateSimpleThread( ZipCompressThread, &work );
+		if( hThread )
+		{
+			threads.AddToTail( hThread );
+		}
+	}
+
+	ZipCompressThread( &work );
+
+	for( int i = 0; i < threads.Count(); i++ )
+	{
+		ThreadJoin( threads[ i ] );
+		ReleaseThreadHandle( threads[ i ] );
+	}
+
+	CUtlVector< int > failedEntries;
+	for( int i = 0; i < jobs.Count(); i++ )
+	{
+		ZipCompressJob_t& job = jobs[ i ];
+		CZipEntry* e = &m_Files[ job.m_nEntry ];
+
+		if( job.m_bFailed )
+		{
+			// Same as failing inline: whatever was there before stays
+			Warning( "ZipFile: LZMA compression failed\n" );
+			if( e->m_nCompressedSize <= 0 )
 			{
-				e.m_DiskCacheOffset = CWin32File::FileTell( m_hDiskCacheWriteFile );
-				CWin32File::FileWrite( m_hDiskCacheWriteFile, e.m_pData, e.m_nCompressedSize );
-				free( e.m_pData );
-				e.m_pData = NULL;
+				failedEntries.AddToTail( job.m_nEntry );
 			}
 		}
 		else
 		{
-			e.m_pData = NULL;
+			StoreEntryData( e, job.m_pCompressedData, job.m_nCompressedSize, job.m_nSize, job.m_CRC, job.m_eCompressionType );
+			m_BuildStats.m_nEntriesCompressed++;
 		}
 
-		m_Files.Insert( e );
+		if( job.m_pCompressedData )
+		{
+			free( job.m_pCompressedData );
+		}
+
+		if( e->m_pPendingData )
+		{
+			free( e->m_pPendingData );
+			e->m_pPendingData = NULL;
+		}
+		e->m_bPending = false;
+		e->m_nPendingSize = 0;
+	}
+
+	for( int i = 0; i < failedEntries.Count(); i++ )
+	{
+		m_Files.RemoveAt( failedEntries[ i ] );
 	}
+
+	m_nPendingEntries = 0;
+	m_BuildStats.m_flCompressSeconds += Plat_FloatTime() - flStartTime;
 }
 
 
@@ -1172,6 +1512,22 @@ bool CZipFile::ReadFileFromZip( HANDLE hZipFile, const char* pRelativeName, bool
 
 	CZipEntry* pEntry = &m_Files[nIndex];
 
+	if( pEntry->m_bPending )
+	{
+		// Still uncompressed
+		if( bTextMode )
+		{
+			buf.SetBufferType( true, false );
+			ReadTextData( ( const char* )pEntry->m_pPendingData, pEntry->m_nPendingSize, buf );
+		}
+		else
+		{
+			buf.SetBufferType( false, false );
+			buf.Put( pEntry->m_pPendingData, pEntry->m_nPendingSize );
+		}
+		return true;
+	}
+
 	void* pData = pEntry->m_pData;
 	CUtlBuffer readBuffer;
 	if( !pData && hZipFile )
@@ -1291,6 +1647,11 @@ void CZipFile::RemoveFileFromZip( const char* relativename )
 
 	if( index != m_Files.InvalidIndex() )
 	{
+		if( m_Files[index].m_bPending )
+		{
+			m_nPendingEntries--;
+		}
+
 		CZipEntry update = m_Files[index];
 		m_Files.Remove( update );
 	}
@@ -1363,6 +1724,9 @@ void CZipFile::ParseXZipCommentString( const char* pCommentString )
 //-----------------------------------------------------------------------------
 unsigned int CZipFile::CalculateSize( void )
 {
+	// Need the compressed sizes
+	FlushPendingCompression();
+
 	unsigned int size = 0;
 	unsigned int dirHeaders = 0;
 	for( int i = m_Files.FirstInorder(); i != m_Files.InvalidIndex(); i = m_Files.NextInorder( i ) )
@@ -1440,7 +1804,7 @@ int CZipFile::GetNextFilename( int id, char* pBuffer, int bufferSize, int& fileS
 	CZipEntry* e = &m_Files[id];
 
 	Q_strncpy( pBuffer, e->m_Name.String(), bufferSize );
-	fileSize = e->m_nUncompressedSize;
+	fileSize = e->m_bPending ? e->m_nPendingSize : e->m_nUncompressedSize;
 
 	return id;
 }
@@ -1474,6 +1838,8 @@ void CZipFile::SaveToBuffer( CUtlBuffer& buf )
 //-----------------------------------------------------------------------------
 void CZipFile::SaveDirectory( IWriteStream& stream )
 {
+	FlushPendingCompression();
+
 	void* pPaddingBuffer = NULL;
 	if( m_AlignmentSize )
 	{
@@ -1724,6 +2090,10 @@ public:
 
 	virtual unsigned int	GetAlignment() OVERRIDE;
 
+	virtual void			SetCompressionThreads( int nThreads ) OVERRIDE;
+	virtual void			SetReuseUnchangedEntries( bool bReuse ) OVERRIDE;
+	virtual void			GetBuildStats( ZipBuildStats_t& stats ) OVERRIDE;
+
 private:
 	CZipFile				m_ZipFile;
 };
@@ -1852,3 +2222,18 @@ unsigned int CZip::GetAlignment()
 	return m_ZipFile.GetAlignment();
 }
 
+void CZip::SetCompressionThreads( int nThreads )
+{
+	m_ZipFile.SetCompressionThreads( nThreads );
+}
+
+void CZip::SetReuseUnchangedEntries( bool bReuse )
+{
+	m_ZipFile.SetReuseUnchangedEntries( bReuse );
+}
+
+void CZip::GetBuildStats( ZipBuildStats_t& stats )
+{
+	m_ZipFile.GetBuildStats( stats );
+}
+
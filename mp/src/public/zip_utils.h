@@ -15,6 +15,19 @@
 class CUtlBuffer;
 #include "tier0/dbg.h"
 
+//-----------------------------------------------------------------------------
+// What the adds since the last Reset() cost, see IZip::GetBuildStats()
+//-----------------------------------------------------------------------------
+struct ZipBuildStats_t
+{
+	int		m_nEntriesAdded;
+	int		m_nEntriesReused;		// same contents as the entry they replaced, its stored data was kept
+	int		m_nEntriesCompressed;	// went through the compressor
+	int64	m_nBytesIn;				// uncompressed bytes added
+	int64	m_nBytesOut;			// bytes stored for them
+	float	m_flCompressSeconds;	// wall time spent hashing and compressing
+};
+
 abstract_class IZip
 {
 public:
@@ -79,6 +92,18 @@ public:
 	virtual void			SetBigEndian( bool bigEndian ) = 0;
 	virtual void			ActivateByteSwapping( bool bActivate ) = 0;
 
+	// With more than one thread, added entries that use compression are kept uncompressed and
+	// compressed in parallel when the zip is next saved or sized. Stored entries are always added
+	// inline. The output is the same either way. Default 1 (inline).
+	virtual void			SetCompressionThreads( int nThreads ) = 0;
+
+	// Adding a compressed entry that already exists with the same CRC, size and compression type
+	// keeps its stored data instead of compressing it again. For updating a previously saved zip.
+	virtual void			SetReuseUnchangedEntries( bool bReuse ) = 0;
+
+	// Counts and timings for the adds since the last Reset()
+	virtual void			GetBuildStats( ZipBuildStats_t& stats ) = 0;
+
 	// Create/Release additional instances
 	// Disk Caching is necessary for large zips
 	static IZip * CreateZip( const char* pDiskCacheWritePath = NULL, bool bSortByName = false );
@@ -19,7 +19,7 @@ using namespace ResponseRules;
 //-----------------------------------------------------------------------------
 // Case-insensitive criteria symbol table
 //-----------------------------------------------------------------------------
-CUtlSymbolTable CriteriaSet::sm_CriteriaSymbols( 1024, 1024, true );
+CUtlHashSymbolTable CriteriaSet::sm_CriteriaSymbols( 1024, true );
 
 //-----------------------------------------------------------------------------
 // Purpose:
@@ -131,7 +131,9 @@ CriteriaSet::~CriteriaSet()
 //-----------------------------------------------------------------------------
 CriteriaSet::CritSymbol_t CriteriaSet::ComputeCriteriaSymbol( const char* criteria )
 {
-	return sm_CriteriaSymbols.AddString( criteria );
+	UtlHashSymId_t id = sm_CriteriaSymbols.AddString( criteria );
+	Assert( id == UTL_INVAL_HASHSYMBOL || id < UTL_INVAL_SYMBOL );
+	return ( id < UTL_INVAL_SYMBOL ) ? CritSymbol_t( ( UtlSymId_t )id ) : CritSymbol_t();
 }
 
 
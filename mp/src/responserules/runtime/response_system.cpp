@@ -12,6 +12,7 @@
 #include "convar.h"
 #include "fmtstr.h"
 #include "generichash.h"
+#include "bitvec.h"
 #include "tier1/mapbase_con_groups.h"
 #ifdef MAPBASE
 	#include "tier1/mapbase_matchers_base.h"
@@ -25,6 +26,8 @@
 using namespace ResponseRules;
 static void CC_RR_Debug_ResponseConcept_Exclude( const CCommand& args );
 static ConCommand rr_debug_responseconcept_exclude( "rr_debugresponseconcept_exclude", CC_RR_Debug_ResponseConcept_Exclude, "Set a list of concepts to exclude from rr_debugresponseconcept. Separate multiple concepts with spaces. Call with no arguments to see current list. Call 'rr_debug_responseconcept_exclude !' to reset." );
+static void CC_RR_Bench_Record( const CCommand& args );
+static ConCommand rr_bench_record( "rr_bench_record", CC_RR_Bench_Record, "Record the next N response queries for rr_bench to replay. 'rr_bench_record 0' discards the recorded queries." );
 
 namespace ResponseRules
 {
@@ -92,6 +95,7 @@ ConVar rr_debugresponses( "rr_debugresponses", "0", FCVAR_NONE, "Show verbose ma
 ConVar rr_debugrule( "rr_debugrule", "", FCVAR_NONE, "If set to the name of the rule, that rule's score will be shown whenever a concept is passed into the response rules system." );
 ConVar rr_dumpresponses( "rr_dumpresponses", "0", FCVAR_NONE, "Dump all response_rules.txt and rules (requires restart)" );
 ConVar rr_debugresponseconcept( "rr_debugresponseconcept", "", FCVAR_NONE, "If set, rr_debugresponses will print only responses testing for the specified concept" );
+ConVar rr_ruleindex( "rr_ruleindex", "1", FCVAR_NONE, "Use the compiled rule index to skip rules which can't match before scoring them." );
 #define RR_DEBUGRESPONSES_SPECIALCASE 4
 
 #ifdef MAPBASE
@@ -184,6 +188,8 @@ static soundlevel_t TextToSoundLevel( const char* key )
 }
 
 CResponseSystem::ExcludeList_t CResponseSystem::m_DebugExcludeList( 4, 0 );
+CUtlVector< CriteriaSet* > CResponseSystem::m_BenchQueries;
+int CResponseSystem::m_nBenchQueriesToRecord = 0;
 
 //-----------------------------------------------------------------------------
 // Purpose:
@@ -193,11 +199,13 @@ CResponseSystem::CResponseSystem() :
 	m_FileDispatch( 0, 0, DefLessFunc( unsigned int ) ),
 	m_RuleDispatch( 0, 0, DefLessFunc( unsigned int ) ),
 	m_ResponseDispatch( 0, 0, DefLessFunc( unsigned int ) ),
-	m_ResponseGroupDispatch( 0, 0, DefLessFunc( unsigned int ) )
+	m_ResponseGroupDispatch( 0, 0, DefLessFunc( unsigned int ) ),
+	m_RuleIndexValues( 0, 0, DefLessFunc( uint64 ) )
 {
 	token[0] = 0;
 	m_bUnget = false;
 	m_bCustomManagable = false;
+	m_bRuleIndexDirty = true;
 #ifdef MAPBASE
 	m_bInProspective = false;
 #endif
@@ -267,6 +275,7 @@ void CResponseSystem::Clear()
 	m_RulePartitions.RemoveAll();
 #endif
 	m_Enumerations.RemoveAll();
+	m_bRuleIndexDirty = true;
 }
 
 //-----------------------------------------------------------------------------
@@ -465,6 +474,10 @@ void CResponseSystem::ComputeMatcher( Criteria* c, Matcher& matcher )
 
 	matcher.SetToken( token );
 	matcher.SetRaw( rawtoken );
+	matcher.tokenval = ( float )atof( token );
+#ifdef MAPBASE
+	matcher.tokenbits = atoi( token );
+#endif
 	matcher.valid = true;
 }
 
@@ -487,7 +500,7 @@ bool CResponseSystem::CompareUsingMatcher( const char* setValue, Matcher& m, boo
 	if( m.isbit )
 	{
 		int v1 = v;
-		int v2 = atoi( m.GetToken() );
+		int v2 = m.tokenbits;
 		if( m.notequal )
 		{
 			return ( v1 & v2 ) == 0;
@@ -551,7 +564,7 @@ bool CResponseSystem::CompareUsingMatcher( const char* setValue, Matcher& m, boo
 	{
 		if( m.isnumeric )
 		{
-			if( v == ( float )atof( m.GetToken() ) )
+			if( v == m.tokenval )
 			{
 				return false;
 			}
@@ -578,7 +591,7 @@ bool CResponseSystem::CompareUsingMatcher( const char* setValue, Matcher& m, boo
 			return false;
 		}
 
-		return v == ( float )atof( m.GetToken() );
+		return v == m.tokenval;
 	}
 
 #ifdef MAPBASE
@@ -1319,55 +1332,345 @@ bool CResponseSystem::GetBestResponse( ResponseSearchResult& searchResult, Rule*
 ResponseRulePartition::tIndex CResponseSystem::FindBestMatchingRule( const CriteriaSet& set, bool verbose, float& scoreOfBestMatchingRule )
 {
 	CUtlVector< ResponseRulePartition::tIndex >	bestrules( 16, 4 );
-	float bestscore = 0.001f;
 	scoreOfBestMatchingRule = 0;
 
+	// The index skips rules without scoring them, so don't use it while someone is watching the scoring
+	const char* pszDebugRule = rr_debugrule.GetString();
+	bool bUseIndex = rr_ruleindex.GetBool() && !verbose && !( pszDebugRule && pszDebugRule[0] );
+
+	float bestscore = CollectBestMatchingRules( set, verbose, bUseIndex, bestrules );
+
+	int bestCount = bestrules.Count();
+	if( bestCount <= 0 )
+	{
+		return m_RulePartitions.InvalidIdx();
+	}
+
+	scoreOfBestMatchingRule = bestscore ;
+	if( bestCount == 1 )
+	{
+		return bestrules[ 0 ] ;
+	}
+	else
+	{
+		// Randomly pick one of the tied matching rules
+		int idx = IEngineEmulator::Get()->GetRandomStream()->RandomInt( 0, bestCount - 1 );
+		if( verbose )
+		{
+			CGMsg( 1, CON_GROUP_RESPONSE_SYSTEM, "Found %i matching rules, selecting slot %i\n", bestCount, idx );
+		}
+		return bestrules[ idx ] ;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Scores the rules in the buckets the criteria set can match and
+//			collects every rule tied for the best score, in bucket order.
+// Output : The best score, or 0.001 if nothing matched
+//-----------------------------------------------------------------------------
+float CResponseSystem::CollectBestMatchingRules( const CriteriaSet& set, bool verbose, bool bUseIndex, CUtlVector< ResponseRulePartition::tIndex >& bestrules )
+{
+	float bestscore = 0.001f;
+	bestrules.RemoveAll();
+
+	if( bUseIndex && m_bRuleIndexDirty )
+	{
+		CompileRuleIndex();
+	}
+
 	CUtlVectorFixed< ResponseRulePartition::tRuleDict*, 2 > buckets( 0, 2 );
 	m_RulePartitions.GetDictsForCriteria( &buckets, set );
 	for( int b = 0 ; b < buckets.Count() ; ++b )
 	{
 		ResponseRulePartition::tRuleDict* prules = buckets[b];
 		int c = prules->Count();
-		int i;
-		for( i = 0; i < c; i++ )
+		if( c <= 0 )
+		{
+			continue;
+		}
+
+		// One bit per rule which still needs scoring
+		int nWords = ( c + 31 ) >> 5;
+		CUtlVectorFixedGrowable< uint32, 32 > candidates;
+		candidates.SetCount( nWords );
+
+		int iBucket = m_RulePartitions.BucketFromDict( prules );
+		if( bUseIndex && m_RuleIndexBuckets[ iBucket ].nRules == c )
+		{
+			FilterRulesUsingIndex( set, iBucket, candidates.Base() );
+		}
+		else
+		{
+			V_memset( candidates.Base(), 0xFF, nWords * sizeof( uint32 ) );
+			if( c & 31 )
+			{
+				candidates[ nWords - 1 ] = ( 1u << ( c & 31 ) ) - 1;
+			}
+		}
+
+		for( int w = 0; w < nWords; w++ )
+		{
+			uint32 bits = candidates[ w ];
+			while( bits )
+			{
+				int i = FirstBitInWord( bits, w << 5 );
+				bits &= bits - 1;
+
+				float score = ScoreCriteriaAgainstRule( set, *prules, i, verbose );
+				// Check equals so that we keep track of all matching rules
+				if( score >= bestscore )
+				{
+					// Reset bucket
+					if( score != bestscore )
+					{
+						bestscore = score;
+						bestrules.RemoveAll();
+					}
+
+					// Add to bucket
+					bestrules.AddToTail( m_RulePartitions.IndexFromDictElem( prules, i ) );
+				}
+			}
+		}
+	}
+
+	return bestscore;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Only required criteria which compare against a literal string go in
+//			the index; anything else can match more than one value.
+//-----------------------------------------------------------------------------
+static bool IsIndexableCriterion( Criteria* c )
+{
+	if( c->IsSubCriteriaType() || !c->required )
+	{
+		return false;
+	}
+
+	Matcher& m = c->matcher;
+	if( !m.valid || m.isnumeric || m.notequal || m.usemin || m.usemax )
+	{
+		return false;
+	}
+
+#ifdef MAPBASE
+	if( m.isbit )
+	{
+		return false;
+	}
+
+	// Wildcards and regex
+	const char* pszToken = m.GetToken();
+	if( pszToken[0] == '@' || strchr( pszToken, '*' ) || strchr( pszToken, '?' ) )
+	{
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+static inline uint64 RuleIndexKey( int iBucket, const CUtlSymbol& nameSym, const char* pszValue )
+{
+	return ( ( uint64 )iBucket << 48 ) | ( ( uint64 )( UtlSymId_t )nameSym << 32 ) | HashStringCaseless( pszValue );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Builds the rule index over every partition bucket. Called after
+//			loading the rule set, and on demand once rules have been added.
+//-----------------------------------------------------------------------------
+void CResponseSystem::CompileRuleIndex()
+{
+	m_RuleIndexCriteria.RemoveAll();
+	m_RuleIndexBits.RemoveAll();
+	m_RuleIndexValues.RemoveAll();
+	m_bRuleIndexDirty = false;
+
+	for( int b = 0; b < ResponseRulePartition::N_RESPONSE_PARTITIONS; b++ )
+	{
+		ResponseRulePartition::tRuleDict& dict = m_RulePartitions.DictForBucket( b );
+		CompiledBucket_t& bucket = m_RuleIndexBuckets[ b ];
+		bucket.nRules = dict.Count();
+		bucket.nWords = ( bucket.nRules + 31 ) >> 5;
+		bucket.iFirstCriterion = m_RuleIndexCriteria.Count();
+
+		for( int i = 0; i < bucket.nRules; i++ )
 		{
-			float score = ScoreCriteriaAgainstRule( set, *prules, i, verbose );
-			// Check equals so that we keep track of all matching rules
-			if( score >= bestscore )
+			Rule* pRule = dict[ i ];
+			for( int j = 0; j < pRule->m_Criteria.Count(); j++ )
 			{
-				// Reset bucket
-				if( score != bestscore )
+				Criteria* pCrit = &m_Criteria[ pRule->m_Criteria[ j ] ];
+				if( !IsIndexableCriterion( pCrit ) )
 				{
-					bestscore = score;
-					bestrules.RemoveAll();
+					continue;
+				}
+
+				int iCrit;
+				for( iCrit = bucket.iFirstCriterion; iCrit < m_RuleIndexCriteria.Count(); iCrit++ )
+				{
+					if( m_RuleIndexCriteria[ iCrit ].nameSym == pCrit->nameSym )
+					{
+						break;
+					}
+				}
+
+				if( iCrit == m_RuleIndexCriteria.Count() )
+				{
+					m_RuleIndexCriteria.AddToTail();
+					m_RuleIndexCriteria[ iCrit ].nameSym = pCrit->nameSym;
+					m_RuleIndexCriteria[ iCrit ].iConstrainedBits = m_RuleIndexBits.AddMultipleToTail( bucket.nWords );
+					V_memset( &m_RuleIndexBits[ m_RuleIndexCriteria[ iCrit ].iConstrainedBits ], 0, bucket.nWords * sizeof( uint32 ) );
+				}
+
+				m_RuleIndexBits[ m_RuleIndexCriteria[ iCrit ].iConstrainedBits + ( i >> 5 ) ] |= 1u << ( i & 31 );
+
+				// Hash collisions only let extra rules through to be scored, they never drop one
+				uint64 key = RuleIndexKey( b, pCrit->nameSym, pCrit->matcher.GetToken() );
+				int slot = m_RuleIndexValues.Find( key );
+				if( slot == m_RuleIndexValues.InvalidIndex() )
+				{
+					int iBits = m_RuleIndexBits.AddMultipleToTail( bucket.nWords );
+					V_memset( &m_RuleIndexBits[ iBits ], 0, bucket.nWords * sizeof( uint32 ) );
+					slot = m_RuleIndexValues.Insert( key, iBits );
 				}
 
-				// Add to bucket
-				bestrules.AddToTail( m_RulePartitions.IndexFromDictElem( prules, i ) );
+				m_RuleIndexBits[ m_RuleIndexValues[ slot ] + ( i >> 5 ) ] |= 1u << ( i & 31 );
 			}
 		}
+
+		bucket.nCriteria = m_RuleIndexCriteria.Count() - bucket.iFirstCriterion;
 	}
+}
 
-	int bestCount = bestrules.Count();
-	if( bestCount <= 0 )
+//-----------------------------------------------------------------------------
+// Purpose: Fills in one bit per rule in the bucket, set if the rule isn't
+//			ruled out by one of its indexed criteria.
+//-----------------------------------------------------------------------------
+void CResponseSystem::FilterRulesUsingIndex( const CriteriaSet& set, int iBucket, uint32* pCandidates )
+{
+	const CompiledBucket_t& bucket = m_RuleIndexBuckets[ iBucket ];
+	int nWords = bucket.nWords;
+
+	V_memset( pCandidates, 0xFF, nWords * sizeof( uint32 ) );
+	if( bucket.nRules & 31 )
 	{
-		return m_RulePartitions.InvalidIdx();
+		pCandidates[ nWords - 1 ] = ( 1u << ( bucket.nRules & 31 ) ) - 1;
 	}
 
-	scoreOfBestMatchingRule = bestscore ;
-	if( bestCount == 1 )
+	for( int k = 0; k < bucket.nCriteria; k++ )
 	{
-		return bestrules[ 0 ] ;
+		const CompiledCriterion_t& crit = m_RuleIndexCriteria[ bucket.iFirstCriterion + k ];
+
+		// Same lookup as ScoreCriteriaAgainstRuleCriteria(): a missing criterion compares as ""
+		const char* pszValue = "";
+		int found = set.FindCriterionIndex( crit.nameSym );
+		if( found != -1 )
+		{
+			pszValue = set.GetValue( found );
+			if( !pszValue )
+			{
+				// Scored as zero without excluding the rule, so leave it to the scoring pass
+				continue;
+			}
+		}
+
+		const uint32* pConstrained = &m_RuleIndexBits[ crit.iConstrainedBits ];
+		int slot = m_RuleIndexValues.Find( RuleIndexKey( iBucket, crit.nameSym, pszValue ) );
+		if( slot == m_RuleIndexValues.InvalidIndex() )
+		{
+			for( int w = 0; w < nWords; w++ )
+			{
+				pCandidates[ w ] &= ~pConstrained[ w ];
+			}
+		}
+		else
+		{
+			const uint32* pAccepted = &m_RuleIndexBits[ m_RuleIndexValues[ slot ] ];
+			for( int w = 0; w < nWords; w++ )
+			{
+				pCandidates[ w ] &= ~pConstrained[ w ] | pAccepted[ w ];
+			}
+		}
 	}
-	else
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Keeps a copy of the criteria set if rr_bench_record is capturing
+//-----------------------------------------------------------------------------
+void CResponseSystem::RecordBenchQuery( const CriteriaSet& set )
+{
+	if( m_nBenchQueriesToRecord <= 0 )
 	{
-		// Randomly pick one of the tied matching rules
-		int idx = IEngineEmulator::Get()->GetRandomStream()->RandomInt( 0, bestCount - 1 );
-		if( verbose )
+		return;
+	}
+
+	m_BenchQueries.AddToTail( new CriteriaSet( set ) );
+	if( --m_nBenchQueriesToRecord == 0 )
+	{
+		CGMsg( 0, CON_GROUP_RESPONSE_SYSTEM, "rr_bench_record: recorded %d queries\n", m_BenchQueries.Count() );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Replays the recorded criteria sets with and without the rule index,
+//			checks they pick the same rules, and reports queries/sec.
+//-----------------------------------------------------------------------------
+void CResponseSystem::BenchmarkRecordedQueries( int nIterations )
+{
+	int nQueries = m_BenchQueries.Count();
+	if( nQueries <= 0 )
+	{
+		CGMsg( 0, CON_GROUP_RESPONSE_SYSTEM, "rr_bench: no recorded queries, use rr_bench_record first\n" );
+		return;
+	}
+
+	nIterations = MAX( nIterations, 1 );
+
+	CUtlVector< ResponseRulePartition::tIndex > scanRules( 16, 4 );
+	CUtlVector< ResponseRulePartition::tIndex > indexRules( 16, 4 );
+
+	int nMatched = 0;
+	int nMismatches = 0;
+	for( int q = 0; q < nQueries; q++ )
+	{
+		float flScanScore = CollectBestMatchingRules( *m_BenchQueries[ q ], false, false, scanRules );
+		float flIndexScore = CollectBestMatchingRules( *m_BenchQueries[ q ], false, true, indexRules );
+
+		if( scanRules.Count() > 0 )
 		{
-			CGMsg( 1, CON_GROUP_RESPONSE_SYSTEM, "Found %i matching rules, selecting slot %i\n", bestCount, idx );
+			nMatched++;
+		}
+
+		if( flScanScore != flIndexScore || scanRules.Count() != indexRules.Count() ||
+				V_memcmp( scanRules.Base(), indexRules.Base(), scanRules.Count() * sizeof( ResponseRulePartition::tIndex ) ) )
+		{
+			nMismatches++;
 		}
-		return bestrules[ idx ] ;
+	}
+
+	double flTimes[2];
+	for( int nMode = 0; nMode < 2; nMode++ )
+	{
+		double flStart = Plat_FloatTime();
+		for( int it = 0; it < nIterations; it++ )
+		{
+			for( int q = 0; q < nQueries; q++ )
+			{
+				CollectBestMatchingRules( *m_BenchQueries[ q ], false, nMode != 0, scanRules );
+			}
+		}
+		flTimes[ nMode ] = MAX( Plat_FloatTime() - flStart, 1e-6 );
+	}
+
+	double flTotal = ( double )nQueries * nIterations;
+	CGMsg( 0, CON_GROUP_RESPONSE_SYSTEM, "rr_bench: %d queries x %d iterations, %d rules, %d matched a rule\n",
+		   nQueries, nIterations, m_RulePartitions.Count(), nMatched );
+	CGMsg( 0, CON_GROUP_RESPONSE_SYSTEM, "  full scan:  %10.0f queries/sec\n", flTotal / flTimes[0] );
+	CGMsg( 0, CON_GROUP_RESPONSE_SYSTEM, "  rule index: %10.0f queries/sec (%.2fx)\n", flTotal / flTimes[1], flTimes[0] / flTimes[1] );
+	if( nMismatches )
+	{
+		CGMsg( 0, CON_GROUP_RESPONSE_SYSTEM, "  %d queries picked different rules with the index!\n", nMismatches );
 	}
 }
 
@@ -1384,6 +1687,11 @@ bool CResponseSystem::FindBestResponse( const CriteriaSet& set, CRR_Response& re
 	bool showRules = ( iDbgResponse >= 2 && iDbgResponse < RR_DEBUGRESPONSES_SPECIALCASE );
 	bool showResult = ( iDbgResponse >= 1 && iDbgResponse < RR_DEBUGRESPONSES_SPECIALCASE );
 
+	if( m_nBenchQueriesToRecord > 0 )
+	{
+		RecordBenchQuery( set );
+	}
+
 	// Look for match. verbose mode used to be at level 2, but disabled because the writers don't actually care for that info.
 	float scoreOfBestRule;
 	ResponseRulePartition::tIndex bestRule = FindBestMatchingRule( set,
@@ -1681,6 +1989,7 @@ void CResponseSystem::LoadRuleSet( const char* basescript )
 	IEngineEmulator::Get()->FreeFile( buffer );
 
 	Assert( m_ScriptStack.Count() == 0 );
+	CompileRuleIndex();
 	float flEnd = Plat_FloatTime();
 	COM_TimestampedLog( "CResponseSystem::LoadRuleSet took %f msec", 1000.0f * ( flEnd - flStart ) );
 }
@@ -2443,6 +2752,7 @@ void CResponseSystem::ParseRule( void )
 	if( m_bParseRuleValid )
 	{
 		m_RulePartitions.GetDictForRule( this, newRule ).Insert( ruleName, newRule );
+		m_bRuleIndexDirty = true;
 	}
 	else
 	{
@@ -2646,6 +2956,7 @@ void CResponseSystem::CopyRuleFrom( Rule* pSrcRule, ResponseRulePartition::tInde
 
 	// Add rule.
 	pCustomSystem->m_RulePartitions.GetDictForRule( this, dstRule ).Insert( m_RulePartitions.GetElementName( iRule ), dstRule );
+	pCustomSystem->InvalidateRuleIndex();
 }
 
 
@@ -3004,6 +3315,28 @@ static void CC_RR_Debug_ResponseConcept_Exclude( const CCommand& args )
 			}
 	}
 }
+static void CC_RR_Bench_Record( const CCommand& args )
+{
+	if( args.ArgC() < 2 )
+	{
+		CGMsg( 0, CON_GROUP_RESPONSE_SYSTEM, "Usage:  rr_bench_record <count>\n" );
+		CGMsg( 0, CON_GROUP_RESPONSE_SYSTEM, "\t%d queries recorded, %d still to record.\n", CResponseSystem::m_BenchQueries.Count(), CResponseSystem::m_nBenchQueriesToRecord );
+		return;
+	}
+
+	int nCount = atoi( args[1] );
+	if( nCount <= 0 )
+	{
+		CResponseSystem::m_BenchQueries.PurgeAndDeleteElements();
+		CResponseSystem::m_nBenchQueriesToRecord = 0;
+		CGMsg( 0, CON_GROUP_RESPONSE_SYSTEM, "Recorded queries discarded.\n" );
+		return;
+	}
+
+	CResponseSystem::m_nBenchQueriesToRecord = nCount;
+	CGMsg( 0, CON_GROUP_RESPONSE_SYSTEM, "Recording the next %d response queries.\n", nCount );
+}
+
 #if RR_DUMPHASHINFO_ENABLED
 void ResponseRulePartition::PrintBucketInfo( CResponseSystem* pSys )
 {
@@ -254,6 +254,17 @@ public:
 	float		LookupEnumeration( const char* name, bool& found );
 
 	ResponseRulePartition::tIndex FindBestMatchingRule( const CriteriaSet& set, bool verbose, float& scoreOfBestMatchingRule );
+	float		CollectBestMatchingRules( const CriteriaSet& set, bool verbose, bool bUseIndex, CUtlVector< ResponseRulePartition::tIndex >& bestrules );
+
+	void		CompileRuleIndex();
+	void		FilterRulesUsingIndex( const CriteriaSet& set, int iBucket, uint32* pCandidates );
+	inline void	InvalidateRuleIndex()
+	{
+		m_bRuleIndexDirty = true;
+	}
+
+	void		BenchmarkRecordedQueries( int nIterations );
+	static void	RecordBenchQuery( const CriteriaSet& set );
 
 #ifdef MAPBASE
 	void		DisableEmptyRules();
@@ -300,6 +311,34 @@ public:
 
 	CUtlVector<int> m_FakedDepletes;
 
+	// Rule index compiled from the partition buckets by CompileRuleIndex(). Each rule in a bucket gets a bit.
+	// For every criterion name that a rule requires to equal a literal string, the bucket stores the rules
+	// constrained by that name and, per value, the rules which accept it. A query ANDs these together and
+	// only scores the rules left over.
+	struct CompiledCriterion_t
+	{
+		CUtlSymbol	nameSym;
+		int			iConstrainedBits;	// offset into m_RuleIndexBits
+	};
+
+	struct CompiledBucket_t
+	{
+		int			nRules;
+		int			nWords;
+		int			iFirstCriterion;	// index into m_RuleIndexCriteria
+		int			nCriteria;
+	};
+
+	CompiledBucket_t				m_RuleIndexBuckets[ ResponseRulePartition::N_RESPONSE_PARTITIONS ];
+	CUtlVector< CompiledCriterion_t > m_RuleIndexCriteria;
+	CUtlVector< uint32 >			m_RuleIndexBits;
+	CUtlMap< uint64, int >			m_RuleIndexValues;	// bucket, name and caseless value hash -> offset into m_RuleIndexBits
+	bool							m_bRuleIndexDirty;
+
+	// Criteria sets captured by rr_bench_record for rr_bench to replay
+	static CUtlVector< CriteriaSet* > m_BenchQueries;
+	static int m_nBenchQueriesToRecord;
+
 	char		token[ 1204 ];
 
 	bool		m_bUnget;
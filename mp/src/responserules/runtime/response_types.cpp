@@ -41,6 +41,10 @@ Matcher::Matcher()
 #endif
 	maxval = 0.0f;
 	minval = 0.0f;
+	tokenval = 0.0f;
+#ifdef MAPBASE
+	tokenbits = 0;
+#endif
 
 	token = UTL_INVAL_SYMBOL;
 	rawtoken = UTL_INVAL_SYMBOL;
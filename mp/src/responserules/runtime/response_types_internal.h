@@ -45,6 +45,12 @@ public:
 	float	maxval;
 	float	minval;
 
+	// The token pre-parsed as a number, so comparisons don't atof() it on every query
+	float	tokenval;
+#ifdef MAPBASE
+	int		tokenbits;
+#endif
+
 	bool	valid : 1;      //1
 	bool	isnumeric : 1;  //2
 	bool	notequal : 1;   //3
@@ -520,6 +526,16 @@ struct ResponseRulePartition
 	/// return a tIndex
 	tIndex IndexFromDictElem( tRuleDict* pDict, int elem );
 
+	/// bucket number of a dict returned by GetDictForRule() or GetDictsForCriteria(), and back
+	inline int BucketFromDict( const tRuleDict* pDict ) const
+	{
+		return pDict - m_RuleParts;
+	}
+	inline tRuleDict& DictForBucket( int bucket )
+	{
+		return m_RuleParts[bucket];
+	}
+
 	// for iteration:
 	inline tIndex First( void );
 	inline tIndex Next( const tIndex& idx );
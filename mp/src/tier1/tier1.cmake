@@ -46,6 +46,7 @@ set(
 	"${TIER1_DIR}/utlbufferutil.cpp"
 	"${TIER1_DIR}/utlstring.cpp"
 	"${TIER1_DIR}/utlsymbol.cpp"
+	"${TIER1_DIR}/utlhashsymbol.cpp"
 	"${TIER1_DIR}/utlbinaryblock.cpp"
 	"$<${IS_LINUX}:${TIER1_DIR}/pathmatch.cpp>"
 	"${TIER1_DIR}/snappy.cpp"
@@ -128,6 +129,7 @@ set(
 	"${SRCDIR}/public/tier1/utlstring.h"
 	"${SRCDIR}/public/tier1/UtlStringMap.h"
 	"${SRCDIR}/public/tier1/utlsymbol.h"
+	"${SRCDIR}/public/tier1/utlhashsymbol.h"
 	"${SRCDIR}/public/tier1/utlsymbollarge.h"
 	"${SRCDIR}/public/tier1/utlvector.h"
 	"${SRCDIR}/public/tier1/utlbinaryblock.h"
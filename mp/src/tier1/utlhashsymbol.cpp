@@ -0,0 +1,352 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Defines a hashed symbol table with 32-bit ids and lock-free lookups
+//
+// $Header: $
+// $NoKeywords: $
+//=============================================================================//
+
+#include "tier1/utlhashsymbol.h"
+#include "tier1/generichash.h"
+#include "tier1/strtools.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+//-----------------------------------------------------------------------------
+// Segment 0 holds ids [0, 256), segment n > 0 holds [256 << (n-1), 256 << n)
+//-----------------------------------------------------------------------------
+inline void CUtlHashSymbolTable::SegmentForId( UtlHashSymId_t id, int& nSegment, uint32& nOffset )
+{
+	if( id < ( 1u << FIRST_SEGMENT_BITS ) )
+	{
+		nSegment = 0;
+		nOffset = id;
+		return;
+	}
+
+#ifdef _WIN32
+	unsigned long nHighBit;
+	_BitScanReverse( &nHighBit, id );
+#else
+	uint32 nHighBit = 31 - __builtin_clz( id );
+#endif
+
+	nSegment = nHighBit - FIRST_SEGMENT_BITS + 1;
+	nOffset = id - ( 1u << nHighBit );
+}
+
+
+//-----------------------------------------------------------------------------
+// constructor, destructor
+//-----------------------------------------------------------------------------
+CUtlHashSymbolTable::CUtlHashSymbolTable( int initSize, bool caseInsensitive ) :
+	m_pHashTable( NULL ),
+	m_nNumStrings( 0 ),
+	m_bInsensitive( caseInsensitive ),
+	m_nPoolSpaceLeft( 0 ),
+	m_nMemoryUsed( 0 )
+{
+	// Keep the hash table at most half full
+	m_nInitSize = 16;
+	while( m_nInitSize < initSize * 2 )
+	{
+		m_nInitSize <<= 1;
+	}
+
+	memset( ( void* )m_pSegments, 0, sizeof( m_pSegments ) );
+	m_pHashTable = AllocHashTable( m_nInitSize );
+	m_nMemoryUsed = sizeof( HashTable_t ) + ( m_nInitSize - 1 ) * sizeof( Slot_t );
+}
+
+CUtlHashSymbolTable::~CUtlHashSymbolTable()
+{
+	RemoveAll();
+
+	HashTable_t* pTable = m_pHashTable;
+	Assert( pTable && !pTable->m_pRetired );
+	free( pTable );
+}
+
+
+//-----------------------------------------------------------------------------
+// Hash table helpers
+//-----------------------------------------------------------------------------
+CUtlHashSymbolTable::HashTable_t* CUtlHashSymbolTable::AllocHashTable( uint32 nSize )
+{
+	Assert( ( nSize & ( nSize - 1 ) ) == 0 );
+
+	size_t nBytes = sizeof( HashTable_t ) + ( nSize - 1 ) * sizeof( Slot_t );
+	HashTable_t* pTable = ( HashTable_t* )malloc( nBytes );
+	memset( ( void* )pTable, 0, nBytes );
+	pTable->m_nMask = nSize - 1;
+	pTable->m_pRetired = NULL;
+	return pTable;
+}
+
+void CUtlHashSymbolTable::InsertIntoHashTable( HashTable_t* pTable, uint32 nHash, UtlHashSymId_t id )
+{
+	uint32 nMask = pTable->m_nMask;
+	uint32 i = nHash & nMask;
+	while( pTable->m_Slots[i].m_nHash != 0 )
+	{
+		i = ( i + 1 ) & nMask;
+	}
+
+	// Readers treat a non-zero hash as a filled slot, so the id has to land first
+	pTable->m_Slots[i].m_nId = id;
+	ThreadMemoryBarrier();
+	pTable->m_Slots[i].m_nHash = nHash;
+}
+
+void CUtlHashSymbolTable::GrowHashTable()
+{
+	HashTable_t* pOld = m_pHashTable;
+	uint32 nNewSize = ( pOld->m_nMask + 1 ) * 2;
+	HashTable_t* pNew = AllocHashTable( nNewSize );
+
+	for( uint32 i = 0; i <= pOld->m_nMask; i++ )
+	{
+		if( pOld->m_Slots[i].m_nHash != 0 )
+		{
+			InsertIntoHashTable( pNew, pOld->m_Slots[i].m_nHash, pOld->m_Slots[i].m_nId );
+		}
+	}
+
+	// Lookups already walking the old table can finish there; it holds everything
+	// that was added before they started. It's freed in RemoveAll().
+	pNew->m_pRetired = pOld;
+	m_nMemoryUsed += sizeof( HashTable_t ) + ( nNewSize - 1 ) * sizeof( Slot_t );
+
+	ThreadMemoryBarrier();
+	m_pHashTable = pNew;
+}
+
+
+//-----------------------------------------------------------------------------
+// String storage
+//-----------------------------------------------------------------------------
+CUtlHashSymbolTable::Entry_t* CUtlHashSymbolTable::AllocEntry( int nLen )
+{
+	// Keep the hash in front of each string aligned
+	int nSize = ( offsetof( Entry_t, m_String ) + nLen + 3 ) & ~3;
+
+	if( nSize > STRING_POOL_SIZE )
+	{
+		char* pBlock = ( char* )malloc( nSize );
+		m_StringPools.AddToTail( pBlock );
+		m_nMemoryUsed += nSize;
+		return ( Entry_t* )pBlock;
+	}
+
+	if( nSize > m_nPoolSpaceLeft )
+	{
+		m_StringPools.AddToTail( ( char* )malloc( STRING_POOL_SIZE ) );
+		m_nPoolSpaceLeft = STRING_POOL_SIZE;
+		m_nMemoryUsed += STRING_POOL_SIZE;
+	}
+
+	Entry_t* pEntry = ( Entry_t* )( m_StringPools.Tail() + STRING_POOL_SIZE - m_nPoolSpaceLeft );
+	m_nPoolSpaceLeft -= nSize;
+	return pEntry;
+}
+
+inline const CUtlHashSymbolTable::Entry_t* CUtlHashSymbolTable::EntryForId( UtlHashSymId_t id ) const
+{
+	int nSegment;
+	uint32 nOffset;
+	SegmentForId( id, nSegment, nOffset );
+	return m_pSegments[nSegment][nOffset];
+}
+
+inline bool CUtlHashSymbolTable::StringsMatch( const char* pA, const char* pB ) const
+{
+	return m_bInsensitive ? !V_stricmp( pA, pB ) : !V_strcmp( pA, pB );
+}
+
+uint32 CUtlHashSymbolTable::ComputeHash( const char* pString ) const
+{
+	// HashString() is only 16 bits, which isn't enough to spread a large table
+	uint32 nHash = m_bInsensitive ? MurmurHash2LowerCase( pString, 0x3501A674 ) : MurmurHash2( pString, V_strlen( pString ), 0x3501A674 );
+
+	// 0 marks an empty slot
+	return nHash ? nHash : 1;
+}
+
+
+//-----------------------------------------------------------------------------
+// Finds the symbol for pString
+//-----------------------------------------------------------------------------
+UtlHashSymId_t CUtlHashSymbolTable::Find( const char* pString ) const
+{
+	if( !pString )
+	{
+		return UTL_INVAL_HASHSYMBOL;
+	}
+
+	return Find( pString, ComputeHash( pString ) );
+}
+
+UtlHashSymId_t CUtlHashSymbolTable::Find( const char* pString, uint32 nHash ) const
+{
+	if( !pString )
+	{
+		return UTL_INVAL_HASHSYMBOL;
+	}
+
+	if( !nHash )
+	{
+		nHash = 1;
+	}
+
+	const HashTable_t* pTable = m_pHashTable;
+	uint32 nMask = pTable->m_nMask;
+	for( uint32 i = nHash & nMask; ; i = ( i + 1 ) & nMask )
+	{
+		uint32 nSlotHash = pTable->m_Slots[i].m_nHash;
+		if( nSlotHash == 0 )
+		{
+			return UTL_INVAL_HASHSYMBOL;
+		}
+
+		if( nSlotHash == nHash )
+		{
+			ThreadMemoryBarrier();
+			UtlHashSymId_t id = pTable->m_Slots[i].m_nId;
+			if( StringsMatch( EntryForId( id )->m_String, pString ) )
+			{
+				return id;
+			}
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Finds and/or creates a symbol based on the string
+//-----------------------------------------------------------------------------
+UtlHashSymId_t CUtlHashSymbolTable::AddString( const char* pString )
+{
+	if( !pString )
+	{
+		return UTL_INVAL_HASHSYMBOL;
+	}
+
+	return AddString( pString, ComputeHash( pString ) );
+}
+
+UtlHashSymId_t CUtlHashSymbolTable::AddString( const char* pString, uint32 nHash )
+{
+	if( !pString )
+	{
+		return UTL_INVAL_HASHSYMBOL;
+	}
+
+	if( !nHash )
+	{
+		nHash = 1;
+	}
+
+	UtlHashSymId_t id = Find( pString, nHash );
+	if( id != UTL_INVAL_HASHSYMBOL )
+	{
+		return id;
+	}
+
+	AUTO_LOCK( m_InsertMutex );
+
+	// Someone may have added it while we were waiting for the lock
+	id = Find( pString, nHash );
+	if( id != UTL_INVAL_HASHSYMBOL )
+	{
+		return id;
+	}
+
+	id = m_nNumStrings;
+	Assert( id != UTL_INVAL_HASHSYMBOL );
+
+	int nLen = V_strlen( pString ) + 1;
+	Entry_t* pEntry = AllocEntry( nLen );
+	pEntry->m_nHash = nHash;
+	memcpy( pEntry->m_String, pString, nLen );
+
+	int nSegment;
+	uint32 nOffset;
+	SegmentForId( id, nSegment, nOffset );
+	if( !m_pSegments[nSegment] )
+	{
+		uint32 nSegmentSize = 1u << ( nSegment ? FIRST_SEGMENT_BITS + nSegment - 1 : FIRST_SEGMENT_BITS );
+		const Entry_t** pSegment = ( const Entry_t** )malloc( nSegmentSize * sizeof( Entry_t* ) );
+		m_nMemoryUsed += nSegmentSize * sizeof( Entry_t* );
+		ThreadMemoryBarrier();
+		m_pSegments[nSegment] = pSegment;
+	}
+	m_pSegments[nSegment][nOffset] = pEntry;
+
+	HashTable_t* pTable = m_pHashTable;
+	if( ( id + 1 ) * 2 > pTable->m_nMask + 1 )
+	{
+		GrowHashTable();
+	}
+
+	// This publishes the string to Find(), so everything above has to be in place first
+	ThreadMemoryBarrier();
+	InsertIntoHashTable( m_pHashTable, nHash, id );
+
+	m_nNumStrings = id + 1;
+	return id;
+}
+
+
+//-----------------------------------------------------------------------------
+// Look up the string associated with a particular symbol
+//-----------------------------------------------------------------------------
+const char* CUtlHashSymbolTable::String( UtlHashSymId_t id ) const
+{
+	if( id >= ( UtlHashSymId_t )m_nNumStrings )
+	{
+		return "";
+	}
+
+	return EntryForId( id )->m_String;
+}
+
+
+//-----------------------------------------------------------------------------
+// Remove all symbols in the table.
+//-----------------------------------------------------------------------------
+void CUtlHashSymbolTable::RemoveAll()
+{
+	AUTO_LOCK( m_InsertMutex );
+
+	HashTable_t* pTable = m_pHashTable;
+	while( pTable )
+	{
+		HashTable_t* pRetired = pTable->m_pRetired;
+		free( pTable );
+		pTable = pRetired;
+	}
+	m_pHashTable = AllocHashTable( m_nInitSize );
+
+	for( int i = 0; i < MAX_SEGMENTS; i++ )
+	{
+		free( ( void* )m_pSegments[i] );
+		m_pSegments[i] = NULL;
+	}
+
+	for( int i = 0; i < m_StringPools.Count(); i++ )
+	{
+		free( m_StringPools[i] );
+	}
+	m_StringPools.RemoveAll();
+	m_nPoolSpaceLeft = 0;
+
+	m_nNumStrings = 0;
+	m_nMemoryUsed = sizeof( HashTable_t ) + ( m_nInitSize - 1 ) * sizeof( Slot_t );
+}
+
+size_t CUtlHashSymbolTable::GetMemoryUsage() const
+{
+	return m_nMemoryUsed;
+}
@@ -44,7 +44,7 @@
 // globals
 //-----------------------------------------------------------------------------
 
-CUtlSymbolTableMT* CUtlSymbol::s_pSymbolTable = 0;
+CUtlHashSymbolTable* CUtlSymbol::s_pSymbolTable = 0;
 bool CUtlSymbol::s_bAllowStaticSymbolTable = true;
 
 
@@ -63,7 +63,7 @@ void CUtlSymbol::Initialize()
 	static bool symbolsInitialized = false;
 	if( !symbolsInitialized )
 	{
-		s_pSymbolTable = new CUtlSymbolTableMT;
+		s_pSymbolTable = new CUtlHashSymbolTable;
 		symbolsInitialized = true;
 	}
 }
@@ -83,7 +83,7 @@ public:
 
 static CCleanupUtlSymbolTable g_CleanupSymbolTable;
 
-CUtlSymbolTableMT* CUtlSymbol::CurrTable()
+CUtlHashSymbolTable* CUtlSymbol::CurrTable()
 {
 	Initialize();
 	return s_pSymbolTable;
@@ -96,11 +96,19 @@ CUtlSymbolTableMT* CUtlSymbol::CurrTable()
 
 CUtlSymbol::CUtlSymbol( const char* pStr )
 {
-	m_Id = CurrTable()->AddString( pStr );
+	UtlHashSymId_t id = CurrTable()->AddString( pStr );
+
+	// CUtlSymbol is still 16 bits
+	AssertMsg( id == UTL_INVAL_HASHSYMBOL || id < UTL_INVAL_SYMBOL, "Global symbol table overflow" );
+	m_Id = ( id < UTL_INVAL_SYMBOL ) ? ( UtlSymId_t )id : UTL_INVAL_SYMBOL;
 }
 
 const char* CUtlSymbol::String( ) const
 {
+	if( m_Id == UTL_INVAL_SYMBOL )
+	{
+		return "";
+	}
 	return CurrTable()->String( m_Id );
 }
 
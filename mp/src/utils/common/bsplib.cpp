@@ -797,6 +797,15 @@ static void WritePakFileLump( void )
 	GetPakFile()->ActivateByteSwapping( IsX360() );
 	GetPakFile()->SaveToBuffer( buf );
 
+	ZipBuildStats_t stats;
+	GetPakFile()->GetBuildStats( stats );
+	if( stats.m_nEntriesAdded )
+	{
+		Msg( "Pakfile: %d files added (%d unchanged, %d compressed), %.1f MB -> %.1f MB in %.2f seconds\n",
+			 stats.m_nEntriesAdded, stats.m_nEntriesReused, stats.m_nEntriesCompressed,
+			 stats.m_nBytesIn / ( 1024.0f * 1024.0f ), stats.m_nBytesOut / ( 1024.0f * 1024.0f ), stats.m_flCompressSeconds );
+	}
+
 	// must respect pak file alignment
 	// pad up and ensure lump starts on same aligned boundary
 	AlignFilePosition( g_hBSPFile, GetPakFile()->GetAlignment() );
@@ -813,6 +822,138 @@ void ClearPakFile( IZip* pak )
 	pak->Reset();
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Generates about nMegabytes of compressible files for RunPakFileBenchmark()
+//-----------------------------------------------------------------------------
+static void BuildPakBenchFiles( CUtlVector< CUtlBuffer* >& files, int nMegabytes )
+{
+	static const char* s_pWords[] =
+	{
+		"\"classname\" ", "\"origin\" ", "\"angles\" ", "\"0 0 0\"", "\"tools/toolsnodraw\"",
+		"\"uaxis\" ", "\"vaxis\" ", "\"plane\" ", "{\n", "}\n", "\n", "\t",
+	};
+
+	// Fixed seed, both passes have to see the same files
+	unsigned int nSeed = 12345;
+	int nTotal = 0;
+	while( nTotal < nMegabytes * 1024 * 1024 )
+	{
+		nSeed = nSeed * 1103515245 + 12345;
+		int nSize = 1024 + ( nSeed >> 8 ) % ( 256 * 1024 );
+
+		CUtlBuffer* pBuf = new CUtlBuffer( 0, nSize, 0 );
+		while( pBuf->TellPut() < nSize )
+		{
+			nSeed = nSeed * 1103515245 + 12345;
+			const char* pWord = s_pWords[ ( nSeed >> 16 ) % ARRAYSIZE( s_pWords ) ];
+			pBuf->Put( pWord, V_strlen( pWord ) );
+			pBuf->PutUnsignedChar( '0' + ( nSeed >> 8 ) % 10 );
+		}
+
+		nTotal += pBuf->TellPut();
+		files.AddToTail( pBuf );
+	}
+}
+
+static double BuildPakBenchZip( IZip* pak, CUtlVector< CUtlBuffer* >& files, IZip::eCompressionType compressionType, CUtlBuffer& outbuf )
+{
+	double flStart = Plat_FloatTime();
+	for( int i = 0; i < files.Count(); i++ )
+	{
+		char szName[MAX_PATH];
+		V_snprintf( szName, sizeof( szName ), "pakbench/file%05d.txt", i );
+		AddBufferToPak( pak, szName, files[i]->Base(), files[i]->TellPut(), false, compressionType );
+	}
+	pak->SaveToBuffer( outbuf );
+	return Plat_FloatTime() - flStart;
+}
+
+static bool ComparePakBenchOutput( const char* pszWhat, CUtlBuffer& expected, CUtlBuffer& actual )
+{
+	int nSize = Min( expected.TellPut(), actual.TellPut() );
+	const byte* pExpected = ( const byte* )expected.Base();
+	const byte* pActual = ( const byte* )actual.Base();
+	for( int i = 0; i < nSize; i++ )
+	{
+		if( pExpected[i] != pActual[i] )
+		{
+			Warning( "%s: byte %d differs from the single threaded pak.\n", pszWhat, i );
+			return false;
+		}
+	}
+
+	if( expected.TellPut() != actual.TellPut() )
+	{
+		Warning( "%s: %d bytes, the single threaded pak has %d.\n", pszWhat, actual.TellPut(), expected.TellPut() );
+		return false;
+	}
+
+	Msg( "%s: matches the single threaded pak.\n", pszWhat );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: -pakbench: saves a pak of about nMegabytes of generated files with
+//			one compression thread and with nThreads, then adds them all again
+//			over the saved pak with reuse on. Times each and checks that all
+//			three give the same bytes.
+//-----------------------------------------------------------------------------
+void RunPakFileBenchmark( int nMegabytes, int nThreads )
+{
+#ifdef ZIP_SUPPORT_LZMA_ENCODE
+	IZip::eCompressionType compressionType = IZip::eCompressionType_LZMA;
+#else
+	// Stored entries never leave the calling thread, so all this can show is that nothing changed
+	IZip::eCompressionType compressionType = IZip::eCompressionType_None;
+	Warning( "This build can't encode LZMA (ZIP_SUPPORT_LZMA_ENCODE), files will be stored uncompressed.\n" );
+#endif
+
+	CUtlVector< CUtlBuffer* > files;
+	BuildPakBenchFiles( files, nMegabytes );
+
+	int64 nBytes = 0;
+	for( int i = 0; i < files.Count(); i++ )
+	{
+		nBytes += files[i]->TellPut();
+	}
+	Msg( "%d files, %.1f MB\n", files.Count(), nBytes / ( 1024.0f * 1024.0f ) );
+
+	CUtlBuffer outbuf[2];
+	double flSeconds[2];
+	for( int nPass = 0; nPass < 2; nPass++ )
+	{
+		IZip* pak = IZip::CreateZip( NULL );
+		pak->SetCompressionThreads( nPass ? nThreads : 1 );
+		flSeconds[nPass] = BuildPakBenchZip( pak, files, compressionType, outbuf[nPass] );
+		Msg( "%2d thread(s):  %.3f seconds, %.1f MB\n", nPass ? nThreads : 1, flSeconds[nPass], outbuf[nPass].TellPut() / ( 1024.0f * 1024.0f ) );
+		IZip::ReleaseZip( pak );
+	}
+	if( flSeconds[1] > 0.0 )
+	{
+		Msg( "Speedup: %.2fx\n", flSeconds[0] / flSeconds[1] );
+	}
+	ComparePakBenchOutput( "Threaded", outbuf[0], outbuf[1] );
+
+	// Same files over the saved pak, as -onlyents and -keepstalezip do
+	{
+		IZip* pak = IZip::CreateZip( NULL );
+		pak->ParseFromBuffer( outbuf[1].Base(), outbuf[1].TellPut() );
+		pak->SetCompressionThreads( nThreads );
+		pak->SetReuseUnchangedEntries( true );
+
+		CUtlBuffer reusebuf;
+		double flReuseSeconds = BuildPakBenchZip( pak, files, compressionType, reusebuf );
+
+		ZipBuildStats_t stats;
+		pak->GetBuildStats( stats );
+		Msg( "Re-added:     %.3f seconds, %d of %d unchanged\n", flReuseSeconds, stats.m_nEntriesReused, stats.m_nEntriesAdded );
+		ComparePakBenchOutput( "Re-added", outbuf[0], reusebuf );
+		IZip::ReleaseZip( pak );
+	}
+
+	files.PurgeAndDeleteElements();
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Add file from disk to .bsp PAK lump
 // Input  : *relativename -
@@ -4809,6 +4950,9 @@ bool RepackBSP( CUtlBuffer& inputBuffer_, CUtlBuffer& outputBuffer, CompressFunc
 				IZip* oldPakFile = IZip::CreateZip( NULL );
 				oldPakFile->ParseFromBuffer( inputBuffer.Base(), inputBuffer.Size() );
 
+				// Entries are compressed on all cores when the new pak is saved
+				newPakFile->SetCompressionThreads( GetCPUInformation()->m_nLogicalProcessors );
+
 				int id = -1;
 				int fileSize;
 				while( 1 )
@@ -4837,6 +4981,12 @@ bool RepackBSP( CUtlBuffer& inputBuffer_, CUtlBuffer& outputBuffer, CompressFunc
 
 				// save new pack to buffer
 				newPakFile->SaveToBuffer( outputBuffer );
+
+				ZipBuildStats_t stats;
+				newPakFile->GetBuildStats( stats );
+				Msg( "Repacking BSP: %d pak files, %.1f MB -> %.1f MB in %.2f seconds\n", stats.m_nEntriesAdded,
+					 stats.m_nBytesIn / ( 1024.0f * 1024.0f ), stats.m_nBytesOut / ( 1024.0f * 1024.0f ), stats.m_flCompressSeconds );
+
 				sOutBSPHeader.lumps[lumpNum].fileofs = newOffset;
 				sOutBSPHeader.lumps[lumpNum].filelen = outputBuffer.TellPut() - newOffset;
 				// Note that this *lump* is uncompressed, it just contains a packfile that uses compression, so we're
@@ -196,6 +196,7 @@ extern int			g_PhysDispSize;
 IZip*				GetPakFile( void );
 IZip*				GetSwapPakFile( void );
 void				ClearPakFile( IZip* pak );
+void				RunPakFileBenchmark( int nMegabytes, int nThreads );
 void				AddFileToPak( IZip* pak, const char* pRelativeName, const char* fullpath, IZip::eCompressionType compressionType = IZip::eCompressionType_None );
 void				AddBufferToPak( IZip* pak, const char* pRelativeName, void* data, int length, bool bTextMode, IZip::eCompressionType compressionType = IZip::eCompressionType_None );
 void				AddDirToPak( IZip* pak, const char* pDirPath, const char* pPakPrefix = NULL );
@@ -2086,6 +2086,216 @@ static KeyValues* ReadKeyValuesFile( const char* pFilename )
 }
 
 
+//-----------------------------------------------------------------------------
+// Map files are read into memory and tokenized on g_nVMFLoadThreads threads
+// before the chunk handlers run over them (see CChunkFileTokens), unless
+// -legacyvmfload is given. Instance files are read and tokenized up front,
+// a file per thread, as soon as the main map's func_instances are reached.
+//-----------------------------------------------------------------------------
+bool	g_bLegacyVMFLoad = false;
+int		g_nVMFLoadThreads = 1;
+
+struct PrefetchedMapFile_t
+{
+	char				m_szFileName[ MAX_PATH ];
+	CChunkFileTokens*	m_pTokens;
+	bool				m_bLoaded;
+	int					m_nUses;		// func_instances that haven't loaded it yet
+};
+
+static CUtlVector< PrefetchedMapFile_t >	s_PrefetchedMapFiles;
+static CChunkFileTokens*					s_pTokenizingMapFile;
+
+
+static void TokenizeMapFileSegment_Thread( int iThread, int iSegment )
+{
+	s_pTokenizingMapFile->TokenizeSegment( iSegment );
+}
+
+
+static void PrefetchMapFile_Thread( int iThread, int iFile )
+{
+	PrefetchedMapFile_t& file = s_PrefetchedMapFiles[ iFile ];
+	if( file.m_pTokens )
+	{
+		return;
+	}
+
+	file.m_pTokens = new CChunkFileTokens;
+	file.m_bLoaded = file.m_pTokens->Load( file.m_szFileName );
+	if( file.m_bLoaded )
+	{
+		for( int i = 0; i < file.m_pTokens->GetSegmentCount(); i++ )
+		{
+			file.m_pTokens->TokenizeSegment( i );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs map loading work on nThreads threads. Everything after map
+//			loading is single threaded (see RunVBSP).
+//-----------------------------------------------------------------------------
+static void RunVMFLoadThreads( int nThreads, int nWorkItems, ThreadWorkerFn fn )
+{
+	int nSavedThreads = numthreads;
+	numthreads = nThreads;
+	RunThreadsOnIndividual( nWorkItems, false, fn );
+	numthreads = nSavedThreads;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Opens a map file for reading.
+// Output : eResult - File.Open's result.
+//			Returns the tokens File reads from, to be handed to
+//			ReleaseMapFileTokens when done, or NULL.
+//-----------------------------------------------------------------------------
+static CChunkFileTokens* OpenMapFile( CChunkFile& File, const char* pszFileName, ChunkFileResult_t& eResult )
+{
+	if( g_bLegacyVMFLoad )
+	{
+		eResult = File.Open( pszFileName, ChunkFile_Read );
+		return NULL;
+	}
+
+	for( int i = 0; i < s_PrefetchedMapFiles.Count(); i++ )
+	{
+		if( !V_stricmp( s_PrefetchedMapFiles[ i ].m_szFileName, pszFileName ) )
+		{
+			eResult = File.Open( s_PrefetchedMapFiles[ i ].m_pTokens );
+			return s_PrefetchedMapFiles[ i ].m_pTokens;
+		}
+	}
+
+	CChunkFileTokens* pTokens = new CChunkFileTokens;
+	if( !pTokens->Load( pszFileName ) )
+	{
+		// Let TokenReader fail on it too, so the error reads the same
+		delete pTokens;
+		eResult = File.Open( pszFileName, ChunkFile_Read );
+		return NULL;
+	}
+
+	s_pTokenizingMapFile = pTokens;
+	RunVMFLoadThreads( g_nVMFLoadThreads, pTokens->GetSegmentCount(), TokenizeMapFileSegment_Thread );
+	s_pTokenizingMapFile = NULL;
+
+	eResult = File.Open( pTokens );
+	return pTokens;
+}
+
+
+static void ReleaseMapFileTokens( CChunkFileTokens* pTokens )
+{
+	if( !pTokens )
+	{
+		return;
+	}
+
+	for( int i = 0; i < s_PrefetchedMapFiles.Count(); i++ )
+	{
+		if( s_PrefetchedMapFiles[ i ].m_pTokens == pTokens )
+		{
+			if( --s_PrefetchedMapFiles[ i ].m_nUses <= 0 )
+			{
+				delete pTokens;
+				s_PrefetchedMapFiles.Remove( i );
+			}
+			return;
+		}
+	}
+
+	delete pTokens;
+}
+
+
+static void FreePrefetchedMapFiles()
+{
+	for( int i = 0; i < s_PrefetchedMapFiles.Count(); i++ )
+	{
+		delete s_PrefetchedMapFiles[ i ].m_pTokens;
+	}
+	s_PrefetchedMapFiles.Purge();
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the file a func_instance in pszFileName refers to.
+//-----------------------------------------------------------------------------
+static bool FindInstanceFile( const char* pszFileName, const char* pszInstanceFile, char* pszOutFileName )
+{
+#ifdef MAPBASE
+	return CMapFile::DeterminePath( pszFileName, pszInstanceFile, pszOutFileName ) || CMapFile::DeterminePath( g_MainMapPath, pszInstanceFile, pszOutFileName );
+#else
+	return CMapFile::DeterminePath( pszFileName, pszInstanceFile, pszOutFileName );
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads and tokenizes the files of every func_instance from
+//			nFirstEntity on, a file per thread, ahead of LoadMapFile.
+// Input  : pszFileName - the main map's file name
+//			nFirstEntity - the first entity to look at
+//-----------------------------------------------------------------------------
+void CMapFile::PrefetchInstances( const char* pszFileName, int nFirstEntity )
+{
+	if( g_bLegacyVMFLoad )
+	{
+		return;
+	}
+
+	for( int i = nFirstEntity; i < num_entities; i++ )
+	{
+		if( strcmp( ValueForKey( &entities[ i ], "classname" ), "func_instance" ) )
+		{
+			continue;
+		}
+
+		char* pInstanceFile = ValueForKey( &entities[ i ], "file" );
+		char InstancePath[ MAX_PATH ];
+		if( !pInstanceFile[ 0 ] || !FindInstanceFile( pszFileName, pInstanceFile, InstancePath ) )
+		{
+			continue;
+		}
+
+		int nFile;
+		for( nFile = 0; nFile < s_PrefetchedMapFiles.Count(); nFile++ )
+		{
+			if( !V_stricmp( s_PrefetchedMapFiles[ nFile ].m_szFileName, InstancePath ) )
+			{
+				break;
+			}
+		}
+
+		if( nFile == s_PrefetchedMapFiles.Count() )
+		{
+			nFile = s_PrefetchedMapFiles.AddToTail();
+			V_strncpy( s_PrefetchedMapFiles[ nFile ].m_szFileName, InstancePath, MAX_PATH );
+			s_PrefetchedMapFiles[ nFile ].m_pTokens = NULL;
+			s_PrefetchedMapFiles[ nFile ].m_bLoaded = false;
+			s_PrefetchedMapFiles[ nFile ].m_nUses = 0;
+		}
+
+		s_PrefetchedMapFiles[ nFile ].m_nUses++;
+	}
+
+	RunVMFLoadThreads( g_nVMFLoadThreads, s_PrefetchedMapFiles.Count(), PrefetchMapFile_Thread );
+
+	// LoadMapFile reports the ones that couldn't be read
+	for( int i = s_PrefetchedMapFiles.Count() - 1; i >= 0; i-- )
+	{
+		if( !s_PrefetchedMapFiles[ i ].m_bLoaded )
+		{
+			delete s_PrefetchedMapFiles[ i ].m_pTokens;
+			s_PrefetchedMapFiles.Remove( i );
+		}
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: this function will set a secondary lookup path for instances.
 // Input  : pszInstancePath - the secondary lookup path
@@ -2223,22 +2433,27 @@ void CMapFile::CheckForInstances( const char* pszFileName )
 
 	// this list will grow as instances are merged onto it.  sub-instances are merged and
 	// automatically done in this processing.
+	int nPrefetched = 0;
 	for( int i = 0; i < num_entities; i++ )
 	{
 		char* pEntity = ValueForKey( &entities[ i ], "classname" );
 		if( !strcmp( pEntity, "func_instance" ) )
 		{
+			// Read this and every other instance known so far in one go. The
+			// ones merged in by them are read when the loop gets to them.
+			if( i >= nPrefetched )
+			{
+				PrefetchInstances( pszFileName, i );
+				nPrefetched = num_entities;
+			}
+
 			char* pInstanceFile = ValueForKey( &entities[ i ], "file" );
 			if( pInstanceFile[ 0 ] )
 			{
 				char	InstancePath[ MAX_PATH ];
 				bool	bLoaded = false;
 
-#ifdef MAPBASE
-				if( DeterminePath( pszFileName, pInstanceFile, InstancePath ) || DeterminePath( g_MainMapPath, pInstanceFile, InstancePath ) )
-#else
-				if( DeterminePath( pszFileName, pInstanceFile, InstancePath ) )
-#endif
+				if( FindInstanceFile( pszFileName, pInstanceFile, InstancePath ) )
 				{
 					if( LoadMapFile( InstancePath ) )
 					{
@@ -2261,6 +2476,8 @@ void CMapFile::CheckForInstances( const char* pszFileName )
 		}
 	}
 
+	FreePrefetchedMapFiles();
+
 	g_LoadingMap = this;
 }
 
@@ -2882,7 +3099,7 @@ bool LoadMapFile( const char* pszFileName )
 		// Open the file.
 		//
 		CChunkFile File;
-		eResult = File.Open( pszFileName, ChunkFile_Read );
+		CChunkFileTokens* pTokens = OpenMapFile( File, pszFileName, eResult );
 
 		//
 		// Read the file.
@@ -2926,6 +3143,8 @@ bool LoadMapFile( const char* pszFileName )
 			}
 
 			File.PopHandlers();
+			File.Close();
+			ReleaseMapFileTokens( pTokens );
 		}
 		else
 		{
@@ -3048,6 +3267,236 @@ bool LoadMapFile( const char* pszFileName )
 	return ( ( eResult == ChunkFile_Ok ) || ( eResult == ChunkFile_EOF ) );
 }
 
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes a 64 unit cube for the map loading benchmark.
+//-----------------------------------------------------------------------------
+static void WriteVMFLoadBenchSolid( CChunkFile& File, int& nID, int nSolid )
+{
+	Vector vecMins( ( nSolid % 256 ) * 64.0f - 8192.0f, ( ( nSolid / 256 ) % 256 ) * 64.0f - 8192.0f, ( nSolid / 65536 ) * 64.0f );
+	Vector vecMaxs = vecMins + Vector( 64, 64, 64 );
+
+	File.BeginChunk( "solid" );
+	File.WriteKeyValueInt( "id", nID++ );
+
+	for( int nSide = 0; nSide < 6; nSide++ )
+	{
+		int nAxis = nSide >> 1;
+		Vector vecPoints[3];
+		for( int i = 0; i < 3; i++ )
+		{
+			vecPoints[i] = vecMins;
+			vecPoints[i][nAxis] = ( nSide & 1 ) ? vecMaxs[nAxis] : vecMins[nAxis];
+		}
+		vecPoints[1][( nAxis + 1 ) % 3] = vecMaxs[( nAxis + 1 ) % 3];
+		vecPoints[2][( nAxis + 2 ) % 3] = vecMaxs[( nAxis + 2 ) % 3];
+
+		char szPlane[MAX_KEYVALUE_LEN];
+		Q_snprintf( szPlane, sizeof( szPlane ), "(%g %g %g) (%g %g %g) (%g %g %g)",
+					( double )vecPoints[0].x, ( double )vecPoints[0].y, ( double )vecPoints[0].z,
+					( double )vecPoints[1].x, ( double )vecPoints[1].y, ( double )vecPoints[1].z,
+					( double )vecPoints[2].x, ( double )vecPoints[2].y, ( double )vecPoints[2].z );
+
+		File.BeginChunk( "side" );
+		File.WriteKeyValueInt( "id", nID++ );
+		File.WriteKeyValue( "plane", szPlane );
+		File.WriteKeyValue( "material", "DEV/DEV_MEASUREGENERIC01B" );
+		File.WriteKeyValue( "uaxis", "[1 0 0 0] 0.25" );
+		File.WriteKeyValue( "vaxis", "[0 -1 0 0] 0.25" );
+		File.WriteKeyValueInt( "rotation", 0 );
+		File.WriteKeyValueInt( "lightmapscale", 16 );
+		File.WriteKeyValueInt( "smoothing_groups", 0 );
+		File.EndChunk();
+	}
+
+	File.BeginChunk( "editor" );
+	File.WriteKeyValue( "color", "0 175 108" );
+	File.WriteKeyValueInt( "visgroupshown", 1 );
+	File.WriteKeyValueInt( "visgroupautoshown", 1 );
+	File.EndChunk();
+
+	File.EndChunk();
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes a map of about nMegabytes for the map loading benchmark:
+//			world brushes, then a mix of brush and point entities.
+//-----------------------------------------------------------------------------
+static bool WriteVMFLoadBenchFile( const char* pszFileName, int nMegabytes )
+{
+	CChunkFile File;
+	if( File.Open( pszFileName, ChunkFile_Write ) != ChunkFile_Ok )
+	{
+		return false;
+	}
+
+	File.BeginChunk( "versioninfo" );
+	File.WriteKeyValueInt( "editorversion", 400 );
+	File.WriteKeyValueInt( "mapversion", 1 );
+	File.WriteKeyValueInt( "formatversion", 100 );
+	File.WriteKeyValueInt( "prefab", 0 );
+	File.EndChunk();
+
+	// A solid comes to about 1.6k; a fifth of them go to entities
+	int nSolids = MAX( nMegabytes * 1024 * 1024 / 1600, 1 );
+	int nWorldSolids = nSolids * 4 / 5;
+	int nID = 1;
+
+	File.BeginChunk( "world" );
+	File.WriteKeyValueInt( "id", nID++ );
+	File.WriteKeyValueInt( "mapversion", 1 );
+	File.WriteKeyValue( "classname", "worldspawn" );
+	File.WriteKeyValue( "skyname", "sky_day01_01" );
+	for( int i = 0; i < nWorldSolids; i++ )
+	{
+		WriteVMFLoadBenchSolid( File, nID, i );
+	}
+	File.EndChunk();
+
+	for( int i = nWorldSolids; i < nSolids; i++ )
+	{
+		char szName[64];
+		Q_snprintf( szName, sizeof( szName ), "bench_%d", i );
+
+		File.BeginChunk( "entity" );
+		File.WriteKeyValueInt( "id", nID++ );
+		File.WriteKeyValue( "targetname", szName );
+
+		if( i & 1 )
+		{
+			File.WriteKeyValue( "classname", "func_brush" );
+			File.WriteKeyValueInt( "solidity", 0 );
+			WriteVMFLoadBenchSolid( File, nID, i );
+		}
+		else
+		{
+			File.WriteKeyValue( "classname", "logic_relay" );
+			File.WriteKeyValue( "origin", "0 0 64" );
+
+			File.BeginChunk( "connections" );
+			File.WriteKeyValue( "OnTrigger", "bench_1,Toggle,,0,-1" );
+			File.WriteKeyValue( "OnTrigger", "!self,Disable,,0.5,1" );
+			File.EndChunk();
+		}
+
+		File.EndChunk();
+	}
+
+	File.Close();
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads every term in the file, like the handlers would.
+//-----------------------------------------------------------------------------
+static int ReadVMFLoadBenchTerms( CChunkFile& File )
+{
+	char szName[MAX_KEYVALUE_LEN];
+	char szValue[MAX_KEYVALUE_LEN];
+	ChunkType_t eChunkType;
+	ChunkFileResult_t eResult;
+	int nTerms = 0;
+
+	while( ( ( eResult = File.ReadNext( szName, szValue, sizeof( szValue ), eChunkType ) ) == ChunkFile_Ok ) || ( eResult == ChunkFile_EndOfChunk ) )
+	{
+		nTerms++;
+	}
+
+	return nTerms;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: -vmfloadbench: times TokenReader against reading from memory on one
+//			thread and on g_nVMFLoadThreads, on a generated map, and checks
+//			that both return the same terms.
+//-----------------------------------------------------------------------------
+void RunVMFLoadBenchmark( int nMegabytes )
+{
+	const char* pszFileName = "vmfloadbench.vmf";
+
+	Msg( "Writing a %d MB map to %s...\n", nMegabytes, pszFileName );
+	if( !WriteVMFLoadBenchFile( pszFileName, nMegabytes ) )
+	{
+		Warning( "Couldn't write %s.\n", pszFileName );
+		return;
+	}
+
+	double flStart = Plat_FloatTime();
+	int nLegacyTerms;
+	{
+		CChunkFile File;
+		File.Open( pszFileName, ChunkFile_Read );
+		nLegacyTerms = ReadVMFLoadBenchTerms( File );
+	}
+	Msg( "TokenReader:           %.3f seconds, %d terms\n", Plat_FloatTime() - flStart, nLegacyTerms );
+
+	for( int nPass = 0; nPass < 2; nPass++ )
+	{
+		int nThreads = nPass ? g_nVMFLoadThreads : 1;
+
+		flStart = Plat_FloatTime();
+		CChunkFileTokens Tokens;
+		Tokens.Load( pszFileName );
+		double flLoaded = Plat_FloatTime();
+
+		s_pTokenizingMapFile = &Tokens;
+		RunVMFLoadThreads( nThreads, Tokens.GetSegmentCount(), TokenizeMapFileSegment_Thread );
+		s_pTokenizingMapFile = NULL;
+		double flTokenized = Plat_FloatTime();
+
+		CChunkFile File;
+		File.Open( &Tokens );
+		int nTerms = ReadVMFLoadBenchTerms( File );
+		double flEnd = Plat_FloatTime();
+
+		Msg( "Memory, %2d thread(s):  %.3f seconds (read %.3f, tokenize %.3f, parse %.3f), %d terms\n",
+			 nThreads, flEnd - flStart, flLoaded - flStart, flTokenized - flLoaded, flEnd - flTokenized, nTerms );
+	}
+
+	//
+	// Both have to return the same terms, errors included.
+	//
+	CChunkFile Legacy;
+	CChunkFile Buffered;
+	CChunkFileTokens Tokens;
+	Legacy.Open( pszFileName, ChunkFile_Read );
+	Tokens.Load( pszFileName );
+	Buffered.Open( &Tokens );
+
+	int nTerm = 0;
+	while( true )
+	{
+		char szLegacyName[MAX_KEYVALUE_LEN], szLegacyValue[MAX_KEYVALUE_LEN];
+		char szName[MAX_KEYVALUE_LEN], szValue[MAX_KEYVALUE_LEN];
+		ChunkType_t eLegacyType, eType;
+
+		ChunkFileResult_t eLegacyResult = Legacy.ReadNext( szLegacyName, szLegacyValue, sizeof( szLegacyValue ), eLegacyType );
+		ChunkFileResult_t eResult = Buffered.ReadNext( szName, szValue, sizeof( szValue ), eType );
+
+		if( ( eLegacyResult != eResult ) ||
+			( ( eResult == ChunkFile_Ok ) && ( ( eLegacyType != eType ) || V_strcmp( szLegacyName, szName ) || V_strcmp( szLegacyValue, szValue ) ) ) )
+		{
+			Warning( "Term %d differs: \"%s\" \"%s\" (%d) from TokenReader, \"%s\" \"%s\" (%d) from memory.\n",
+					 nTerm, szLegacyName, szLegacyValue, eLegacyResult, szName, szValue, eResult );
+			break;
+		}
+
+		if( ( eResult != ChunkFile_Ok ) && ( eResult != ChunkFile_EndOfChunk ) )
+		{
+			Msg( "All %d terms match.\n", nTerm );
+			break;
+		}
+
+		nTerm++;
+	}
+
+	Legacy.Close();
+	remove( pszFileName );
+}
+
 ChunkFileResult_t LoadSideCallback( CChunkFile* pFile, LoadSide_t* pSideInfo )
 {
 	return g_LoadingMap->LoadSideCallback( pFile, pSideInfo );
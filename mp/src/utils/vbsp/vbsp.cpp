@@ -963,6 +963,8 @@ int RunVBSP( int argc, char** argv )
 	int		i;
 	double		start, end;
 	char		path[1024];
+	int			nVMFLoadBenchMegabytes = 0;
+	int			nPakBenchMegabytes = 0;
 
 	CommandLine()->CreateCmdLine( argc, argv );
 	MathLib_Init( 2.2f, 2.2f, 0.0f, OVERBRIGHT, false, true, true, false );
@@ -1221,6 +1223,18 @@ int RunVBSP( int argc, char** argv )
 		{
 			g_NodrawTriggers = true;
 		}
+		else if( !Q_stricmp( argv[i], "-legacyvmfload" ) )
+		{
+			g_bLegacyVMFLoad = true;
+		}
+		else if( !Q_stricmp( argv[i], "-vmfloadbench" ) && i < argc - 1 )
+		{
+			nVMFLoadBenchMegabytes = atoi( argv[++i] );
+		}
+		else if( !Q_stricmp( argv[i], "-pakbench" ) && i < argc - 1 )
+		{
+			nPakBenchMegabytes = atoi( argv[++i] );
+		}
 		else if( !Q_stricmp( argv[i], "-FullMinidumps" ) )
 		{
 			EnableFullMinidumps( true );
@@ -1352,6 +1366,27 @@ int RunVBSP( int argc, char** argv )
 		}
 	}
 
+	if( nVMFLoadBenchMegabytes > 0 )
+	{
+		ThreadSetDefault();
+		g_nVMFLoadThreads = numthreads;
+		RunVMFLoadBenchmark( nVMFLoadBenchMegabytes );
+
+		DeleteCmdLine( argc, argv );
+		CmdLib_Cleanup();
+		CmdLib_Exit( 0 );
+	}
+
+	if( nPakBenchMegabytes > 0 )
+	{
+		ThreadSetDefault();
+		RunPakFileBenchmark( nPakBenchMegabytes, numthreads );
+
+		DeleteCmdLine( argc, argv );
+		CmdLib_Cleanup();
+		CmdLib_Exit( 0 );
+	}
+
 	if( i != argc - 1 )
 	{
 		PrintCommandLine( argc, argv );
@@ -1431,6 +1466,14 @@ int RunVBSP( int argc, char** argv )
 				"  -x360		   : Generate Xbox360 version of vsp\n"
 				"  -nox360		   : Disable generation Xbox360 version of vsp (default)\n"
 				"  -replacematerials : Substitute materials according to materialsub.txt in content\\maps\n"
+				"  -legacyvmfload  : Read the .vmf and its instances a token at a time from disk\n"
+				"                    instead of tokenizing them in memory on all threads.\n"
+				"  -vmfloadbench <MB> : Write a test map of about <MB> megabytes, time loading it\n"
+				"                    both ways, check they read the same, and exit.\n"
+				"                    mapfile is only used to find the game.\n"
+				"  -pakbench <MB>  : Save a pak of about <MB> megabytes of test files on one\n"
+				"                    thread and on all threads, time both, check they give\n"
+				"                    the same bytes, and exit.\n"
 				"  -FullMinidumps  : Write large minidumps on crash.\n"
 #ifdef MAPBASE
 				"  -insert_search_path <directory> : Includes an extra base directory for mounting additional content.\n"
@@ -1477,8 +1520,14 @@ int RunVBSP( int argc, char** argv )
 	}
 
 	ThreadSetDefault();
+	g_nVMFLoadThreads = numthreads;		// map loading still gets them
 	numthreads = 1;		// multiple threads aren't helping...
 
+	// So does the pakfile. Files re-added unchanged over a loaded pak (-onlyents, -keepstalezip)
+	// keep their stored data.
+	GetPakFile()->SetCompressionThreads( g_nVMFLoadThreads );
+	GetPakFile()->SetReuseUnchangedEntries( true );
+
 	// Setup the logfile.
 	char logFile[512];
 	_snprintf( logFile, sizeof( logFile ), "%s.log", g_source );
@@ -300,6 +300,7 @@ public:
 	static bool			DeterminePath( const char* pszBaseFileName, const char* pszInstanceFileName, char* pszOutFileName );
 
 	void				CheckForInstances( const char* pszFileName );
+	void				PrefetchInstances( const char* pszFileName, int nFirstEntity );
 	void				MergeInstance( entity_t* pInstanceEntity, CMapFile* Instance );
 	void				MergePlanes( entity_t* pInstanceEntity, CMapFile* Instance, Vector& InstanceOrigin, QAngle& InstanceAngle, matrix3x4_t& InstanceMatrix );
 	void				MergeBrushes( entity_t* pInstanceEntity, CMapFile* Instance, Vector& InstanceOrigin, QAngle& InstanceAngle, matrix3x4_t& InstanceMatrix );
@@ -443,7 +444,11 @@ extern	char	g_source[1024];
 extern char		g_mapbase[ 64 ];
 extern CUtlVector<int> g_SkyAreas;
 
+extern	bool	g_bLegacyVMFLoad;
+extern	int		g_nVMFLoadThreads;
+
 bool 	LoadMapFile( const char* pszFileName );
+void	RunVMFLoadBenchmark( int nMegabytes );
 int		GetVertexnum( Vector& v );
 bool Is3DSkyboxArea( int area );
 
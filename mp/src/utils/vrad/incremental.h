@@ -172,5 +172,8 @@ private:
 };
 
 
+// True if the two lights would light the world the same way
+bool CompareLights( dworldlight_t* a, dworldlight_t* b );
+
 
 #endif // INCREMENTAL_H
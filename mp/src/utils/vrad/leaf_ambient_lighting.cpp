@@ -97,26 +97,41 @@ float Engine_WorldLightDistanceFalloff( const dworldlight_t* wl, const Vector& d
 }
 
 
-void AddEmitSurfaceLights( const Vector& vStart, Vector lightBoxColor[6] )
+// The lights with DWL_FLAGS_INAMBIENTCUBE, gathered once before any leaf is lit
+static CUtlVector<dworldlight_t*> s_AmbientCubeLights;
+
+// this stores each sample of the ambient lighting
+struct ambientsample_t
 {
+	Vector pos;
+	Vector cube[6];
+};
+
+// Adds the emit_surface lights to up to four samples. Each light is tested
+// against all of them with one packet of rays.
+void AddEmitSurfaceLights( ambientsample_t* pSamples, int nSamples )
+{
+	Assert( nSamples > 0 && nSamples <= 4 );
+
 	fltx4 fractionVisible;
 
 	FourVectors vStart4, wlOrigin4;
-	vStart4.DuplicateVector( vStart );
-
-	for( int iLight = 0; iLight < *pNumworldlights; iLight++ )
+	for( int i = 0; i < 4; i++ )
 	{
-		dworldlight_t* wl = &dworldlights[iLight];
+		// a short packet repeats its last sample
+		const Vector& vStart = pSamples[ min( i, nSamples - 1 ) ].pos;
+		vStart4.X( i ) = vStart.x;
+		vStart4.Y( i ) = vStart.y;
+		vStart4.Z( i ) = vStart.z;
+	}
 
-		// Should this light even go in the ambient cubes?
-		if( !( wl->flags & DWL_FLAGS_INAMBIENTCUBE ) )
-		{
-			continue;
-		}
+	for( int iLight = 0; iLight < s_AmbientCubeLights.Count(); iLight++ )
+	{
+		dworldlight_t* wl = s_AmbientCubeLights[iLight];
 
 		Assert( wl->type == emit_surface );
 
-		// Can this light see the point?
+		// Can this light see any of the points?
 		wlOrigin4.DuplicateVector( wl->origin );
 		TestLine( vStart4, wlOrigin4, &fractionVisible );
 		if( !TestSignSIMD( CmpGtSIMD( fractionVisible, Four_Zeros ) ) )
@@ -124,26 +139,32 @@ void AddEmitSurfaceLights( const Vector& vStart, Vector lightBoxColor[6] )
 			continue;
 		}
 
-		// Add this light's contribution.
-		Vector vDelta = wl->origin - vStart;
-		float flDistanceScale = Engine_WorldLightDistanceFalloff( wl, vDelta );
+		for( int nSample = 0; nSample < nSamples; nSample++ )
+		{
+			const Vector& vStart = pSamples[nSample].pos;
+			Vector* lightBoxColor = pSamples[nSample].cube;
 
-		Vector vDeltaNorm = vDelta;
-		VectorNormalize( vDeltaNorm );
-		float flAngleScale = Engine_WorldLightAngle( wl, wl->normal, vDeltaNorm, vDeltaNorm );
+			// Add this light's contribution.
+			Vector vDelta = wl->origin - vStart;
+			float flDistanceScale = Engine_WorldLightDistanceFalloff( wl, vDelta );
 
-		float ratio = flDistanceScale * flAngleScale * SubFloat( fractionVisible, 0 );
-		if( ratio == 0 )
-		{
-			continue;
-		}
+			Vector vDeltaNorm = vDelta;
+			VectorNormalize( vDeltaNorm );
+			float flAngleScale = Engine_WorldLightAngle( wl, wl->normal, vDeltaNorm, vDeltaNorm );
 
-		for( int i = 0; i < 6; i++ )
-		{
-			float t = DotProduct( g_BoxDirections[i], vDeltaNorm );
-			if( t > 0 )
+			float ratio = flDistanceScale * flAngleScale * SubFloat( fractionVisible, nSample );
+			if( ratio == 0 )
 			{
-				lightBoxColor[i] += wl->intensity * ( t * ratio );
+				continue;
+			}
+
+			for( int i = 0; i < 6; i++ )
+			{
+				float t = DotProduct( g_BoxDirections[i], vDeltaNorm );
+				if( t > 0 )
+				{
+					lightBoxColor[i] += wl->intensity * ( t * ratio );
+				}
 			}
 		}
 	}
@@ -187,10 +208,6 @@ void ComputeAmbientFromSphericalSamples( int iThread, const Vector& vStart, Vect
 
 		lightBoxColor[j] *= 1 / t;
 	}
-
-	// Now add direct light from the emit_surface lights. These go in the ambient cube because
-	// there are a ton of them and they are often so dim that they get filtered out by r_worldlightmin.
-	AddEmitSurfaceLights( vStart, lightBoxColor );
 }
 
 
@@ -256,24 +273,30 @@ public:
 				continue;
 			}
 
+			// Cast to the six faces of the leaf bounds in one batch
+			Vector ends[6];
+			float t[6];
+			Vector normals[6];
 			for( int j = 0; j < 6; j++ )
 			{
-				Vector start = samplePosition;
+				ends[j] = samplePosition;
 				int axis = j % 3;
-				start[axis] = ( j < 3 ) ? pLeaf->mins[axis] : pLeaf->maxs[axis];
-				float t;
-				Vector normal;
-				CastRayInLeaf( m_iThread, samplePosition, start, leafIndex, &t, &normal );
-				if( t == 0.0f )
+				ends[j][axis] = ( j < 3 ) ? pLeaf->mins[axis] : pLeaf->maxs[axis];
+			}
+			CastRaysInLeaf( m_iThread, samplePosition, ends, 6, leafIndex, t, normals );
+
+			for( int j = 0; j < 6; j++ )
+			{
+				if( t[j] == 0.0f )
 				{
 					// inside a func_detail, try again.
 					bValid = false;
 					break;
 				}
-				if( t != 1.0f )
+				if( t[j] != 1.0f )
 				{
-					Vector delta = start - samplePosition;
-					if( DotProduct( delta, normal ) > 0 )
+					Vector delta = ends[j] - samplePosition;
+					if( DotProduct( delta, normals[j] ) > 0 )
 					{
 						// hit backside of displacement, try again.
 						bValid = false;
@@ -322,13 +345,6 @@ void GetLeafBoundaryPlanes( CUtlVector<dplane_t>& list, int leafIndex )
 	}
 }
 
-// this stores each sample of the ambient lighting
-struct ambientsample_t
-{
-	Vector pos;
-	Vector cube[6];
-};
-
 // add the sample to the list.  If we exceed the maximum number of samples, the worst sample will
 // be discarded.  This has the effect of converging on the best samples when enough are added.
 void AddSampleToList( CUtlVector<ambientsample_t>& list, const Vector& samplePosition, Vector* pCube )
@@ -582,15 +598,26 @@ void ComputeAmbientForLeaf( int iThread, int leafID, CUtlVector<ambientsample_t>
 		// NOTE: We copy the nearest non-solid leaf sample pointers into this leaf at the end
 		return;
 	}
-	Vector cube[6];
+	// compute every candidate sample first so the light tests can share ray packets
+	CUtlVector<ambientsample_t> samples;
+	samples.SetCount( sampleCount );
+	for( int i = 0; i < sampleCount; i++ )
+	{
+		sampler.GenerateLeafSamplePosition( leafID, leafPlanes, samples[i].pos );
+		ComputeAmbientFromSphericalSamples( iThread, samples[i].pos, samples[i].cube );
+	}
+
+	// Now add direct light from the emit_surface lights. These go in the ambient cube because
+	// there are a ton of them and they are often so dim that they get filtered out by r_worldlightmin.
+	for( int i = 0; i < sampleCount; i += 4 )
+	{
+		AddEmitSurfaceLights( samples.Base() + i, min( sampleCount - i, 4 ) );
+	}
+
 	for( int i = 0; i < sampleCount; i++ )
 	{
-		// compute each candidate sample and add to the list
-		Vector samplePosition;
-		sampler.GenerateLeafSamplePosition( leafID, leafPlanes, samplePosition );
-		ComputeAmbientFromSphericalSamples( iThread, samplePosition, cube );
 		// note this will remove the least valuable sample once the limit is reached
-		AddSampleToList( list, samplePosition, cube );
+		AddSampleToList( list, samples[i].pos, samples[i].cube );
 	}
 
 	// remove any samples that can be reconstructed with the remaining data
@@ -678,6 +705,7 @@ void ComputePerLeafAmbientLighting()
 		if( wl->flags & DWL_FLAGS_INAMBIENTCUBE )
 		{
 			++nInAmbientCube;
+			s_AmbientCubeLights.AddToTail( wl );
 		}
 	}
 
@@ -687,6 +715,8 @@ void ComputePerLeafAmbientLighting()
 
 	RunThreadsOn( numleafs, true, ThreadComputeLeafAmbient );
 
+	s_AmbientCubeLights.Purge();
+
 	// now write out the data
 	Msg( "Writing leaf ambient..." );
 	g_pLeafAmbientIndex->RemoveAll();
@@ -0,0 +1,512 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Keeps each face's direct lighting between compiles so only faces
+//			that a changed light can reach get relit.
+//
+// $NoKeywords: $
+//=============================================================================//
+#include "lightcache.h"
+#include "incremental.h"
+#include "gamebspfile.h"
+#include "filesystem.h"
+
+
+CLightCache* g_pLightCache = NULL;
+
+
+// -------------------------------------------------------------------------------- //
+// CLightCache.
+// -------------------------------------------------------------------------------- //
+
+CLightCache::CLightCache()
+{
+	m_pFilename = NULL;
+	m_OptionsCRC = 0;
+}
+
+
+void CLightCache::Init( char const* pCacheFilename, char const* pOptions )
+{
+	m_pFilename = pCacheFilename;
+	m_OptionsCRC = CRC32_ProcessSingleBuffer( pOptions, V_strlen( pOptions ) );
+}
+
+
+//-----------------------------------------------------------------------------
+// Everything other than the lights that direct lighting depends on: the faces
+// and their lightmap layout, plus everything that casts shadows.
+//-----------------------------------------------------------------------------
+CRC32_t CLightCache::ComputeGeometryCRC()
+{
+	CRC32_t crc;
+	CRC32_Init( &crc );
+
+	CRC32_ProcessBuffer( &crc, dvertexes, numvertexes * sizeof( dvertex_t ) );
+	CRC32_ProcessBuffer( &crc, dplanes, numplanes * sizeof( dplane_t ) );
+	CRC32_ProcessBuffer( &crc, dedges, numedges * sizeof( dedge_t ) );
+	CRC32_ProcessBuffer( &crc, dsurfedges, numsurfedges * sizeof( int ) );
+	CRC32_ProcessBuffer( &crc, texinfo.Base(), texinfo.Count() * sizeof( texinfo_t ) );
+	CRC32_ProcessBuffer( &crc, dmodels, nummodels * sizeof( dmodel_t ) );
+	CRC32_ProcessBuffer( &crc, dbrushes, numbrushes * sizeof( dbrush_t ) );
+	CRC32_ProcessBuffer( &crc, dbrushsides, numbrushsides * sizeof( dbrushside_t ) );
+	CRC32_ProcessBuffer( &crc, g_dispinfo.Base(), g_dispinfo.Count() * sizeof( ddispinfo_t ) );
+	CRC32_ProcessBuffer( &crc, g_DispVerts.Base(), g_DispVerts.Count() * sizeof( CDispVert ) );
+
+	// dface_t also holds this compile's lighting results, so only take the layout
+	for( int i = 0; i < numfaces; i++ )
+	{
+		dface_t const* f = &g_pFaces[i];
+		CRC32_ProcessBuffer( &crc, &f->planenum, sizeof( f->planenum ) );
+		CRC32_ProcessBuffer( &crc, &f->side, sizeof( f->side ) );
+		CRC32_ProcessBuffer( &crc, &f->firstedge, sizeof( f->firstedge ) );
+		CRC32_ProcessBuffer( &crc, &f->numedges, sizeof( f->numedges ) );
+		CRC32_ProcessBuffer( &crc, &f->texinfo, sizeof( f->texinfo ) );
+		CRC32_ProcessBuffer( &crc, &f->dispinfo, sizeof( f->dispinfo ) );
+		CRC32_ProcessBuffer( &crc, &f->smoothingGroups, sizeof( f->smoothingGroups ) );
+		CRC32_ProcessBuffer( &crc, f->m_LightmapTextureMinsInLuxels, sizeof( f->m_LightmapTextureMinsInLuxels ) );
+		CRC32_ProcessBuffer( &crc, f->m_LightmapTextureSizeInLuxels, sizeof( f->m_LightmapTextureSizeInLuxels ) );
+	}
+
+	GameLumpHandle_t hStaticProps = g_GameLumps.GetGameLumpHandle( GAMELUMP_STATIC_PROPS );
+	if( hStaticProps != g_GameLumps.InvalidGameLump() )
+	{
+		CRC32_ProcessBuffer( &crc, g_GameLumps.GetGameLump( hStaticProps ), g_GameLumps.GameLumpSize( hStaticProps ) );
+	}
+
+	CRC32_Final( &crc );
+	return crc;
+}
+
+
+void CLightCache::CaptureLight( directlight_t* dl, CachedLight_t* pOut )
+{
+	pOut->m_Light = dl->light;
+	pOut->m_flStartFadeDistance = dl->m_flStartFadeDistance;
+	pOut->m_flEndFadeDistance = dl->m_flEndFadeDistance;
+	pOut->m_flCapDist = dl->m_flCapDist;
+	pOut->m_bValid = true;
+}
+
+
+bool CLightCache::LightsMatch( CachedLight_t const& a, CachedLight_t const& b )
+{
+	if( !a.m_bValid || !b.m_bValid )
+	{
+		return false;
+	}
+
+	return CompareLights( const_cast<dworldlight_t*>( &a.m_Light ), const_cast<dworldlight_t*>( &b.m_Light ) ) &&
+		   a.m_Light.type == b.m_Light.type && a.m_Light.style == b.m_Light.style &&
+		   a.m_flStartFadeDistance == b.m_flStartFadeDistance &&
+		   a.m_flEndFadeDistance == b.m_flEndFadeDistance &&
+		   a.m_flCapDist == b.m_flCapDist;
+}
+
+
+//-----------------------------------------------------------------------------
+// Only hard falloff actually goes to zero; everything else is bounded by PVS alone
+//-----------------------------------------------------------------------------
+bool CLightCache::WithinFalloff( CachedLight_t const& light, FaceEntry_t const& face )
+{
+	if( light.m_flEndFadeDistance <= light.m_flStartFadeDistance )
+	{
+		return true;
+	}
+
+	if( light.m_Light.type == emit_skylight || light.m_Light.type == emit_skyambient )
+	{
+		return true;
+	}
+
+	Vector vecClosest;
+	CalcClosestPointOnAABB( face.m_vecMins, face.m_vecMaxs, light.m_Light.origin, vecClosest );
+	return vecClosest.DistToSqr( light.m_Light.origin ) <= light.m_flEndFadeDistance * light.m_flEndFadeDistance;
+}
+
+
+bool CLightCache::Load( CUtlVector<CachedLight_t>& oldLights )
+{
+	m_FileData.Purge();
+	if( !g_pFileSystem->ReadFile( m_pFilename, NULL, m_FileData ) )
+	{
+		return false;
+	}
+
+	int version = m_FileData.GetInt();
+	int nFaces = m_FileData.GetInt();
+	CRC32_t geometryCRC = m_FileData.GetUnsignedInt();
+	CRC32_t optionsCRC = m_FileData.GetUnsignedInt();
+	if( version != LIGHTCACHE_VERSION || nFaces != numfaces )
+	{
+		return false;
+	}
+
+	if( geometryCRC != ComputeGeometryCRC() )
+	{
+		Msg( "Light cache: geometry changed since %s was written\n", m_pFilename );
+		return false;
+	}
+
+	if( optionsCRC != m_OptionsCRC )
+	{
+		Msg( "Light cache: options changed since %s was written\n", m_pFilename );
+		return false;
+	}
+
+	int nLights = m_FileData.GetInt();
+	if( nLights < 0 || nLights * ( int )sizeof( CachedLight_t ) > m_FileData.GetBytesRemaining() )
+	{
+		return false;
+	}
+
+	oldLights.SetCount( nLights );
+	m_FileData.Get( oldLights.Base(), nLights * sizeof( CachedLight_t ) );
+
+	for( int i = 0; i < numfaces && m_FileData.IsValid(); i++ )
+	{
+		FaceEntry_t& face = m_Faces[i];
+		face.m_nNumSamples = m_FileData.GetInt();
+		if( face.m_nNumSamples < 0 )
+		{
+			continue;
+		}
+
+		face.m_nNormalCount = m_FileData.GetInt();
+		m_FileData.Get( face.m_Styles, sizeof( face.m_Styles ) );
+		m_FileData.Get( &face.m_vecMins, sizeof( Vector ) );
+		m_FileData.Get( &face.m_vecMaxs, sizeof( Vector ) );
+
+		int nClusters = m_FileData.GetInt();
+		int nFaceLights = m_FileData.GetInt();
+		if( nClusters < 0 || nFaceLights < 0 || ( nClusters + nFaceLights ) * ( int )sizeof( int ) > m_FileData.GetBytesRemaining() )
+		{
+			return false;
+		}
+
+		face.m_Clusters.SetCount( nClusters );
+		m_FileData.Get( face.m_Clusters.Base(), nClusters * sizeof( int ) );
+		face.m_Lights.SetCount( nFaceLights );
+		m_FileData.Get( face.m_Lights.Base(), nFaceLights * sizeof( int ) );
+		for( int j = 0; j < nFaceLights; j++ )
+		{
+			if( face.m_Lights[j] < 0 || face.m_Lights[j] >= nLights )
+			{
+				return false;
+			}
+		}
+
+		int nStyles = 0;
+		while( nStyles < MAXLIGHTMAPS && face.m_Styles[nStyles] != 255 )
+		{
+			++nStyles;
+		}
+
+		face.m_nDataOffset = m_FileData.TellGet();
+		m_FileData.SeekGet( CUtlBuffer::SEEK_CURRENT, nStyles * face.m_nNormalCount * face.m_nNumSamples * sizeof( LightingValue_t ) );
+	}
+
+	return m_FileData.IsValid();
+}
+
+
+//-----------------------------------------------------------------------------
+// Match this run's lights against the cached ones and decide which faces can
+// keep their direct lighting.
+//-----------------------------------------------------------------------------
+void CLightCache::PrepareForLighting()
+{
+	m_Faces.SetCount( numfaces );
+	for( int i = 0; i < numfaces; i++ )
+	{
+		m_Faces[i].m_nNumSamples = -1;
+		m_Faces[i].m_bReuse = false;
+	}
+
+	// This run's lights, by dl->index
+	CUtlVector<CachedLight_t> newLights;
+	CUtlVector<directlight_t*> newDirectLights;
+	newLights.SetCount( numdlights );
+	newDirectLights.SetCount( numdlights );
+	memset( newLights.Base(), 0, numdlights * sizeof( CachedLight_t ) );
+	memset( newDirectLights.Base(), 0, numdlights * sizeof( directlight_t* ) );
+	for( directlight_t* dl = activelights; dl != NULL; dl = dl->next )
+	{
+		CaptureLight( dl, &newLights[dl->index] );
+		newDirectLights[dl->index] = dl;
+	}
+
+	CUtlVector<CachedLight_t> oldLights;
+	if( !Load( oldLights ) )
+	{
+		Msg( "Light cache: nothing usable in %s, lighting every face\n", m_pFilename );
+		for( int i = 0; i < numfaces; i++ )
+		{
+			m_Faces[i].m_nNumSamples = -1;
+			m_Faces[i].m_Clusters.Purge();
+			m_Faces[i].m_Lights.Purge();
+		}
+		m_FileData.Purge();
+		return;
+	}
+
+	// Pair up unchanged lights. Lights usually come out in the same order, so try that first.
+	CUtlVector<int> oldToNew;
+	CUtlVector<bool> newMatched;
+	oldToNew.SetCount( oldLights.Count() );
+	newMatched.SetCount( numdlights );
+	memset( newMatched.Base(), 0, numdlights * sizeof( bool ) );
+
+	int nChanged = 0;
+	for( int i = 0; i < oldLights.Count(); i++ )
+	{
+		oldToNew[i] = -1;
+		if( !oldLights[i].m_bValid )
+		{
+			continue;
+		}
+
+		if( i < numdlights && !newMatched[i] && LightsMatch( oldLights[i], newLights[i] ) )
+		{
+			oldToNew[i] = i;
+		}
+		else
+		{
+			for( int j = 0; j < numdlights; j++ )
+			{
+				if( !newMatched[j] && LightsMatch( oldLights[i], newLights[j] ) )
+				{
+					oldToNew[i] = j;
+					break;
+				}
+			}
+		}
+
+		if( oldToNew[i] >= 0 )
+		{
+			newMatched[oldToNew[i]] = true;
+		}
+		else
+		{
+			++nChanged;
+		}
+	}
+
+	CUtlVector<directlight_t*> newUnmatched;
+	for( int j = 0; j < numdlights; j++ )
+	{
+		if( newDirectLights[j] && !newMatched[j] )
+		{
+			newUnmatched.AddToTail( newDirectLights[j] );
+		}
+	}
+	nChanged += newUnmatched.Count();
+
+	int nLitFaces = 0, nReused = 0;
+	for( int i = 0; i < numfaces; i++ )
+	{
+		FaceEntry_t& face = m_Faces[i];
+		if( face.m_nNumSamples < 0 )
+		{
+			continue;
+		}
+		++nLitFaces;
+
+		// Did a light that's gone or different reach this face?
+		bool bReuse = true;
+		for( int j = 0; bReuse && j < face.m_Lights.Count(); j++ )
+		{
+			int iOld = face.m_Lights[j];
+			if( oldToNew[iOld] < 0 && WithinFalloff( oldLights[iOld], face ) )
+			{
+				bReuse = false;
+			}
+		}
+
+		// Does a new or different light reach it now?
+		CUtlVector<int> pvsLights;
+		for( int j = 0; bReuse && j < newUnmatched.Count(); j++ )
+		{
+			directlight_t* dl = newUnmatched[j];
+			for( int k = 0; k < face.m_Clusters.Count(); k++ )
+			{
+				if( PVSCheck( dl->pvs, face.m_Clusters[k] ) )
+				{
+					if( WithinFalloff( newLights[dl->index], face ) )
+					{
+						bReuse = false;
+					}
+					pvsLights.AddToTail( dl->index );
+					break;
+				}
+			}
+		}
+
+		face.m_bReuse = bReuse;
+		if( bReuse )
+		{
+			// Keep the light list the same as gathering would have made it
+			int nKept = 0;
+			for( int j = 0; j < face.m_Lights.Count(); j++ )
+			{
+				int iNew = oldToNew[face.m_Lights[j]];
+				if( iNew >= 0 )
+				{
+					face.m_Lights[nKept++] = iNew;
+				}
+			}
+			face.m_Lights.SetCountNonDestructively( nKept );
+			face.m_Lights.AddVectorToTail( pvsLights );
+			++nReused;
+		}
+		else
+		{
+			face.m_Clusters.RemoveAll();
+			face.m_Lights.RemoveAll();
+		}
+	}
+
+	Msg( "Light cache: %d lights changed, reusing direct lighting on %d of %d faces\n", nChanged, nReused, nLitFaces );
+}
+
+
+bool CLightCache::RestoreFace( int facenum, dface_t* f, facelight_t* fl, int normalCount )
+{
+	FaceEntry_t& face = m_Faces[facenum];
+	if( !face.m_bReuse )
+	{
+		return false;
+	}
+
+	if( face.m_nNumSamples != fl->numsamples || face.m_nNormalCount != normalCount || face.m_Styles[0] != 0 )
+	{
+		// Sampling came out differently, so light it from scratch
+		face.m_bReuse = false;
+		face.m_Clusters.RemoveAll();
+		face.m_Lights.RemoveAll();
+		return false;
+	}
+
+	int nBytes = fl->numsamples * sizeof( LightingValue_t );
+	byte const* pData = ( byte const* )m_FileData.Base() + face.m_nDataOffset;
+	for( int k = 0; k < MAXLIGHTMAPS && face.m_Styles[k] != 255; k++ )
+	{
+		f->styles[k] = face.m_Styles[k];
+		for( int n = 0; n < normalCount; n++ )
+		{
+			if( !fl->light[k][n] )
+			{
+				fl->light[k][n] = ( LightingValue_t* )calloc( fl->numsamples, sizeof( LightingValue_t ) );
+			}
+			memcpy( fl->light[k][n], pData, nBytes );
+			pData += nBytes;
+		}
+	}
+
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Only one thread works on a face at a time, so these don't need to lock
+//-----------------------------------------------------------------------------
+void CLightCache::AddSampleClusters( int facenum, int const* pClusters, int nClusters )
+{
+	CUtlVector<int>& clusters = m_Faces[facenum].m_Clusters;
+	for( int i = 0; i < nClusters; i++ )
+	{
+		if( pClusters[i] >= 0 && clusters.Find( pClusters[i] ) == clusters.InvalidIndex() )
+		{
+			clusters.AddToTail( pClusters[i] );
+		}
+	}
+}
+
+void CLightCache::AddLightToFace( int facenum, directlight_t* dl )
+{
+	CUtlVector<int>& lights = m_Faces[facenum].m_Lights;
+	if( lights.Count() && lights.Tail() == dl->index )
+	{
+		return;
+	}
+
+	if( lights.Find( dl->index ) == lights.InvalidIndex() )
+	{
+		lights.AddToTail( dl->index );
+	}
+}
+
+
+bool CLightCache::Save()
+{
+	CUtlBuffer buf;
+	buf.PutInt( LIGHTCACHE_VERSION );
+	buf.PutInt( numfaces );
+	buf.PutUnsignedInt( ComputeGeometryCRC() );
+	buf.PutUnsignedInt( m_OptionsCRC );
+
+	buf.PutInt( numdlights );
+	for( int i = 0; i < numdlights; i++ )
+	{
+		CachedLight_t light;
+		memset( &light, 0, sizeof( light ) );
+		for( directlight_t* dl = activelights; dl != NULL; dl = dl->next )
+		{
+			if( dl->index == i )
+			{
+				CaptureLight( dl, &light );
+				break;
+			}
+		}
+		buf.Put( &light, sizeof( light ) );
+	}
+
+	for( int facenum = 0; facenum < numfaces; facenum++ )
+	{
+		dface_t* f = &g_pFaces[facenum];
+		facelight_t* fl = &facelight[facenum];
+		if( f->styles[0] == 255 || fl->numsamples <= 0 || !fl->light[0][0] )
+		{
+			buf.PutInt( -1 );
+			continue;
+		}
+
+		FaceEntry_t const& face = m_Faces[facenum];
+		int normalCount = ( texinfo[f->texinfo].flags & SURF_BUMPLIGHT ) ? NUM_BUMP_VECTS + 1 : 1;
+
+		Vector vecMins, vecMaxs;
+		ClearBounds( vecMins, vecMaxs );
+		for( int i = 0; i < fl->numsamples; i++ )
+		{
+			AddPointToBounds( fl->sample[i].pos, vecMins, vecMaxs );
+		}
+
+		buf.PutInt( fl->numsamples );
+		buf.PutInt( normalCount );
+		buf.Put( f->styles, sizeof( f->styles ) );
+		buf.Put( &vecMins, sizeof( Vector ) );
+		buf.Put( &vecMaxs, sizeof( Vector ) );
+		buf.PutInt( face.m_Clusters.Count() );
+		buf.PutInt( face.m_Lights.Count() );
+		buf.Put( face.m_Clusters.Base(), face.m_Clusters.Count() * sizeof( int ) );
+		buf.Put( face.m_Lights.Base(), face.m_Lights.Count() * sizeof( int ) );
+
+		for( int k = 0; k < MAXLIGHTMAPS && f->styles[k] != 255; k++ )
+		{
+			for( int n = 0; n < normalCount; n++ )
+			{
+				buf.Put( fl->light[k][n], fl->numsamples * sizeof( LightingValue_t ) );
+			}
+		}
+	}
+
+	m_FileData.Purge();
+
+	if( !g_pFileSystem->WriteFile( m_pFilename, NULL, buf ) )
+	{
+		Warning( "Light cache: unable to write %s\n", m_pFilename );
+		return false;
+	}
+
+	Msg( "Light cache: wrote %s (%d KB)\n", m_pFilename, buf.TellPut() / 1024 );
+	return true;
+}
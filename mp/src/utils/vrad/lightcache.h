@@ -0,0 +1,101 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Keeps each face's direct lighting between compiles so only faces
+//			that a changed light can reach get relit.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef LIGHTCACHE_H
+#define LIGHTCACHE_H
+#ifdef _WIN32
+	#pragma once
+#endif
+
+#include "utlvector.h"
+#include "utlbuffer.h"
+#include "vrad.h"
+#include "lightmap.h"
+#include "checksum_crc.h"
+
+#define LIGHTCACHE_VERSION	1
+
+
+//-----------------------------------------------------------------------------
+// The parts of a light that direct lighting depends on
+//-----------------------------------------------------------------------------
+struct CachedLight_t
+{
+	dworldlight_t	m_Light;
+	float			m_flStartFadeDistance;
+	float			m_flEndFadeDistance;
+	float			m_flCapDist;
+	int				m_bValid;
+};
+
+
+//-----------------------------------------------------------------------------
+// Direct light cache. -lightcache turns it on.
+//
+// The file next to the .bsp holds, for every face, its direct lighting (all
+// lightstyles and bump directions), the clusters its samples were in and the
+// lights whose PVS reached it. On the next compile with the same geometry and
+// options, lights are matched against the stored ones; a face is only relit if
+// a removed/changed light reached it before, or a new/changed light's PVS and
+// hard falloff reach it now. Everything after direct lighting (bounce, final
+// composite) runs as usual.
+//-----------------------------------------------------------------------------
+class CLightCache
+{
+public:
+	CLightCache();
+
+	// pOptions is the part of the command line that affects lighting
+	void	Init( char const* pCacheFilename, char const* pOptions );
+
+	// Call once activelights is final and before BuildFacelights.
+	void	PrepareForLighting();
+
+	// Called from BuildFacelights after the samples are built. Fills in the
+	// face's lightstyles and direct lighting if it can be reused.
+	bool	RestoreFace( int facenum, dface_t* f, facelight_t* fl, int normalCount );
+
+	// Called while gathering light for a face that isn't being reused
+	void	AddSampleClusters( int facenum, int const* pClusters, int nClusters );
+	void	AddLightToFace( int facenum, directlight_t* dl );
+
+	// Writes the file after BuildFacelights.
+	bool	Save();
+
+private:
+	struct FaceEntry_t
+	{
+		CUtlVector<int>	m_Clusters;
+		CUtlVector<int>	m_Lights;		// light table indices; dl->index once this run's lights are in
+		Vector			m_vecMins;
+		Vector			m_vecMaxs;
+		bool			m_bReuse;
+
+		// Cached lighting, in m_FileData
+		int				m_nNumSamples;
+		int				m_nNormalCount;
+		byte			m_Styles[MAXLIGHTMAPS];
+		int				m_nDataOffset;
+	};
+
+	CRC32_t	ComputeGeometryCRC();
+	bool	Load( CUtlVector<CachedLight_t>& oldLights );
+	void	CaptureLight( directlight_t* dl, CachedLight_t* pOut );
+	bool	LightsMatch( CachedLight_t const& a, CachedLight_t const& b );
+	bool	WithinFalloff( CachedLight_t const& light, FaceEntry_t const& face );
+
+	char const*		m_pFilename;
+	CRC32_t			m_OptionsCRC;
+
+	CUtlBuffer		m_FileData;
+	CUtlVector<FaceEntry_t>	m_Faces;
+};
+
+extern CLightCache* g_pLightCache;	// null if not caching direct lighting
+
+#endif // LIGHTCACHE_H
@@ -22,6 +22,7 @@
 #include "mathlib/quantize.h"
 #include "bitmap/imageformat.h"
 #include "coordsize.h"
+#include "lightcache.h"
 
 enum
 {
@@ -2624,6 +2625,11 @@ static void GatherSampleLightAt4Points( SSE_SampleInfo_t& info, int sampleIdx, i
 {
 	SSE_sampleLightOutput_t out;
 
+	if( g_pLightCache )
+	{
+		g_pLightCache->AddSampleClusters( info.m_FaceNum, info.m_Clusters, numSamples );
+	}
+
 	// Iterate over all direct lights and add them to the particular sample
 	for( directlight_t* dl = activelights; dl != NULL; dl = dl->next )
 	{
@@ -2643,6 +2649,11 @@ static void GatherSampleLightAt4Points( SSE_SampleInfo_t& info, int sampleIdx, i
 			continue;
 		}
 
+		if( g_pLightCache )
+		{
+			g_pLightCache->AddLightToFace( info.m_FaceNum, dl );
+		}
+
 		GatherSampleLightSSE( out, dl, info.m_FaceNum, info.m_Points, info.m_PointNormals, info.m_NormalCount, info.m_iThread );
 
 		// Apply the PVS check filter and compute falloff x dot
@@ -2758,6 +2769,12 @@ static void ResampleLightAt4Points( SSE_SampleInfo_t& info, int lightStyleIndex,
 			continue;
 		}
 
+		if( g_pLightCache )
+		{
+			g_pLightCache->AddSampleClusters( info.m_FaceNum, info.m_Clusters, 4 );
+			g_pLightCache->AddLightToFace( info.m_FaceNum, dl );
+		}
+
 		// NOTE: Notice here that if the light is on the back side of the face
 		// (tested by checking the dot product of the face normal and the light position)
 		// we don't want it to contribute to *any* of the bumped lightmaps. It glows
@@ -3302,8 +3319,11 @@ void BuildFacelights( int iThread, int facenum )
 	f->styles[0] = 0;
 	AllocateLightstyleSamples( fl, 0, sampleInfo.m_NormalCount );
 
+	// Nothing that reaches this face changed since the light cache was written?
+	bool bCached = g_pLightCache && g_pLightCache->RestoreFace( facenum, f, fl, sampleInfo.m_NormalCount );
+
 	// sample the lights at each sample location
-	for( int grp = 0; grp < numGroups; ++grp )
+	for( int grp = 0; !bCached && grp < numGroups; ++grp )
 	{
 		int nSample = 4 * grp;
 
@@ -3354,7 +3374,7 @@ void BuildFacelights( int iThread, int facenum )
 	}
 
 	// get rid of the -extra functionality on displacement surfaces
-	if( do_extra && !sampleInfo.m_IsDispFace )
+	if( do_extra && !sampleInfo.m_IsDispFace && !bCached )
 	{
 		// For each lightstyle, perform a supersampling pass
 		for( int i = 0; i < MAXLIGHTMAPS; ++i )
@@ -19,6 +19,7 @@
 #include "tools_minidump.h"
 #include "loadcmdline.h"
 #include "byteswap.h"
+#include "lightcache.h"
 
 #define ALLOWDEBUGOPTIONS (0 || _DEBUG)
 
@@ -59,6 +60,7 @@ bool	    bDumpNormals = false;
 bool		g_bDumpRtEnv = false;
 bool		bRed2Black = true;
 bool		g_bFastAmbient = false;
+int			g_nDispCollBenchRays = 0;
 bool        g_bNoSkyRecurse = false;
 bool		g_bDumpPropLightmaps = false;
 
@@ -80,6 +82,7 @@ char		level_lights[MAX_PATH] = "";
 
 char		vismatfile[_MAX_PATH] = "";
 char		incrementfile[_MAX_PATH] = "";
+char		lightcachefile[_MAX_PATH] = "";
 
 IIncremental* g_pIncremental = 0;
 bool		g_bInterrupt = false;	// Wsed with background lighting in WC. Tells VRAD
@@ -91,6 +94,7 @@ float g_flSkySampleScale = 1.0;
 bool g_bLargeDispSampleRadius = false;
 
 bool g_bOnlyStaticProps = false;
+bool g_bUseLightCache = false;
 bool g_bShowStaticPropNormals = false;
 
 
@@ -2116,7 +2120,17 @@ bool RadWorld_Go()
 	else
 #endif // MPI && _WIN32
 	{
+		if( g_pLightCache )
+		{
+			g_pLightCache->PrepareForLighting();
+		}
+
 		RunThreadsOnIndividual( numfaces, true, BuildFacelights );
+
+		if( g_pLightCache )
+		{
+			g_pLightCache->Save();
+		}
 	}
 
 	// Was the process interrupted?
@@ -2292,6 +2306,8 @@ void VRAD_LoadBSP( char const* pFilename )
 
 	strcpy( incrementfile, source );
 	Q_DefaultExtension( incrementfile, ".r0", sizeof( incrementfile ) );
+	strcpy( lightcachefile, source );
+	Q_DefaultExtension( lightcachefile, ".lightcache", sizeof( lightcachefile ) );
 	Q_DefaultExtension( source, ".bsp", sizeof( source ) );
 
 #if defined ( MPI ) && defined ( _WIN32 )
@@ -2352,6 +2368,11 @@ void VRAD_LoadBSP( char const* pFilename )
 	StaticPropMgr()->Init();
 	StaticDispMgr()->Init();
 
+	if( g_nDispCollBenchRays > 0 )
+	{
+		StaticDispMgr()->BenchmarkRayTests( g_nDispCollBenchRays );
+	}
+
 	if( !visdatasize )
 	{
 		Msg( "No vis information, direct lighting only.\n" );
@@ -2427,12 +2448,16 @@ void VRAD_ComputeOtherLighting()
 		ComputeDetailPropLighting( THREADINDEX_MAIN );
 	}
 
+	double start = Plat_FloatTime();
 	ComputePerLeafAmbientLighting();
+	Msg( "Leaf ambient lighting: %.2f seconds\n", Plat_FloatTime() - start );
 
 	// bake the static props high quality vertex lighting into the bsp
 	if( !do_fast && g_bStaticPropLighting )
 	{
+		start = Plat_FloatTime();
 		StaticPropMgr()->ComputeLighting( THREADINDEX_MAIN );
+		Msg( "Static prop lighting: %.2f seconds\n", Plat_FloatTime() - start );
 	}
 }
 
@@ -2545,6 +2570,18 @@ int ParseCommandLine( int argc, char** argv, bool* onlydetail )
 		{
 			g_bDumpRtEnv = true;
 		}
+		else if( !Q_stricmp( argv[i], "-dispcollbench" ) )
+		{
+			if( ++i < argc && *argv[i] )
+			{
+				g_nDispCollBenchRays = atoi( argv[i] );
+			}
+			else
+			{
+				Warning( "Error: expected a ray count after '-dispcollbench'\n" );
+				return -1;
+			}
+		}
 		else if( !Q_stricmp( argv[i], "-LargeDispSampleRadius" ) )
 		{
 			g_bLargeDispSampleRadius = true;
@@ -2608,6 +2645,10 @@ int ParseCommandLine( int argc, char** argv, bool* onlydetail )
 		{
 			do_extra = false;
 		}
+		else if( !Q_stricmp( argv[i], "-lightcache" ) )
+		{
+			g_bUseLightCache = true;
+		}
 		else if( !Q_stricmp( argv[i], "-debugextra" ) )
 		{
 			debug_extra = true;
@@ -2953,11 +2994,17 @@ void PrintUsage( int argc, char** argv )
 		"  -dump           : Write debugging .txt files.\n"
 		"  -dumpnormals    : Write normals to debug files.\n"
 		"  -dumptrace      : Write ray-tracing environment to debug files.\n"
+		"  -dispcollbench # : Time # rays per displacement against the displacement\n"
+		"                    collision trees, per triangle and four-wide, then one\n"
+		"                    ray at a time and batched.\n"
 		"  -threads        : Control the number of threads vbsp uses (defaults to the #\n"
 		"                    or processors on your machine).\n"
 		"  -lights <file>  : Load a lights file in addition to lights.rad and the\n"
 		"                    level lights file.\n"
 		"  -noextra        : Disable supersampling.\n"
+		"  -lightcache     : Keep direct lighting in <bspname>.lightcache and on the\n"
+		"                    next run only relight faces that changed lights reach.\n"
+		"                    Delete the file after changing models or materials.\n"
 		"  -debugextra     : Places debugging data in lightmaps to visualize\n"
 		"                    supersampling.\n"
 		"  -smooth #       : Set the threshold for smoothing groups, in degrees\n"
@@ -3024,6 +3071,34 @@ void PrintUsage( int argc, char** argv )
 #endif
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Options that only change how vrad runs or what it reports, not the
+//			lighting it writes. Returns how many arguments follow the option,
+//			or -1 if it can change the output.
+//-----------------------------------------------------------------------------
+static int GetOutputNeutralOptionArgCount( const char* pArg )
+{
+	static const char* s_pOptionsWithArg[] = { "-threads", "-dispcollbench" };
+	static const char* s_pOptions[] = { "-verbose", "-v", "-lightcache", "-low", "-loghash", "-dump", "-dumpnormals",
+										"-dumptrace", "-StopOnExit", "-steam", "-allowdebug", "-FullMinidumps", CMDLINEOPTION_NOVCONFIG };
+
+	for( int i = 0; i < ARRAYSIZE( s_pOptionsWithArg ); i++ )
+	{
+		if( !Q_stricmp( pArg, s_pOptionsWithArg[i] ) )
+		{
+			return 1;
+		}
+	}
+	for( int i = 0; i < ARRAYSIZE( s_pOptions ); i++ )
+	{
+		if( !Q_stricmp( pArg, s_pOptions[i] ) )
+		{
+			return 0;
+		}
+	}
+	return -1;
+}
+
 int RunVRAD( int argc, char** argv )
 {
 #if defined(_MSC_VER) && ( _MSC_VER >= 1310 )
@@ -3059,6 +3134,36 @@ int RunVRAD( int argc, char** argv )
 
 	VRAD_LoadBSP( argv[i] );
 
+	// Worker machines each light a subset of faces, so the cache only makes sense locally
+#if defined ( MPI ) && defined ( _WIN32 )
+	if( g_bUseMPI )
+	{
+		g_bUseLightCache = false;
+	}
+#endif // MPI && _WIN32
+
+	if( g_bUseLightCache && !g_pIncremental )
+	{
+		// Any option that could change the lighting; the rest don't invalidate the cache
+		char szOptions[2048] = "";
+		for( int iArg = 1; iArg < i; iArg++ )
+		{
+			int nSkip = GetOutputNeutralOptionArgCount( argv[iArg] );
+			if( nSkip >= 0 )
+			{
+				iArg += nSkip;
+				continue;
+			}
+
+			Q_strncat( szOptions, argv[iArg], sizeof( szOptions ), COPY_ALL_CHARACTERS );
+			Q_strncat( szOptions, " ", sizeof( szOptions ), COPY_ALL_CHARACTERS );
+		}
+
+		static CLightCache s_LightCache;
+		s_LightCache.Init( lightcachefile, szOptions );
+		g_pLightCache = &s_LightCache;
+	}
+
 	if( ( ! onlydetail ) && ( ! g_bOnlyStaticProps ) )
 	{
 		RadWorld_Go();
@@ -277,6 +277,7 @@ extern bool			bRed2Black;
 extern bool         g_bNoSkyRecurse;
 extern bool			bDumpNormals;
 extern bool			g_bFastAmbient;
+extern int			g_nDispCollBenchRays;
 extern float		maxchop;
 extern FileHandle_t	pFileSamples[4][4];
 extern qboolean		g_bLowPriority;
@@ -529,8 +530,11 @@ public:
 									  int ndxLeaf, float& dist, dface_t*& pFace, Vector2D& luxelCoord ) = 0;
 	virtual void ClipRayToDispInLeaf( DispTested_t& dispTested, Ray_t const& ray,
 									  int ndxLeaf, float& dist, Vector* pNormal ) = 0;
+	virtual void ClipRaysToDispInLeaf( DispTested_t& dispTested, Ray_t const* pRays, int nRays,
+									   int ndxLeaf, float* pDists, Vector* pNormals ) = 0;
 	virtual void StartRayTest( DispTested_t& dispTested ) = 0;
 	virtual void AddPolysForRayTrace() = 0;
+	virtual void BenchmarkRayTests( int nRaysPerDisp ) = 0;
 
 	// general timing -- should be moved!!
 	virtual void StartTimer( const char* name ) = 0;
@@ -11,6 +11,7 @@ set(
 	"${VRAD_DLL_DIR}/imagepacker.cpp"
 	"${VRAD_DLL_DIR}/incremental.cpp"
 	"${VRAD_DLL_DIR}/leaf_ambient_lighting.cpp"
+	"${VRAD_DLL_DIR}/lightcache.cpp"
 	"${VRAD_DLL_DIR}/lightmap.cpp"
 	"${SRCDIR}/public/loadcmdline.cpp"
 	"${SRCDIR}/public/lumpfiles.cpp"
@@ -61,6 +62,7 @@ set(
 	"${VRAD_DLL_DIR}/imagepacker.h"
 	"${VRAD_DLL_DIR}/incremental.h"
 	"${VRAD_DLL_DIR}/leaf_ambient_lighting.h"
+	"${VRAD_DLL_DIR}/lightcache.h"
 	"${VRAD_DLL_DIR}/lightmap.h"
 	"${VRAD_DLL_DIR}/macro_texture.h"
 	"${SRCDIR}/public/map_utils.h"
@@ -576,31 +576,50 @@ public:
 
 bool CastRayInLeaf( int iThread, const Vector& start, const Vector& end, int leafIndex, float* pFraction, Vector* pNormal )
 {
-	pFraction[0] = 1.0f;
+	CastRaysInLeaf( iThread, start, &end, 1, leafIndex, pFraction, pNormal );
+	return pFraction[0] != 1.0f ? true : false;
+}
 
-	Ray_t ray;
-	ray.Init( start, end, vec3_origin, vec3_origin );
-	CBaseTrace trace;
-	if( TraceLeafBrushes( leafIndex, start, end, trace ) != 1.0f )
-	{
-		pFraction[0] = trace.fraction;
-		*pNormal = trace.plane.normal;
-	}
-	else
+//-----------------------------------------------------------------------------
+// Casts several rays from one point against the brushes and displacements in
+// a leaf. The displacements are tested against all the rays together.
+//-----------------------------------------------------------------------------
+void CastRaysInLeaf( int iThread, const Vector& start, const Vector* pEnds, int nRays, int leafIndex, float* pFractions, Vector* pNormals )
+{
+	CUtlVectorFixedGrowable<Ray_t, 8> rays;
+	rays.SetCount( nRays );
+	for( int i = 0; i < nRays; ++i )
 	{
-		Assert( !trace.startsolid && !trace.allsolid );
+		pFractions[i] = 1.0f;
+		rays[i].Init( start, pEnds[i], vec3_origin, vec3_origin );
+
+		CBaseTrace trace;
+		if( TraceLeafBrushes( leafIndex, start, pEnds[i], trace ) != 1.0f )
+		{
+			pFractions[i] = trace.fraction;
+			pNormals[i] = trace.plane.normal;
+		}
+		else
+		{
+			Assert( !trace.startsolid && !trace.allsolid );
+		}
 	}
+
 	StaticDispMgr()->StartRayTest( s_DispTested[iThread] );
 	// Now try to clip against all displacements in the leaf
-	float dist;
-	Vector normal;
-	StaticDispMgr()->ClipRayToDispInLeaf( s_DispTested[iThread], ray, leafIndex, dist, &normal );
-	if( dist < pFraction[0] )
+	CUtlVectorFixedGrowable<float, 8> dists;
+	CUtlVectorFixedGrowable<Vector, 8> normals;
+	dists.SetCount( nRays );
+	normals.SetCount( nRays );
+	StaticDispMgr()->ClipRaysToDispInLeaf( s_DispTested[iThread], rays.Base(), nRays, leafIndex, dists.Base(), normals.Base() );
+	for( int i = 0; i < nRays; ++i )
 	{
-		pFraction[0] = dist;
-		*pNormal = normal;
+		if( dists[i] < pFractions[i] )
+		{
+			pFractions[i] = dists[i];
+			pNormals[i] = normals[i];
+		}
 	}
-	return pFraction[0] != 1.0f ? true : false;
 }
 
 //-----------------------------------------------------------------------------
@@ -27,6 +27,7 @@ void CalcRayAmbientLighting(
 );
 
 bool CastRayInLeaf( int iThread, const Vector& start, const Vector& end, int leafIndex, float* pFraction, Vector* pNormal );
+void CastRaysInLeaf( int iThread, const Vector& start, const Vector* pEnds, int nRays, int leafIndex, float* pFractions, Vector* pNormals );
 
 void ComputeDetailPropLighting( int iThread );
 
@@ -18,8 +18,10 @@
 #include "utlrbtree.h"
 #include "tier0/fasttimer.h"
 #include "disp_vrad.h"
+#include "vstdlib/random.h"
 
 class CBSPDispRayDistanceEnumerator;
+class CBSPDispRaysDistanceEnumerator;
 
 //=============================================================================
 //
@@ -115,9 +117,12 @@ public:
 							  float& dist, dface_t*& pFace, Vector2D& luxelCoord );
 	void ClipRayToDispInLeaf( DispTested_t& dispTested, Ray_t const& ray,
 							  int ndxLeaf, float& dist, Vector* pNormal );
+	void ClipRaysToDispInLeaf( DispTested_t& dispTested, Ray_t const* pRays, int nRays,
+							   int ndxLeaf, float* pDists, Vector* pNormals );
 
 	void StartRayTest( DispTested_t& dispTested );
 	void AddPolysForRayTrace( void );
+	void BenchmarkRayTests( int nRaysPerDisp );
 
 	// general timing -- should be moved!!
 	void StartTimer( const char* name );
@@ -130,6 +135,7 @@ public:
 	bool DispRay_EnumerateLeaf( int ndxLeaf, int context );
 	bool DispRay_EnumerateElement( int userId, int context );
 	bool DispRayDistance_EnumerateElement( int userId, CBSPDispRayDistanceEnumerator* pEnum );
+	bool DispRaysDistance_EnumerateElement( int userId, CBSPDispRaysDistanceEnumerator* pEnum );
 
 	bool DispFaceList_EnumerateLeaf( int ndxLeaf, int context );
 	bool DispFaceList_EnumerateElement( int userId, int context );
@@ -264,6 +270,26 @@ public:
 	Vector			m_Normal;
 };
 
+//-----------------------------------------------------------------------------
+// The same, for a batch of rays tested against each disp together
+//-----------------------------------------------------------------------------
+
+class CBSPDispRaysDistanceEnumerator : public IBSPTreeDataEnumerator
+{
+public:
+	// IBSPTreeDataEnumerator
+	bool FASTCALL EnumerateElement( int userId, int context )
+	{
+		return s_DispMgr.DispRaysDistance_EnumerateElement( userId, this );
+	}
+
+	DispTested_t*	m_pDispTested;
+	Ray_t const*	m_pRays;
+	int				m_nRays;
+	float*			m_pDists;
+	Vector*			m_pNormals;
+};
+
 
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
@@ -619,6 +645,29 @@ void CVRadDispMgr::ClipRayToDispInLeaf( DispTested_t& dispTested, Ray_t const& r
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: ClipRayToDispInLeaf for several rays at once. Each disp in the leaf
+//          is tested once against all the rays. pDists and pNormals are only
+//          written for rays that hit; pDists[i] starts at 1.
+//-----------------------------------------------------------------------------
+void CVRadDispMgr::ClipRaysToDispInLeaf( DispTested_t& dispTested, Ray_t const* pRays, int nRays,
+										 int ndxLeaf, float* pDists, Vector* pNormals )
+{
+	for( int i = 0; i < nRays; ++i )
+	{
+		pDists[i] = 1.0f;
+	}
+
+	CBSPDispRaysDistanceEnumerator rayTestEnum;
+	rayTestEnum.m_pDispTested = &dispTested;
+	rayTestEnum.m_pRays = pRays;
+	rayTestEnum.m_nRays = nRays;
+	rayTestEnum.m_pDists = pDists;
+	rayTestEnum.m_pNormals = pNormals;
+
+	m_pBSPTreeData->EnumerateElementsInLeaf( ndxLeaf, &rayTestEnum, 0 );
+}
+
 void CVRadDispMgr::AddPolysForRayTrace( void )
 {
 	int nTreeCount = m_DispTrees.Size();
@@ -632,6 +681,168 @@ void CVRadDispMgr::AddPolysForRayTrace( void )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Time rays against every displacement collision tree two ways: one
+//          triangle at a time, and four triangles at a time as the lighting
+//          traces do. Half the rays are ground traces straight down through
+//          the displacement, the rest run in random directions across its
+//          bounds. Reports throughput and any disagreement.
+//-----------------------------------------------------------------------------
+void CVRadDispMgr::BenchmarkRayTests( int nRaysPerDisp )
+{
+	int nTreeCount = m_DispTrees.Size();
+	if( !nTreeCount || nRaysPerDisp <= 0 )
+	{
+		return;
+	}
+
+	CUniformRandomStream randomStream;
+	randomStream.SetSeed( 0 );
+
+	CUtlVector<Ray_t, CUtlMemoryAligned<Ray_t, 16> > rays;
+	CUtlVector<int> rayTrees;
+	rays.EnsureCapacity( nTreeCount * nRaysPerDisp );
+	rayTrees.EnsureCapacity( nTreeCount * nRaysPerDisp );
+	for( int iTree = 0; iTree < nTreeCount; ++iTree )
+	{
+		Vector vecMins, vecMaxs;
+		m_DispTrees[iTree].m_pDispTree->GetBounds( vecMins, vecMaxs );
+
+		for( int iRay = 0; iRay < nRaysPerDisp; ++iRay )
+		{
+			Vector vecStart, vecEnd;
+			for( int iAxis = 0; iAxis < 3; ++iAxis )
+			{
+				vecStart[iAxis] = randomStream.RandomFloat( vecMins[iAxis], vecMaxs[iAxis] );
+				vecEnd[iAxis] = randomStream.RandomFloat( vecMins[iAxis], vecMaxs[iAxis] );
+			}
+
+			if( iRay & 1 )
+			{
+				vecStart.z = vecMaxs.z + 16.0f;
+				vecEnd.Init( vecStart.x, vecStart.y, vecMins.z - 16.0f );
+			}
+
+			rays[rays.AddToTail()].Init( vecStart, vecEnd );
+			rayTrees.AddToTail( iTree );
+		}
+	}
+
+	int nRays = rays.Count();
+	CUtlVector<CBaseTrace> traces[2];
+	int nHits[2] = { 0, 0 };
+	double flSeconds[2];
+
+	for( int iMode = 0; iMode < 2; ++iMode )
+	{
+		g_bDispCollScalarTriTests = ( iMode == 0 );
+
+		traces[iMode].SetCount( nRays );
+		for( int iRay = 0; iRay < nRays; ++iRay )
+		{
+			traces[iMode][iRay].fraction = 1.0f;
+		}
+
+		CFastTimer timer;
+		timer.Start();
+		for( int iRay = 0; iRay < nRays; ++iRay )
+		{
+			const Ray_t& ray = rays[iRay];
+			CVRADDispColl* pTree = m_DispTrees[rayTrees[iRay]].m_pDispTree;
+			Vector vecMins, vecMaxs;
+			pTree->GetBounds( vecMins, vecMaxs );
+			if( IsBoxIntersectingRay( vecMins, vecMaxs, ray.m_Start, ray.m_Delta, DISPCOLL_DIST_EPSILON ) &&
+					pTree->AABBTree_Ray( ray, ray.InvDelta(), &traces[iMode][iRay], true ) )
+			{
+				++nHits[iMode];
+			}
+		}
+		timer.End();
+		flSeconds[iMode] = timer.GetDuration().GetSeconds();
+	}
+
+	g_bDispCollScalarTriTests = false;
+
+	int nMismatches = 0;
+	for( int iRay = 0; iRay < nRays; ++iRay )
+	{
+		if( FloatMakePositive( traces[1][iRay].fraction - traces[0][iRay].fraction ) > 1e-4f )
+		{
+			++nMismatches;
+		}
+	}
+
+	static const char* s_pModeNames[2] = { "per triangle", "four-wide" };
+	Msg( "Displacement ray benchmark: %d displacements, %d rays\n", nTreeCount, nRays );
+	for( int iMode = 0; iMode < 2; ++iMode )
+	{
+		Msg( "  %-12s: %8.2f ms, %10.0f rays/sec, %d hits\n", s_pModeNames[iMode], flSeconds[iMode] * 1000.0,
+			 ( flSeconds[iMode] > 0.0 ) ? nRays / flSeconds[iMode] : 0.0, nHits[iMode] );
+	}
+	if( nMismatches )
+	{
+		Warning( "  %d rays got a different fraction from the per triangle test\n", nMismatches );
+	}
+
+	// Barycentric tests, one ray at a time vs. each disp's rays as one batch
+	CUtlVector<RayDispOutput_t> outputs[2];
+	int nBaryHits[2] = { 0, 0 };
+	double flBarySeconds[2];
+	for( int iMode = 0; iMode < 2; ++iMode )
+	{
+		outputs[iMode].SetCount( nRays );
+		for( int iRay = 0; iRay < nRays; ++iRay )
+		{
+			outputs[iMode][iRay].ndxVerts[0] = -1;
+			outputs[iMode][iRay].dist = FLT_MAX;
+		}
+
+		CFastTimer timer;
+		timer.Start();
+		if( iMode == 0 )
+		{
+			for( int iRay = 0; iRay < nRays; ++iRay )
+			{
+				if( m_DispTrees[rayTrees[iRay]].m_pDispTree->AABBTree_Ray( rays[iRay], outputs[iMode][iRay] ) )
+				{
+					++nBaryHits[iMode];
+				}
+			}
+		}
+		else
+		{
+			for( int iTree = 0; iTree < nTreeCount; ++iTree )
+			{
+				int iFirst = iTree * nRaysPerDisp;
+				nBaryHits[iMode] += m_DispTrees[iTree].m_pDispTree->AABBTree_RayBatch( &rays[iFirst], nRaysPerDisp, &outputs[iMode][iFirst] );
+			}
+		}
+		timer.End();
+		flBarySeconds[iMode] = timer.GetDuration().GetSeconds();
+	}
+
+	nMismatches = 0;
+	for( int iRay = 0; iRay < nRays; ++iRay )
+	{
+		if( ( outputs[0][iRay].ndxVerts[0] == -1 ) != ( outputs[1][iRay].ndxVerts[0] == -1 ) ||
+				( outputs[0][iRay].ndxVerts[0] != -1 && FloatMakePositive( outputs[1][iRay].dist - outputs[0][iRay].dist ) > 1e-4f ) )
+		{
+			++nMismatches;
+		}
+	}
+
+	static const char* s_pBaryModeNames[2] = { "single ray", "batched" };
+	for( int iMode = 0; iMode < 2; ++iMode )
+	{
+		Msg( "  %-12s: %8.2f ms, %10.0f rays/sec, %d hits (barycentric)\n", s_pBaryModeNames[iMode], flBarySeconds[iMode] * 1000.0,
+			 ( flBarySeconds[iMode] > 0.0 ) ? nRays / flBarySeconds[iMode] : 0.0, nBaryHits[iMode] );
+	}
+	if( nMismatches )
+	{
+		Warning( "  %d rays got a different result from the batched test\n", nMismatches );
+	}
+}
+
 
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
@@ -777,6 +988,65 @@ bool CVRadDispMgr::DispRayDistance_EnumerateElement( int userId, CBSPDispRayDist
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+bool CVRadDispMgr::DispRaysDistance_EnumerateElement( int userId, CBSPDispRaysDistanceEnumerator* pCtx )
+{
+	DispCollTree_t& dispTree = m_DispTrees[userId];
+
+	// don't test twice (check tested value)
+	if( pCtx->m_pDispTested->m_pTested[userId] == pCtx->m_pDispTested->m_Enum )
+	{
+		return true;
+	}
+
+	// set the tested value
+	pCtx->m_pDispTested->m_pTested[userId] = pCtx->m_pDispTested->m_Enum;
+
+	// Test all the rays in one pass down the disp's tree
+	CUtlVectorFixedGrowable<RayDispOutput_t, 8> outputs;
+	outputs.SetCount( pCtx->m_nRays );
+	for( int i = 0; i < pCtx->m_nRays; ++i )
+	{
+		RayDispOutput_t& output = outputs[i];
+		output.ndxVerts[0] = -1;
+		output.ndxVerts[1] = -1;
+		output.ndxVerts[2] = -1;
+		output.ndxVerts[3] = -1;
+		output.u = -1.0f;
+		output.v = -1.0f;
+		output.dist = FLT_MAX;
+	}
+
+	if( !dispTree.m_pDispTree->AABBTree_RayBatch( pCtx->m_pRays, pCtx->m_nRays, outputs.Base() ) )
+	{
+		return true;
+	}
+
+	// Keep each hit that's closer than the previous disps'
+	for( int i = 0; i < pCtx->m_nRays; ++i )
+	{
+		const RayDispOutput_t& output = outputs[i];
+		if( output.ndxVerts[0] == -1 || output.dist >= pCtx->m_pDists[i] )
+		{
+			continue;
+		}
+
+		pCtx->m_pDists[i] = output.dist;
+
+		Vector v0, v1, v2;
+		dispTree.m_pDispTree->GetVert( output.ndxVerts[0], v0 );
+		dispTree.m_pDispTree->GetVert( output.ndxVerts[1], v1 );
+		dispTree.m_pDispTree->GetVert( output.ndxVerts[2], v2 );
+		Vector e0 = v1 - v0;
+		Vector e1 = v2 - v0;
+		pCtx->m_pNormals[i] = CrossProduct( e0, e1 );
+		VectorNormalize( pCtx->m_pNormals[i] );
+	}
+
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 // Test a ray against a particular dispinfo
 //-----------------------------------------------------------------------------
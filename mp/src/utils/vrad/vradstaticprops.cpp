@@ -1189,71 +1189,120 @@ bool PositionInSolid( Vector& position )
 }
 
 //-----------------------------------------------------------------------------
-// Trace from a vertex to each direct light source, accumulating its contribution.
+// Trace from a stream of points to each direct light source, accumulating each
+// light's contribution. Points go through GatherSampleLightSSE four at a time,
+// so each light's falloff and visibility rays are shared by a whole packet.
 //-----------------------------------------------------------------------------
-void ComputeDirectLightingAtPoint( Vector& position, Vector& normal, Vector& outColor, int iThread,
-								   int static_prop_id_to_skip = -1, int nLFlags = 0 )
+void ComputeDirectLightingAtPoints( int nPoints, const Vector* pPositions, const Vector* pNormals, Vector* pOutColors, int iThread,
+									int static_prop_id_to_skip = -1, int nLFlags = 0 )
 {
 	SSE_sampleLightOutput_t	sampleOutput;
 
-	outColor.Init();
-
-	// Iterate over all direct lights and accumulate their contribution
-	int cluster = ClusterFromPoint( position );
-	for( directlight_t* dl = activelights; dl != NULL; dl = dl->next )
+	for( int nFirst = 0; nFirst < nPoints; nFirst += 4 )
 	{
-		if( dl->light.style )
-		{
-			// skip lights with style
-			continue;
-		}
+		const Vector* pPosition = pPositions + nFirst;
+		const Vector* pNormal = pNormals + nFirst;
+		Vector* pOutColor = pOutColors + nFirst;
+		int nCount = min( nPoints - nFirst, 4 );
 
-		// is this lights cluster visible?
-		if( !PVSCheck( dl->pvs, cluster ) )
+		int clusters[4];
+		for( int i = 0; i < nCount; i++ )
 		{
-			continue;
+			clusters[i] = ClusterFromPoint( pPosition[i] );
+			pOutColor[i].Init();
 		}
 
-		// push the vertex towards the light to avoid surface acne
-		Vector adjusted_pos = position;
-		float flEpsilon = 0.0;
-
-		if( dl->light.type != emit_skyambient )
+		// Iterate over all direct lights and accumulate their contribution
+		for( directlight_t* dl = activelights; dl != NULL; dl = dl->next )
 		{
-			// push towards the light
-			Vector fudge;
-			if( dl->light.type == emit_skylight )
+			if( dl->light.style )
 			{
-				fudge = -( dl->light.normal );
+				// skip lights with style
+				continue;
 			}
-			else
+
+			// is this lights cluster visible?
+			bool bVisible[4] = { false, false, false, false };
+			int nFirstVisible = -1;
+			for( int i = 0; i < nCount; i++ )
 			{
-				fudge = dl->light.origin - position;
-				VectorNormalize( fudge );
+				bVisible[i] = PVSCheck( dl->pvs, clusters[i] );
+				if( bVisible[i] && nFirstVisible < 0 )
+				{
+					nFirstVisible = i;
+				}
 			}
-			fudge *= 4.0;
-			adjusted_pos += fudge;
-		}
-		else
-		{
-			// push out along normal
-			adjusted_pos += 4.0 * normal;
-//			flEpsilon = 1.0;
-		}
 
-		FourVectors adjusted_pos4;
-		FourVectors normal4;
-		adjusted_pos4.DuplicateVector( adjusted_pos );
-		normal4.DuplicateVector( normal );
+			if( nFirstVisible < 0 )
+			{
+				continue;
+			}
 
-		GatherSampleLightSSE( sampleOutput, dl, -1, adjusted_pos4, &normal4, 1, iThread, nLFlags | GATHERLFLAGS_FORCE_FAST,
-							  static_prop_id_to_skip, flEpsilon );
+			FourVectors adjusted_pos4;
+			FourVectors normal4;
+			float flEpsilon = 0.0;
 
-		//VectorMA( outColor, sampleOutput.m_flFalloff.m128_f32[0] * sampleOutput.m_flDot[0].m128_f32[0], dl->light.intensity, outColor );
-		VectorMA( outColor, FLTX4_ELEMENT( sampleOutput.m_flFalloff, 0 ) * FLTX4_ELEMENT( sampleOutput.m_flDot[0], 0 ), dl->light.intensity, outColor );
+			for( int i = 0; i < 4; i++ )
+			{
+				// lanes the light can't reach, and the end of the stream, repeat a point it can
+				int nPoint = bVisible[i] ? i : nFirstVisible;
+				const Vector& position = pPosition[nPoint];
+				const Vector& normal = pNormal[nPoint];
+
+				// push the vertex towards the light to avoid surface acne
+				Vector adjusted_pos = position;
+
+				if( dl->light.type != emit_skyambient )
+				{
+					// push towards the light
+					Vector fudge;
+					if( dl->light.type == emit_skylight )
+					{
+						fudge = -( dl->light.normal );
+					}
+					else
+					{
+						fudge = dl->light.origin - position;
+						VectorNormalize( fudge );
+					}
+					fudge *= 4.0;
+					adjusted_pos += fudge;
+				}
+				else
+				{
+					// push out along normal
+					adjusted_pos += 4.0 * normal;
+//					flEpsilon = 1.0;
+				}
+
+				adjusted_pos4.X( i ) = adjusted_pos.x;
+				adjusted_pos4.Y( i ) = adjusted_pos.y;
+				adjusted_pos4.Z( i ) = adjusted_pos.z;
+				normal4.X( i ) = normal.x;
+				normal4.Y( i ) = normal.y;
+				normal4.Z( i ) = normal.z;
+			}
+
+			GatherSampleLightSSE( sampleOutput, dl, -1, adjusted_pos4, &normal4, 1, iThread, nLFlags | GATHERLFLAGS_FORCE_FAST,
+								  static_prop_id_to_skip, flEpsilon );
+
+			for( int i = 0; i < nCount; i++ )
+			{
+				if( bVisible[i] )
+				{
+					VectorMA( pOutColor[i], FLTX4_ELEMENT( sampleOutput.m_flFalloff, i ) * FLTX4_ELEMENT( sampleOutput.m_flDot[0], i ), dl->light.intensity, pOutColor[i] );
+				}
+			}
+		}
 	}
 }
 
+void ComputeDirectLightingAtPoint( Vector& position, Vector& normal, Vector& outColor, int iThread,
+								   int static_prop_id_to_skip = -1, int nLFlags = 0 )
+{
+	ComputeDirectLightingAtPoints( 1, &position, &normal, &outColor, iThread, static_prop_id_to_skip, nLFlags );
+}
+
 //-----------------------------------------------------------------------------
 // Takes the results from a ComputeLighting call and applies it to the static prop in question.
 //-----------------------------------------------------------------------------
@@ -1416,6 +1465,14 @@ void CVradStaticPropMgr::ComputeLighting( CStaticProp& prop, int iThread, int pr
 			colorVerts.EnsureCount( pStudioModel->numvertices );
 			memset( colorVerts.Base(), 0, colorVerts.Count() * sizeof( colorVertex_t ) );
 
+			// vertexes that aren't in solid, lit together once every mesh has been walked
+			CUtlVector<int> sampleVertexes;
+			CUtlVector<Vector> samplePositions;
+			CUtlVector<Vector> sampleNormals;
+			sampleVertexes.EnsureCapacity( pStudioModel->numvertices );
+			samplePositions.EnsureCapacity( pStudioModel->numvertices );
+			sampleNormals.EnsureCapacity( pStudioModel->numvertices );
+
 			int numVertexes = 0;
 			for( int meshID = 0; meshID < pStudioModel->nummeshes; ++meshID )
 			{
@@ -1450,38 +1507,46 @@ void CVradStaticPropMgr::ComputeLighting( CStaticProp& prop, int iThread, int pr
 					}
 					else
 					{
-						Vector direct_pos = samplePosition;
-
-
+						sampleVertexes.AddToTail( numVertexes );
+						samplePositions.AddToTail( samplePosition );
+						sampleNormals.AddToTail( sampleNormal );
+					}
 
-						Vector directColor( 0, 0, 0 );
-						ComputeDirectLightingAtPoint( direct_pos,
-													  sampleNormal, directColor, iThread,
-													  skip_prop, nFlags );
-						Vector indirectColor( 0, 0, 0 );
+					numVertexes++;
+				}
+			}
 
-						if( g_bShowStaticPropNormals )
-						{
-							directColor = sampleNormal;
-							directColor += Vector( 1.0, 1.0, 1.0 );
-							directColor *= 50.0;
-						}
-						else
-						{
-							if( numbounce >= 1 )
-								ComputeIndirectLightingAtPoint(
-									samplePosition, sampleNormal,
-									indirectColor, iThread, true,
-									( prop.m_Flags & STATIC_PROP_IGNORE_NORMALS ) != 0 );
-						}
+			CUtlVector<Vector> directColors;
+			directColors.SetCount( samplePositions.Count() );
+			ComputeDirectLightingAtPoints( samplePositions.Count(), samplePositions.Base(), sampleNormals.Base(), directColors.Base(), iThread,
+										   skip_prop, nFlags );
 
-						colorVerts[numVertexes].m_bValid = true;
-						colorVerts[numVertexes].m_Position = samplePosition;
-						VectorAdd( directColor, indirectColor, colorVerts[numVertexes].m_Color );
-					}
+			for( int nSample = 0; nSample < sampleVertexes.Count(); nSample++ )
+			{
+				Vector& samplePosition = samplePositions[nSample];
+				Vector& sampleNormal = sampleNormals[nSample];
+				Vector& directColor = directColors[nSample];
+				Vector indirectColor( 0, 0, 0 );
 
-					numVertexes++;
+				if( g_bShowStaticPropNormals )
+				{
+					directColor = sampleNormal;
+					directColor += Vector( 1.0, 1.0, 1.0 );
+					directColor *= 50.0;
+				}
+				else
+				{
+					if( numbounce >= 1 )
+						ComputeIndirectLightingAtPoint(
+							samplePosition, sampleNormal,
+							indirectColor, iThread, true,
+							( prop.m_Flags & STATIC_PROP_IGNORE_NORMALS ) != 0 );
 				}
+
+				colorVertex_t& colorVert = colorVerts[sampleVertexes[nSample]];
+				colorVert.m_bValid = true;
+				colorVert.m_Position = samplePosition;
+				VectorAdd( directColor, indirectColor, colorVert.m_Color );
 			}
 
 			// color in the bad vertexes
@@ -2478,6 +2543,10 @@ static void GenerateLightmapSamplesForMesh( const matrix3x4_t& _matPos, const ma
 	// on the other side.
 	// First attempt: Just pretend the triangle was larger and cast a ray from this new world pos
 	// as above.
+	CUtlVector<int> sampleTexels;
+	CUtlVector<Vector> samplePositions;
+	CUtlVector<Vector> sampleNormals;
+
 	int linearPos = 0;
 	for( int j = 0; j < _lightmapResY; ++j )
 	{
@@ -2503,22 +2572,31 @@ static void GenerateLightmapSamplesForMesh( const matrix3x4_t& _matPos, const ma
 
 			if( shouldProcess )
 			{
-				Vector directColor( 0, 0, 0 ),
-					   indirectColor( 0, 0, 0 );
-
+				sampleTexels.AddToTail( linearPos );
+				samplePositions.AddToTail( colorTexels[linearPos].m_WorldPosition );
+				sampleNormals.AddToTail( colorTexels[linearPos].m_WorldNormal );
+			}
 
-				ComputeDirectLightingAtPoint( colorTexels[linearPos].m_WorldPosition, colorTexels[linearPos].m_WorldNormal, directColor, _iThread, _skipProp, _flags );
+			++linearPos;
+		}
+	}
 
-				if( numbounce >= 1 )
-				{
-					ComputeIndirectLightingAtPoint( colorTexels[linearPos].m_WorldPosition, colorTexels[linearPos].m_WorldNormal, indirectColor, _iThread, true, ( _flags & GATHERLFLAGS_IGNORE_NORMALS ) != 0 );
-				}
+	// Light the texels as one stream so neighbors share ray packets
+	CUtlVector<Vector> directColors;
+	directColors.SetCount( samplePositions.Count() );
+	ComputeDirectLightingAtPoints( samplePositions.Count(), samplePositions.Base(), sampleNormals.Base(), directColors.Base(), _iThread, _skipProp, _flags );
 
-				VectorAdd( directColor, indirectColor, colorTexels[linearPos].m_Color );
-			}
+	for( int nSample = 0; nSample < sampleTexels.Count(); nSample++ )
+	{
+		colorTexel_t& texel = colorTexels[sampleTexels[nSample]];
+		Vector indirectColor( 0, 0, 0 );
 
-			++linearPos;
+		if( numbounce >= 1 )
+		{
+			ComputeIndirectLightingAtPoint( texel.m_WorldPosition, texel.m_WorldNormal, indirectColor, _iThread, true, ( _flags & GATHERLFLAGS_IGNORE_NORMALS ) != 0 );
 		}
+
+		VectorAdd( directColors[nSample], indirectColor, texel.m_Color );
 	}
 }
 
@@ -39,6 +39,9 @@
 #include <vgui_controls/EditablePanel.h>
 #include <vgui_controls/MessageBox.h>
 #include "filesystem.h"
+#include "tier0/fasttimer.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utlstring.h"
 
 #if defined( _X360 )
 	#include "xbox/xbox_win32stubs.h"
@@ -54,6 +57,199 @@ using namespace vgui;
 //-----------------------------------------------------------------------------
 IMPLEMENT_HANDLES( BuildGroup, 20 )
 
+//-----------------------------------------------------------------------------
+// .res layout cache. Parsing a layout means reading the text, following its
+// #base files and applying resolution and conditional keys; the result only
+// depends on the files read and those inputs, so it's kept in binary form and
+// read back the next time a panel loads the same layout, as long as none of
+// the files it was built from has changed.
+//-----------------------------------------------------------------------------
+ConVar vgui_res_cache( "vgui_res_cache", "1", 0, "Reuse parsed .res layouts instead of parsing them each time a panel loads them." );
+
+namespace
+{
+	// A file a cached layout was built from, looked up the way it was loaded
+	struct ResLayoutFile_t
+	{
+		CUtlString	m_Name;
+		CUtlString	m_PathID;		// empty for a NULL path ID
+		long		m_nFileTime;	// 0 if it didn't exist
+	};
+
+	struct ResLayout_t
+	{
+		ResLayout_t() : m_nLoads( 0 ), m_nHits( 0 ), m_flLoadMs( 0.0f ), m_flBuildMs( 0.0f ) {}
+
+		CUtlBuffer	m_Data;			// KeyValues::WriteAsBinary() of the processed layout, empty if not cached
+		CUtlVector< ResLayoutFile_t > m_Files;
+
+		int			m_nLoads;
+		int			m_nHits;
+		float		m_flLoadMs;
+		float		m_flBuildMs;	// creating and applying settings to the panels
+	};
+
+	CUtlDict< ResLayout_t*, int > g_ResLayouts;
+
+	ResLayout_t* FindOrAddResLayout( const char* pKey )
+	{
+		int i = g_ResLayouts.Find( pKey );
+		if( i == g_ResLayouts.InvalidIndex() )
+		{
+			i = g_ResLayouts.Insert( pKey, new ResLayout_t );
+		}
+		return g_ResLayouts[ i ];
+	}
+
+	// Everything the processed layout depends on
+	void BuildResLayoutKey( char* pKey, int nKeySize, const char* controlResourceName, const char* pathID, bool bMinMode, KeyValues* pConditions )
+	{
+		V_snprintf( pKey, nKeySize, "%s|%s|%d", controlResourceName, pathID ? pathID : "", bMinMode );
+		if( IsX360() )
+		{
+			V_strncat( pKey, "|", nKeySize );
+			V_strncat( pKey, surface()->GetResolutionKey(), nKeySize );
+		}
+		if( pConditions )
+		{
+			for( KeyValues* pCondition = pConditions->GetFirstSubKey(); pCondition != NULL; pCondition = pCondition->GetNextKey() )
+			{
+				V_strncat( pKey, "|", nKeySize );
+				V_strncat( pKey, pCondition->GetName(), nKeySize );
+			}
+		}
+	}
+
+	void AddResLayoutFile( CUtlVector< ResLayoutFile_t >& files, const char* pFileName, const char* pathID )
+	{
+		ResLayoutFile_t& file = files[ files.AddToTail() ];
+		file.m_Name = pFileName;
+		file.m_PathID = pathID ? pathID : "";
+		file.m_nFileTime = g_pFullFileSystem->GetFileTime( pFileName, pathID );
+	}
+
+	// Adds the #base and #include files of a layout file and of the files they
+	// include. KeyValues looks them up relative to the including file with a
+	// NULL path ID, so they're recorded that way.
+	void AddResLayoutIncludes( CUtlVector< ResLayoutFile_t >& files, const char* pFileName, const char* pathID, int nDepth )
+	{
+		if( nDepth > 8 )
+		{
+			return;
+		}
+
+		CUtlBuffer buf( 0, 0, CUtlBuffer::TEXT_BUFFER );
+		if( !g_pFullFileSystem->ReadFile( pFileName, pathID, buf ) )
+		{
+			return;
+		}
+		buf.PutChar( '\0' );
+
+		char dir[ MAX_PATH ];
+		V_ExtractFilePath( pFileName, dir, sizeof( dir ) );
+
+		for( const char* pLine = ( const char* )buf.Base(); pLine; )
+		{
+			const char* pNextLine = strchr( pLine, '\n' );
+
+			while( *pLine == ' ' || *pLine == '\t' )
+			{
+				pLine++;
+			}
+
+			int nDirective = !V_strnicmp( pLine, "#base", 5 ) ? 5 : !V_strnicmp( pLine, "#include", 8 ) ? 8 : 0;
+			if( nDirective )
+			{
+				const char* p = pLine + nDirective;
+				while( *p == ' ' || *p == '\t' )
+				{
+					p++;
+				}
+
+				bool bQuoted = ( *p == '"' );
+				if( bQuoted )
+				{
+					p++;
+				}
+
+				char name[ MAX_PATH ];
+				int nLen = 0;
+				while( *p && *p != '\r' && *p != '\n' && nLen < ( int )sizeof( name ) - 1 &&
+					( bQuoted ? *p != '"' : ( *p != ' ' && *p != '\t' ) ) )
+				{
+					name[ nLen++ ] = *p++;
+				}
+				name[ nLen ] = 0;
+
+				if( nLen )
+				{
+					char fullpath[ MAX_PATH ];
+					V_snprintf( fullpath, sizeof( fullpath ), "%s%s", dir, name );
+					AddResLayoutFile( files, fullpath, NULL );
+					AddResLayoutIncludes( files, fullpath, NULL, nDepth + 1 );
+				}
+			}
+
+			pLine = pNextLine ? pNextLine + 1 : NULL;
+		}
+	}
+
+	bool IsResLayoutCurrent( const ResLayout_t* pLayout )
+	{
+		FOR_EACH_VEC( pLayout->m_Files, i )
+		{
+			const ResLayoutFile_t& file = pLayout->m_Files[ i ];
+			const char* pathID = file.m_PathID.IsEmpty() ? NULL : file.m_PathID.Get();
+			if( g_pFullFileSystem->GetFileTime( file.m_Name.Get(), pathID ) != file.m_nFileTime )
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	int __cdecl ResLayoutBuildTimeLessFunc( const int* pLeft, const int* pRight )
+	{
+		float flLeft = g_ResLayouts[ *pLeft ]->m_flBuildMs + g_ResLayouts[ *pLeft ]->m_flLoadMs;
+		float flRight = g_ResLayouts[ *pRight ]->m_flBuildMs + g_ResLayouts[ *pRight ]->m_flLoadMs;
+		return ( flLeft > flRight ) ? -1 : ( flLeft < flRight ) ? 1 : 0;
+	}
+}
+
+CON_COMMAND( vgui_res_cache_flush, "Forget all cached .res layouts so they're parsed again." )
+{
+	FOR_EACH_DICT_FAST( g_ResLayouts, i )
+	{
+		g_ResLayouts[ i ]->m_Data.Purge();
+	}
+}
+
+CON_COMMAND( vgui_res_stats, "Lists .res layouts by the time spent loading them and building their panels." )
+{
+	CUtlVector< int > sorted;
+	FOR_EACH_DICT_FAST( g_ResLayouts, i )
+	{
+		sorted.AddToTail( i );
+	}
+	sorted.Sort( ResLayoutBuildTimeLessFunc );
+
+	int nLoads = 0, nHits = 0, nBytes = 0;
+	float flLoadMs = 0.0f, flBuildMs = 0.0f;
+	Msg( "%6s %6s %10s %10s  %s\n", "loads", "cached", "load ms", "build ms", "layout" );
+	for( int i = 0; i < sorted.Count(); i++ )
+	{
+		ResLayout_t* pLayout = g_ResLayouts[ sorted[ i ] ];
+		Msg( "%6d %6d %10.3f %10.3f  %s\n", pLayout->m_nLoads, pLayout->m_nHits, pLayout->m_flLoadMs, pLayout->m_flBuildMs, g_ResLayouts.GetElementName( sorted[ i ] ) );
+
+		nLoads += pLayout->m_nLoads;
+		nHits += pLayout->m_nHits;
+		nBytes += pLayout->m_Data.TellPut();
+		flLoadMs += pLayout->m_flLoadMs;
+		flBuildMs += pLayout->m_flBuildMs;
+	}
+	Msg( "%6d %6d %10.3f %10.3f  total, %d KB cached\n", nLoads, nHits, flLoadMs, flBuildMs, nBytes / 1024 );
+}
+
 
 //-----------------------------------------------------------------------------
 // Purpose: Constructor
@@ -883,6 +1079,21 @@ void BuildGroup::LoadControlSettings( const char* controlResourceName, const cha
 	// make sure the file is registered
 	RegisterControlSettingsFile( controlResourceName, pathID );
 
+	CFastTimer timer;
+	timer.Start();
+
+	bool bMinMode = false;
+	if( IsPC() )
+	{
+		ConVarRef cl_hud_minmode( "cl_hud_minmode", true );
+		bMinMode = cl_hud_minmode.IsValid() && cl_hud_minmode.GetBool();
+	}
+
+	char key[ 1024 ];
+	BuildResLayoutKey( key, sizeof( key ), controlResourceName, pathID, bMinMode, pConditions );
+	ResLayout_t* pLayout = FindOrAddResLayout( key );
+	pLayout->m_nLoads++;
+
 	// Use the keyvalues they passed in or load them.
 	KeyValues* rDat = pPreloadedKeyValues;
 	if( !rDat )
@@ -890,39 +1101,76 @@ void BuildGroup::LoadControlSettings( const char* controlResourceName, const cha
 		// load the resource data from the file
 		rDat  = new KeyValues( controlResourceName );
 
-		// check the skins directory first, if an explicit pathID hasn't been set
-		bool bSuccess = false;
-		if( !pathID )
+		if( vgui_res_cache.GetBool() )
 		{
-			bSuccess = rDat->LoadFromFile( g_pFullFileSystem, controlResourceName, "SKIN" );
-		}
-		if( !bSuccess )
-		{
-			bSuccess = rDat->LoadFromFile( g_pFullFileSystem, controlResourceName, pathID );
+			if( pLayout->m_Data.TellPut() && IsResLayoutCurrent( pLayout ) )
+			{
+				pLayout->m_Data.SeekGet( CUtlBuffer::SEEK_HEAD, 0 );
+				if( rDat->ReadAsBinary( pLayout->m_Data ) )
+				{
+					pLayout->m_nHits++;
+				}
+				else
+				{
+					rDat->Clear();
+					pLayout->m_Data.Purge();
+				}
+			}
 		}
 
-		if( bSuccess )
+		if( !pLayout->m_Data.TellPut() )
 		{
-			if( IsX360() )
+			// check the skins directory first, if an explicit pathID hasn't been set
+			bool bSuccess = false;
+			const char* pLoadedPathID = pathID;
+			if( !pathID )
 			{
-				rDat->ProcessResolutionKeys( surface()->GetResolutionKey() );
+				bSuccess = rDat->LoadFromFile( g_pFullFileSystem, controlResourceName, "SKIN" );
+				if( bSuccess )
+				{
+					pLoadedPathID = "SKIN";
+				}
 			}
-			if( IsPC() )
+			if( !bSuccess )
+			{
+				bSuccess = rDat->LoadFromFile( g_pFullFileSystem, controlResourceName, pathID );
+			}
+
+			if( bSuccess )
 			{
-				ConVarRef cl_hud_minmode( "cl_hud_minmode", true );
-				if( cl_hud_minmode.IsValid() && cl_hud_minmode.GetBool() )
+				if( IsX360() )
+				{
+					rDat->ProcessResolutionKeys( surface()->GetResolutionKey() );
+				}
+				if( bMinMode )
 				{
 					rDat->ProcessResolutionKeys( "_minmode" );
 				}
-			}
 
-			if( pConditions && pConditions->GetFirstSubKey() )
-			{
-				ProcessConditionalKeys( rDat, pConditions );
+				if( pConditions && pConditions->GetFirstSubKey() )
+				{
+					ProcessConditionalKeys( rDat, pConditions );
+				}
+
+				if( vgui_res_cache.GetBool() && rDat->WriteAsBinary( pLayout->m_Data ) )
+				{
+					pLayout->m_Files.RemoveAll();
+					if( !pathID && !pLoadedPathID )
+					{
+						// a skin added later would be loaded instead
+						AddResLayoutFile( pLayout->m_Files, controlResourceName, "SKIN" );
+					}
+					AddResLayoutFile( pLayout->m_Files, controlResourceName, pLoadedPathID );
+					AddResLayoutIncludes( pLayout->m_Files, controlResourceName, pLoadedPathID, 0 );
+				}
 			}
 		}
 	}
 
+	timer.End();
+	pLayout->m_flLoadMs += timer.GetDuration().GetMillisecondsF();
+	timer.Start();
+
 	// save off the resource name
 	delete [] m_pResourceName;
 	m_pResourceName = new char[strlen( controlResourceName ) + 1];
@@ -941,6 +1189,9 @@ void BuildGroup::LoadControlSettings( const char* controlResourceName, const cha
 	// loop through the resource data sticking info into controls
 	ApplySettings( rDat );
 
+	timer.End();
+	pLayout->m_flBuildMs += timer.GetDuration().GetMillisecondsF();
+
 	if( m_pParentPanel )
 	{
 		m_pParentPanel->InvalidateLayout();
@@ -1163,11 +1414,55 @@ void BuildGroup::DeleteAllControlsCreatedByControlSettingsFile()
 	m_pBuildContext->Repaint();
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: indexes a panel under its current name, unless a live panel that
+//			still has that name got there first
+//-----------------------------------------------------------------------------
+static void AddPanelByName( CUtlDict< PHandle, int >& panelsByName, Panel* panel )
+{
+	char const* panelName = panel->GetName();
+	int i = panelsByName.Find( panelName );
+	if( i == panelsByName.InvalidIndex() )
+	{
+		panelsByName[panelsByName.Insert( panelName )] = panel;
+		return;
+	}
+
+	Panel* other = panelsByName[i].Get();
+	if( !other || Q_stricmp( other->GetName(), panelName ) )
+	{
+		panelsByName[i] = panel;
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: serializes settings from a resource data container
 //-----------------------------------------------------------------------------
 void BuildGroup::ApplySettings( KeyValues* resourceData )
 {
+	// make the control name match CASE INSENSITIVE! The first registered panel with a name wins.
+	CUtlDict< PHandle, int > panelsByName;
+	for( int i = 0; i < _panelDar.Count(); i++ )
+	{
+		Panel* panel = _panelDar[i].Get();
+
+		if( !panel ) // this can happen if we had two of the same handle in the list
+		{
+			_panelDar.Remove( i );
+			--i;
+			continue;
+		}
+
+		char const* panelName = panel->GetName();
+		if( panelsByName.Find( panelName ) == panelsByName.InvalidIndex() )
+		{
+			panelsByName.Insert( panelName, _panelDar[i] );
+		}
+	}
+
+	// panels registered up to here are in the map
+	int nIndexed = _panelDar.Count();
+
 	// loop through all the keys, applying them wherever
 	for( KeyValues* controlKeys = resourceData->GetFirstSubKey(); controlKeys != NULL; controlKeys = controlKeys->GetNextKey() )
 	{
@@ -1182,30 +1477,29 @@ void BuildGroup::ApplySettings( KeyValues* resourceData )
 		char const* keyName = controlKeys->GetName();
 
 		// check to see if any buildgroup panels have this name
-		for( int i = 0; i < _panelDar.Count(); i++ )
+		int i = panelsByName.Find( keyName );
+		Panel* panel = ( i != panelsByName.InvalidIndex() ) ? panelsByName[i].Get() : NULL;
+		if( i != panelsByName.InvalidIndex() && ( !panel || Q_stricmp( panel->GetName(), keyName ) ) )
 		{
-			Panel* panel = _panelDar[i].Get();
-
-			if( !panel ) // this can happen if we had two of the same handle in the list
+			// applying settings deleted or renamed it; see if another panel has the name
+			panel = NULL;
+			for( int j = 0; j < _panelDar.Count(); j++ )
 			{
-				_panelDar.Remove( i );
-				--i;
-				continue;
+				Panel* other = _panelDar[j].Get();
+				if( other && !Q_stricmp( other->GetName(), keyName ) )
+				{
+					panel = other;
+					break;
+				}
 			}
+			panelsByName[i] = panel;
+		}
 
-
-			Assert( panel );
-
-			// make the control name match CASE INSENSITIVE!
-			char const* panelName = panel->GetName();
-
-			if( !Q_stricmp( panelName, keyName ) )
-			{
-				// apply the settings
-				panel->ApplySettings( controlKeys );
-				bFound = true;
-				break;
-			}
+		if( panel )
+		{
+			// apply the settings
+			panel->ApplySettings( controlKeys );
+			bFound = true;
 		}
 
 		if( !bFound )
@@ -1214,7 +1508,27 @@ void BuildGroup::ApplySettings( KeyValues* resourceData )
 			if( keyName /*controlKeys->GetInt("AlwaysCreate", false)*/ )
 			{
 				// create the control even though it wasn't registered
-				NewControl( controlKeys );
+				panel = NewControl( controlKeys );
+			}
+		}
+
+		// Settings can rename the panel ("fieldName") and create or delete others, keep the map
+		// in step so later keys find them by their new names
+		if( panel )
+		{
+			AddPanelByName( panelsByName, panel );
+		}
+
+		if( _panelDar.Count() < nIndexed )
+		{
+			nIndexed = 0;
+		}
+		for( ; nIndexed < _panelDar.Count(); nIndexed++ )
+		{
+			Panel* other = _panelDar[nIndexed].Get();
+			if( other )
+			{
+				AddPanelByName( panelsByName, other );
 			}
 		}
 	}
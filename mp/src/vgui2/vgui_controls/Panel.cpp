@@ -51,6 +51,22 @@ using namespace vgui;
 
 #define TRIPLE_PRESS_MSEC	300
 
+// FindChildByName() switches from a linear search to a name index at this many children
+#define CHILD_NAME_INDEX_MIN_CHILDREN	16
+
+//-----------------------------------------------------------------------------
+// Purpose: Maps child names to their panels. Children are added and removed
+//			inside vgui without telling us about removals, so the index is
+//			rebuilt whenever a child was added, renamed or the count changed.
+//-----------------------------------------------------------------------------
+struct Panel::ChildNameIndex_t
+{
+	// case insensitive, like the linear search; duplicated names map to NULL
+	CUtlDict< VPANEL, int >	m_Children;
+	int						m_nChildCount;
+	bool					m_bDirty;
+};
+
 const char* g_PinCornerStrings [] =
 {
 	"PIN_TOPLEFT",
@@ -700,6 +716,7 @@ Panel::Panel( Panel* parent, const char* panelName, HScheme scheme )
 void Panel::Init( int x, int y, int wide, int tall )
 {
 	_panelName = NULL;
+	m_pChildNameIndex = NULL;
 	_tooltipText = NULL;
 	_pinToSibling = NULL;
 	m_hMouseEventHandler = NULL;
@@ -836,6 +853,7 @@ Panel::~Panel()
 	ivgui()->FreePanel( _vpanel );
 	// free our name
 	delete [] _panelName;
+	delete m_pChildNameIndex;
 
 	if( _tooltipText && _tooltipText[0] )
 	{
@@ -893,6 +911,12 @@ void Panel::SetName( const char* panelName )
 		_panelName = new char[ len ];
 		Q_strncpy( _panelName, panelName, len );
 	}
+
+	Panel* pParent = GetParent();
+	if( pParent )
+	{
+		pParent->InvalidateChildNameIndex();
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -1523,6 +1547,8 @@ void Panel::SetParent( VPANEL newParent )
 void Panel::OnChildAdded( VPANEL child )
 {
 	Assert( !_flags.IsFlagSet( IN_PERFORM_LAYOUT ) );
+
+	InvalidateChildNameIndex();
 }
 
 //-----------------------------------------------------------------------------
@@ -1623,6 +1649,13 @@ int Panel::FindChildIndexByName( const char* childName )
 //-----------------------------------------------------------------------------
 Panel* Panel::FindChildByName( const char* childName, bool recurseDown )
 {
+	// A recursive search checks each child's subtree before the next child, so only
+	// the flat search can go straight to the name
+	if( !recurseDown && childName[0] && GetChildCount() >= CHILD_NAME_INDEX_MIN_CHILDREN )
+	{
+		return FindChildByNameIndexed( childName );
+	}
+
 	for( int i = 0; i < GetChildCount(); i++ )
 	{
 		Panel* pChild = GetChild( i );
@@ -1649,6 +1682,89 @@ Panel* Panel::FindChildByName( const char* childName, bool recurseDown )
 	return NULL;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: FindChildByName() through the child name index
+//-----------------------------------------------------------------------------
+Panel* Panel::FindChildByNameIndexed( const char* childName )
+{
+	int nChildCount = GetChildCount();
+	if( !m_pChildNameIndex )
+	{
+		m_pChildNameIndex = new ChildNameIndex_t;
+		m_pChildNameIndex->m_bDirty = true;
+	}
+
+	ChildNameIndex_t* pIndex = m_pChildNameIndex;
+	if( pIndex->m_bDirty || pIndex->m_nChildCount != nChildCount )
+	{
+		pIndex->m_Children.RemoveAll();
+		for( int i = 0; i < nChildCount; i++ )
+		{
+			Panel* pChild = GetChild( i );
+			if( !pChild || !pChild->_panelName )
+			{
+				continue;
+			}
+
+			int idx = pIndex->m_Children.Find( pChild->_panelName );
+			if( idx == pIndex->m_Children.InvalidIndex() )
+			{
+				pIndex->m_Children.Insert( pChild->_panelName, pChild->GetVPanel() );
+			}
+			else
+			{
+				// The first one in child order wins, and that order can change
+				pIndex->m_Children[ idx ] = NULL;
+			}
+		}
+
+		pIndex->m_nChildCount = nChildCount;
+		pIndex->m_bDirty = false;
+	}
+
+	int idx = pIndex->m_Children.Find( childName );
+	if( idx == pIndex->m_Children.InvalidIndex() )
+	{
+		return NULL;
+	}
+
+	VPANEL child = pIndex->m_Children[ idx ];
+	if( child )
+	{
+		if( ipanel()->GetParent( child ) == GetVPanel() )
+		{
+			Panel* pChild = ipanel()->GetPanel( child, GetControlsModuleName() );
+			if( pChild && !V_stricmp( pChild->GetName(), childName ) )
+			{
+				return pChild;
+			}
+		}
+
+		// Something changed under us
+		pIndex->m_bDirty = true;
+	}
+
+	// Duplicated names fall back to the search
+	for( int i = 0; i < nChildCount; i++ )
+	{
+		Panel* pChild = GetChild( i );
+		if( pChild && !V_stricmp( pChild->GetName(), childName ) )
+		{
+			return pChild;
+		}
+	}
+
+	return NULL;
+}
+
+void Panel::InvalidateChildNameIndex()
+{
+	if( m_pChildNameIndex )
+	{
+		m_pChildNameIndex->m_bDirty = true;
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Finds a sibling panel by name
 //-----------------------------------------------------------------------------